@@ -489,6 +489,11 @@ typedef uint32_t VC_CONTAINER_READ_FLAGS_T;
 #define VC_CONTAINER_READ_FLAG_SKIP   2
 /** Force the container to read data from the specified track */
 #define VC_CONTAINER_READ_FLAG_FORCE_TRACK 4
+/** Allow the container to return the packet data in place instead of copying it into
+ * the buffer given by the caller. This is only possible for some readers and i/o
+ * (e.g. memory mapped files). When it happens, the data pointer of the packet is
+ * replaced and stays valid until the container is closed. */
+#define VC_CONTAINER_READ_FLAG_BORROW 8
 /* @} */
 
 /** Reads a data packet from a container reader.
@@ -504,6 +509,8 @@ typedef uint32_t VC_CONTAINER_READ_FLAGS_T;
  * \ref VC_CONTAINER_READ_FLAG_SKIP will instruct the reader to skip the next packet. In this case
  * it isn't necessary for the caller to pass a pointer to a \ref VC_CONTAINER_PACKET_T structure
  * unless the \ref VC_CONTAINER_READ_FLAG_INFO is also given.\n
+ * \ref VC_CONTAINER_READ_FLAG_BORROW will allow the reader to point the data of the packet
+ * directly at its own copy of the data instead of copying it.\n
  * A combination of all these flags can be used.
  *
  * \param  context   Pointer to the context of the reader to use
@@ -597,6 +604,19 @@ typedef struct VC_CONTAINER_WRITE_STATS_T
    /** This logs the length of time that we wait for a flush command to complete. */
    VC_CONTAINER_STATS_T flush;
 } VC_CONTAINER_WRITE_STATS_T;
+
+/** This type represents the statistics saved by the io layer when reading ahead. */
+typedef struct VC_CONTAINER_READ_STATS_T
+{
+   /** This logs the number of bytes read ahead in count, and the microseconds taken to read
+    * in num. */
+   VC_CONTAINER_STATS_T read;
+   /** This logs the length of time the reader has to wait for the asynchronous task. */
+   VC_CONTAINER_STATS_T wait;
+   uint32_t hits;      /**< Number of cache refills served from the read ahead areas */
+   uint32_t misses;    /**< Number of cache refills which had to be read synchronously */
+   uint32_t discarded; /**< Number of read ahead areas thrown away because of seeks */
+} VC_CONTAINER_READ_STATS_T;
    
 
 /** Control operations which can be done on containers. */
@@ -660,7 +680,8 @@ typedef enum
 
    /** Collects performance statistics.\n
     * Arguments:\n
-    *   arg1= VC_CONTAINER_WRITE_STATS_T *: */
+    *   arg1= VC_CONTAINER_WRITE_STATS_T *: when writing\n
+    *   arg1= VC_CONTAINER_READ_STATS_T *: when reading */
    VC_CONTAINER_CONTROL_GET_IO_PERF_STATS,
 
    /** HACK.\n
@@ -717,6 +738,35 @@ typedef enum
     *   arg2= VC_CONTAINER_FOURCC_T: codec variant to output */
    VC_CONTAINER_CONTROL_TRACK_PACKETIZE,
 
+   /** Enable or disable an in-memory index of the samples of each track.\n
+    * Readers which support it will then seek and look up samples without going
+    * back to the index tables stored in the stream.\n
+    * Arguments:\n
+    *   arg1= bool: enable or disable */
+   VC_CONTAINER_CONTROL_SET_SAMPLE_INDEX,
+
+   /** Get the amount of memory used by the in-memory sample index.\n
+    * Arguments:\n
+    *   arg1= uint64_t *: memory used in bytes */
+   VC_CONTAINER_CONTROL_GET_SAMPLE_INDEX_SIZE,
+
+   /** Keep the seek index built by the reader in a persistent cache so it can be
+    * reused the next time the same file is opened. Only applies to readers which
+    * build their own index because the format doesn't provide one. The cache is
+    * also enabled by the "index_cache" URI option.\n
+    * Arguments:\n
+    *   arg1= const char *: path of the cache file, or NULL to use the path of the
+    *                       stream with a ".vcidx" extension appended */
+   VC_CONTAINER_CONTROL_SET_INDEX_CACHE,
+
+   /** Set the number of cache areas the I/O layer fills in the background when it
+    * detects that the stream is being read sequentially. This is only used by i/o
+    * modules which rely on the caching layer (e.g. local files or http) and can also
+    * be set with the "read_ahead" URI option.\n
+    * Arguments:\n
+    *   arg1= uint32_t: number of areas to read ahead, 0 disables reading ahead */
+   VC_CONTAINER_CONTROL_IO_SET_READ_AHEAD,
+
    /** Private user extensions must be above this number */
    VC_CONTAINER_CONTROL_USER_EXTENSIONS = 0x1000
 
@@ -27,15 +27,42 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "containers/containers.h"
+#include "containers/core/containers_private.h"
+#include "containers/core/containers_uri.h"
 #include "containers/core/containers_index.h"
 
+#define INDEX_CACHE_MAGIC     VC_FOURCC('v','c','i','x')
+#define INDEX_CACHE_VERSION   1
+#define INDEX_CACHE_EXTENSION ".vcidx"
+
 typedef struct {
    int64_t file_offset;
    int64_t time;
 } VC_CONTAINER_INDEX_POS_T;
 
+// Identifies the stream (and the reader) an index was built for
+typedef struct {
+   uint32_t format;
+   uint32_t reserved;
+   int64_t file_size;
+   int64_t file_mtime;
+} VC_CONTAINER_INDEX_KEY_T;
+
+// Header of a cache file. It is followed by the entries, in time order. Everything is
+// stored in native byte order with natural alignment so the file can be mapped directly.
+typedef struct {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t count;                    // number of entries which follow
+   uint32_t max_count;                // decimation state of the index when it was saved
+   VC_CONTAINER_INDEX_KEY_T key;
+} VC_CONTAINER_INDEX_FILE_HEADER_T;
+
 struct  VC_CONTAINER_INDEX_T {
    int len;                           // log2 of length of entry array
    int next;                          // next array entry to write into
@@ -44,6 +71,9 @@ struct  VC_CONTAINER_INDEX_T {
    int count;                         // number of calls to index_add since last entry added
    int max_count;                     // log2 of the number of calls to discard between each entry added
    int64_t max_time;                  // time of the latest entry
+   char *cache_path;                  // cache file this index is saved to, if any
+   VC_CONTAINER_INDEX_KEY_T key;      // key of the stream saved in the cache
+   int dirty;                         // whether entries were added since the cache was attached
    VC_CONTAINER_INDEX_POS_T entry[0]; // array of position/time pairs   
 };
 
@@ -89,11 +119,20 @@ VC_CONTAINER_STATUS_T vc_container_index_create( VC_CONTAINER_INDEX_T **index, i
    return status;
 }
 
+static VC_CONTAINER_STATUS_T index_cache_save( VC_CONTAINER_INDEX_T *index );
+
 VC_CONTAINER_STATUS_T vc_container_index_free( VC_CONTAINER_INDEX_T *index )
 {
    if(index == NULL)
       return VC_CONTAINER_ERROR_FAILED;
 
+   if(index->cache_path)
+   {
+      if(index->dirty)
+         index_cache_save(index);
+      free(index->cache_path);
+   }
+
    free(index);
    return VC_CONTAINER_SUCCESS;
 }
@@ -134,6 +173,7 @@ VC_CONTAINER_STATUS_T vc_container_index_add( VC_CONTAINER_INDEX_T *index, int64
       index->count = 0;
       index->next++;
       index->max_time = time;
+      index->dirty = 1;
    }
 
    return VC_CONTAINER_SUCCESS;
@@ -190,3 +230,172 @@ VC_CONTAINER_STATUS_T vc_container_index_get( VC_CONTAINER_INDEX_T *index, int l
    return VC_CONTAINER_SUCCESS;
 }
 
+
+static VC_CONTAINER_STATUS_T index_cache_save( VC_CONTAINER_INDEX_T *index )
+{
+   VC_CONTAINER_INDEX_FILE_HEADER_T header;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_FAILED;
+   size_t size = strlen(index->cache_path) + sizeof(".XXXXXX");
+   char *temp_path = malloc(size);
+   FILE *stream = NULL;
+   int i, fd;
+
+   if(temp_path == NULL)
+      return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+
+   // Write to a temporary file first and then move it in place, so that other
+   // processes sharing the cache never see a partially written file. The name
+   // is unique so that processes indexing the same file don't write over each other.
+   snprintf(temp_path, size, "%s.XXXXXX", index->cache_path);
+   fd = mkstemp(temp_path);
+   if(fd < 0)
+   {
+      free(temp_path);
+      return VC_CONTAINER_ERROR_FAILED;
+   }
+   fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+   stream = fdopen(fd, "wb");
+   if(stream == NULL)
+   {
+      close(fd);
+      goto end;
+   }
+
+   memset(&header, 0, sizeof(header));
+   header.magic = INDEX_CACHE_MAGIC;
+   header.version = INDEX_CACHE_VERSION;
+   header.count = index->next;
+   header.max_count = index->max_count;
+   header.key = index->key;
+   if(fwrite(&header, sizeof(header), 1, stream) != 1) goto end;
+
+   for(i = 0; i < index->next; i++)
+      if(fwrite(&index->entry[ENTRY(index, i)], sizeof(index->entry[0]), 1, stream) != 1) goto end;
+
+   if(fclose(stream) == 0 && rename(temp_path, index->cache_path) == 0)
+      status = VC_CONTAINER_SUCCESS;
+   stream = NULL;
+
+ end:
+   if(stream) fclose(stream);
+   if(status != VC_CONTAINER_SUCCESS) remove(temp_path);
+   free(temp_path);
+   return status;
+}
+
+static VC_CONTAINER_STATUS_T index_cache_load( VC_CONTAINER_INDEX_T **index, int length,
+   const char *path, const VC_CONTAINER_INDEX_KEY_T *key )
+{
+   VC_CONTAINER_INDEX_FILE_HEADER_T header;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_CORRUPTED;
+   VC_CONTAINER_INDEX_T *id = NULL;
+   VC_CONTAINER_INDEX_POS_T pos;
+   FILE *stream = fopen(path, "rb");
+   uint32_t i, step = 1;
+
+   if(stream == NULL)
+      return VC_CONTAINER_ERROR_URI_NOT_FOUND;
+
+   if(fread(&header, sizeof(header), 1, stream) != 1 ||
+      header.magic != INDEX_CACHE_MAGIC || header.version != INDEX_CACHE_VERSION ||
+      memcmp(&header.key, key, sizeof(*key)) || header.count == 0)
+      goto error;
+
+   if((status = vc_container_index_create(&id, length)) != VC_CONTAINER_SUCCESS)
+      goto error;
+   status = VC_CONTAINER_ERROR_CORRUPTED;
+
+   // The cache may have been saved from a longer index, in which case we keep
+   // every step'th entry and decimate future entries accordingly
+   id->max_count = header.max_count;
+   while(header.count > step * (1u << id->len))
+   {
+      step <<= 1;
+      id->max_count++;
+   }
+
+   for(i = 0; i < header.count; i++)
+   {
+      if(fread(&pos, sizeof(pos), 1, stream) != 1) goto error;
+      if(i % step) continue;
+      if(id->next && pos.time <= id->max_time) goto error;
+      id->entry[id->next++] = pos;
+      id->max_time = pos.time;
+   }
+
+   fclose(stream);
+   *index = id;
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   fclose(stream);
+   if(id) vc_container_index_free(id);
+   return status;
+}
+
+VC_CONTAINER_STATUS_T vc_container_index_cache( VC_CONTAINER_T *ctx, VC_CONTAINER_INDEX_T **index,
+   int length, VC_CONTAINER_FOURCC_T format, const char *cache_path )
+{
+   const char *scheme = vc_uri_scheme(ctx->priv->uri);
+   const char *path = vc_uri_path(ctx->priv->uri);
+   VC_CONTAINER_INDEX_T *cached = NULL;
+   VC_CONTAINER_INDEX_KEY_T key;
+   VC_CONTAINER_STATUS_T status;
+   char *file_path;
+   struct stat st;
+   size_t size;
+
+   // Only local files have a size and modification time we can trust
+   if((scheme && strcasecmp(scheme, "file")) || path == NULL || stat(path, &st) != 0)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   memset(&key, 0, sizeof(key));
+   key.format = format;
+   key.file_size = (int64_t)st.st_size;
+   key.file_mtime = (int64_t)st.st_mtime;
+
+   // Work out where the cache lives
+   size = cache_path && *cache_path ? strlen(cache_path) + 1 : strlen(path) + sizeof(INDEX_CACHE_EXTENSION);
+   file_path = malloc(size);
+   if(file_path == NULL)
+      return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   if(cache_path && *cache_path)
+      strcpy(file_path, cache_path);
+   else
+      snprintf(file_path, size, "%s" INDEX_CACHE_EXTENSION, path);
+
+   // Use the cached index if it covers at least as much of the stream as ours
+   if(index_cache_load(&cached, length, file_path, &key) == VC_CONTAINER_SUCCESS)
+   {
+      if(*index == NULL || cached->max_time >= (*index)->max_time)
+      {
+         if(*index)
+         {
+            // The index we're replacing is of no further use, don't save it
+            (*index)->dirty = 0;
+            vc_container_index_free(*index);
+         }
+         *index = cached;
+      }
+      else
+         vc_container_index_free(cached);
+   }
+   else if(*index == NULL)
+   {
+      if((status = vc_container_index_create(index, length)) != VC_CONTAINER_SUCCESS)
+      {
+         free(file_path);
+         return status;
+      }
+   }
+   else
+   {
+      // Make sure whatever we have already gets saved
+      (*index)->dirty = 1;
+   }
+
+   free((*index)->cache_path);
+   (*index)->cache_path = file_path;
+   (*index)->key = key;
+   return VC_CONTAINER_SUCCESS;
+}
@@ -49,7 +49,8 @@ VC_CONTAINER_STATUS_T vc_container_index_create( VC_CONTAINER_INDEX_T **index, i
 
 
 /**
- * Frees an index.
+ * Frees an index. If a cache is attached to the index and entries were added
+ * since it was attached, the index is saved to the cache first.
  * @param index  Pointer to valid index.
  * @return       Status code.
  */
@@ -79,4 +80,22 @@ VC_CONTAINER_STATUS_T vc_container_index_add( VC_CONTAINER_INDEX_T *index, int64
  */
 VC_CONTAINER_STATUS_T vc_container_index_get( VC_CONTAINER_INDEX_T *index, int later, int64_t *time, int64_t *file_offset, int *past );
 
+/**
+ * Attaches a persistent cache to an index. The cache is a sidecar file which is
+ * keyed on the size and modification time of the stream and on the format of the
+ * reader. If a valid cache exists and covers at least as much of the stream as the
+ * current index, the current index is replaced by the cached one. The index is
+ * written back to the cache by vc_container_index_free if new entries were added.
+ * Only streams which are local files can be cached.
+ * @param  ctx         Pointer to the container context using the index.
+ * @param  index       Pointer to the index (can point to a NULL index, in which case one is created).
+ * @param  length      Suggested length of index, if one needs creating.
+ * @param  format      Identifier for the reader which built the index.
+ * @param  cache_path  Path of the cache file, or NULL (or empty) to use the stream path with a
+ *                     ".vcidx" extension appended.
+ * @return             Status code.
+ */
+VC_CONTAINER_STATUS_T vc_container_index_cache( VC_CONTAINER_T *ctx, VC_CONTAINER_INDEX_T **index,
+   int length, VC_CONTAINER_FOURCC_T format, const char *cache_path );
+
 #endif /* VC_CONTAINERS_WRITER_UTILS_H */
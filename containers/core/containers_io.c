@@ -43,6 +43,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MEM_CACHE_TMP_MAX_SIZE (32*1024) /* Needs to be a power of 2 */
 #define MEM_CACHE_ALIGNMENT (1*1024) /* Needs to be a power of 2 */
 #define MEM_CACHE_AREA_READ_MAX_SIZE (4*1024*1024) /* Needs to be a power of 2 */
+#define MAX_NUM_READ_AHEAD_AREAS 16
+#define NUM_READ_AHEAD_AREAS MAX_NUM_MEMORY_AREAS
 
 typedef struct VC_CONTAINER_IO_PRIVATE_CACHE_T
 {
@@ -79,6 +81,7 @@ typedef struct VC_CONTAINER_IO_PRIVATE_T
    int64_t actual_offset;
 
    struct VC_CONTAINER_IO_ASYNC_T *async_io;
+   struct VC_CONTAINER_IO_READ_AHEAD_T *read_ahead;
 
 } VC_CONTAINER_IO_PRIVATE_T;
 
@@ -93,6 +96,8 @@ VC_CONTAINER_STATUS_T vc_container_io_pktfile_open( VC_CONTAINER_IO_T *p_ctx, co
                                                  VC_CONTAINER_IO_MODE_T mode );
 VC_CONTAINER_STATUS_T vc_container_io_http_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
                                                  VC_CONTAINER_IO_MODE_T mode );
+VC_CONTAINER_STATUS_T vc_container_io_mmap_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
+                                                 VC_CONTAINER_IO_MODE_T mode );
 static VC_CONTAINER_STATUS_T io_seek_not_seekable(VC_CONTAINER_IO_T *p_ctx, int64_t offset);
 
 static size_t vc_container_io_cache_read( VC_CONTAINER_IO_T *p_ctx,
@@ -114,6 +119,18 @@ static VC_CONTAINER_STATUS_T async_io_wait_complete( struct VC_CONTAINER_IO_ASYN
 static void async_io_stats_initialise( struct VC_CONTAINER_IO_ASYNC_T *ctx, int enable );
 static void async_io_stats_get( struct VC_CONTAINER_IO_ASYNC_T *ctx, VC_CONTAINER_WRITE_STATS_T *stats );
 
+static struct VC_CONTAINER_IO_READ_AHEAD_T *read_ahead_start( VC_CONTAINER_IO_T *io, unsigned int num_areas );
+static void read_ahead_stop( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx );
+static void read_ahead_cancel( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx );
+static bool read_ahead_seek( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx,
+                             VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int64_t offset );
+static size_t read_ahead_refill( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx,
+                                 VC_CONTAINER_IO_PRIVATE_CACHE_T *cache );
+static void read_ahead_update( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx,
+                               VC_CONTAINER_IO_PRIVATE_CACHE_T *cache );
+static void read_ahead_stats_initialise( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, int enable );
+static void read_ahead_stats_get( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_STATS_T *stats );
+
 /*****************************************************************************/
 static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAINER_IO_MODE_T mode,
                                                      VC_CONTAINER_IO_CAPABILITIES_T capabilities,
@@ -123,6 +140,8 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
    VC_CONTAINER_IO_T *p_ctx = 0;
    VC_CONTAINER_IO_PRIVATE_T *private = 0;
    unsigned int uri_length, caches = 0, cache_max_size, num_areas = MAX_NUM_MEMORY_AREAS;
+   unsigned int read_ahead_areas = NUM_READ_AHEAD_AREAS;
+   const char *value;
 
    /* XXX */
    uri_length = strlen(uri) + 1;
@@ -146,6 +165,9 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
       if(status) status = vc_container_io_pktfile_open(p_ctx, uri, mode);
 #ifdef ENABLE_CONTAINER_IO_HTTP
       if(status) status = vc_container_io_http_open(p_ctx, uri, mode);
+#endif
+#ifdef ENABLE_CONTAINER_IO_MMAP
+      if(status) status = vc_container_io_mmap_open(p_ctx, uri, mode);
 #endif
       if(status) status = vc_container_io_file_open(p_ctx, uri, mode);
       if(status != VC_CONTAINER_SUCCESS) goto error;
@@ -201,6 +223,12 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
    if(mode == VC_CONTAINER_IO_MODE_WRITE && p_ctx->priv->cache && num_areas >= 2)
       p_ctx->priv->async_io = async_io_start( p_ctx, num_areas, 0 );
 
+   /* Try to read ahead in the background if we're in read mode and we know the size of the stream */
+   if(vc_uri_find_query(p_ctx->uri_parts, 0, "read_ahead", &value) && value)
+      read_ahead_areas = strtoul(value, NULL, 0);
+   if(mode == VC_CONTAINER_IO_MODE_READ && p_ctx->priv->cache && p_ctx->size && read_ahead_areas)
+      p_ctx->priv->read_ahead = read_ahead_start( p_ctx, read_ahead_areas );
+
  end:
    if(p_status) *p_status = status;
    return p_ctx;
@@ -242,6 +270,9 @@ VC_CONTAINER_STATUS_T vc_container_io_close( VC_CONTAINER_IO_T *p_ctx )
                vc_container_io_cache_flush( p_ctx, &p_ctx->priv->caches, 1 );
          }
          
+         if(p_ctx->priv->read_ahead)
+            read_ahead_stop( p_ctx->priv->read_ahead );
+
          if(p_ctx->priv->async_io)
             async_io_stop( p_ctx->priv->async_io );
          else if(p_ctx->priv->caches_num)
@@ -315,6 +346,24 @@ size_t vc_container_io_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_
    return ret < 0 ? 0 : ret;
 }
 
+/*****************************************************************************/
+void *vc_container_io_borrow(VC_CONTAINER_IO_T *p_ctx, size_t size)
+{
+   void *data;
+
+   /* Data which goes through the cache can't be accessed directly */
+   if(!p_ctx->pf_borrow || p_ctx->priv->cache)
+      return NULL;
+
+   data = p_ctx->pf_borrow(p_ctx, size);
+   if(!data)
+      return NULL;
+
+   p_ctx->priv->actual_offset += size;
+   p_ctx->offset += size;
+   return data;
+}
+
 /*****************************************************************************/
 size_t vc_container_io_skip(VC_CONTAINER_IO_T *p_ctx, size_t size)
 {
@@ -403,6 +452,10 @@ VC_CONTAINER_STATUS_T vc_container_io_control_list(VC_CONTAINER_IO_T *context, V
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
 
+   /* The i/o module can't be used while the read ahead thread is using it */
+   if (context->pf_control && context->priv->read_ahead)
+      read_ahead_cancel(context->priv->read_ahead);
+
    if (context->pf_control)
       status = context->pf_control(context, operation, args);
 
@@ -426,6 +479,30 @@ VC_CONTAINER_STATUS_T vc_container_io_control_list(VC_CONTAINER_IO_T *context, V
       async_io_stats_get(context->priv->async_io, va_arg(args, VC_CONTAINER_WRITE_STATS_T *));
    }
 
+   if(operation == VC_CONTAINER_CONTROL_SET_IO_PERF_STATS && context->priv->read_ahead)
+   {
+      status = VC_CONTAINER_SUCCESS;
+      read_ahead_stats_initialise(context->priv->read_ahead, va_arg(args, int));
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_GET_IO_PERF_STATS && context->priv->read_ahead)
+   {
+      status = VC_CONTAINER_SUCCESS;
+      read_ahead_stats_get(context->priv->read_ahead, va_arg(args, VC_CONTAINER_READ_STATS_T *));
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_IO_SET_READ_AHEAD && context->priv->caches_num &&
+      !context->priv->async_io && context->size)
+   {
+      unsigned int areas = va_arg(args, uint32_t);
+      status = VC_CONTAINER_SUCCESS;
+      if(context->priv->read_ahead)
+         read_ahead_stop(context->priv->read_ahead);
+      context->priv->read_ahead = areas ? read_ahead_start(context, areas) : 0;
+      if(areas && !context->priv->read_ahead)
+         status = VC_CONTAINER_ERROR_FAILED;
+   }
+
    return status;
 }
 
@@ -489,6 +566,15 @@ size_t vc_container_io_cache(VC_CONTAINER_IO_T *p_ctx, size_t size)
       main_cache->position += cache->size;
    }
 
+   /* The read ahead thread might have moved the i/o module further along */
+   if(cache->mem_size > cache->size && private->read_ahead)
+   {
+      read_ahead_cancel(private->read_ahead);
+      if(private->actual_offset != cache->offset + (int64_t)cache->size &&
+         cache->io->pf_seek(cache->io, cache->offset + cache->size) != VC_CONTAINER_SUCCESS)
+         return 0;
+   }
+
    /* Read the rest of the cache directly from the stream */
    if(cache->mem_size > cache->size)
    {
@@ -516,6 +602,15 @@ static size_t vc_container_io_cache_refill( VC_CONTAINER_IO_T *p_ctx,
 
    if(ret) return 0; /* TODO what should we do there ? */
 
+   if(p_ctx->priv->read_ahead)
+   {
+      /* Check if the data has already been read in the background */
+      if(cache == &p_ctx->priv->caches)
+         ret = read_ahead_refill( p_ctx->priv->read_ahead, cache );
+      if(ret) return ret;
+      read_ahead_cancel( p_ctx->priv->read_ahead );
+   }
+
    if(p_ctx->priv->actual_offset != cache->offset)
    {
       if(cache->io->pf_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
@@ -526,6 +621,9 @@ static size_t vc_container_io_cache_refill( VC_CONTAINER_IO_T *p_ctx,
    cache->size = ret;
    cache->position = 0;
    cache->io->priv->actual_offset = cache->offset + ret;
+
+   if(p_ctx->priv->read_ahead && cache == &p_ctx->priv->caches)
+      read_ahead_update( p_ctx->priv->read_ahead, cache );
    return ret;
 }
 
@@ -561,8 +659,9 @@ static size_t vc_container_io_cache_read( VC_CONTAINER_IO_T *p_ctx,
       bytes = cache->size - cache->position; /* Bytes left in cache */
 
 #if 1 // FIXME Only if stream is seekable
-      /* Try to read directly from the stream if the cache just gets in the way */
-      if(!bytes && size > cache->mem_size)
+      /* Try to read directly from the stream if the cache just gets in the way.
+       * When reading ahead, the cache is what keeps the i/o busy so always use it. */
+      if(!bytes && size > cache->mem_size && !p_ctx->priv->read_ahead)
       {
          bytes = cache->mem_size;
          ret = vc_container_io_cache_refill_bypass( p_ctx, cache, data + read, bytes);
@@ -671,6 +770,10 @@ static VC_CONTAINER_STATUS_T vc_container_io_cache_seek(VC_CONTAINER_IO_T *p_ctx
       return VC_CONTAINER_SUCCESS;
    }
 
+   /* Check if the seek position is in the area we're reading ahead */
+   if(p_ctx->priv->read_ahead && read_ahead_seek( p_ctx->priv->read_ahead, cache, offset ))
+      return VC_CONTAINER_SUCCESS;
+
    shift = cache->buffer - cache->mem;
    if(!cache->dirty && shift && cache->size &&
       offset >= cache->offset - (int64_t)shift && offset < cache->offset)
@@ -753,10 +856,10 @@ static size_t vc_container_io_cache_flush( VC_CONTAINER_IO_T *p_ctx,
  * to continue its work while the I/O is taking place in the background.
  *****************************************************************************/
 
-#ifdef ENABLE_CONTAINERS_ASYNC_IO
+#if defined(ENABLE_CONTAINERS_ASYNC_IO) || defined(ENABLE_CONTAINERS_READ_AHEAD)
 #include "vcos.h"
 
-#define NUMPC(c,n,s) ((c) < (1<<(s)) ? (n) : ((n) / (c >> (s))))
+#define NUMPC(c,n,s) ((c) < (1U<<(s)) ? (n) : ((n) / (c >> (s))))
 
 static void stats_initialise(VC_CONTAINER_STATS_T *st, uint32_t shift)
 {
@@ -829,6 +932,9 @@ static void stats_add_value(VC_CONTAINER_STATS_T *st, uint32_t count, uint32_t n
    }
 }
 
+#endif
+
+#ifdef ENABLE_CONTAINERS_ASYNC_IO
 typedef struct VC_CONTAINER_IO_ASYNC_T
 {
    VC_CONTAINER_IO_T *io;
@@ -1086,3 +1192,436 @@ static void async_io_stats_get( struct VC_CONTAINER_IO_ASYNC_T *ctx, VC_CONTAINE
 
 
 #endif
+
+/*****************************************************************************
+ * Asynchronous read ahead.
+ * This is the counterpart of the asynchronous writes for readers. Once we
+ * detect that the stream is being read sequentially, a background thread
+ * fills the next few cache areas so that the demuxing can overlap with the
+ * I/O. Any access which isn't sequential cancels the read ahead and falls
+ * back to synchronous reads.
+ *****************************************************************************/
+
+#ifdef ENABLE_CONTAINERS_READ_AHEAD
+
+/** Number of back to back cache refills before we start reading ahead */
+#define READ_AHEAD_SEQUENTIAL_REFILLS 2
+
+typedef enum {
+   READ_AHEAD_AREA_FREE = 0,
+   READ_AHEAD_AREA_QUEUED,
+   READ_AHEAD_AREA_READING,
+   READ_AHEAD_AREA_DONE
+} READ_AHEAD_AREA_STATE_T;
+
+typedef struct VC_CONTAINER_IO_READ_AHEAD_AREA_T
+{
+   READ_AHEAD_AREA_STATE_T state;
+   uint8_t *mem;          /**< Base address of the memory area */
+   unsigned int shift;    /**< Offset of the valid data in the memory area */
+   int64_t offset;        /**< Offset of the data in the stream */
+   size_t request;        /**< Number of bytes requested */
+   size_t size;           /**< Number of bytes actually read */
+
+} VC_CONTAINER_IO_READ_AHEAD_AREA_T;
+
+typedef struct VC_CONTAINER_IO_READ_AHEAD_T
+{
+   VC_CONTAINER_IO_T *io;
+   VCOS_THREAD_T thread;
+   VCOS_MUTEX_T lock;
+   VCOS_EVENT_T wake_event; /**< Signalled when areas have been queued */
+   VCOS_EVENT_T done_event; /**< Signalled when an area has been read */
+   bool thread_started;
+   int quit;
+
+   unsigned int num_area;
+   VC_CONTAINER_IO_READ_AHEAD_AREA_T area[MAX_NUM_READ_AHEAD_AREAS];
+   unsigned int head;       /**< Next area to be consumed by the reader */
+   unsigned int queued;     /**< Number of areas in use, starting at head */
+   unsigned int fill;       /**< Next area to be read by the thread */
+   int64_t next_offset;     /**< Offset following the last queued area */
+   int64_t io_offset;       /**< Current position of the i/o module */
+   bool io_moved;           /**< The thread moved the i/o module since the last cancel */
+
+   int64_t last_end;        /**< End of the data from the last refill */
+   unsigned int sequential; /**< Number of consecutive sequential refills */
+
+   int stats_enable;
+   VC_CONTAINER_READ_STATS_T stats;
+
+} VC_CONTAINER_IO_READ_AHEAD_T;
+
+/*****************************************************************************/
+static void read_ahead_stats_initialise( VC_CONTAINER_IO_READ_AHEAD_T *ctx, int enable )
+{
+   vcos_mutex_lock(&ctx->lock);
+   ctx->stats_enable = enable;
+   memset(&ctx->stats, 0, sizeof(ctx->stats));
+   stats_initialise(&ctx->stats.read, 8);
+   stats_initialise(&ctx->stats.wait, 0);
+   vcos_mutex_unlock(&ctx->lock);
+}
+
+static void read_ahead_stats_get( VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_STATS_T *stats )
+{
+   vcos_mutex_lock(&ctx->lock);
+   *stats = ctx->stats;
+   vcos_mutex_unlock(&ctx->lock);
+}
+
+static void *read_ahead_thread(void *argv)
+{
+   VC_CONTAINER_IO_READ_AHEAD_T *ctx = argv;
+   VC_CONTAINER_IO_T *io = ctx->io;
+
+   while (1)
+   {
+      vcos_event_wait(&ctx->wake_event);
+      if(ctx->quit) break;
+
+      vcos_mutex_lock(&ctx->lock);
+      while(ctx->area[ctx->fill].state == READ_AHEAD_AREA_QUEUED)
+      {
+         VC_CONTAINER_IO_READ_AHEAD_AREA_T *area = &ctx->area[ctx->fill];
+         unsigned long time = 0;
+         size_t size = 0;
+
+         area->state = READ_AHEAD_AREA_READING;
+         vcos_mutex_unlock(&ctx->lock);
+
+         if(ctx->stats_enable)
+            time = vcos_getmicrosecs();
+
+         if(ctx->io_offset == area->offset ||
+            io->pf_seek(io, area->offset) == VC_CONTAINER_SUCCESS)
+            size = io->pf_read(io, area->mem + area->shift, area->request);
+
+         vcos_mutex_lock(&ctx->lock);
+         if(ctx->stats_enable)
+            stats_add_value(&ctx->stats.read, size, vcos_getmicrosecs() - time);
+         area->size = size;
+         area->state = READ_AHEAD_AREA_DONE;
+         ctx->io_offset = area->offset + size;
+         ctx->io_moved = true;
+         if(++ctx->fill == ctx->num_area)
+            ctx->fill = 0;
+         vcos_event_signal(&ctx->done_event);
+      }
+      vcos_mutex_unlock(&ctx->lock);
+   }
+
+   return NULL;
+}
+
+/*****************************************************************************/
+static void read_ahead_queue( VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   VC_CONTAINER_IO_T *io = ctx->io;
+   bool queued = false;
+
+   vcos_mutex_lock(&ctx->lock);
+   while(ctx->queued < ctx->num_area)
+   {
+      VC_CONTAINER_IO_READ_AHEAD_AREA_T *area = &ctx->area[(ctx->head + ctx->queued) % ctx->num_area];
+
+      /* We never read past the end of the stream so the i/o module doesn't
+       * flag an end of stream while the reader still has data to consume */
+      if(ctx->next_offset >= io->size) break;
+
+      if(!area->mem) area->mem = malloc(cache->mem_size);
+      if(!area->mem) break;
+
+      area->offset = ctx->next_offset;
+      area->shift = area->offset & (MEM_CACHE_ALIGNMENT-1);
+      area->request = cache->mem_size - area->shift;
+      if((int64_t)area->request > io->size - area->offset)
+         area->request = io->size - area->offset;
+      area->size = 0;
+      area->state = READ_AHEAD_AREA_QUEUED;
+      ctx->next_offset += area->request;
+      ctx->queued++;
+      queued = true;
+   }
+   vcos_mutex_unlock(&ctx->lock);
+
+   if(!queued) return;
+
+   if(!ctx->thread_started)
+   {
+      if(vcos_thread_create(&ctx->thread, "read_ahead", NULL, read_ahead_thread, ctx) != VCOS_SUCCESS)
+      {
+         /* Carry on without reading ahead */
+         read_ahead_cancel(ctx);
+         ctx->num_area = 0;
+         return;
+      }
+      ctx->thread_started = true;
+   }
+   vcos_event_signal(&ctx->wake_event);
+}
+
+/*****************************************************************************/
+static void read_ahead_cancel( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   unsigned int i;
+
+   /* Even with nothing left in the queue (e.g. once everything up to the end
+    * of the stream has been consumed) the thread may have moved the i/o module */
+   if(!ctx->queued && !ctx->io_moved) return;
+
+   vcos_mutex_lock(&ctx->lock);
+
+   /* Stop the thread from picking up any more work */
+   for(i = 0; i < ctx->num_area; i++)
+      if(ctx->area[i].state == READ_AHEAD_AREA_QUEUED)
+         ctx->area[i].state = READ_AHEAD_AREA_FREE;
+
+   /* Wait for the read in progress to complete */
+   for(i = 0; i < ctx->num_area; i++)
+   {
+      while(ctx->area[i].state == READ_AHEAD_AREA_READING)
+      {
+         vcos_mutex_unlock(&ctx->lock);
+         vcos_event_wait(&ctx->done_event);
+         vcos_mutex_lock(&ctx->lock);
+      }
+   }
+
+   ctx->stats.discarded += ctx->queued;
+   for(i = 0; i < ctx->num_area; i++)
+      ctx->area[i].state = READ_AHEAD_AREA_FREE;
+   ctx->head = ctx->fill = ctx->queued = 0;
+   ctx->io_moved = false;
+   vcos_mutex_unlock(&ctx->lock);
+
+   /* The i/o module is now where the thread left it */
+   ctx->io->priv->actual_offset = ctx->io_offset;
+}
+
+/*****************************************************************************/
+static bool read_ahead_seek( VC_CONTAINER_IO_READ_AHEAD_T *ctx,
+                             VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int64_t offset )
+{
+   /* Short forward seeks (e.g. skipping the data of another track) are served
+    * by the areas we're reading ahead. Anything else goes to the i/o module. */
+   if(!ctx->queued || cache != &ctx->io->priv->caches ||
+      offset < cache->offset + (int64_t)cache->size || offset >= ctx->next_offset)
+   {
+      read_ahead_cancel(ctx);
+      return false;
+   }
+
+   vc_container_io_cache_flush( ctx->io, cache, 1 );
+   cache->offset = offset;
+   return true;
+}
+
+/*****************************************************************************/
+static size_t read_ahead_refill( VC_CONTAINER_IO_READ_AHEAD_T *ctx,
+                                 VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   VC_CONTAINER_IO_READ_AHEAD_AREA_T *area = 0;
+   int64_t offset = cache->offset;
+   unsigned long time = 0;
+   uint8_t *mem;
+
+   if(!ctx->queued || offset < ctx->area[ctx->head].offset || offset >= ctx->next_offset)
+      return 0;
+
+   vcos_mutex_lock(&ctx->lock);
+   while(ctx->queued)
+   {
+      area = &ctx->area[ctx->head];
+
+      if(area->state != READ_AHEAD_AREA_DONE)
+      {
+         if(ctx->stats_enable)
+            time = vcos_getmicrosecs();
+         while(area->state != READ_AHEAD_AREA_DONE)
+         {
+            vcos_mutex_unlock(&ctx->lock);
+            vcos_event_wait(&ctx->done_event);
+            vcos_mutex_lock(&ctx->lock);
+         }
+         if(ctx->stats_enable)
+            stats_add_value(&ctx->stats.wait, 1, vcos_getmicrosecs() - time);
+      }
+
+      if(offset < area->offset + (int64_t)area->size)
+         break;
+
+      /* We've skipped over this area */
+      area->state = READ_AHEAD_AREA_FREE;
+      if(++ctx->head == ctx->num_area)
+         ctx->head = 0;
+      ctx->queued--;
+      ctx->stats.discarded++;
+      if(area->size < area->request)
+         break; /* We won't find anything beyond a short read */
+      area = 0;
+   }
+
+   if(!area || area->state != READ_AHEAD_AREA_DONE)
+   {
+      vcos_mutex_unlock(&ctx->lock);
+      return 0;
+   }
+
+   /* Swap the memory of the cache with the area we've just read */
+   mem = cache->mem;
+   cache->mem = area->mem;
+   cache->buffer = cache->mem + area->shift;
+   cache->buffer_end = cache->mem + cache->mem_size;
+   cache->offset = area->offset;
+   cache->size = area->size;
+   cache->position = offset - area->offset;
+   area->mem = mem;
+
+   area->state = READ_AHEAD_AREA_FREE;
+   if(++ctx->head == ctx->num_area)
+      ctx->head = 0;
+   ctx->queued--;
+   ctx->stats.hits++;
+   vcos_mutex_unlock(&ctx->lock);
+
+   ctx->last_end = cache->offset + cache->size;
+
+   /* Keep the thread busy */
+   if(cache->size == area->request)
+      read_ahead_queue(ctx, cache);
+
+   return cache->size - cache->position;
+}
+
+/*****************************************************************************/
+static void read_ahead_update( VC_CONTAINER_IO_READ_AHEAD_T *ctx,
+                               VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   ctx->stats.misses++;
+
+   if(cache->offset == ctx->last_end) ctx->sequential++;
+   else ctx->sequential = 0;
+   ctx->last_end = cache->offset + cache->size;
+
+   /* Start reading ahead once the access pattern looks sequential */
+   if(ctx->sequential < READ_AHEAD_SEQUENTIAL_REFILLS || !ctx->num_area ||
+      cache->size != (size_t)(cache->buffer_end - cache->buffer))
+      return;
+
+   ctx->io_offset = ctx->io->priv->actual_offset;
+   ctx->next_offset = ctx->last_end;
+   read_ahead_queue(ctx, cache);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_IO_READ_AHEAD_T *read_ahead_start( VC_CONTAINER_IO_T *io, unsigned int num_areas )
+{
+   VC_CONTAINER_IO_READ_AHEAD_T *ctx;
+
+   ctx = malloc(sizeof(*ctx));
+   if(!ctx) goto error;
+   memset(ctx, 0, sizeof(*ctx));
+   ctx->io = io;
+   ctx->num_area = MIN(num_areas, MAX_NUM_READ_AHEAD_AREAS);
+   ctx->last_end = io->priv->caches.offset;
+
+   if(vcos_mutex_create(&ctx->lock, "read_ahead_lock") != VCOS_SUCCESS)
+      goto error_lock;
+   if(vcos_event_create(&ctx->wake_event, "read_ahead_wake") != VCOS_SUCCESS)
+      goto error_wake_event;
+   if(vcos_event_create(&ctx->done_event, "read_ahead_done") != VCOS_SUCCESS)
+      goto error_done_event;
+
+   read_ahead_stats_initialise(ctx, 0);
+
+   /* The thread itself is only started once we actually need to read ahead */
+   return ctx;
+
+ error_done_event:
+   vcos_event_delete(&ctx->wake_event);
+ error_wake_event:
+   vcos_mutex_delete(&ctx->lock);
+ error_lock:
+   free(ctx);
+ error:
+   return 0;
+}
+
+static void read_ahead_stop( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   unsigned int i;
+
+   read_ahead_cancel(ctx);
+
+   if(ctx->thread_started)
+   {
+      ctx->quit = 1;
+      vcos_event_signal(&ctx->wake_event);
+      vcos_thread_join(&ctx->thread, NULL);
+   }
+   vcos_event_delete(&ctx->done_event);
+   vcos_event_delete(&ctx->wake_event);
+   vcos_mutex_delete(&ctx->lock);
+
+   for(i = 0; i < MAX_NUM_READ_AHEAD_AREAS; i++)
+      free(ctx->area[i].mem);
+
+   ctx->io->priv->read_ahead = 0;
+   free(ctx);
+}
+#else
+
+static struct VC_CONTAINER_IO_READ_AHEAD_T *read_ahead_start( VC_CONTAINER_IO_T *io, unsigned int num_areas )
+{
+   VC_CONTAINER_PARAM_UNUSED(io);
+   VC_CONTAINER_PARAM_UNUSED(num_areas);
+   return 0;
+}
+
+static void read_ahead_stop( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+}
+
+static void read_ahead_cancel( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+}
+
+static bool read_ahead_seek( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx,
+                             VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int64_t offset )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+   VC_CONTAINER_PARAM_UNUSED(cache);
+   VC_CONTAINER_PARAM_UNUSED(offset);
+   return false;
+}
+
+static size_t read_ahead_refill( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx,
+                                 VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+   VC_CONTAINER_PARAM_UNUSED(cache);
+   return 0;
+}
+
+static void read_ahead_update( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx,
+                               VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+   VC_CONTAINER_PARAM_UNUSED(cache);
+}
+
+static void read_ahead_stats_initialise( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, int enable )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+   VC_CONTAINER_PARAM_UNUSED(enable);
+}
+
+static void read_ahead_stats_get( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_STATS_T *stats )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+   VC_CONTAINER_PARAM_UNUSED(stats);
+}
+#endif
@@ -121,6 +121,12 @@ struct VC_CONTAINER_IO_T
    VC_CONTAINER_STATUS_T (*pf_control)(struct VC_CONTAINER_IO_T *io, 
                                        VC_CONTAINER_CONTROL_T operation, va_list args);
 
+   /** \private
+    * Function pointer to get direct access to data from a container io module.
+    * This is optional and only implemented by modules which have the whole stream
+    * addressable in memory. */
+   void *(*pf_borrow)(struct VC_CONTAINER_IO_T *io, size_t size);
+
 };
 
 /** Opens an i/o stream pointed to by a URI.
@@ -172,6 +178,18 @@ size_t vc_container_io_peek(VC_CONTAINER_IO_T *context, void *buffer, size_t siz
  */
 size_t vc_container_io_read(VC_CONTAINER_IO_T *context, void *buffer, size_t size);
 
+/** Get direct access to data in an i/o stream and advance the read position past it.
+ * This avoids copying the data but is only supported by some i/o modules (e.g. when
+ * the stream is memory mapped). The data stays valid until the i/o stream is closed and
+ * can be modified in place without affecting the stream.
+ * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  size        Number of bytes to access
+ * \return             Pointer to the data or NULL if direct access isn't possible, in
+ *                     which case the read position is unchanged and the caller should
+ *                     use vc_container_io_read instead.
+ */
+void *vc_container_io_borrow(VC_CONTAINER_IO_T *context, size_t size);
+
 /** Skip data in an i/o stream without reading it.
  * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
  * \param  size        Number of bytes to skip
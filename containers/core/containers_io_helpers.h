@@ -555,6 +555,7 @@ STATIC_INLINE VC_CONTAINER_STATUS_T vc_container_io_write_le_uint64(VC_CONTAINER
 #define SKIP_BYTES(ctx, size) vc_container_io_skip((ctx)->priv->io, (size_t)(size))
 #define SEEK(ctx, off) vc_container_io_seek((ctx)->priv->io, (int64_t)(off))
 #define CACHE_BYTES(ctx, size) vc_container_io_cache((ctx)->priv->io, (size_t)(size))
+#define BORROW_BYTES(ctx, size) vc_container_io_borrow((ctx)->priv->io, (size_t)(size))
 
 #define _SKIP_GUID(ctx) vc_container_io_skip((ctx)->priv->io, 16)
 #define _SKIP_U8(ctx)  (vc_container_io_skip((ctx)->priv->io, 1) != 1)
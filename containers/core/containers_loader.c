@@ -64,9 +64,9 @@ static const char* container_for_fileext(const char *fileext);
  ********************************************************************************/
 
 static const char *readers[] =
-{"mp4", "asf", "avi", "mkv", "wav", "flv", "simple", "rawvideo", "mpga", "ps", "rtp", "rtsp", "rcv", "rv9", "qsynth", "binary", 0};
+{"mp4", "asf", "avi", "mkv", "wav", "flv", "simple", "rawvideo", "mpga", "ts", "ps", "rtp", "rtsp", "rcv", "rv9", "qsynth", "binary", 0};
 static const char *writers[] =
-{"mp4", "asf", "avi", "binary", "simple", "rawvideo", 0};
+{"mp4", "asf", "avi", "ts", "binary", "simple", "rawvideo", 0};
 static const char *metadata_readers[] =
 {"id3", 0};
 
@@ -81,6 +81,8 @@ VC_CONTAINER_STATUS_T mkv_reader_open( VC_CONTAINER_T * );
 VC_CONTAINER_STATUS_T wav_reader_open( VC_CONTAINER_T * );
 VC_CONTAINER_STATUS_T flv_reader_open( VC_CONTAINER_T * );
 VC_CONTAINER_STATUS_T ps_reader_open( VC_CONTAINER_T * );
+VC_CONTAINER_STATUS_T ts_reader_open( VC_CONTAINER_T * );
+VC_CONTAINER_STATUS_T ts_writer_open( VC_CONTAINER_T * );
 VC_CONTAINER_STATUS_T rtp_reader_open( VC_CONTAINER_T * );
 VC_CONTAINER_STATUS_T rtsp_reader_open( VC_CONTAINER_T * );
 VC_CONTAINER_STATUS_T binary_reader_open( VC_CONTAINER_T * );
@@ -109,6 +111,7 @@ static struct
    {"mp4",  &mp4_reader_open},
    {"flv",  &flv_reader_open},
    {"ps",  &ps_reader_open},
+   {"ts",  &ts_reader_open},
    {"binary",  &binary_reader_open},
    {"rtp",  &rtp_reader_open},
    {"rtsp", &rtsp_reader_open},
@@ -138,6 +141,7 @@ static struct
 {
    {"avi", &avi_writer_open},
    {"mp4", &mp4_writer_open},
+   {"ts", &ts_writer_open},
    {"binary", &binary_writer_open},
    {"simple", &simple_writer_open},
    {"rawvideo", &rawvideo_writer_open},
@@ -160,6 +164,8 @@ static const struct {
    { "mp2",  "mpga" },
    { "mp3",  "mpga" },
    { "webm", "mkv" },
+   { "m2ts", "ts" },
+   { "mts",  "ts" },
    { "mid",  "qsynth" },
    { "mld",  "qsynth" },
    { "mmf",  "qsynth" },
@@ -47,6 +47,7 @@ VC_CONTAINER_STATUS_T flv_reader_open( VC_CONTAINER_T *p_ctx );
 Defines.
 ******************************************************************************/
 #define FLV_TRACKS_MAX 2
+#define FLV_INDEX_SIZE 512
 
 #define FLV_TAG_TYPE_AUDIO 8
 #define FLV_TAG_TYPE_VIDEO 9
@@ -715,6 +716,21 @@ static VC_CONTAINER_STATUS_T flv_find_previous_frame(VC_CONTAINER_T *p_ctx, int
    return status;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T flv_reader_control( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_CONTROL_T operation, va_list args )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   switch(operation)
+   {
+   case VC_CONTAINER_CONTROL_SET_INDEX_CACHE:
+      return vc_container_index_cache(p_ctx, &module->state.index, FLV_INDEX_SIZE,
+         VC_FOURCC('f','l','v',' '), va_arg(args, const char *));
+   default: return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   }
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T flv_reader_close( VC_CONTAINER_T *p_ctx )
 {
@@ -989,6 +1005,7 @@ VC_CONTAINER_STATUS_T flv_reader_open( VC_CONTAINER_T *p_ctx )
    uint8_t buffer[4], type_flags;
    unsigned int i, frames, audio_present, video_present;
    uint32_t data_offset;
+   const char *cache = 0;
 
    /* Check the FLV marker */
    if( PEEK_BYTES(p_ctx, buffer, 4) < 4 ) goto error;
@@ -1112,9 +1129,13 @@ VC_CONTAINER_STATUS_T flv_reader_open( VC_CONTAINER_T *p_ctx )
    /* Try and create an index.  All times are signed, so adding a base timestamp
     * of zero means that we will always seek back to the start of the file, even if
     * the actual frame timestamps start at some higher number. */
-   if(vc_container_index_create(&module->state.index, 512) == VC_CONTAINER_SUCCESS)
+   if(vc_container_index_create(&module->state.index, FLV_INDEX_SIZE) == VC_CONTAINER_SUCCESS)
       vc_container_index_add(module->state.index, 0LL, (int64_t) data_offset);
 
+   /* Reuse the index built by a previous session if requested */
+   if(vc_uri_find_query(p_ctx->priv->uri, 0, "index_cache", &cache))
+      vc_container_index_cache(p_ctx, &module->state.index, FLV_INDEX_SIZE, VC_FOURCC('f','l','v',' '), cache);
+
    /* Use the metadata we read */
    if(module->audio_track >= 0)
    {
@@ -1155,6 +1176,7 @@ VC_CONTAINER_STATUS_T flv_reader_open( VC_CONTAINER_T *p_ctx )
    p_ctx->priv->pf_close = flv_reader_close;
    p_ctx->priv->pf_read = flv_reader_read;
    p_ctx->priv->pf_seek = flv_reader_seek;
+   p_ctx->priv->pf_control = flv_reader_control;
 
    return VC_CONTAINER_SUCCESS;
 
@@ -92,23 +92,61 @@ Defines and constants.
 #define HTTP_STATUS_OK                 200
 #define HTTP_STATUS_PARTIAL_CONTENT    206
 
+/** Size of the blocks kept in the block cache. This is also the granularity
+ * of the range requests sent to the server. */
+#define IO_HTTP_BLOCK_SIZE             (64*1024)
+/** Number of blocks in the block cache */
+#define IO_HTTP_BLOCKS_NUM             64
+/** Maximum number of connections used to send range requests in parallel */
+#define IO_HTTP_CONNECTIONS_MAX        4
+/** Number of blocks requested at once when the stream is read sequentially */
+#define IO_HTTP_READ_AHEAD_BLOCKS      8
+/** Amount of data speculatively requested from the end of the stream along with
+ * the first request. This is where MP4 files which aren't fast start keep their
+ * moov and where some other formats keep their index. */
+#define IO_HTTP_TAIL_PREFETCH_SIZE     (256*1024)
+
 typedef struct http_header_tag {
    const char *name;
    char *value;
 } HTTP_HEADER_T;
 
+/** A block of the stream held in the block cache */
+typedef struct io_http_block_tag {
+   int64_t index;          /**< Index of the block in the stream, -1 if unused */
+   size_t size;            /**< Number of valid bytes in the block */
+   uint32_t last_used;     /**< Used to find the least recently used block */
+   uint8_t *data;
+} IO_HTTP_BLOCK_T;
+
+/** A range requested on one of the connections */
+typedef struct io_http_range_tag {
+   int64_t offset;
+   size_t size;
+} IO_HTTP_RANGE_T;
+
 
 /******************************************************************************
 Type definitions
 ******************************************************************************/
 typedef struct VC_CONTAINER_IO_MODULE_T
 {
-   VC_CONTAINER_NET_T *sock;
+   VC_CONTAINER_NET_T *sock;                    /**< Socket currently in use */
+   VC_CONTAINER_NET_T *socks[IO_HTTP_CONNECTIONS_MAX]; /**< Connections to the server */
    VC_CONTAINERS_LIST_T *header_list;           /**< Parsed response headers, pointing into comms buffer */
 
    bool persistent;
    int64_t cur_offset;
-   bool reconnecting;
+
+   IO_HTTP_BLOCK_T blocks[IO_HTTP_BLOCKS_NUM];  /**< Block cache */
+   uint32_t use_count;                          /**< Incremented every time a block is used */
+   int64_t next_block;                          /**< Block following the last one requested */
+   bool tail_prefetched;                        /**< Whether the end of the stream was requested */
+
+   /* Socket settings, applied to every connection when it is opened */
+   uint32_t read_buffer_size;                   /**< Read buffer size, 0 if never set */
+   uint32_t read_timeout_ms;                    /**< Read timeout */
+   bool read_timeout_set;                       /**< Whether read_timeout_ms was ever set */
 
    /* Buffer used for sending and receiving HTTP messages */
    char comms_buffer[COMMS_BUFFER_SIZE];
@@ -120,6 +158,7 @@ Function prototypes
 
 static int io_http_header_comparator(const HTTP_HEADER_T *first, const HTTP_HEADER_T *second);
 static VC_CONTAINER_STATUS_T io_http_send(VC_CONTAINER_IO_T *p_ctx);
+static void io_http_disconnect(VC_CONTAINER_IO_MODULE_T *module, unsigned int conn);
 
 VC_CONTAINER_STATUS_T vc_container_io_http_open(VC_CONTAINER_IO_T *, const char *,
    VC_CONTAINER_IO_MODE_T);
@@ -491,26 +530,23 @@ static VC_CONTAINER_STATUS_T io_http_read_response(VC_CONTAINER_IO_T *p_ctx)
 }
 
 /**************************************************************************//**
- * Send a GET request to the HTTP server.
+ * Send a GET request for a range of the stream to the HTTP server.
  *
  * @param p_ctx      The reader context.
+ * @param range      The range of the stream to request.
  * @return  The resulting status of the function.
  */
-static VC_CONTAINER_STATUS_T io_http_send_get_request(VC_CONTAINER_IO_T *p_ctx, size_t size)
+static VC_CONTAINER_STATUS_T io_http_send_get_request(VC_CONTAINER_IO_T *p_ctx, const IO_HTTP_RANGE_T *range)
 {
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
    char *ptr = module->comms_buffer, *end = ptr + sizeof(module->comms_buffer);
-   int64_t end_offset;
 
    ptr += snprintf(ptr, end - ptr, HTTP_REQUEST_LINE_FORMAT, GET_METHOD,
                    vc_uri_path(p_ctx->uri_parts), vc_uri_host(p_ctx->uri_parts));
 
-   end_offset = module->cur_offset + size - 1;
-   if (end_offset >= p_ctx->size)
-      end_offset = p_ctx->size - 1;
-
    if (ptr < end)
-      ptr += snprintf(ptr, end - ptr, HTTP_RANGE_REQUEST, module->cur_offset, end_offset);
+      ptr += snprintf(ptr, end - ptr, HTTP_RANGE_REQUEST, range->offset,
+                      range->offset + (int64_t)range->size - 1);
 
    if (ptr < end)
       ptr += snprintf(ptr, end - ptr, TRAILING_HEADERS_FORMAT);
@@ -552,13 +588,18 @@ static VC_CONTAINER_STATUS_T io_http_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offs
 static VC_CONTAINER_STATUS_T io_http_close(VC_CONTAINER_IO_T *p_ctx)
 {
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   unsigned int i;
 
    if (!module)
       return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
 
+   for (i = 0; i < IO_HTTP_CONNECTIONS_MAX; i++)
+      io_http_disconnect(module, i);
    io_http_close_socket(module);
    if (module->header_list)
       vc_containers_list_destroy(module->header_list);
+   for (i = 0; i < IO_HTTP_BLOCKS_NUM; i++)
+      free(module->blocks[i].data);
 
    free(module);
    p_ctx->module = NULL;
@@ -566,57 +607,185 @@ static VC_CONTAINER_STATUS_T io_http_close(VC_CONTAINER_IO_T *p_ctx)
    return VC_CONTAINER_SUCCESS;
 }
 
-/*****************************************************************************/
-static size_t io_http_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+/**************************************************************************//**
+ * Apply a setting to a connection to the server.
+ *
+ * @param sock       The connection.
+ * @param operation  The socket control to apply.
+ * @return  The resulting status of the function.
+ */
+static vc_container_net_status_t io_http_net_control(VC_CONTAINER_NET_T *sock,
+   vc_container_net_control_t operation, ...)
+{
+   vc_container_net_status_t status;
+   va_list args;
+
+   va_start(args, operation);
+   status = vc_container_net_control(sock, operation, args);
+   va_end(args);
+
+   return status;
+}
+
+/**************************************************************************//**
+ * Make one of the connections to the server the current one, opening it if
+ * it isn't already.
+ * New connections get the socket settings previously set on the module.
+ *
+ * @param p_ctx   The reader context.
+ * @param conn    The connection to use.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_connect(VC_CONTAINER_IO_T *p_ctx, unsigned int conn)
 {
-   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
-   size_t content_length;
-   size_t bytes_read;
-   size_t ret = 0;
-   char *ptr = buffer;
+   VC_CONTAINER_STATUS_T status;
 
-   /*
-    * Are we at the end of the file?
-    */
+   module->sock = module->socks[conn];
+   if (module->sock)
+      return VC_CONTAINER_SUCCESS;
 
-   if (module->cur_offset >= p_ctx->size)
+   status = io_http_open_socket(p_ctx);
+   if (status != VC_CONTAINER_SUCCESS)
    {
-      p_ctx->status = VC_CONTAINER_ERROR_EOS;
-      return 0;
+      LOG_ERROR(NULL, "Error opening socket for GET request");
+      return status;
    }
+   module->socks[conn] = module->sock;
 
-   if (!module->persistent)
+   if (module->read_buffer_size &&
+       io_http_net_control(module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_BUFFER_SIZE,
+          module->read_buffer_size) != VC_CONTAINER_NET_SUCCESS)
+      LOG_ERROR(NULL, "Error setting read buffer size on connection %u", conn);
+   if (module->read_timeout_set &&
+       io_http_net_control(module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_TIMEOUT_MS,
+          module->read_timeout_ms) != VC_CONTAINER_NET_SUCCESS)
+      LOG_ERROR(NULL, "Error setting read timeout on connection %u", conn);
+
+   return status;
+}
+
+/*****************************************************************************/
+static void io_http_disconnect(VC_CONTAINER_IO_MODULE_T *module, unsigned int conn)
+{
+   if (module->sock == module->socks[conn])
+      module->sock = NULL;
+   if (module->socks[conn])
+      vc_container_net_close(module->socks[conn]);
+   module->socks[conn] = NULL;
+}
+
+/*****************************************************************************/
+static IO_HTTP_BLOCK_T *io_http_find_block(VC_CONTAINER_IO_MODULE_T *module, int64_t index)
+{
+   unsigned int i;
+
+   for (i = 0; i < IO_HTTP_BLOCKS_NUM; i++)
+      if (module->blocks[i].index == index)
+         return &module->blocks[i];
+
+   return NULL;
+}
+
+/**************************************************************************//**
+ * Get a block of the block cache to store new data, recycling the least
+ * recently used one if needed.
+ *
+ * @param module  The HTTP module.
+ * @param index   The index of the block in the stream.
+ * @return  The block or NULL if we ran out of memory.
+ */
+static IO_HTTP_BLOCK_T *io_http_new_block(VC_CONTAINER_IO_MODULE_T *module, int64_t index)
+{
+   IO_HTTP_BLOCK_T *block = &module->blocks[0];
+   unsigned int i;
+
+   for (i = 1; i < IO_HTTP_BLOCKS_NUM && block->index >= 0; i++)
+      if (module->blocks[i].index < 0 || module->blocks[i].last_used < block->last_used)
+         block = &module->blocks[i];
+
+   if (!block->data)
+      block->data = malloc(IO_HTTP_BLOCK_SIZE);
+   if (!block->data)
+      return NULL;
+
+   block->index = index;
+   block->size = 0;
+   block->last_used = ++module->use_count;
+   return block;
+}
+
+/**************************************************************************//**
+ * Send a range request on one of the connections. If the server closed a
+ * persistent connection since we last used it, we reconnect and try again.
+ *
+ * @param p_ctx   The reader context.
+ * @param conn    The connection to use.
+ * @param range   The range of the stream to request.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_request(VC_CONTAINER_IO_T *p_ctx, unsigned int conn,
+   const IO_HTTP_RANGE_T *range)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   VC_CONTAINER_STATUS_T status;
+   bool reused = module->socks[conn] != NULL;
+
+   status = io_http_connect(p_ctx, conn);
+   if (status == VC_CONTAINER_SUCCESS)
+      status = io_http_send_get_request(p_ctx, range);
+
+   if (status != VC_CONTAINER_SUCCESS && reused)
    {
-      status = io_http_open_socket(p_ctx);
-      if (status != VC_CONTAINER_SUCCESS)
-      {
-         LOG_ERROR(NULL, "Error opening socket for GET request");
-         return status;
-      }
+      LOG_DEBUG(NULL, "reconnecting");
+      io_http_disconnect(module, conn);
+      status = io_http_connect(p_ctx, conn);
+      if (status == VC_CONTAINER_SUCCESS)
+         status = io_http_send_get_request(p_ctx, range);
    }
 
-   /* Send GET request and get response */
-   status = io_http_send_get_request(p_ctx, size);
    if (status != VC_CONTAINER_SUCCESS)
    {
       LOG_ERROR(NULL, "Error sending GET request");
-      goto error;
+      io_http_disconnect(module, conn);
    }
 
+   return status;
+}
+
+/**************************************************************************//**
+ * Receive the response to a range request and store its content in the
+ * block cache.
+ *
+ * @param p_ctx   The reader context.
+ * @param conn    The connection the request was sent on.
+ * @param range   The range of the stream which was requested.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_receive(VC_CONTAINER_IO_T *p_ctx, unsigned int conn,
+   const IO_HTTP_RANGE_T *range)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   VC_CONTAINER_STATUS_T status;
+   IO_HTTP_BLOCK_T *block = NULL;
+   int64_t offset = range->offset;
+   size_t remaining = range->size;
+
+   module->sock = module->socks[conn];
+   if (!module->sock)
+      return VC_CONTAINER_ERROR_FAILED;
+
    status = io_http_read_response(p_ctx);
-   if (status == VC_CONTAINER_ERROR_EOS && !module->reconnecting)
+   if (status == VC_CONTAINER_ERROR_EOS)
    {
+      /* The server closed the persistent connection before seeing our request */
       LOG_DEBUG(NULL, "reconnecting");
-      io_http_close_socket(module);
-      status = io_http_open_socket(p_ctx);
+      io_http_disconnect(module, conn);
+      status = io_http_connect(p_ctx, conn);
       if (status == VC_CONTAINER_SUCCESS)
-      {
-         module->reconnecting = true;
-         status = io_http_read(p_ctx, buffer, size);
-         module->reconnecting = false;
-         return status;
-      }
+         status = io_http_send_get_request(p_ctx, range);
+      if (status == VC_CONTAINER_SUCCESS)
+         status = io_http_read_response(p_ctx);
    }
    if (status != VC_CONTAINER_SUCCESS)
    {
@@ -625,47 +794,192 @@ static size_t io_http_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
    }
 
    /*
-    * How much data is the server offering us?
+    * Make sure the server is sending us what we asked for
     */
 
-   content_length = (size_t)io_http_get_content_length(module->header_list);
-   if (content_length > size)
+   if (io_http_get_content_length(module->header_list) != range->size)
    {
-      LOG_ERROR(NULL, "received too much data (%i/%i)",
-                (int)content_length, (int)size);
+      LOG_ERROR(NULL, "unexpected amount of data (%i/%i)",
+                (int)io_http_get_content_length(module->header_list), (int)range->size);
       status = VC_CONTAINER_ERROR_CORRUPTED;
       goto error;
    }
 
-   bytes_read = 0;
-   while (bytes_read < content_length && p_ctx->status == VC_CONTAINER_SUCCESS)
+   if (!module->persistent || !io_http_check_persistent_connection(module->header_list))
+      module->persistent = false;
+
+   while (remaining)
    {
-      ret = io_http_read_from_net(p_ctx, ptr, content_length - bytes_read);
-      if (p_ctx->status == VC_CONTAINER_SUCCESS)
+      size_t size = MIN(remaining, IO_HTTP_BLOCK_SIZE), ret;
+
+      block = io_http_new_block(module, offset / IO_HTTP_BLOCK_SIZE);
+      if (!block)
       {
-         bytes_read += ret;
-         ptr += ret;
+         status = VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+         goto error;
       }
-   }
 
-   if (p_ctx->status == VC_CONTAINER_SUCCESS)
-   {
-      module->cur_offset += bytes_read;
-      ret = bytes_read;
+      while (block->size < size)
+      {
+         ret = io_http_read_from_net(p_ctx, block->data + block->size, size - block->size);
+         if (p_ctx->status != VC_CONTAINER_SUCCESS)
+         {
+            status = p_ctx->status;
+            goto error;
+         }
+         block->size += ret;
+      }
+
+      offset += size;
+      remaining -= size;
    }
 
    if (!module->persistent)
-      io_http_close_socket(module);
+      io_http_disconnect(module, conn);
 
-   return ret;
+   return VC_CONTAINER_SUCCESS;
 
 error:
-   if (!module->persistent)
-      io_http_close_socket(module);
-
+   if (block && block->size != IO_HTTP_BLOCK_SIZE && remaining)
+      block->index = -1;
+   io_http_disconnect(module, conn);
    return status;
 }
 
+/**************************************************************************//**
+ * Fetch a block of the stream into the block cache.
+ * When the stream is read sequentially, the following blocks are requested
+ * as well and the requests are spread over several connections to the server
+ * so that their round trips overlap. The end of the stream is also requested
+ * speculatively the first time we go to the server.
+ *
+ * @param p_ctx   The reader context.
+ * @param first   The index of the block we need.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_fetch(VC_CONTAINER_IO_T *p_ctx, int64_t first)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   VC_CONTAINER_STATUS_T status, ret_status = VC_CONTAINER_SUCCESS;
+   IO_HTTP_RANGE_T ranges[IO_HTTP_CONNECTIONS_MAX];
+   int64_t num_blocks = (p_ctx->size + IO_HTTP_BLOCK_SIZE - 1) / IO_HTTP_BLOCK_SIZE;
+   unsigned int blocks, count, connections = IO_HTTP_CONNECTIONS_MAX, num_ranges, i;
+   int64_t tail = -1;
+
+   /* Work out how many blocks to ask for */
+   count = first == module->next_block ? IO_HTTP_READ_AHEAD_BLOCKS : 1;
+   for (blocks = 1; blocks < count && first + blocks < num_blocks; blocks++)
+      if (io_http_find_block(module, first + blocks))
+         break;
+   module->next_block = first + blocks;
+
+   /* Keep one connection for the end of the stream if we haven't fetched it yet */
+   if (!module->tail_prefetched)
+   {
+      module->tail_prefetched = true;
+      tail = (p_ctx->size - IO_HTTP_TAIL_PREFETCH_SIZE) / IO_HTTP_BLOCK_SIZE;
+      if (tail < first + blocks)
+         tail = first + blocks;
+      if (tail < num_blocks)
+         connections--;
+      else
+         tail = -1;
+   }
+
+   /* Spread the blocks over the connections */
+   num_ranges = MIN(connections, blocks);
+   for (i = 0; i < num_ranges; i++)
+   {
+      int64_t start = first + blocks * i / num_ranges;
+      int64_t end = first + blocks * (i + 1) / num_ranges;
+      ranges[i].offset = start * IO_HTTP_BLOCK_SIZE;
+      ranges[i].size = (size_t)(MIN(end * IO_HTTP_BLOCK_SIZE, p_ctx->size) - ranges[i].offset);
+   }
+
+   if (tail >= 0)
+   {
+      ranges[num_ranges].offset = tail * IO_HTTP_BLOCK_SIZE;
+      ranges[num_ranges].size = (size_t)(p_ctx->size - ranges[num_ranges].offset);
+      num_ranges++;
+   }
+
+   /* Send all the requests before waiting for any of the responses */
+   for (i = 0; i < num_ranges; i++)
+   {
+      status = io_http_request(p_ctx, i, &ranges[i]);
+      if (status != VC_CONTAINER_SUCCESS)
+      {
+         if (!i) ret_status = status;
+         ranges[i].size = 0;
+      }
+   }
+
+   for (i = 0; i < num_ranges; i++)
+   {
+      if (!ranges[i].size)
+         continue;
+
+      status = io_http_receive(p_ctx, i, &ranges[i]);
+      if (status != VC_CONTAINER_SUCCESS && !i)
+         ret_status = status;
+   }
+
+   return ret_status;
+}
+
+/*****************************************************************************/
+static size_t io_http_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_HTTP_BLOCK_T *block;
+   uint8_t *ptr = buffer;
+   size_t ret = 0, bytes, offset;
+
+   while (ret < size)
+   {
+      /*
+       * Are we at the end of the file?
+       */
+
+      if (module->cur_offset >= p_ctx->size)
+      {
+         status = VC_CONTAINER_ERROR_EOS;
+         break;
+      }
+
+      block = io_http_find_block(module, module->cur_offset / IO_HTTP_BLOCK_SIZE);
+      if (!block)
+      {
+         status = io_http_fetch(p_ctx, module->cur_offset / IO_HTTP_BLOCK_SIZE);
+         if (status != VC_CONTAINER_SUCCESS)
+            break;
+         block = io_http_find_block(module, module->cur_offset / IO_HTTP_BLOCK_SIZE);
+         if (!block)
+         {
+            status = VC_CONTAINER_ERROR_FAILED;
+            break;
+         }
+      }
+
+      block->last_used = ++module->use_count;
+      offset = (size_t)(module->cur_offset % IO_HTTP_BLOCK_SIZE);
+      if (offset >= block->size)
+      {
+         status = VC_CONTAINER_ERROR_EOS;
+         break;
+      }
+
+      bytes = MIN(size - ret, block->size - offset);
+      memcpy(ptr + ret, block->data + offset, bytes);
+      module->cur_offset += bytes;
+      ret += bytes;
+   }
+
+   p_ctx->status = status;
+   return ret;
+}
+
 /*****************************************************************************/
 static size_t io_http_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_t size)
 {
@@ -683,19 +997,36 @@ static VC_CONTAINER_STATUS_T io_http_control(struct VC_CONTAINER_IO_T *p_ctx,
       VC_CONTAINER_CONTROL_T operation,
       va_list args)
 {
-   vc_container_net_status_t net_status;
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   vc_container_net_status_t net_status = VC_CONTAINER_NET_SUCCESS;
+   vc_container_net_control_t net_operation;
    VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+   uint32_t value;
 
+   /* Remember the setting so that connections opened later on get it too */
    switch (operation)
    {
    case VC_CONTAINER_CONTROL_IO_SET_READ_BUFFER_SIZE:
-      net_status = vc_container_net_control(p_ctx->module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_BUFFER_SIZE, args);
+      net_operation = VC_CONTAINER_NET_CONTROL_SET_READ_BUFFER_SIZE;
+      value = module->read_buffer_size = va_arg(args, uint32_t);
       break;
    case VC_CONTAINER_CONTROL_IO_SET_READ_TIMEOUT_MS:
-      net_status = vc_container_net_control(p_ctx->module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_TIMEOUT_MS, args);
+      net_operation = VC_CONTAINER_NET_CONTROL_SET_READ_TIMEOUT_MS;
+      value = module->read_timeout_ms = va_arg(args, uint32_t);
+      module->read_timeout_set = true;
       break;
    default:
-      net_status = VC_CONTAINER_NET_ERROR_NOT_ALLOWED;
+      p_ctx->status = VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+      return p_ctx->status;
+   }
+
+   /* Apply the setting to all the open connections */
+   for (i = 0; i < IO_HTTP_CONNECTIONS_MAX && net_status == VC_CONTAINER_NET_SUCCESS; i++)
+   {
+      if (!module->socks[i])
+         continue;
+      net_status = io_http_net_control(module->socks[i], net_operation, value);
    }
 
    status = translate_net_status_to_container_status(net_status);
@@ -822,6 +1153,7 @@ VC_CONTAINER_STATUS_T vc_container_io_http_open(VC_CONTAINER_IO_T *p_ctx,
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    VC_CONTAINER_IO_MODULE_T *module = 0;
+   unsigned int i;
    VC_CONTAINER_PARAM_UNUSED(unused);
 
    /* Check the URI to see if we're dealing with an http stream */
@@ -881,6 +1213,11 @@ VC_CONTAINER_STATUS_T vc_container_io_http_open(VC_CONTAINER_IO_T *p_ctx,
    if (status != VC_CONTAINER_SUCCESS)
       goto error;
 
+   /* Keep the connection around for the range requests */
+   module->socks[0] = module->sock;
+   for (i = 0; i < IO_HTTP_BLOCKS_NUM; i++)
+      module->blocks[i].index = -1;
+
    p_ctx->pf_close   = io_http_close;
    p_ctx->pf_read    = io_http_read;
    p_ctx->pf_write   = NULL;
@@ -0,0 +1,235 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "containers/containers.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_io.h"
+#include "containers/core/containers_uri.h"
+
+/** Amount of data we ask the kernel to read ahead of the current position
+ * when the stream is being read sequentially */
+#define IO_MMAP_READ_AHEAD (4*1024*1024)
+
+/** Seeks further than this count as random access */
+#define IO_MMAP_SEEK_DISTANCE (1024*1024)
+
+/** Number of consecutive long seeks after which we stop the kernel from
+ * reading ahead */
+#define IO_MMAP_RANDOM_SEEKS 2
+
+typedef enum {
+   IO_MMAP_ACCESS_SEQUENTIAL,
+   IO_MMAP_ACCESS_RANDOM
+} IO_MMAP_ACCESS_T;
+
+typedef struct VC_CONTAINER_IO_MODULE_T
+{
+   int fd;
+   uint8_t *data;       /**< Start of the mapping */
+   size_t size;         /**< Size of the mapping */
+   size_t position;     /**< Current position in the mapping */
+
+   size_t page_size;
+   IO_MMAP_ACCESS_T access; /**< Access pattern we advised the kernel of */
+   unsigned int seeks;  /**< Number of consecutive long seeks */
+   size_t sequential;   /**< Amount of data read since the last long seek */
+   size_t advised;      /**< End of the area we asked the kernel to read ahead */
+
+} VC_CONTAINER_IO_MODULE_T;
+
+VC_CONTAINER_STATUS_T vc_container_io_mmap_open( VC_CONTAINER_IO_T *, const char *,
+   VC_CONTAINER_IO_MODE_T );
+
+/*****************************************************************************/
+static void io_mmap_advise( VC_CONTAINER_IO_MODULE_T *module, IO_MMAP_ACCESS_T access )
+{
+   if(module->access == access) return;
+   module->access = access;
+   posix_madvise(module->data, module->size, access == IO_MMAP_ACCESS_RANDOM ?
+      POSIX_MADV_RANDOM : POSIX_MADV_SEQUENTIAL);
+}
+
+/*****************************************************************************/
+static void io_mmap_consume( VC_CONTAINER_IO_MODULE_T *module, size_t size )
+{
+   size_t start, end;
+
+   module->position += size;
+   module->sequential += size;
+
+   /* Long enough sequential runs switch us back to sequential access */
+   if(module->access == IO_MMAP_ACCESS_RANDOM && module->sequential >= IO_MMAP_READ_AHEAD)
+   {
+      io_mmap_advise(module, IO_MMAP_ACCESS_SEQUENTIAL);
+      module->advised = module->position;
+   }
+
+   /* Keep the area ahead of us paged in */
+   if(module->access != IO_MMAP_ACCESS_SEQUENTIAL ||
+      module->position + IO_MMAP_READ_AHEAD / 2 < module->advised)
+      return;
+
+   start = MAX(module->advised, module->position) & ~(module->page_size - 1);
+   end = MIN(module->position + IO_MMAP_READ_AHEAD, module->size);
+   if(end > start)
+      posix_madvise(module->data + start, end - start, POSIX_MADV_WILLNEED);
+   module->advised = module->position + IO_MMAP_READ_AHEAD;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_mmap_close( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   if(module->data) munmap(module->data, module->size);
+   close(module->fd);
+   free(module);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static size_t io_mmap_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+
+   if(size > module->size - module->position)
+   {
+      size = module->size - module->position;
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+   }
+
+   memcpy(buffer, module->data + module->position, size);
+   io_mmap_consume(module, size);
+   return size;
+}
+
+/*****************************************************************************/
+static void *io_mmap_borrow(VC_CONTAINER_IO_T *p_ctx, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   void *data = module->data + module->position;
+
+   if(size > module->size - module->position)
+      return NULL;
+
+   io_mmap_consume(module, size);
+   return data;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_mmap_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t distance;
+
+   if(offset < 0 || (uint64_t)offset > module->size)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      return p_ctx->status;
+   }
+
+   /* Track the access pattern of the reader. Short hops (e.g. skipping
+    * another track's data) still count as sequential access. */
+   distance = (size_t)offset > module->position ?
+      (size_t)offset - module->position : module->position - (size_t)offset;
+   if(distance > IO_MMAP_SEEK_DISTANCE)
+   {
+      module->sequential = 0;
+      module->advised = (size_t)offset;
+      if(++module->seeks >= IO_MMAP_RANDOM_SEEKS)
+         io_mmap_advise(module, IO_MMAP_ACCESS_RANDOM);
+   }
+   else if(distance)
+      module->seeks = 0;
+
+   module->position = (size_t)offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_mmap_open( VC_CONTAINER_IO_T *p_ctx,
+   const char *unused, VC_CONTAINER_IO_MODE_T mode )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_IO_MODULE_T *module = 0;
+   const char *scheme = vc_uri_scheme(p_ctx->uri_parts);
+   const char *path = vc_uri_path(p_ctx->uri_parts);
+   struct stat st;
+   int fd = -1;
+   VC_CONTAINER_PARAM_UNUSED(unused);
+
+   /* Only used when explicitly requested, and only for reading */
+   if(!scheme || strcasecmp(scheme, "mmap") || !path)
+      return VC_CONTAINER_ERROR_URI_NOT_FOUND;
+   if(mode != VC_CONTAINER_IO_MODE_READ)
+      return VC_CONTAINER_ERROR_URI_NOT_FOUND;
+
+   fd = open(path, O_RDONLY);
+   if(fd < 0) { status = VC_CONTAINER_ERROR_URI_NOT_FOUND; goto error; }
+   if(fstat(fd, &st) || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > SIZE_MAX)
+   { status = VC_CONTAINER_ERROR_URI_OPEN_FAILED; goto error; }
+
+   module = malloc( sizeof(*module) );
+   if(!module) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+   memset(module, 0, sizeof(*module));
+   module->fd = fd;
+   module->size = (size_t)st.st_size;
+   module->page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+   /* The mapping is private and writeable so that readers can modify borrowed
+    * data in place (e.g. byte swapping or decryption) without touching the file */
+   if(module->size)
+   {
+      void *data = mmap(NULL, module->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if(data == MAP_FAILED) { status = VC_CONTAINER_ERROR_URI_OPEN_FAILED; goto error; }
+      module->data = data;
+      posix_madvise(module->data, module->size, POSIX_MADV_SEQUENTIAL);
+   }
+
+   p_ctx->module = module;
+   p_ctx->pf_close = io_mmap_close;
+   p_ctx->pf_read = io_mmap_read;
+   p_ctx->pf_seek = io_mmap_seek;
+   p_ctx->pf_borrow = io_mmap_borrow;
+   p_ctx->size = module->size;
+
+   /* The whole file is addressable so we don't need the caching layer */
+   p_ctx->capabilities = 0;
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   if(fd >= 0) close(fd);
+   free(module);
+   return status;
+}
@@ -73,6 +73,20 @@ typedef enum {
    MP4_BOX_TYPE_DAWP              = VC_FOURCC('d','a','w','p'),
    MP4_BOX_TYPE_DEVC              = VC_FOURCC('d','e','v','c'),
    MP4_BOX_TYPE_WAVE              = VC_FOURCC('w','a','v','e'),
+   MP4_BOX_TYPE_MVEX              = VC_FOURCC('m','v','e','x'),
+   MP4_BOX_TYPE_TREX              = VC_FOURCC('t','r','e','x'),
+   MP4_BOX_TYPE_MOOF              = VC_FOURCC('m','o','o','f'),
+   MP4_BOX_TYPE_MFHD              = VC_FOURCC('m','f','h','d'),
+   MP4_BOX_TYPE_TRAF              = VC_FOURCC('t','r','a','f'),
+   MP4_BOX_TYPE_TFHD              = VC_FOURCC('t','f','h','d'),
+   MP4_BOX_TYPE_TFDT              = VC_FOURCC('t','f','d','t'),
+   MP4_BOX_TYPE_TRUN              = VC_FOURCC('t','r','u','n'),
+   MP4_BOX_TYPE_MEHD              = VC_FOURCC('m','e','h','d'),
+   MP4_BOX_TYPE_STYP              = VC_FOURCC('s','t','y','p'),
+   MP4_BOX_TYPE_SIDX              = VC_FOURCC('s','i','d','x'),
+   MP4_BOX_TYPE_MFRA              = VC_FOURCC('m','f','r','a'),
+   MP4_BOX_TYPE_TFRA              = VC_FOURCC('t','f','r','a'),
+   MP4_BOX_TYPE_MFRO              = VC_FOURCC('m','f','r','o'),
    MP4_BOX_TYPE_ZERO              = 0
 } MP4_BOX_TYPE_T;
 
@@ -85,6 +99,7 @@ typedef enum {
    MP4_BRAND_SKM2                 = VC_FOURCC('s','k','m','2'),
    MP4_BRAND_SKM3                 = VC_FOURCC('s','k','m','3'),
    MP4_BRAND_QT                   = VC_FOURCC('q','t',' ',' '),
+   MP4_BRAND_ISO6                 = VC_FOURCC('i','s','o','6'),
    MP4_BRAND_NUM
 } MP4_BRAND_T;
 
@@ -100,6 +115,27 @@ typedef enum
    MP4_SAMPLE_TABLE_NUM
 } MP4_SAMPLE_TABLE_T;
 
+/* Flags used in movie fragment boxes
+ * see ISO/IEC 14496-12:2012 section 8.8 */
+#define MP4_TFHD_FLAG_BASE_DATA_OFFSET              0x000001
+#define MP4_TFHD_FLAG_SAMPLE_DESCRIPTION_INDEX      0x000002
+#define MP4_TFHD_FLAG_DEFAULT_SAMPLE_DURATION       0x000008
+#define MP4_TFHD_FLAG_DEFAULT_SAMPLE_SIZE           0x000010
+#define MP4_TFHD_FLAG_DEFAULT_SAMPLE_FLAGS          0x000020
+#define MP4_TFHD_FLAG_DURATION_IS_EMPTY             0x010000
+#define MP4_TFHD_FLAG_DEFAULT_BASE_IS_MOOF          0x020000
+
+#define MP4_TRUN_FLAG_DATA_OFFSET                   0x000001
+#define MP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS            0x000004
+#define MP4_TRUN_FLAG_SAMPLE_DURATION               0x000100
+#define MP4_TRUN_FLAG_SAMPLE_SIZE                   0x000200
+#define MP4_TRUN_FLAG_SAMPLE_FLAGS                  0x000400
+#define MP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME       0x000800
+
+#define MP4_SAMPLE_FLAGS_SYNC                       0x02000000 /* depends on no other sample */
+#define MP4_SAMPLE_FLAGS_NON_SYNC                   0x01010000 /* depends on others, non-sync */
+#define MP4_SAMPLE_FLAGS_IS_NON_SYNC                0x00010000
+
 /* Values for object_type_indication (mp4_decoder_config_descriptor)
  * see ISO/IEC 14496-1:2001(E) section 8.6.6.2 table 8 p. 30
  * see ISO/IEC 14496-15:2003 (draft) section 4.2.2 table 3 p. 11
@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "containers/core/containers_io_helpers.h"
 #include "containers/core/containers_utils.h"
 #include "containers/core/containers_logging.h"
+#include "containers/core/containers_index.h"
 #include "containers/mp4/mp4_common.h"
 #undef CONTAINER_HELPER_LOG_INDENT
 #define CONTAINER_HELPER_LOG_INDENT(a) (a)->priv->module->box_level
@@ -61,6 +62,12 @@ Defines.
 
 #define MP4_MAX_SAMPLES_BATCH_SIZE (16*1024)
 
+#define MP4_FRAGMENT_INDEX_SIZE 1024
+#define MP4_FRAGMENT_SAMPLES_MAX (1<<20) /* Maximum number of samples in a track fragment */
+
+#define MP4_INDEX_BLOCK_SAMPLES 64
+#define MP4_INDEX_ENTRY_MAX_SIZE 32 /* Worst case size of an encoded sample description */
+
 #define MP4_SKIP_U8(ctx,n)   (size -= 1, SKIP_U8(ctx,n))
 #define MP4_SKIP_U16(ctx,n)  (size -= 2, SKIP_U16(ctx,n))
 #define MP4_SKIP_U24(ctx,n)  (size -= 3, SKIP_U24(ctx,n))
@@ -111,10 +118,60 @@ typedef struct
 
 } MP4_READER_STATE_T;
 
+/** Block of samples in the in-memory sample index.
+ * The decoding time and offset of the first sample of a block are stored as absolute
+ * values, the description of the samples themselves is delta-encoded in the index data. */
+typedef struct
+{
+   int64_t dts;               /**< decoding time of the first sample in track timescale */
+   int64_t offset;            /**< file offset of the first sample */
+   uint32_t data;             /**< position of the first sample in the index data */
+} MP4_INDEX_BLOCK_T;
+
+/** Decoded description of a sample from the in-memory sample index */
+typedef struct
+{
+   uint32_t sample;           /**< sample number (starting from 0) */
+   int64_t dts;               /**< decoding time in track timescale */
+   int64_t offset;            /**< file offset of the sample data */
+   uint32_t size;             /**< size of the sample data */
+   uint32_t duration;         /**< duration in track timescale */
+   int32_t composition_offset;/**< composition time offset in track timescale */
+   bool keyframe;             /**< sample is a sync sample */
+   uint32_t data;             /**< position of the next sample in the index data */
+} MP4_INDEX_ENTRY_T;
+
+/** In-memory sample index of a track */
+typedef struct
+{
+   uint32_t samples;          /**< number of samples in the index */
+   bool composition;          /**< composition time offsets are stored */
+
+   MP4_INDEX_BLOCK_T *blocks; /**< one block every MP4_INDEX_BLOCK_SAMPLES samples */
+   uint8_t *data;             /**< delta-encoded sample descriptions */
+   uint32_t data_size;        /**< size of the index data */
+
+   uint32_t *sync_samples;    /**< sorted list of sync samples (starting from 0) */
+   uint32_t sync_samples_num; /**< number of entries in sync_samples */
+
+   MP4_INDEX_ENTRY_T entry;   /**< last decoded entry, speeds up sequential access */
+} MP4_SAMPLE_INDEX_T;
+
+/** Sample description built from the track fragment run boxes of a movie fragment */
+typedef struct
+{
+   int64_t offset;            /**< file offset of the sample data */
+   int64_t dts;               /**< decoding time in track timescale */
+   uint32_t size;             /**< size of the sample data */
+   int32_t composition_offset;/**< composition time offset in track timescale */
+   uint32_t flags;            /**< sample flags (MP4_SAMPLE_FLAGS_*) */
+} MP4_READER_SAMPLE_T;
+
 typedef struct VC_CONTAINER_TRACK_MODULE_T
 {
    MP4_READER_STATE_T state;
 
+   uint32_t track_id;
    int64_t timescale;
    uint8_t object_type_indication;
 
@@ -127,6 +184,21 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
 
    uint32_t samples_batch_size;
 
+   MP4_SAMPLE_INDEX_T *index; /**< optional in-memory index of the samples */
+
+   /* Defaults for movie fragments (from the trex box) */
+   uint32_t default_sample_duration;
+   uint32_t default_sample_size;
+   uint32_t default_sample_flags;
+
+   struct {
+      MP4_READER_SAMPLE_T *samples; /**< samples of this track in the current fragment */
+      unsigned int samples_num;     /**< number of valid entries in samples */
+      unsigned int samples_max;     /**< number of allocated entries in samples */
+      unsigned int sample;          /**< index of the next sample to read */
+      int64_t next_dts;             /**< decoding time following the last parsed sample */
+   } fragment;
+
 } VC_CONTAINER_TRACK_MODULE_T;
 
 typedef struct VC_CONTAINER_MODULE_T
@@ -145,6 +217,24 @@ typedef struct VC_CONTAINER_MODULE_T
    int64_t data_offset;
    int64_t data_size;
 
+   bool fragmented;               /**< samples are described by movie fragments */
+   struct {
+      int64_t first_offset;       /**< offset of the first moof box */
+      int64_t moof_offset;        /**< offset of the moof box currently loaded */
+      int64_t next_offset;        /**< offset at which to look for the next moof box */
+      unsigned int index_track;   /**< track used to index and seek fragments */
+      bool sidx_found;            /**< a segment index has been used to build the index */
+      VC_CONTAINER_INDEX_T *index;/**< index of fragment times and moof offsets */
+
+      /* Track fragment parsing state */
+      int track;                  /**< track of the current traf box, or -1 if unknown */
+      int64_t base_offset;        /**< base data offset of the current traf box */
+      int64_t data_end;           /**< end of the data described so far */
+      uint32_t default_sample_duration;
+      uint32_t default_sample_size;
+      uint32_t default_sample_flags;
+   } fragment;
+
 } VC_CONTAINER_MODULE_T;
 
 /******************************************************************************
@@ -186,6 +276,20 @@ static VC_CONTAINER_STATUS_T mp4_read_box_soun_dawp( VC_CONTAINER_T *p_ctx, int6
 static VC_CONTAINER_STATUS_T mp4_read_box_soun_devc( VC_CONTAINER_T *p_ctx, int64_t size );
 static VC_CONTAINER_STATUS_T mp4_read_box_soun_wave( VC_CONTAINER_T *p_ctx, int64_t size );
 
+static VC_CONTAINER_STATUS_T mp4_read_box_mvex( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_mehd( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_trex( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_moof( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_traf( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_tfhd( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_tfdt( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_trun( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_sidx( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_mfra( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_tfra( VC_CONTAINER_T *p_ctx, int64_t size );
+
+static void mp4_index_free( MP4_SAMPLE_INDEX_T *index );
+
 static struct {
   const MP4_BOX_TYPE_T type;
   VC_CONTAINER_STATUS_T (*pf_func)( VC_CONTAINER_T *, int64_t );
@@ -229,6 +333,22 @@ static struct {
    {MP4_BOX_TYPE_WAVE, mp4_read_box_soun_wave, MP4_BOX_TYPE_SOUN},
    {MP4_BOX_TYPE_ESDS, mp4_read_box_esds, MP4_BOX_TYPE_SOUN},
 
+   /* Movie fragment boxes */
+   {MP4_BOX_TYPE_MVEX, mp4_read_box_mvex, MP4_BOX_TYPE_MOOV},
+   {MP4_BOX_TYPE_MEHD, mp4_read_box_mehd, MP4_BOX_TYPE_MVEX},
+   {MP4_BOX_TYPE_TREX, mp4_read_box_trex, MP4_BOX_TYPE_MVEX},
+   {MP4_BOX_TYPE_STYP, 0,                 MP4_BOX_TYPE_ROOT},
+   {MP4_BOX_TYPE_SIDX, mp4_read_box_sidx, MP4_BOX_TYPE_ROOT},
+   {MP4_BOX_TYPE_MOOF, mp4_read_box_moof, MP4_BOX_TYPE_ROOT},
+   {MP4_BOX_TYPE_MFHD, 0,                 MP4_BOX_TYPE_MOOF},
+   {MP4_BOX_TYPE_TRAF, mp4_read_box_traf, MP4_BOX_TYPE_MOOF},
+   {MP4_BOX_TYPE_TFHD, mp4_read_box_tfhd, MP4_BOX_TYPE_TRAF},
+   {MP4_BOX_TYPE_TFDT, mp4_read_box_tfdt, MP4_BOX_TYPE_TRAF},
+   {MP4_BOX_TYPE_TRUN, mp4_read_box_trun, MP4_BOX_TYPE_TRAF},
+   {MP4_BOX_TYPE_MFRA, mp4_read_box_mfra, MP4_BOX_TYPE_ROOT},
+   {MP4_BOX_TYPE_TFRA, mp4_read_box_tfra, MP4_BOX_TYPE_MFRA},
+   {MP4_BOX_TYPE_MFRO, 0,                 MP4_BOX_TYPE_MFRA},
+
    {MP4_BOX_TYPE_UNKNOWN, 0,              MP4_BOX_TYPE_UNKNOWN}
 };
 
@@ -528,6 +648,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_trak( VC_CONTAINER_T *p_ctx, int64_t s
 static VC_CONTAINER_STATUS_T mp4_read_box_tkhd( VC_CONTAINER_T *p_ctx, int64_t size )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
    uint32_t i, version;
    int64_t duration;
 
@@ -538,7 +659,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_tkhd( VC_CONTAINER_T *p_ctx, int64_t s
    {
       MP4_SKIP_U64(p_ctx, "creation_time");
       MP4_SKIP_U64(p_ctx, "modification_time");
-      MP4_SKIP_U32(p_ctx, "track_ID");
+      track_module->track_id = MP4_READ_U32(p_ctx, "track_ID");
       MP4_SKIP_U32(p_ctx, "reserved");
       duration = MP4_READ_U64(p_ctx, "duration");
    }
@@ -546,7 +667,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_tkhd( VC_CONTAINER_T *p_ctx, int64_t s
    {
       MP4_SKIP_U32(p_ctx, "creation_time");
       MP4_SKIP_U32(p_ctx, "modification_time");
-      MP4_SKIP_U32(p_ctx, "track_ID");
+      track_module->track_id = MP4_READ_U32(p_ctx, "track_ID");
       MP4_SKIP_U32(p_ctx, "reserved");
       duration = MP4_READ_U32(p_ctx, "duration");
    }
@@ -1197,6 +1318,332 @@ static VC_CONTAINER_STATUS_T mp4_read_box_text( VC_CONTAINER_T *p_ctx, int64_t s
    return STREAM_STATUS(p_ctx);
 }
 
+/*****************************************************************************/
+static int mp4_find_track( VC_CONTAINER_T *p_ctx, uint32_t track_id )
+{
+   unsigned int i;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+      if(p_ctx->tracks[i]->priv->module->track_id == track_id) return i;
+   return -1;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_mvex( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   /* The presence of this box signals that we can expect movie fragments. Create the
+    * index used to seek between fragments (this isn't a critical error) */
+   if(!module->fragment.index &&
+      vc_container_index_create(&module->fragment.index, MP4_FRAGMENT_INDEX_SIZE) != VC_CONTAINER_SUCCESS)
+      LOG_DEBUG(p_ctx, "could not create fragment index");
+
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_MVEX);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_mehd( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   uint32_t version;
+   int64_t duration;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   if(version) duration = MP4_READ_U64(p_ctx, "fragment_duration");
+   else duration = MP4_READ_U32(p_ctx, "fragment_duration");
+
+   if(module->timescale && duration)
+      p_ctx->duration = duration * 1000000 / module->timescale;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_trex( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   uint32_t track_id;
+   int track;
+
+   MP4_SKIP_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   track_id = MP4_READ_U32(p_ctx, "track_ID");
+   MP4_SKIP_U32(p_ctx, "default_sample_description_index");
+
+   track = mp4_find_track(p_ctx, track_id);
+   if(track < 0) return STREAM_STATUS(p_ctx);
+   track_module = p_ctx->tracks[track]->priv->module;
+
+   track_module->default_sample_duration = MP4_READ_U32(p_ctx, "default_sample_duration");
+   track_module->default_sample_size = MP4_READ_U32(p_ctx, "default_sample_size");
+   track_module->default_sample_flags = MP4_READ_U32(p_ctx, "default_sample_flags");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_moof( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   /* Data offsets are relative to the start of the moof box by default */
+   module->fragment.data_end = module->fragment.moof_offset;
+
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_MOOF);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_traf( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+
+   module->fragment.track = -1;
+   status = mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_TRAF);
+   module->fragment.track = -1;
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_tfhd( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   uint32_t flags, track_id;
+   int track;
+
+   MP4_SKIP_U8(p_ctx, "version");
+   flags = MP4_READ_U24(p_ctx, "flags");
+   track_id = MP4_READ_U32(p_ctx, "track_ID");
+
+   track = mp4_find_track(p_ctx, track_id);
+   if(track < 0)
+   {
+      LOG_DEBUG(p_ctx, "fragment references unknown track %u", track_id);
+      return STREAM_STATUS(p_ctx);
+   }
+   track_module = p_ctx->tracks[track]->priv->module;
+   module->fragment.track = track;
+
+   /* The base data offset for the first track fragment is the start of the moof box,
+    * for the following ones it is the end of the data of the preceding track fragment */
+   if(flags & MP4_TFHD_FLAG_BASE_DATA_OFFSET)
+      module->fragment.base_offset = MP4_READ_U64(p_ctx, "base_data_offset");
+   else if(flags & MP4_TFHD_FLAG_DEFAULT_BASE_IS_MOOF)
+      module->fragment.base_offset = module->fragment.moof_offset;
+   else
+      module->fragment.base_offset = module->fragment.data_end;
+   module->fragment.data_end = module->fragment.base_offset;
+
+   if(flags & MP4_TFHD_FLAG_SAMPLE_DESCRIPTION_INDEX)
+      MP4_SKIP_U32(p_ctx, "sample_description_index");
+
+   module->fragment.default_sample_duration = (flags & MP4_TFHD_FLAG_DEFAULT_SAMPLE_DURATION) ?
+      MP4_READ_U32(p_ctx, "default_sample_duration") : track_module->default_sample_duration;
+   module->fragment.default_sample_size = (flags & MP4_TFHD_FLAG_DEFAULT_SAMPLE_SIZE) ?
+      MP4_READ_U32(p_ctx, "default_sample_size") : track_module->default_sample_size;
+   module->fragment.default_sample_flags = (flags & MP4_TFHD_FLAG_DEFAULT_SAMPLE_FLAGS) ?
+      MP4_READ_U32(p_ctx, "default_sample_flags") : track_module->default_sample_flags;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_tfdt( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   uint32_t version;
+   int64_t dts;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   if(version) dts = MP4_READ_U64(p_ctx, "base_media_decode_time");
+   else dts = MP4_READ_U32(p_ctx, "base_media_decode_time");
+
+   if(module->fragment.track >= 0)
+      p_ctx->tracks[module->fragment.track]->priv->module->fragment.next_dts = dts;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_trun( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   MP4_READER_SAMPLE_T *sample;
+   uint32_t flags, samples, first_flags = 0, i;
+   unsigned int entry_size = 0;
+   int64_t offset;
+
+   if(module->fragment.track < 0) return VC_CONTAINER_SUCCESS;
+   track_module = p_ctx->tracks[module->fragment.track]->priv->module;
+
+   MP4_SKIP_U8(p_ctx, "version");
+   flags = MP4_READ_U24(p_ctx, "flags");
+   samples = MP4_READ_U32(p_ctx, "sample_count");
+
+   offset = module->fragment.data_end;
+   if(flags & MP4_TRUN_FLAG_DATA_OFFSET)
+      offset = module->fragment.base_offset + (int32_t)MP4_READ_U32(p_ctx, "data_offset");
+   if(flags & MP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS)
+      first_flags = MP4_READ_U32(p_ctx, "first_sample_flags");
+
+   if(flags & MP4_TRUN_FLAG_SAMPLE_DURATION) entry_size += 4;
+   if(flags & MP4_TRUN_FLAG_SAMPLE_SIZE) entry_size += 4;
+   if(flags & MP4_TRUN_FLAG_SAMPLE_FLAGS) entry_size += 4;
+   if(flags & MP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME) entry_size += 4;
+   if((int64_t)samples * entry_size > size) return VC_CONTAINER_ERROR_CORRUPTED;
+   /* Trun boxes without per-sample fields can claim any number of samples. Bounding the
+    * total also keeps the size of the sample table well within a size_t. */
+   if(samples > MP4_FRAGMENT_SAMPLES_MAX - track_module->fragment.samples_num)
+      return VC_CONTAINER_ERROR_CORRUPTED;
+
+   /* Grow the sample table of the track if needed */
+   if(track_module->fragment.samples_num + samples > track_module->fragment.samples_max)
+   {
+      unsigned int samples_max = track_module->fragment.samples_num + samples;
+      sample = realloc(track_module->fragment.samples, samples_max * sizeof(*sample));
+      if(!sample) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      track_module->fragment.samples = sample;
+      track_module->fragment.samples_max = samples_max;
+   }
+
+   sample = track_module->fragment.samples + track_module->fragment.samples_num;
+   for(i = 0; i < samples; i++, sample++)
+   {
+      uint32_t duration = module->fragment.default_sample_duration;
+
+      sample->size = module->fragment.default_sample_size;
+      sample->flags = (!i && (flags & MP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS)) ?
+         first_flags : module->fragment.default_sample_flags;
+      sample->composition_offset = 0;
+
+      if(flags & MP4_TRUN_FLAG_SAMPLE_DURATION) duration = _READ_U32(p_ctx);
+      if(flags & MP4_TRUN_FLAG_SAMPLE_SIZE) sample->size = _READ_U32(p_ctx);
+      if(flags & MP4_TRUN_FLAG_SAMPLE_FLAGS) sample->flags = _READ_U32(p_ctx);
+      if(flags & MP4_TRUN_FLAG_SAMPLE_COMPOSITION_TIME)
+         sample->composition_offset = (int32_t)_READ_U32(p_ctx);
+
+      sample->offset = offset;
+      sample->dts = track_module->fragment.next_dts;
+      offset += sample->size;
+      track_module->fragment.next_dts += duration;
+   }
+   size -= samples * entry_size;
+
+   track_module->fragment.samples_num += samples;
+   module->fragment.data_end = offset;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_sidx( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   uint32_t version, timescale, references, i;
+   int64_t time, offset;
+
+   /* Only the first segment index is used, and only if it comes before any fragment */
+   if(module->fragment.sidx_found || module->fragment.moof_offset || !module->fragment.index)
+      return VC_CONTAINER_SUCCESS;
+
+   /* Offsets are relative to the first byte following the segment index */
+   offset = STREAM_POSITION(p_ctx) + size;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   MP4_SKIP_U32(p_ctx, "reference_ID");
+   timescale = MP4_READ_U32(p_ctx, "timescale");
+   if(version)
+   {
+      time = MP4_READ_U64(p_ctx, "earliest_presentation_time");
+      offset += MP4_READ_U64(p_ctx, "first_offset");
+   }
+   else
+   {
+      time = MP4_READ_U32(p_ctx, "earliest_presentation_time");
+      offset += MP4_READ_U32(p_ctx, "first_offset");
+   }
+   MP4_SKIP_U16(p_ctx, "reserved");
+   references = MP4_READ_U16(p_ctx, "reference_count");
+   if(!timescale || references * 12 > size) return VC_CONTAINER_ERROR_CORRUPTED;
+
+   for(i = 0; i < references; i++)
+   {
+      uint32_t referenced_size = _READ_U32(p_ctx) & 0x7FFFFFFF;
+      uint32_t duration = _READ_U32(p_ctx);
+      _SKIP_U32(p_ctx); /* SAP information */
+
+      vc_container_index_add(module->fragment.index, time * 1000000 / timescale, offset);
+      offset += referenced_size;
+      time += duration;
+   }
+   size -= references * 12;
+
+   if(!p_ctx->duration)
+      p_ctx->duration = time * 1000000 / timescale;
+   module->fragment.sidx_found = true;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_mfra( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_MFRA);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_tfra( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   uint32_t version, track_id, lengths, entries, i;
+   unsigned int entry_size, skip;
+   int64_t time, offset;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   track_id = MP4_READ_U32(p_ctx, "track_ID");
+   lengths = MP4_READ_U32(p_ctx, "length_size_of_traf_trun_sample_num");
+   entries = MP4_READ_U32(p_ctx, "number_of_entry");
+
+   /* We only need the random access points of the track used for seeking */
+   if(!module->fragment.index || !p_ctx->tracks_num) return STREAM_STATUS(p_ctx);
+   track_module = p_ctx->tracks[module->fragment.index_track]->priv->module;
+   if(track_id != track_module->track_id || !track_module->timescale)
+      return STREAM_STATUS(p_ctx);
+
+   skip = ((lengths >> 4) & 3) + ((lengths >> 2) & 3) + (lengths & 3) + 3;
+   entry_size = (version ? 16 : 8) + skip;
+   if((int64_t)entries * entry_size > size) return VC_CONTAINER_ERROR_CORRUPTED;
+
+   for(i = 0; i < entries; i++)
+   {
+      if(version)
+      {
+         time = _READ_U64(p_ctx);
+         offset = _READ_U64(p_ctx);
+      }
+      else
+      {
+         time = _READ_U32(p_ctx);
+         offset = _READ_U32(p_ctx);
+      }
+      SKIP_BYTES(p_ctx, skip);
+
+      vc_container_index_add(module->fragment.index,
+         time * 1000000 / track_module->timescale, offset);
+   }
+   size -= entries * entry_size;
+
+   return STREAM_STATUS(p_ctx);
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_reader_close( VC_CONTAINER_T *p_ctx )
 {
@@ -1204,7 +1651,13 @@ static VC_CONTAINER_STATUS_T mp4_reader_close( VC_CONTAINER_T *p_ctx )
    unsigned int i;
 
    for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      mp4_index_free(p_ctx->tracks[i]->priv->module->index);
+      free(p_ctx->tracks[i]->priv->module->fragment.samples);
       vc_container_free_track(p_ctx, p_ctx->tracks[i]);
+   }
+   if(module->fragment.index)
+      vc_container_index_free(module->fragment.index);
    free(module);
    return VC_CONTAINER_SUCCESS;
 }
@@ -1341,6 +1794,247 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_table( VC_CONTAINER_T *p_ctx,
    return state->status;
 }
 
+/*****************************************************************************/
+static uint8_t *mp4_index_put( uint8_t *data, uint64_t value )
+{
+   for(; value >= 0x80; value >>= 7)
+      *data++ = (uint8_t)(value | 0x80);
+   *data++ = (uint8_t)value;
+   return data;
+}
+
+/*****************************************************************************/
+static const uint8_t *mp4_index_get( const uint8_t *data, uint64_t *value )
+{
+   unsigned int shift = 0;
+
+   for(*value = 0; *data & 0x80; shift += 7)
+      *value |= (uint64_t)(*data++ & 0x7F) << shift;
+   *value |= (uint64_t)*data++ << shift;
+   return data;
+}
+
+#define MP4_INDEX_ZIGZAG(v) (((uint64_t)(v) << 1) ^ (uint64_t)((v) < 0 ? -1 : 0))
+#define MP4_INDEX_UNZIGZAG(v) ((int64_t)((v) >> 1) ^ -(int64_t)((v) & 1))
+
+/*****************************************************************************/
+static void mp4_index_block_start( MP4_SAMPLE_INDEX_T *index, uint32_t block )
+{
+   MP4_INDEX_ENTRY_T *entry = &index->entry;
+
+   /* Samples are encoded relative to this pseudo-entry at the start of each block */
+   memset(entry, 0, sizeof(*entry));
+   entry->sample = block * MP4_INDEX_BLOCK_SAMPLES - 1;
+   entry->dts = index->blocks[block].dts;
+   entry->offset = index->blocks[block].offset;
+   entry->data = index->blocks[block].data;
+}
+
+/*****************************************************************************/
+static const MP4_INDEX_ENTRY_T *mp4_index_entry( MP4_SAMPLE_INDEX_T *index, uint32_t sample )
+{
+   MP4_INDEX_ENTRY_T *entry = &index->entry;
+   const uint8_t *data;
+   uint64_t header, value;
+
+   if(sample >= index->samples) return NULL;
+   if(entry->sample == sample) return entry;
+
+   /* Carry on from the last decoded entry unless we'd have to go backwards
+    * or the requested sample is in another block */
+   if(entry->sample + 1 > sample ||
+      (entry->sample + 1) / MP4_INDEX_BLOCK_SAMPLES != sample / MP4_INDEX_BLOCK_SAMPLES)
+      mp4_index_block_start(index, sample / MP4_INDEX_BLOCK_SAMPLES);
+
+   while(entry->sample != sample)
+   {
+      /* The first sample of a block is encoded relative to the start of the block */
+      if(!((entry->sample + 1) % MP4_INDEX_BLOCK_SAMPLES))
+         mp4_index_block_start(index, (entry->sample + 1) / MP4_INDEX_BLOCK_SAMPLES);
+
+      data = index->data + entry->data;
+      data = mp4_index_get(data, &header);
+
+      entry->dts += entry->duration;
+      entry->offset += entry->size;
+      entry->size = (uint32_t)(header >> 3);
+      entry->keyframe = !!(header & 4);
+      if(header & 2)
+      {
+         data = mp4_index_get(data, &value);
+         entry->duration = (uint32_t)value;
+      }
+      if(header & 1)
+      {
+         data = mp4_index_get(data, &value);
+         entry->offset += MP4_INDEX_UNZIGZAG(value);
+      }
+      if(index->composition)
+      {
+         data = mp4_index_get(data, &value);
+         entry->composition_offset = (int32_t)MP4_INDEX_UNZIGZAG(value);
+      }
+      entry->data = data - index->data;
+      entry->sample++;
+   }
+
+   return entry;
+}
+
+/*****************************************************************************/
+static uint32_t mp4_index_find_sample( MP4_SAMPLE_INDEX_T *index, int64_t time )
+{
+   const MP4_INDEX_ENTRY_T *entry;
+   uint32_t start = 0, end, sample;
+
+   if(!index->samples || time < index->blocks[0].dts) return 0;
+
+   /* Find the last block starting before the requested time */
+   end = (index->samples - 1) / MP4_INDEX_BLOCK_SAMPLES;
+   while(start < end)
+   {
+      uint32_t middle = (start + end + 1) / 2;
+      if(index->blocks[middle].dts <= time) start = middle;
+      else end = middle - 1;
+   }
+
+   /* And the sample within the block */
+   for(sample = start * MP4_INDEX_BLOCK_SAMPLES; sample < index->samples; sample++)
+   {
+      entry = mp4_index_entry(index, sample);
+      if(entry->dts + entry->duration > time) break;
+   }
+
+   return sample;
+}
+
+/*****************************************************************************/
+static uint32_t mp4_index_find_sync_sample( MP4_SAMPLE_INDEX_T *index, uint32_t sample,
+   bool forward )
+{
+   uint32_t start = 0, end = index->sync_samples_num;
+
+   /* Every sample is a sync sample when there's no sync sample table */
+   if(!index->sync_samples_num) return sample;
+
+   /* Find the first sync sample after the requested one */
+   while(start < end)
+   {
+      uint32_t middle = (start + end) / 2;
+      if(index->sync_samples[middle] <= sample) start = middle + 1;
+      else end = middle;
+   }
+
+   /* Like with the sample table, stay where we are if there's no sync sample after this one */
+   if(start == index->sync_samples_num) return sample;
+   if(forward) return index->sync_samples[start];
+   return start ? index->sync_samples[start - 1] : 0;
+}
+
+/*****************************************************************************/
+static uint64_t mp4_index_size( const MP4_SAMPLE_INDEX_T *index )
+{
+   uint32_t blocks = (index->samples + MP4_INDEX_BLOCK_SAMPLES - 1) / MP4_INDEX_BLOCK_SAMPLES;
+
+   return sizeof(*index) + blocks * sizeof(*index->blocks) + index->data_size +
+      index->sync_samples_num * sizeof(*index->sync_samples);
+}
+
+/*****************************************************************************/
+static void mp4_index_free( MP4_SAMPLE_INDEX_T *index )
+{
+   if(!index) return;
+   free(index->blocks);
+   free(index->data);
+   free(index->sync_samples);
+   free(index);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_index_read_sample_header( VC_CONTAINER_T *p_ctx, uint32_t track,
+   MP4_READER_STATE_T *state )
+{
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[track]->priv->module;
+   const MP4_INDEX_ENTRY_T *entry;
+
+   /* Switch to the next sample */
+   state->offset += state->sample_size;
+   state->sample_offset = 0;
+   state->sample_size = 0;
+
+   entry = mp4_index_entry(track_module->index, state->sample);
+   if(!entry)
+   {
+      state->status = VC_CONTAINER_ERROR_EOS;
+      return state->status;
+   }
+   state->sample++;
+
+   state->offset = entry->offset;
+   state->sample_size = entry->size;
+   state->keyframe = entry->keyframe;
+   if(track_module->timescale)
+   {
+      state->dts = entry->dts * 1000000 / track_module->timescale;
+      state->pts = (entry->dts + entry->composition_offset) * 1000000 / track_module->timescale;
+   }
+
+   return state->status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_fragment_sample_header( VC_CONTAINER_T *p_ctx, uint32_t track,
+   MP4_READER_STATE_T *state )
+{
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[track]->priv->module;
+   MP4_READER_SAMPLE_T *sample;
+
+   if(state->status != VC_CONTAINER_SUCCESS) return state->status;
+
+   if(state->sample_offset < state->sample_size)
+      return state->status; /* We still have data left from the current sample */
+
+   /* Switch to the next sample */
+   state->offset += state->sample_size;
+   state->sample_offset = 0;
+   state->sample_size = 0;
+
+   /* Check if this track has anything left in the current fragment */
+   if(track_module->fragment.sample >= track_module->fragment.samples_num)
+   {
+      state->status = VC_CONTAINER_ERROR_EOS;
+      return state->status;
+   }
+
+   sample = &track_module->fragment.samples[track_module->fragment.sample++];
+   state->offset = sample->offset;
+   state->sample_size = sample->size;
+   state->sample++;
+
+   if(track_module->timescale)
+   {
+      state->dts = sample->dts * 1000000 / track_module->timescale;
+      state->pts = (sample->dts + sample->composition_offset) * 1000000 / track_module->timescale;
+   }
+   state->keyframe = !(sample->flags & MP4_SAMPLE_FLAGS_IS_NON_SYNC);
+
+   /* Try to batch several samples together if requested. We'll always stop at
+    * discontinuities in the sample data */
+   while(track_module->samples_batch_size &&
+         state->sample_size < track_module->samples_batch_size &&
+         track_module->fragment.sample < track_module->fragment.samples_num)
+   {
+      sample = &track_module->fragment.samples[track_module->fragment.sample];
+      if(sample->offset != state->offset + state->sample_size) break;
+
+      state->sample_size += sample->size;
+      track_module->fragment.sample++;
+      state->sample++;
+   }
+
+   return state->status;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_read_sample_header( VC_CONTAINER_T *p_ctx, uint32_t track,
    MP4_READER_STATE_T *state )
@@ -1352,6 +2046,11 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_header( VC_CONTAINER_T *p_ctx, uint
    if(state->sample_offset < state->sample_size)
       return state->status; /* We still have data left from the current sample */
 
+   if(p_ctx->priv->module->fragmented)
+      return mp4_read_fragment_sample_header(p_ctx, track, state);
+   if(track_module->index)
+      return mp4_index_read_sample_header(p_ctx, track, state);
+
    /* Switch to the next sample */
    state->offset += state->sample_size;
    state->sample_offset = 0;
@@ -1450,7 +2149,7 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_header( VC_CONTAINER_T *p_ctx, uint
 
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_read_sample_data( VC_CONTAINER_T *p_ctx, uint32_t track,
-   MP4_READER_STATE_T *state, uint8_t *data, unsigned int *data_size )
+   MP4_READER_STATE_T *state, uint8_t **data, unsigned int *data_size, bool borrow )
 {
    VC_CONTAINER_STATUS_T status;
    unsigned int size = state->sample_size - state->sample_offset;
@@ -1461,10 +2160,15 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_data( VC_CONTAINER_T *p_ctx, uint32
 
    if(data)
    {
+      uint8_t *borrowed;
+
       state->status = SEEK(p_ctx, state->offset + state->sample_offset);
       if(state->status != VC_CONTAINER_SUCCESS) return state->status;
 
-      size = READ_BYTES(p_ctx, data, size);
+      /* Point straight at the data if the i/o allows it */
+      borrowed = borrow ? BORROW_BYTES(p_ctx, size) : 0;
+      if(borrowed) *data = borrowed;
+      else size = READ_BYTES(p_ctx, *data, size);
    }
    state->sample_offset += size;
 
@@ -1481,10 +2185,100 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_data( VC_CONTAINER_T *p_ctx, uint32
    return status;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_fragment( VC_CONTAINER_T *p_ctx, int64_t offset )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   VC_CONTAINER_STATUS_T status;
+   MP4_BOX_TYPE_T box_type;
+   int64_t box_size;
+   unsigned int i;
+
+   /* Skip everything until the next moof box. We do not look inside the boxes we skip
+    * so this stays cheap even when we need to go over large mdat boxes. */
+   status = SEEK(p_ctx, offset);
+   while(status == VC_CONTAINER_SUCCESS)
+   {
+      status = mp4_read_box_header( p_ctx, INT64_C(-1), &box_type, &box_size );
+      if(status != VC_CONTAINER_SUCCESS) break;
+      if(box_type == MP4_BOX_TYPE_MOOF) break;
+      if(box_type == MP4_BOX_TYPE_MFRA) return VC_CONTAINER_ERROR_EOS;
+      status = SEEK(p_ctx, STREAM_POSITION(p_ctx) + box_size);
+   }
+   if(status != VC_CONTAINER_SUCCESS)
+      return STREAM_EOS(p_ctx) ? VC_CONTAINER_ERROR_EOS : status;
+
+   /* Start afresh with the samples described by this fragment */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      track_module = p_ctx->tracks[i]->priv->module;
+      track_module->fragment.samples_num = 0;
+      track_module->fragment.sample = 0;
+   }
+
+   module->fragment.moof_offset = module->box_offset;
+   status = mp4_read_box_data( p_ctx, box_type, box_size, MP4_BOX_TYPE_ROOT );
+   if(status != VC_CONTAINER_SUCCESS) return status;
+   module->fragment.next_offset = STREAM_POSITION(p_ctx);
+
+   /* Remember where this fragment starts so we can come back to it quickly */
+   track_module = p_ctx->tracks[module->fragment.index_track]->priv->module;
+   if(module->fragment.index && track_module->fragment.samples_num && track_module->timescale)
+      vc_container_index_add(module->fragment.index,
+         track_module->fragment.samples[0].dts * 1000000 / track_module->timescale,
+         module->fragment.moof_offset);
+
+   /* Initialise tracks */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      track_module = p_ctx->tracks[i]->priv->module;
+      memset(&track_module->state, 0, sizeof(track_module->state));
+      mp4_read_fragment_sample_header(p_ctx, i, &track_module->state);
+   }
+
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_mfra( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_STATUS_T status;
+   int64_t size = p_ctx->priv->io->size, box_size;
+   MP4_BOX_TYPE_T box_type;
+
+   /* The mfro box at the very end of the stream gives us the size of the mfra box */
+   if(size < 16) return VC_CONTAINER_ERROR_NOT_FOUND;
+   status = SEEK(p_ctx, size - 16);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   if(_READ_U32(p_ctx) != 16 || _READ_FOURCC(p_ctx) != MP4_BOX_TYPE_MFRO)
+      return VC_CONTAINER_ERROR_NOT_FOUND;
+   _SKIP_U32(p_ctx); /* version and flags */
+   box_size = _READ_U32(p_ctx);
+   if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS || box_size > size)
+      return VC_CONTAINER_ERROR_NOT_FOUND;
+
+   status = SEEK(p_ctx, size - box_size);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+   status = mp4_read_box_header( p_ctx, box_size, &box_type, &box_size );
+   if(status != VC_CONTAINER_SUCCESS) return status;
+   if(box_type != MP4_BOX_TYPE_MFRA) return VC_CONTAINER_ERROR_NOT_FOUND;
+
+   return mp4_read_box_data( p_ctx, box_type, box_size, MP4_BOX_TYPE_ROOT );
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_next_fragment( VC_CONTAINER_T *p_ctx )
+{
+   return mp4_read_fragment(p_ctx, p_ctx->priv->module->fragment.next_offset);
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
                                               VC_CONTAINER_PACKET_T *packet, uint32_t flags )
 {
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module;
    VC_CONTAINER_STATUS_T status;
    MP4_READER_STATE_T *state;
@@ -1493,6 +2287,17 @@ static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
    uint8_t *data = 0;
    int64_t offset;
 
+   /* Move on to the next movie fragment once all the tracks have been exhausted */
+   while(module->fragmented)
+   {
+      for(i = 0; i < p_ctx->tracks_num; i++)
+         if(p_ctx->tracks[i]->priv->module->state.status == VC_CONTAINER_SUCCESS) break;
+      if(i < p_ctx->tracks_num) break;
+
+      status = mp4_read_next_fragment(p_ctx);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+
    /* Select the track to read from. If no specific track is requested by the caller, this
     * will be the track to which the next bit of data in the mdat belongs to */
    if(!(flags & VC_CONTAINER_READ_FLAG_FORCE_TRACK))
@@ -1517,10 +2322,23 @@ static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
    state = &track_module->state;
 
    status = mp4_read_sample_header(p_ctx, track, state);
+
+   /* A forced read can't wait for the other tracks to be read first so we move on to the
+    * next fragment with samples for this track, dropping whatever is left of the others */
+   while(status == VC_CONTAINER_ERROR_EOS && module->fragmented &&
+         (flags & VC_CONTAINER_READ_FLAG_FORCE_TRACK))
+   {
+      status = mp4_read_next_fragment(p_ctx);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+      status = mp4_read_sample_header(p_ctx, track, state);
+   }
+
+   if(status == VC_CONTAINER_ERROR_EOS && module->fragmented)
+      return VC_CONTAINER_ERROR_CONTINUE; /* Other tracks need to be read first */
    if(status != VC_CONTAINER_SUCCESS) return status;
 
    if(!packet) /* Skip packet */
-      return mp4_read_sample_data(p_ctx, track, state, 0, 0);
+      return mp4_read_sample_data(p_ctx, track, state, 0, 0, false);
 
    packet->dts = state->dts;
    packet->pts = state->pts;
@@ -1532,20 +2350,22 @@ static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
    packet->size = state->sample_size - state->sample_offset;
 
    if(flags & VC_CONTAINER_READ_FLAG_SKIP)
-      return mp4_read_sample_data(p_ctx, track, state, 0, 0);
+      return mp4_read_sample_data(p_ctx, track, state, 0, 0, false);
    else if((flags & VC_CONTAINER_READ_FLAG_INFO) || !packet->data)
       return VC_CONTAINER_SUCCESS;
 
    data = packet->data;
    data_size = packet->buffer_size;
 
-   status = mp4_read_sample_data(p_ctx, track, state, data, &data_size);
+   status = mp4_read_sample_data(p_ctx, track, state, &data, &data_size,
+      !!(flags & VC_CONTAINER_READ_FLAG_BORROW));
    if(status != VC_CONTAINER_SUCCESS)
    {
       /* FIXME */
       return status;
    }
 
+   packet->data = data;
    packet->size = data_size;
    if(state->sample_offset) //?
       packet->flags &= ~VC_CONTAINER_PACKET_FLAG_FRAME_END;
@@ -1569,6 +2389,12 @@ static uint32_t mp4_find_sample( VC_CONTAINER_T *p_ctx, uint32_t track,
     * rounding errors in the timestamp (because of the timescale conversion) */
    seek_time_up = seek_time_up * track_module->timescale / 1000000;
 
+   if(track_module->index)
+   {
+      sample = mp4_index_find_sample(track_module->index, MAX(seek_time, seek_time_up));
+      goto end;
+   }
+
    status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].offset);
    if(status != VC_CONTAINER_SUCCESS) goto end;
 
@@ -1610,6 +2436,13 @@ static VC_CONTAINER_STATUS_T mp4_seek_track( VC_CONTAINER_T *p_ctx, uint32_t tra
 
    memset(state, 0, sizeof(*state));
 
+   /* The in-memory index gives us direct access to the sample */
+   if(track_module->index)
+   {
+      state->sample = sample;
+      return mp4_read_sample_header(p_ctx, track, state);
+   }
+
    /* Find the right chunk */
    for(i = 0, samples = sample; i < track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries; i++)
    {
@@ -1701,6 +2534,85 @@ static VC_CONTAINER_STATUS_T mp4_seek_track( VC_CONTAINER_T *p_ctx, uint32_t tra
    return state->status;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_reader_seek_fragment(VC_CONTAINER_T *p_ctx,
+   int64_t *offset, VC_CONTAINER_SEEK_FLAGS_T flags)
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   VC_CONTAINER_STATUS_T status;
+   int64_t seek_time = *offset, time = *offset, moof_offset = module->fragment.first_offset;
+   unsigned int i, sample, index_track = module->fragment.index_track;
+   int past;
+
+   /* Find the closest fragment starting before the requested time using the index
+    * (built from the sidx / mfra boxes and from the fragments we've already seen) */
+   if(!seek_time || !module->fragment.index ||
+      vc_container_index_get(module->fragment.index, 0, &time, &moof_offset, &past) !=
+         VC_CONTAINER_SUCCESS || time > seek_time)
+   {
+      moof_offset = module->fragment.first_offset;
+      time = 0;
+   }
+
+   /* The decoding time is only a best guess in case the fragment doesn't have a tfdt box */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      track_module = p_ctx->tracks[i]->priv->module;
+      track_module->fragment.next_dts = time * track_module->timescale / 1000000;
+   }
+
+   status = mp4_read_fragment(p_ctx, moof_offset);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   /* Walk the following fragments (only reading their moof box) until we find the
+    * one which contains the requested time. When we reach the end of the stream,
+    * the last fragment is still loaded. */
+   track_module = p_ctx->tracks[index_track]->priv->module;
+   while(track_module->timescale &&
+         track_module->fragment.next_dts * 1000000 / track_module->timescale <= seek_time)
+   {
+      if(mp4_read_next_fragment(p_ctx) != VC_CONTAINER_SUCCESS) break;
+   }
+
+   /* Find the closest sync sample on the seeking track */
+   for(i = 0, sample = 0; i < track_module->fragment.samples_num && track_module->timescale; i++)
+   {
+      MP4_READER_SAMPLE_T *s = &track_module->fragment.samples[i];
+      if(s->flags & MP4_SAMPLE_FLAGS_IS_NON_SYNC) continue;
+      if(s->dts * 1000000 / track_module->timescale > seek_time)
+      {
+         if(flags & VC_CONTAINER_SEEK_FLAG_FORWARD) sample = i;
+         break;
+      }
+      sample = i;
+   }
+
+   track_module->fragment.sample = sample;
+   memset(&track_module->state, 0, sizeof(track_module->state));
+   mp4_read_fragment_sample_header(p_ctx, index_track, &track_module->state);
+   if(track_module->state.status == VC_CONTAINER_SUCCESS)
+      seek_time = track_module->state.dts;
+
+   /* Position the other tracks at the same time */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      if(i == index_track) continue;
+      track_module = p_ctx->tracks[i]->priv->module;
+
+      for(sample = 0; sample < track_module->fragment.samples_num && track_module->timescale; sample++)
+         if(track_module->fragment.samples[sample].dts * 1000000 / track_module->timescale >= seek_time)
+            break;
+
+      track_module->fragment.sample = sample;
+      memset(&track_module->state, 0, sizeof(track_module->state));
+      mp4_read_fragment_sample_header(p_ctx, i, &track_module->state);
+   }
+
+   *offset = seek_time;
+   return VC_CONTAINER_SUCCESS;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    int64_t *offset, VC_CONTAINER_SEEK_MODE_T mode, VC_CONTAINER_SEEK_FLAGS_T flags)
@@ -1710,9 +2622,11 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    VC_CONTAINER_STATUS_T status;
    uint32_t i, track, sample, prev_sample, next_sample;
    int64_t seek_time = *offset;
-   VC_CONTAINER_PARAM_UNUSED(module);
    VC_CONTAINER_PARAM_UNUSED(mode);
 
+   if(module->fragmented)
+      return mp4_reader_seek_fragment(p_ctx, offset, flags);
+
    /* Reset the states */
    for(i = 0; i < p_ctx->tracks_num; i++)
       memset(&p_ctx->tracks[i]->priv->module->state, 0, sizeof(p_ctx->tracks[i]->priv->module->state));
@@ -1741,6 +2655,12 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
 
    /* Find the closest sync sample */
+   if(track_module->index)
+   {
+      sample = mp4_index_find_sync_sample(track_module->index, sample,
+                                          flags & VC_CONTAINER_SEEK_FLAG_FORWARD);
+      goto sync_sample_found;
+   }
    status = mp4_seek_sample_table( p_ctx, track_module, &track_module->state, MP4_SAMPLE_TABLE_STSS );
    if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
    for(i = 0, prev_sample = 0, next_sample = 0;
@@ -1756,6 +2676,7 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    }
 
    /* Do the seek on this track and use its timestamp as the new seek point */
+ sync_sample_found:
    status = mp4_seek_track(p_ctx, track, &track_module->state, sample);
    if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
    seek_time = track_module->state.pts;
@@ -1777,6 +2698,184 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    return VC_CONTAINER_SUCCESS;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_index_build( VC_CONTAINER_T *p_ctx, uint32_t track )
+{
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[track]->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   MP4_SAMPLE_INDEX_T *index;
+   MP4_READER_STATE_T state;
+   uint32_t blocks_max = 0, data_max = 0, sync_max = 0;
+   int64_t expected_offset = 0;
+   uint32_t duration = 0;
+
+   if(track_module->index) return VC_CONTAINER_SUCCESS;
+
+   /* Tracks read in batch mode (i.e. PCM audio) have far too many samples for this */
+   if(track_module->samples_batch_size) return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   index = malloc(sizeof(*index));
+   if(!index) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   memset(index, 0, sizeof(*index));
+   index->composition = track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries != 0;
+
+   /* Go through the whole sample table once, using a state of our own so we
+    * don't disturb the reading position of the track */
+   memset(&state, 0, sizeof(state));
+   while(mp4_read_sample_header(p_ctx, track, &state) == VC_CONTAINER_SUCCESS)
+   {
+      uint32_t sample = index->samples;
+      uint64_t header;
+      uint8_t *data;
+
+      if(!(sample % MP4_INDEX_BLOCK_SAMPLES))
+      {
+         uint32_t block = sample / MP4_INDEX_BLOCK_SAMPLES;
+         if(block >= blocks_max)
+         {
+            MP4_INDEX_BLOCK_T *blocks;
+            blocks_max = blocks_max ? blocks_max * 2 : 64;
+            blocks = realloc(index->blocks, blocks_max * sizeof(*blocks));
+            if(!blocks) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+            index->blocks = blocks;
+         }
+         index->blocks[block].dts = state.duration - state.sample_duration;
+         index->blocks[block].offset = state.offset;
+         index->blocks[block].data = index->data_size;
+         expected_offset = state.offset;
+         duration = 0;
+      }
+
+      if(index->data_size + MP4_INDEX_ENTRY_MAX_SIZE > data_max)
+      {
+         data_max = data_max ? data_max * 2 : 4096;
+         data = realloc(index->data, data_max);
+         if(!data) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+         index->data = data;
+      }
+
+      if(state.keyframe)
+      {
+         if(index->sync_samples_num >= sync_max)
+         {
+            uint32_t *sync_samples;
+            sync_max = sync_max ? sync_max * 2 : 64;
+            sync_samples = realloc(index->sync_samples, sync_max * sizeof(*sync_samples));
+            if(!sync_samples) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+            index->sync_samples = sync_samples;
+         }
+         index->sync_samples[index->sync_samples_num++] = sample;
+      }
+
+      /* Encode the sample description as a delta from the previous sample */
+      header = ((uint64_t)state.sample_size << 3) | (state.keyframe ? 4 : 0) |
+         (state.sample_duration != duration ? 2 : 0) | (state.offset != expected_offset ? 1 : 0);
+      data = mp4_index_put(index->data + index->data_size, header);
+      if(header & 2)
+         data = mp4_index_put(data, state.sample_duration);
+      if(header & 1)
+         data = mp4_index_put(data, MP4_INDEX_ZIGZAG(state.offset - expected_offset));
+      if(index->composition)
+         data = mp4_index_put(data, MP4_INDEX_ZIGZAG((int64_t)state.sample_composition_offset));
+      index->data_size = data - index->data;
+
+      expected_offset = state.offset + state.sample_size;
+      duration = state.sample_duration;
+      index->samples++;
+
+      state.sample_offset = state.sample_size; /* Move on to the next sample */
+   }
+
+   if(!index->samples)
+   {
+      status = state.status == VC_CONTAINER_ERROR_EOS ? VC_CONTAINER_ERROR_NOT_FOUND : state.status;
+      goto error;
+   }
+
+   /* Give back the memory we don't need */
+   if(index->data_size < data_max)
+   {
+      uint8_t *data = realloc(index->data, index->data_size);
+      if(data) index->data = data;
+   }
+
+   mp4_index_block_start(index, 0);
+   track_module->index = index;
+
+   LOG_DEBUG(p_ctx, "track %u: indexed %u samples using %"PRIu64" bytes", track,
+             index->samples, mp4_index_size(index));
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   mp4_index_free(index);
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_reader_set_sample_index( VC_CONTAINER_T *p_ctx, bool enable )
+{
+   VC_CONTAINER_STATUS_T status = enable ? VC_CONTAINER_ERROR_NOT_FOUND : VC_CONTAINER_SUCCESS;
+   unsigned int i;
+
+   /* Fragmented files only ever have the samples of a single fragment in memory */
+   if(p_ctx->priv->module->fragmented) return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      MP4_READER_STATE_T *state = &track_module->state;
+
+      if(enable)
+      {
+         /* The reading state stays valid since it is shared with the sample tables */
+         if(mp4_index_build(p_ctx, i) != VC_CONTAINER_SUCCESS)
+            LOG_DEBUG(p_ctx, "track %u won't be indexed", i);
+         if(track_module->index) status = VC_CONTAINER_SUCCESS;
+      }
+      else if(track_module->index)
+      {
+         unsigned int sample_offset = state->sample_offset;
+         uint32_t sample = state->sample;
+
+         mp4_index_free(track_module->index);
+         track_module->index = NULL;
+
+         /* Rebuild the sample tables reading state for the current sample */
+         if(state->status == VC_CONTAINER_SUCCESS && sample)
+         {
+            mp4_seek_track(p_ctx, i, state, sample - 1);
+            state->sample_offset = sample_offset;
+         }
+      }
+   }
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_reader_control( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_CONTROL_T operation, va_list args )
+{
+   unsigned int i;
+
+   switch(operation)
+   {
+   case VC_CONTAINER_CONTROL_SET_SAMPLE_INDEX:
+      return mp4_reader_set_sample_index(p_ctx, (bool)va_arg(args, int));
+
+   case VC_CONTAINER_CONTROL_GET_SAMPLE_INDEX_SIZE:
+      {
+         uint64_t *size = va_arg(args, uint64_t *);
+         for(i = 0, *size = 0; i < p_ctx->tracks_num; i++)
+            if(p_ctx->tracks[i]->priv->module->index)
+               *size += mp4_index_size(p_ctx->tracks[i]->priv->module->index);
+         return VC_CONTAINER_SUCCESS;
+      }
+
+   default: return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   }
+}
+
 /******************************************************************************
 Global function definitions.
 ******************************************************************************/
@@ -1830,7 +2929,14 @@ VC_CONTAINER_STATUS_T mp4_reader_open( VC_CONTAINER_T *p_ctx )
       status = mp4_read_box_header( p_ctx, INT64_C(-1), &box_type, &box_size );
       if(status != VC_CONTAINER_SUCCESS) goto error;
 
-      if(box_type == MP4_BOX_TYPE_MDAT)
+      if(box_type == MP4_BOX_TYPE_MOOF && module->found_moov)
+      {
+         /* The samples are described by movie fragments which we'll read as we go */
+         module->fragmented = true;
+         module->fragment.first_offset = module->box_offset;
+         break;
+      }
+      else if(box_type == MP4_BOX_TYPE_MDAT)
       {
          module->data_offset = STREAM_POSITION(p_ctx);
          module->data_size = box_size;
@@ -1845,19 +2951,44 @@ VC_CONTAINER_STATUS_T mp4_reader_open( VC_CONTAINER_T *p_ctx )
       if(module->found_moov && module->data_offset) break; /* We've got everything we want */
    }
 
-   /* Initialise tracks */
-   for(i = 0; i < p_ctx->tracks_num; i++)
+   if(module->fragmented)
    {
-      /* FIXME: we should check we've got at least one success */
-      status = mp4_read_sample_header(p_ctx, i, &p_ctx->tracks[i]->priv->module->state);
+      if(!p_ctx->tracks_num) { status = VC_CONTAINER_ERROR_NO_TRACK_AVAILABLE; goto error; }
+
+      /* Use the first video track to index and seek fragments */
+      for(i = 0; i < p_ctx->tracks_num; i++)
+         if(p_ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) break;
+      module->fragment.index_track = i < p_ctx->tracks_num ? i : 0;
+
+      /* Without a segment index, check for a movie fragment random access box */
+      if(!module->fragment.sidx_found && module->fragment.index && STREAM_SEEKABLE(p_ctx))
+         mp4_read_mfra(p_ctx);
+
+      /* Load the first fragment. This also initialises the tracks. */
+      status = mp4_read_fragment(p_ctx, module->fragment.first_offset);
+      if(status != VC_CONTAINER_SUCCESS) goto error;
    }
+   else
+   {
+      /* Initialise tracks */
+      for(i = 0; i < p_ctx->tracks_num; i++)
+      {
+         /* FIXME: we should check we've got at least one success */
+         status = mp4_read_sample_header(p_ctx, i, &p_ctx->tracks[i]->priv->module->state);
+      }
 
-   status = SEEK(p_ctx, module->data_offset);
-   if(status != VC_CONTAINER_SUCCESS) goto error;
+      status = SEEK(p_ctx, module->data_offset);
+      if(status != VC_CONTAINER_SUCCESS) goto error;
+   }
 
    p_ctx->priv->pf_close = mp4_reader_close;
    p_ctx->priv->pf_read = mp4_reader_read;
    p_ctx->priv->pf_seek = mp4_reader_seek;
+   p_ctx->priv->pf_control = mp4_reader_control;
+
+   /* Build the in-memory sample index straight away if requested */
+   if(vc_uri_find_query(p_ctx->priv->uri, 0, "sample_index", 0) && !module->fragmented)
+      mp4_reader_set_sample_index(p_ctx, true);
 
    if(STREAM_SEEKABLE(p_ctx))
       p_ctx->capabilities |= VC_CONTAINER_CAPS_CAN_SEEK;
@@ -47,6 +47,9 @@ Defines.
 
 #define MP4_64BITS_TIME 0 /* 0 to disable / 1 to enable */
 
+#define MP4_FRAGMENT_SIZE_MAX (4*1024*1024) /* Default maximum size of a fragment */
+#define MP4_FRAGMENT_SAMPLES_MIN 64
+
 /******************************************************************************
 Type definitions.
 ******************************************************************************/
@@ -69,8 +72,24 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
    int64_t first_pts;
    int64_t last_pts;
 
+   /* Fragmented mode */
+   unsigned int fragment_samples;   /**< Number of samples in the current fragment */
+   uint32_t fragment_data_offset;   /**< Offset of the first sample in the mdat payload */
+   uint32_t fragment_last_duration; /**< Duration of the last sample written (timescale units) */
+
 } VC_CONTAINER_TRACK_MODULE_T;
 
+typedef struct MP4_FRAGMENT_SAMPLE_T
+{
+   uint32_t track;
+   uint32_t flags;
+   uint32_t offset;   /**< Offset of the sample data in the fragment buffer */
+   uint32_t size;
+   uint32_t duration; /**< Duration in timescale units, computed when the fragment is flushed */
+   int64_t dts;
+
+} MP4_FRAGMENT_SAMPLE_T;
+
 typedef struct VC_CONTAINER_MODULE_T
 {
    int box_level;
@@ -96,6 +115,25 @@ typedef struct VC_CONTAINER_MODULE_T
    int64_t duration;
    /**/
 
+   /* Fragmented mode. Samples are accumulated in memory and written out as
+    * moof / mdat pairs instead of being indexed in the moov at the end. */
+   bool fragmented;
+   bool has_video;
+   int64_t fragment_duration;        /**< Target duration of a fragment in microseconds */
+   unsigned int fragment_size_max;   /**< Maximum size of the payload of a fragment */
+   uint32_t fragment_sequence;
+   struct {
+      uint8_t *data;
+      unsigned int size;
+      unsigned int buffer_size;
+      MP4_FRAGMENT_SAMPLE_T *samples;
+      unsigned int samples_num;
+      unsigned int samples_max;
+      int64_t start_dts;
+      unsigned int moof_size;
+      bool open;                     /**< A sample is currently being written */
+   } fragment;
+
 } VC_CONTAINER_MODULE_T;
 
 /******************************************************************************
@@ -128,6 +166,14 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stss( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_vide( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_soun( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_esds( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mvex( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_trex( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_moof( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mfhd( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_traf( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_tfhd( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_tfdt( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_trun( VC_CONTAINER_T *p_ctx );
 
 static struct {
   const MP4_BOX_TYPE_T type;
@@ -159,6 +205,14 @@ static struct {
    {MP4_BOX_TYPE_VIDE, mp4_write_box_vide},
    {MP4_BOX_TYPE_SOUN, mp4_write_box_soun},
    {MP4_BOX_TYPE_ESDS, mp4_write_box_esds},
+   {MP4_BOX_TYPE_MVEX, mp4_write_box_mvex},
+   {MP4_BOX_TYPE_TREX, mp4_write_box_trex},
+   {MP4_BOX_TYPE_MOOF, mp4_write_box_moof},
+   {MP4_BOX_TYPE_MFHD, mp4_write_box_mfhd},
+   {MP4_BOX_TYPE_TRAF, mp4_write_box_traf},
+   {MP4_BOX_TYPE_TFHD, mp4_write_box_tfhd},
+   {MP4_BOX_TYPE_TFDT, mp4_write_box_tfdt},
+   {MP4_BOX_TYPE_TRUN, mp4_write_box_trun},
    {MP4_BOX_TYPE_UNKNOWN, 0}
 };
 
@@ -231,6 +285,8 @@ static VC_CONTAINER_STATUS_T mp4_write_box_ftyp( VC_CONTAINER_T *p_ctx )
    WRITE_FOURCC(p_ctx, MP4_BRAND_ISOM, "compatible_brands");
    WRITE_FOURCC(p_ctx, MP4_BRAND_MP42, "compatible_brands");
    WRITE_FOURCC(p_ctx, MP4_BRAND_3GP4, "compatible_brands");
+   if(module->fragmented)
+      WRITE_FOURCC(p_ctx, MP4_BRAND_ISO6, "compatible_brands");
 
    return STREAM_STATUS(p_ctx);
 }
@@ -252,6 +308,9 @@ static VC_CONTAINER_STATUS_T mp4_write_box_moov( VC_CONTAINER_T *p_ctx )
       if(status != VC_CONTAINER_SUCCESS) return status;
    }
 
+   if(module->fragmented)
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MVEX);
+
    return status;
 }
 
@@ -572,7 +631,9 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stbl( VC_CONTAINER_T *p_ctx )
    else
       status = mp4_write_box(p_ctx, MP4_BOX_TYPE_CO64);
 
-   if(track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO)
+   /* No stss means all samples are sync samples so we don't write an empty
+    * one in fragmented mode (the sync information is in the trun boxes) */
+   if(track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO && !module->fragmented)
    {
       status = mp4_write_box(p_ctx, MP4_BOX_TYPE_STSS);
       if(status != VC_CONTAINER_SUCCESS) return status;
@@ -651,9 +712,10 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stts( VC_CONTAINER_T *p_ctx )
 
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries, "entry_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragmented)
    {
-      /* We're not actually writing the data, we just want the size */
+      /* We're not actually writing the data, we just want the size
+       * (or the samples will be described by the movie fragments) */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries * 8);
       return STREAM_STATUS(p_ctx);
    }
@@ -710,9 +772,10 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stsc( VC_CONTAINER_T *p_ctx )
    WRITE_U24(p_ctx, 0, "flags");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries, "entry_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragmented)
    {
-      /* We're not actually writing the data, we just want the size */
+      /* We're not actually writing the data, we just want the size
+       * (or the samples will be described by the movie fragments) */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries * 12);
       return STREAM_STATUS(p_ctx);
    }
@@ -777,9 +840,10 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stsz( VC_CONTAINER_T *p_ctx )
    WRITE_U32(p_ctx, 0, "sample_size");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries, "sample_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragmented)
    {
-      /* We're not actually writing the data, we just want the size */
+      /* We're not actually writing the data, we just want the size
+       * (or the samples will be described by the movie fragments) */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries * 4);
       return STREAM_STATUS(p_ctx);
    }
@@ -819,9 +883,10 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stco( VC_CONTAINER_T *p_ctx )
    WRITE_U24(p_ctx, 0, "flags");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries, "entry_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragmented)
    {
-      /* We're not actually writing the data, we just want the size */
+      /* We're not actually writing the data, we just want the size
+       * (or the samples will be described by the movie fragments) */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries * 4);
       return STREAM_STATUS(p_ctx);
    }
@@ -861,9 +926,10 @@ static VC_CONTAINER_STATUS_T mp4_write_box_co64( VC_CONTAINER_T *p_ctx )
    WRITE_U24(p_ctx, 0, "flags");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries, "entry_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragmented)
    {
-      /* We're not actually writing the data, we just want the size */
+      /* We're not actually writing the data, we just want the size
+       * (or the samples will be described by the movie fragments) */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries * 8);
       return STREAM_STATUS(p_ctx);
    }
@@ -886,9 +952,10 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stss( VC_CONTAINER_T *p_ctx )
    WRITE_U24(p_ctx, 0, "flags");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries, "entry_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragmented)
    {
-      /* We're not actually writing the data, we just want the size */
+      /* We're not actually writing the data, we just want the size
+       * (or the samples will be described by the movie fragments) */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries * 4);
       return STREAM_STATUS(p_ctx);
    }
@@ -1138,6 +1205,367 @@ static VC_CONTAINER_STATUS_T mp4_write_box_esds( VC_CONTAINER_T *p_ctx )
    return STREAM_STATUS(p_ctx);
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mvex( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   unsigned int i;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      module->current_track = i;
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TREX);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_trex( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+
+   WRITE_U32(p_ctx, module->current_track + 1, "track_ID");
+   WRITE_U32(p_ctx, 1, "default_sample_description_index");
+   WRITE_U32(p_ctx, 0, "default_sample_duration");
+   WRITE_U32(p_ctx, 0, "default_sample_size");
+   WRITE_U32(p_ctx, 0, "default_sample_flags");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_moof( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   unsigned int i;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MFHD);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      if(!p_ctx->tracks[i]->priv->module->fragment_samples) continue;
+      module->current_track = i;
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TRAF);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mfhd( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U32(p_ctx, module->fragment_sequence, "sequence_number");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_traf( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_STATUS_T status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TFHD);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TFDT);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   return mp4_write_box(p_ctx, MP4_BOX_TYPE_TRUN);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_tfhd( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, MP4_TFHD_FLAG_DEFAULT_BASE_IS_MOOF, "flags");
+   WRITE_U32(p_ctx, module->current_track + 1, "track_ID");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_tfdt( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   int64_t base_dts = 0;
+   unsigned int i;
+
+   /* The decode time of the fragment is the one of its first sample for this track */
+   for(i = 0; i < module->fragment.samples_num; i++)
+   {
+      if(module->fragment.samples[i].track != module->current_track) continue;
+      base_dts = module->fragment.samples[i].dts * MP4_TIMESCALE / 1000000;
+      break;
+   }
+   if(base_dts < 0) base_dts = 0;
+
+   WRITE_U8(p_ctx,  1, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U64(p_ctx, base_dts, "base_media_decode_time");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_trun( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
+   unsigned int i;
+   bool video;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, MP4_TRUN_FLAG_DATA_OFFSET | MP4_TRUN_FLAG_SAMPLE_DURATION |
+      MP4_TRUN_FLAG_SAMPLE_SIZE | MP4_TRUN_FLAG_SAMPLE_FLAGS, "flags");
+   WRITE_U32(p_ctx, track_module->fragment_samples, "sample_count");
+
+   /* Offset is relative to the start of the moof box and the samples for this
+    * track are stored contiguously after the mdat header */
+   WRITE_U32(p_ctx, module->fragment.moof_size + 8 + track_module->fragment_data_offset, "data_offset");
+
+   if(module->null.refcount)
+   {
+      /* We're not actually writing the data, we just want the size */
+      WRITE_BYTES(p_ctx, 0, track_module->fragment_samples * 12);
+      return STREAM_STATUS(p_ctx);
+   }
+
+   /* Only video has non-sync samples, every sample of the other tracks is a sync sample */
+   video = p_ctx->tracks[module->current_track]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO;
+
+   for(i = 0; i < module->fragment.samples_num; i++)
+   {
+      MP4_FRAGMENT_SAMPLE_T *sample = &module->fragment.samples[i];
+      if(sample->track != module->current_track) continue;
+
+      WRITE_U32(p_ctx, sample->duration, "sample_duration");
+      WRITE_U32(p_ctx, sample->size, "sample_size");
+      WRITE_U32(p_ctx, (!video || (sample->flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME)) ?
+         MP4_SAMPLE_FLAGS_SYNC : MP4_SAMPLE_FLAGS_NON_SYNC, "sample_flags");
+   }
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_flush_fragment( VC_CONTAINER_T *p_ctx,
+   const VC_CONTAINER_PACKET_T *next )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   int64_t next_dts[MP4_TRACKS_MAX];
+   MP4_FRAGMENT_SAMPLE_T *last[MP4_TRACKS_MAX];
+   uint32_t data_offset = 0;
+   unsigned int i;
+
+   if(!module->fragment.samples_num) return VC_CONTAINER_SUCCESS;
+
+   /* Work out the sample durations. The last sample of a track gets its duration
+    * from the sample which triggered the flush or from the previous sample. */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      next_dts[i] = -1;
+      last[i] = 0;
+      p_ctx->tracks[i]->priv->module->fragment_samples = 0;
+   }
+   if(next && next->track < p_ctx->tracks_num)
+      next_dts[next->track] = next->dts * MP4_TIMESCALE / 1000000;
+
+   for(i = module->fragment.samples_num; i > 0; i--)
+   {
+      MP4_FRAGMENT_SAMPLE_T *sample = &module->fragment.samples[i-1];
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[sample->track]->priv->module;
+      int64_t dts = sample->dts * MP4_TIMESCALE / 1000000;
+
+      if(next_dts[sample->track] < 0)
+      {
+         /* Use the previous fragment's last duration unless this track has another
+          * sample in this fragment */
+         sample->duration = track_module->fragment_last_duration;
+         last[sample->track] = sample;
+      }
+      else
+      {
+         sample->duration = next_dts[sample->track] > dts ? next_dts[sample->track] - dts : 0;
+         if(last[sample->track]) last[sample->track]->duration = sample->duration;
+         last[sample->track] = 0;
+      }
+      next_dts[sample->track] = dts;
+      track_module->fragment_samples++;
+   }
+
+   /* Samples are grouped by track inside the mdat */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      unsigned int j;
+
+      track_module->fragment_data_offset = data_offset;
+      for(j = 0; j < module->fragment.samples_num; j++)
+      {
+         MP4_FRAGMENT_SAMPLE_T *sample = &module->fragment.samples[j];
+         if(sample->track != i) continue;
+         data_offset += sample->size;
+         track_module->fragment_last_duration = sample->duration;
+      }
+   }
+
+   module->fragment_sequence++;
+
+   /* We need to know the size of the moof to be able to write the data offsets */
+   module->fragment.moof_size = 0;
+   if(!vc_container_writer_extraio_enable(p_ctx, &module->null))
+   {
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOF);
+      module->fragment.moof_size = STREAM_POSITION(p_ctx);
+   }
+   vc_container_writer_extraio_disable(p_ctx, &module->null);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOF);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   WRITE_U32(p_ctx, data_offset + 8, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      unsigned int j;
+
+      if(!p_ctx->tracks[i]->priv->module->fragment_samples) continue;
+      for(j = 0; j < module->fragment.samples_num; j++)
+      {
+         MP4_FRAGMENT_SAMPLE_T *sample = &module->fragment.samples[j];
+         if(sample->track != i) continue;
+         WRITE_BYTES(p_ctx, module->fragment.data + sample->offset, sample->size);
+      }
+   }
+   p_ctx->size += module->fragment.moof_size + 8;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+      p_ctx->tracks[i]->priv->module->fragment_samples = 0;
+   module->fragment.samples_num = 0;
+   module->fragment.size = 0;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static bool mp4_writer_fragment_is_full( VC_CONTAINER_T *p_ctx,
+   const VC_CONTAINER_PACKET_T *packet )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_T *track = p_ctx->tracks[packet->track];
+
+   if(!module->fragment.samples_num)
+      return false;
+   if(module->fragment.size + packet->size > module->fragment_size_max)
+      return true;
+   if(!module->fragment_duration ||
+      packet->pts - module->fragment.start_dts < module->fragment_duration)
+      return false;
+
+   /* Only start new fragments on random access points */
+   if(!module->has_video)
+      return true;
+   return track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO &&
+      (packet->flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_write_fragmented( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_PACKET_T *packet )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   MP4_FRAGMENT_SAMPLE_T *sample;
+
+   if(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START)
+   {
+      VC_CONTAINER_PACKET_T next = *packet;
+      next.dts = packet->pts; /* Same convention as the non-fragmented mode */
+
+      if(mp4_writer_fragment_is_full(p_ctx, packet))
+      {
+         status = mp4_writer_flush_fragment(p_ctx, &next);
+         if(status != VC_CONTAINER_SUCCESS) return status;
+      }
+
+      if(module->fragment.samples_num >= module->fragment.samples_max)
+      {
+         unsigned int samples_max = module->fragment.samples_max * 2;
+         MP4_FRAGMENT_SAMPLE_T *samples;
+         if(!samples_max) samples_max = MP4_FRAGMENT_SAMPLES_MIN;
+         samples = realloc(module->fragment.samples, samples_max * sizeof(*samples));
+         if(!samples) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+         module->fragment.samples = samples;
+         module->fragment.samples_max = samples_max;
+      }
+
+      if(!module->fragment.samples_num)
+         module->fragment.start_dts = packet->pts;
+
+      sample = &module->fragment.samples[module->fragment.samples_num];
+      sample->track = packet->track;
+      sample->flags = packet->flags;
+      sample->offset = module->fragment.size;
+      sample->size = 0;
+      sample->duration = 0;
+      sample->dts = packet->pts;
+      module->fragment.open = true;
+   }
+
+   if(!module->fragment.open)
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+   sample = &module->fragment.samples[module->fragment.samples_num];
+   sample->flags |= packet->flags;
+
+   /* Append the data to the fragment buffer */
+   if(module->fragment.size + packet->size > module->fragment.buffer_size)
+   {
+      unsigned int buffer_size = module->fragment.size + packet->size;
+      uint8_t *data;
+      if(buffer_size < module->fragment_size_max) buffer_size = module->fragment_size_max;
+      data = realloc(module->fragment.data, buffer_size);
+      if(!data) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      module->fragment.data = data;
+      module->fragment.buffer_size = buffer_size;
+   }
+   memcpy(module->fragment.data + module->fragment.size, packet->data, packet->size);
+   module->fragment.size += packet->size;
+   sample->size += packet->size;
+   p_ctx->size += packet->size;
+
+   if(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_END)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[sample->track]->priv->module;
+      track_module->last_pts = sample->dts;
+      if(!track_module->samples) track_module->first_pts = sample->dts;
+      track_module->samples++;
+      module->fragment.samples_num++;
+      module->fragment.open = false;
+   }
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_add_track_done( VC_CONTAINER_T *p_ctx );
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_writer_close( VC_CONTAINER_T *p_ctx )
 {
@@ -1145,20 +1573,33 @@ static VC_CONTAINER_STATUS_T mp4_writer_close( VC_CONTAINER_T *p_ctx )
    VC_CONTAINER_STATUS_T status;
    int64_t mdat_size;
 
-   mdat_size = STREAM_POSITION(p_ctx) - module->mdat_offset;
+   if(module->fragmented)
+   {
+      /* Write the init segment if no data was ever written, then whatever is
+       * left of the last fragment. We never need to seek back. */
+      status = mp4_writer_add_track_done(p_ctx);
+      if(status == VC_CONTAINER_SUCCESS)
+         status = mp4_writer_flush_fragment(p_ctx, 0);
+   }
+   else
+   {
+      mdat_size = STREAM_POSITION(p_ctx) - module->mdat_offset;
 
-   /* Write the moov box */
-   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+      /* Write the moov box */
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
 
-   /* Finalise the mdat box */
-   SEEK(p_ctx, module->mdat_offset);
-   WRITE_U32(p_ctx, (uint32_t)mdat_size, "mdat size" );
+      /* Finalise the mdat box */
+      SEEK(p_ctx, module->mdat_offset);
+      WRITE_U32(p_ctx, (uint32_t)mdat_size, "mdat size" );
+   }
 
    for(; p_ctx->tracks_num > 0; p_ctx->tracks_num--)
       vc_container_free_track(p_ctx, p_ctx->tracks[p_ctx->tracks_num-1]);
 
-   vc_container_writer_extraio_delete(p_ctx, &module->temp);
+   if(module->temp.io) vc_container_writer_extraio_delete(p_ctx, &module->temp);
    vc_container_writer_extraio_delete(p_ctx, &module->null);
+   free(module->fragment.samples);
+   free(module->fragment.data);
    free(module);
 
    return status;
@@ -1236,8 +1677,22 @@ static VC_CONTAINER_STATUS_T mp4_writer_add_track_done( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   unsigned int i;
    if(module->tracks_add_done) return status;
 
+   if(module->fragmented)
+   {
+      /* The moov box is written straight away and forms the init segment */
+      for(i = 0; i < p_ctx->tracks_num; i++)
+         if(p_ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO)
+            module->has_video = true;
+
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+      p_ctx->size = STREAM_POSITION(p_ctx);
+      if(status == VC_CONTAINER_SUCCESS) module->tracks_add_done = true;
+      return status;
+   }
+
    /* We need to find out the size of the object we're going to write it. */
    if(!vc_container_writer_extraio_enable(p_ctx, &module->null))
    {
@@ -1332,6 +1787,9 @@ static VC_CONTAINER_STATUS_T mp4_writer_write( VC_CONTAINER_T *p_ctx,
       if(status != VC_CONTAINER_SUCCESS) return status;
    }
 
+   if(module->fragmented)
+      return mp4_writer_write_fragmented(p_ctx, packet);
+
    if(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START)
       ++module->samples; /* Switching to a new sample */
 
@@ -1372,6 +1830,7 @@ VC_CONTAINER_STATUS_T mp4_writer_open( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
    const char *extension = vc_uri_path_extension(p_ctx->priv->uri);
+   const char *fragment = 0, *fragment_size = 0;
    VC_CONTAINER_MODULE_T *module = 0;
    MP4_BRAND_T brand;
 
@@ -1400,22 +1859,45 @@ VC_CONTAINER_STATUS_T mp4_writer_open( VC_CONTAINER_T *p_ctx )
    else brand = MP4_BRAND_ISOM;
    module->brand = brand;
 
+   /* Check if the user wants a fragmented file. The fragment duration is given
+    * in milliseconds and the maximum size of a fragment in bytes. */
+   vc_uri_find_query(p_ctx->priv->uri, 0, "fragment", &fragment);
+   vc_uri_find_query(p_ctx->priv->uri, 0, "fragment_size", &fragment_size);
+   if(fragment || fragment_size)
+   {
+      module->fragmented = true;
+      module->fragment_size_max = MP4_FRAGMENT_SIZE_MAX;
+      if(fragment) module->fragment_duration = INT64_C(1000) * strtoul(fragment, 0, 0);
+      if(fragment_size && strtoul(fragment_size, 0, 0))
+         module->fragment_size_max = strtoul(fragment_size, 0, 0);
+      LOG_DEBUG(p_ctx, "fragmented mode (%"PRIi64"us / %u bytes)",
+         module->fragment_duration, module->fragment_size_max);
+   }
+
    /* Create a null i/o writer to help us out in writing our data */
    status = vc_container_writer_extraio_create_null(p_ctx, &module->null);
    if(status != VC_CONTAINER_SUCCESS) goto error;
 
-   /* Create a temporary i/o writer to help us out in writing our data */
-   status = vc_container_writer_extraio_create_temp(p_ctx, &module->temp);
-   if(status != VC_CONTAINER_SUCCESS) goto error;
+   /* Create a temporary i/o writer to help us out in writing our data.
+    * In fragmented mode the samples are described in the movie fragments
+    * so we don't need it. */
+   if(!module->fragmented)
+   {
+      status = vc_container_writer_extraio_create_temp(p_ctx, &module->temp);
+      if(status != VC_CONTAINER_SUCCESS) goto error;
+   }
 
    status = mp4_write_box(p_ctx, MP4_BOX_TYPE_FTYP);
    if(status != VC_CONTAINER_SUCCESS) goto error;
 
    /* Start the mdat box */
-   module->mdat_offset = STREAM_POSITION(p_ctx);
-   WRITE_U32(p_ctx, 0, "size");
-   WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
-   module->data_offset = STREAM_POSITION(p_ctx);
+   if(!module->fragmented)
+   {
+      module->mdat_offset = STREAM_POSITION(p_ctx);
+      WRITE_U32(p_ctx, 0, "size");
+      WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+      module->data_offset = STREAM_POSITION(p_ctx);
+   }
 
    p_ctx->priv->pf_close = mp4_writer_close;
    p_ctx->priv->pf_write = mp4_writer_write;
@@ -1427,6 +1909,7 @@ VC_CONTAINER_STATUS_T mp4_writer_open( VC_CONTAINER_T *p_ctx )
    if(module)
    {
       if(module->null.io) vc_container_writer_extraio_delete(p_ctx, &module->null);
+      if(module->temp.io) vc_container_writer_extraio_delete(p_ctx, &module->temp);
       free(module);
    }
    return status;
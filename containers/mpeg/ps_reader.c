@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "containers/core/containers_io_helpers.h"
 #include "containers/core/containers_utils.h"
 #include "containers/core/containers_logging.h"
+#include "containers/core/containers_index.h"
 #undef CONTAINER_HELPER_LOG_INDENT
 #define CONTAINER_HELPER_LOG_INDENT(a) (2*(a)->priv->module->level)
 
@@ -52,6 +53,15 @@ Defines.
     at open time or when resyncing. */
 #define PS_PACK_SCAN_MAX 128
 
+/** Number of entries in the time index. Entries are thinned out by the index
+    itself once it fills up. */
+#define PS_INDEX_SIZE 512
+
+/** Maximum number of probes made when narrowing down a seek position, and
+    the size of the byte range at which we stop probing. */
+#define PS_SEEK_PROBES_MAX 12
+#define PS_SEEK_WINDOW_MIN (16*1024)
+
 /******************************************************************************
 Type definitions.
 ******************************************************************************/
@@ -104,6 +114,11 @@ typedef struct VC_CONTAINER_MODULE_T
 
    /** Offset to the most recent pack start code we've seen */
    uint64_t pack_offset;
+
+   /** Sparse index of system_clock_reference (in microseconds from scr_offset)
+       to pack offsets. Filled in while probing at open time, while seeking and
+       while reading, and used to narrow down seek positions. */
+   VC_CONTAINER_INDEX_T *index;
    
    /** Program stream mux rate is often incorrect or fixed to 25200 (10.08 
        Mbit/s) which yields inaccurate duration estimate for most files. We
@@ -331,6 +346,11 @@ static VC_CONTAINER_STATUS_T ps_read_pack_header( VC_CONTAINER_T *ctx )
    module->scr = scr;
    module->mux_rate = mux_rate;
 
+   /* Record this pack in our index (entries which don't extend the
+      time covered by the index are ignored) */
+   if (module->index && scr >= module->scr_offset)
+      vc_container_index_add(module->index, (scr - module->scr_offset) / INT64_C(27), pack_offset);
+
    /* Check for a system header */
    if(PEEK_U32(ctx) == 0x1BB)
       return ps_read_system_header(ctx);
@@ -977,6 +997,121 @@ STATIC_INLINE VC_CONTAINER_STATUS_T ps_find_pes_packet( VC_CONTAINER_T *ctx )
    return status;
 }
 
+/*****************************************************************************/
+/** Find the first pack header at or after the given position and return its
+    offset and its system_clock_reference (in microseconds from scr_offset) */
+static VC_CONTAINER_STATUS_T ps_probe_pack( VC_CONTAINER_T *ctx, uint64_t position,
+   int64_t *p_time, uint64_t *p_pack_offset )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   uint8_t buffer[4];
+   unsigned int i;
+
+   SEEK(ctx, position);
+
+   for (i = 0; i != PS_PACK_SCAN_MAX; ++i)
+   {
+      if((status = ps_find_start_code(ctx, buffer)) != VC_CONTAINER_SUCCESS)
+         return status;
+
+      if (buffer[3] == 0xBA)
+      {
+         *p_pack_offset = STREAM_POSITION(ctx);
+
+         /* Make sure the probe doesn't disturb the timestamp bias */
+         module->scr = module->scr_offset;
+         if (ps_read_pack_header(ctx) == VC_CONTAINER_SUCCESS)
+         {
+            *p_time = (module->scr - module->scr_offset) / INT64_C(27);
+            return VC_CONTAINER_SUCCESS;
+         }
+      }
+      else
+      {
+         /* Skip PES packet */
+         unsigned length;
+         SKIP_U32(ctx, "PES packet startcode");
+         length = READ_U16(ctx, "PES packet length");
+         SKIP_BYTES(ctx, length);
+      }
+   }
+
+   return VC_CONTAINER_ERROR_NOT_FOUND;
+}
+
+/*****************************************************************************/
+/** Find the offset of a pack with a system_clock_reference at or just before
+    the given time. We start from the closest entries in our index and narrow
+    the range down by probing the stream. */
+static uint64_t ps_find_position( VC_CONTAINER_T *ctx, int64_t time )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   int64_t low_time = 0, high_time = ctx->duration, entry_time, probe_time, offset;
+   uint64_t low = module->data_offset, high = module->data_offset + module->data_size;
+   uint64_t position, probe_offset;
+   unsigned int i, repeats = 0;
+   int past, side, last_side = 0;
+
+   if (module->index)
+   {
+      entry_time = time;
+      if (vc_container_index_get(module->index, 0, &entry_time, &offset, &past) == VC_CONTAINER_SUCCESS &&
+          entry_time <= time)
+      {
+         low_time = entry_time;
+         low = offset;
+      }
+      entry_time = time;
+      if (vc_container_index_get(module->index, 1, &entry_time, &offset, &past) == VC_CONTAINER_SUCCESS &&
+          !past && entry_time > time)
+      {
+         high_time = entry_time;
+         high = offset;
+      }
+   }
+
+   for (i = 0; i < PS_SEEK_PROBES_MAX && high > low + PS_SEEK_WINDOW_MIN; i++)
+   {
+      /* Interpolate between the bounds but always discard at least an eighth
+         of the range. Fall back to bisection when interpolation keeps
+         landing on the same side of the target, which happens when the
+         data rate changes a lot within the range. */
+      position = low + (high - low) / 2;
+      if (high_time > low_time && repeats < 2)
+         position = low + (uint64_t)((time - low_time) * (double)(high - low) / (high_time - low_time));
+      position = MAX(position, low + (high - low) / 8);
+      position = MIN(position, high - (high - low) / 8);
+
+      if (ps_probe_pack(ctx, position, &probe_time, &probe_offset) != VC_CONTAINER_SUCCESS ||
+          probe_offset >= high)
+      {
+         /* Nothing usable in the upper part of the range */
+         high = position;
+         continue;
+      }
+
+      LOG_DEBUG(ctx, "seek probe %"PRIu64": %"PRId64"us (target %"PRId64"us)",
+         probe_offset, probe_time, time);
+
+      side = probe_time <= time ? -1 : 1;
+      if (side < 0)
+      {
+         low = probe_offset;
+         low_time = probe_time;
+      }
+      else
+      {
+         high = probe_offset;
+         high_time = probe_time;
+      }
+      repeats = side == last_side ? repeats + 1 : 0;
+      last_side = side;
+   }
+
+   return low;
+}
+
 /*****************************************************************************
 Functions exported as part of the Container Module API
 *****************************************************************************/
@@ -1060,6 +1195,7 @@ static VC_CONTAINER_STATUS_T ps_reader_seek( VC_CONTAINER_T *ctx,
    VC_CONTAINER_MODULE_T *module = ctx->priv->module;
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    uint64_t seekpos, position;
+   unsigned int i;
    int64_t scr;
    
    VC_CONTAINER_PARAM_UNUSED(flags);
@@ -1077,16 +1213,27 @@ static VC_CONTAINER_STATUS_T ps_reader_seek( VC_CONTAINER_T *ctx,
       if (!ctx->duration)
          return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
 
-      /* The following is an estimate that might be quite inaccurate */
-      seekpos = module->data_offset + (*p_offset * module->data_size) / ctx->duration;
+      seekpos = ps_find_position(ctx, *p_offset);
    }
 
    SEEK(ctx, seekpos);
    module->scr = module->scr_offset;
+   if (module->scr_bias == VC_CONTAINER_TIME_UNKNOWN)
+      module->scr_bias = -module->scr_offset;
    status = ps_find_pes_packet(ctx);
    if (status && status != VC_CONTAINER_ERROR_EOS)
       goto error;
 
+   /* We most likely landed in the middle of a frame so skip ahead to the
+      next PES packet which carries a timestamp */
+   for (i = 0; !status && module->packet_pts == VC_CONTAINER_TIME_UNKNOWN && i < PS_PACK_SCAN_MAX; i++)
+   {
+      SKIP_BYTES(ctx, module->packet_data_size);
+      status = ps_find_pes_packet(ctx);
+   }
+   if (status && status != VC_CONTAINER_ERROR_EOS)
+      goto error;
+
    module->packet_data_left = module->packet_data_size;
 
    if (module->packet_pts != VC_CONTAINER_TIME_UNKNOWN)
@@ -1102,6 +1249,23 @@ error:
    return status;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T ps_reader_control( VC_CONTAINER_T *ctx,
+   VC_CONTAINER_CONTROL_T operation, va_list args )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+
+   switch(operation)
+   {
+   case VC_CONTAINER_CONTROL_SET_INDEX_CACHE:
+      if (!module->index)
+         return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+      return vc_container_index_cache(ctx, &module->index, PS_INDEX_SIZE,
+         VC_FOURCC('p','s',' ',' '), va_arg(args, const char *));
+   default: return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   }
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T ps_reader_close( VC_CONTAINER_T *ctx )
 {
@@ -1110,6 +1274,8 @@ static VC_CONTAINER_STATUS_T ps_reader_close( VC_CONTAINER_T *ctx )
 
    for(i = 0; i < ctx->tracks_num; i++)
       vc_container_free_track(ctx, ctx->tracks[i]);
+   if(module->index)
+      vc_container_index_free(module->index);
    free(module);
    return VC_CONTAINER_SUCCESS;
 }
@@ -1120,6 +1286,7 @@ VC_CONTAINER_STATUS_T ps_reader_open( VC_CONTAINER_T *ctx )
    const char *extension = vc_uri_path_extension(ctx->priv->uri);
    VC_CONTAINER_MODULE_T *module = 0;
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+   const char *cache = 0;
    uint8_t buffer[4];
    unsigned int i;
 
@@ -1155,6 +1322,15 @@ VC_CONTAINER_STATUS_T ps_reader_open( VC_CONTAINER_T *ctx )
       packet */
    module->data_offset = STREAM_POSITION(ctx);
 
+   /* The index is only an optimisation for seeking so we carry on without it */
+   if(STREAM_SEEKABLE(ctx) &&
+      vc_container_index_create(&module->index, PS_INDEX_SIZE) != VC_CONTAINER_SUCCESS)
+      module->index = 0;
+
+   /* Reuse the index built by a previous session if requested */
+   if(module->index && vc_uri_find_query(ctx->priv->uri, 0, "index_cache", &cache))
+      vc_container_index_cache(ctx, &module->index, PS_INDEX_SIZE, VC_FOURCC('p','s',' ',' '), cache);
+
    /* Search for tracks, reset time reference and calculation state first */
    ctx->priv->module->scr_offset = ctx->priv->module->scr = VC_CONTAINER_TIME_UNKNOWN;
    ctx->priv->module->searching_tracks = true;
@@ -1191,7 +1367,8 @@ resync:
    /* Estimate data rate (necessary for seeking) */
    if(STREAM_SEEKABLE(ctx))
    {
-      /* Estimate data rate by jumping in the stream */
+      /* Estimate data rate by jumping in the stream. The packs we find on the
+         way also seed the seek index. */
       #define PS_PACK_SEARCH_MAX 64
       uint64_t position = module->data_offset;
       for (i = 0; i != PS_PACK_SEARCH_MAX; ++i)
@@ -1250,6 +1427,7 @@ resync:
    ctx->priv->pf_close = ps_reader_close;
    ctx->priv->pf_read = ps_reader_read;
    ctx->priv->pf_seek = ps_reader_seek;
+   ctx->priv->pf_control = ps_reader_control;
 
    return STREAM_STATUS(ctx);
 
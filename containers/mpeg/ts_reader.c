@@ -0,0 +1,1218 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#define CONTAINER_IS_BIG_ENDIAN
+//#define ENABLE_CONTAINERS_LOG_FORMAT
+//#define ENABLE_CONTAINERS_LOG_FORMAT_VERBOSE
+#include "containers/core/containers_private.h"
+#include "containers/core/containers_io_helpers.h"
+#include "containers/core/containers_utils.h"
+#include "containers/core/containers_logging.h"
+
+/******************************************************************************
+Defines.
+******************************************************************************/
+#define TS_TRACKS_MAX 8
+
+#define TS_SYNC_BYTE 0x47
+#define TS_PACKET_SIZE 188      /**< Size of a transport packet proper */
+#define TS_PACKET_SIZE_MAX 204  /**< Largest packet stride we support (with RS parity bytes) */
+
+/** Number of packets we pull from the io layer in one go. Demuxing then runs
+    over the whole block in memory. */
+#define TS_BLOCK_PACKETS 64
+
+/** Number of consecutive sync bytes needed to (re)acquire sync */
+#define TS_SYNC_PACKETS 5
+
+/** Maximum number of bytes scanned when trying to reacquire sync */
+#define TS_SYNC_FAIL_MAX (1024*1024)
+
+/** Maximum number of transport packets scanned for PAT, PMT and PCR at open time.
+    PSI tables are supposed to be repeated at least every 100ms so this
+    should be plenty. */
+#define TS_SCAN_PACKETS_MAX 32768
+
+#define TS_SECTION_SIZE_MAX 1024          /**< Maximum size of a PSI section */
+#define TS_PES_SIZE_DEFAULT (16*1024)     /**< Initial size of a PES reassembly buffer */
+#define TS_PES_SIZE_MAX (8*1024*1024)     /**< Maximum size of a PES packet we reassemble */
+
+#define TS_PID_PAT  0x0000
+#define TS_PID_NULL 0x1FFF
+
+#define TS_PCR_WRAP (INT64_C(300) << 33)          /**< PCR wraparound in 27MHz ticks */
+#define TS_PCR_JUMP_MAX (INT64_C(27000000) * 10)  /**< PCR jump that we treat as a discontinuity */
+
+/** Amount of data we scan from the end of the stream to find the last PCR (doubled
+    at each attempt until TS_DURATION_SCAN_MAX is reached) */
+#define TS_DURATION_SCAN_MIN (TS_BLOCK_PACKETS * TS_PACKET_SIZE * 4)
+#define TS_DURATION_SCAN_MAX (8*1024*1024)
+
+#define TS_SEEK_ITERATIONS_MAX 16
+#define TS_SEEK_ATTEMPTS_MAX 4
+#define TS_SEEK_SCAN_MAX (1024*1024)             /**< Bytes scanned for a PCR at each seek iteration */
+#define TS_SEEK_PRECISION (INT64_C(27000) * 250)  /**< Seek precision we aim for (250ms in 27MHz ticks) */
+
+/******************************************************************************
+Type definitions.
+******************************************************************************/
+typedef struct TS_SECTION_T
+{
+   uint8_t data[TS_SECTION_SIZE_MAX];
+   unsigned int size;   /**< Number of bytes of the section assembled so far */
+   bool started;        /**< We have seen the start of the section */
+
+} TS_SECTION_T;
+
+typedef struct VC_CONTAINER_TRACK_MODULE_T
+{
+   /** PID and stream_type of the elementary stream */
+   unsigned int pid;
+   unsigned int stream_type;
+
+   /** Last continuity_counter we've seen (-1 if unknown) */
+   int continuity_counter;
+
+   /** PES packet reassembly state */
+   uint8_t *pes;
+   unsigned int pes_size;
+   unsigned int pes_max;
+   unsigned int pes_expected;  /**< Payload size given by PES_packet_length (0 if unbounded) */
+   bool pes_started;
+   int64_t pes_pts;            /**< Presentation timestamp of the PES packet (in microseconds) */
+   int64_t pes_dts;            /**< Decoding timestamp of the PES packet (in microseconds) */
+   uint32_t pes_flags;
+
+   /** Stream signals random access points with the random_access_indicator */
+   bool random_access;
+
+   /** Drop PES packets until the next random access point (after a seek) */
+   bool wait_random_access;
+
+   /** Data was lost before the current PES packet */
+   bool discontinuity;
+
+} VC_CONTAINER_TRACK_MODULE_T;
+
+typedef struct VC_CONTAINER_MODULE_T
+{
+   /** Track data */
+   VC_CONTAINER_TRACK_T *tracks[TS_TRACKS_MAX];
+
+   /** State flag denoting whether or not we are searching
+       for tracks (at open time) */
+   bool searching_tracks;
+
+   /** Packet stride (188, 192 or 204 bytes) */
+   unsigned int packet_size;
+
+   /** Offset to the first sync byte and size of the transport stream data */
+   uint64_t data_offset;
+   uint64_t data_size;
+
+   /** Block of transport packets read from the stream */
+   uint8_t block[TS_BLOCK_PACKETS * TS_PACKET_SIZE_MAX];
+   unsigned int block_size;  /**< Number of valid bytes in the block */
+   unsigned int block_pos;   /**< Offset of the next packet in the block */
+   uint64_t block_offset;    /**< Stream offset of the start of the block */
+
+   /** PSI state */
+   unsigned int program_number; /**< Program we are demuxing (0 for the first one) */
+   unsigned int pmt_pid;
+   unsigned int pcr_pid;
+   TS_SECTION_T pat;
+   TS_SECTION_T pmt;
+   bool pmt_found;
+
+   /** First program_clock_reference value we've seen (in 27MHz ticks) */
+   int64_t pcr_first;
+
+   /** Most recent program_clock_reference value we've seen (in 27MHz ticks) */
+   int64_t pcr;
+
+   /** Offset we add to the clock to make it zero based and continuous across
+       wraparounds and discontinuities */
+   int64_t pcr_bias;
+
+   /** Track which has a complete PES packet waiting to be handed out */
+   int pes_pending;
+
+   /** Complete PES packet being read out */
+   uint8_t *packet_data;
+   unsigned int packet_max;
+   unsigned int packet_data_size;
+   unsigned int packet_data_left;
+   int64_t packet_pts;
+   int64_t packet_dts;
+   uint32_t packet_flags;
+   int packet_track;
+
+} VC_CONTAINER_MODULE_T;
+
+/******************************************************************************
+Function prototypes
+******************************************************************************/
+
+VC_CONTAINER_STATUS_T ts_reader_open( VC_CONTAINER_T * );
+
+/******************************************************************************
+Local Functions
+******************************************************************************/
+
+/** Count the number of consecutive sync bytes found at the given stride */
+static unsigned int ts_sync_count( const uint8_t *data, unsigned int size,
+   unsigned int packet_size )
+{
+   unsigned int i;
+
+   for (i = 0; i < TS_SYNC_PACKETS && i * packet_size < size; i++)
+      if (data[i * packet_size] != TS_SYNC_BYTE) break;
+
+   return i;
+}
+
+/*****************************************************************************/
+static uint32_t ts_crc32( const uint8_t *data, unsigned int size )
+{
+   uint32_t crc = 0xFFFFFFFF;
+   unsigned int i;
+
+   while (size--)
+   {
+      crc ^= (uint32_t)*data++ << 24;
+      for (i = 0; i < 8; i++)
+         crc = (crc << 1) ^ (crc & 0x80000000 ? 0x04C11DB7 : 0);
+   }
+
+   return crc;
+}
+
+/*****************************************************************************/
+static int64_t ts_read_timestamp( const uint8_t *data )
+{
+   return ((int64_t)(data[0] & 0x0E) << 29) | (data[1] << 22) |
+      ((data[2] & 0xFE) << 14) | (data[3] << 7) | (data[4] >> 1);
+}
+
+/** Distance from b to a on the (wrapping) 27MHz clock */
+static int64_t ts_pcr_delta( int64_t a, int64_t b )
+{
+   int64_t delta = (a - b) % TS_PCR_WRAP;
+   return delta < 0 ? delta + TS_PCR_WRAP : delta;
+}
+
+/*****************************************************************************/
+static void ts_update_pcr( VC_CONTAINER_T *ctx, int64_t pcr, bool discontinuity )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+
+   if (module->pcr_first == VC_CONTAINER_TIME_UNKNOWN)
+      module->pcr_first = pcr;
+
+   if (module->pcr == VC_CONTAINER_TIME_UNKNOWN)
+   {
+      /* Timeline is relative to the first program_clock_reference of the stream */
+      module->pcr_bias = ts_pcr_delta(pcr, module->pcr_first) - pcr;
+   }
+   else if (discontinuity || ts_pcr_delta(pcr, module->pcr) > TS_PCR_JUMP_MAX)
+   {
+      /* Carry on from where we were */
+      LOG_DEBUG(ctx, "pcr discontinuity (%"PRId64" -> %"PRId64")", module->pcr, pcr);
+      module->pcr_bias += module->pcr - pcr;
+   }
+   else if (pcr < module->pcr)
+   {
+      /* Wraparound */
+      module->pcr_bias += TS_PCR_WRAP;
+   }
+
+   module->pcr = pcr;
+}
+
+/*****************************************************************************/
+static int64_t ts_pes_time_to_us( VC_CONTAINER_T *ctx, int64_t time )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   int64_t delta;
+
+   /* Need to wait for program_clock_reference first */
+   if (time == VC_CONTAINER_TIME_UNKNOWN || module->pcr == VC_CONTAINER_TIME_UNKNOWN)
+      return VC_CONTAINER_TIME_UNKNOWN;
+
+   /* 90kHz (PES) clock --> 27MHz system clock, relative to the most recent
+      program_clock_reference to deal with wraparounds */
+   delta = INT64_C(300) * time - module->pcr;
+   if (delta > TS_PCR_WRAP / 2) delta -= TS_PCR_WRAP;
+   else if (delta < -TS_PCR_WRAP / 2) delta += TS_PCR_WRAP;
+
+   return (module->pcr + module->pcr_bias + delta) / INT64_C(27);
+}
+
+/*****************************************************************************/
+static void ts_reset_block( VC_CONTAINER_T *ctx, uint64_t offset )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+
+   SEEK(ctx, offset);
+   module->block_offset = offset;
+   module->block_size = module->block_pos = 0;
+}
+
+/** Make sure we have at least size bytes available in the block, pulling
+    the next block of packets from the io layer if necessary */
+static VC_CONTAINER_STATUS_T ts_fill_block( VC_CONTAINER_T *ctx, unsigned int size )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   unsigned int left = module->block_size - module->block_pos;
+
+   if (left >= size)
+      return VC_CONTAINER_SUCCESS;
+
+   memmove(module->block, module->block + module->block_pos, left);
+   module->block_offset += module->block_pos;
+   module->block_pos = 0;
+   module->block_size = left + READ_BYTES(ctx, module->block + left, sizeof(module->block) - left);
+
+   if (module->block_size >= size)
+      return VC_CONTAINER_SUCCESS;
+   return STREAM_ERROR(ctx) ? STREAM_STATUS(ctx) : VC_CONTAINER_ERROR_EOS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T ts_resync( VC_CONTAINER_T *ctx )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   unsigned int packet_size = module->packet_size;
+   unsigned int scanned = 0, size, i, count;
+   VC_CONTAINER_STATUS_T status;
+   uint8_t *data;
+
+   while (scanned < TS_SYNC_FAIL_MAX)
+   {
+      status = ts_fill_block(ctx, TS_SYNC_PACKETS * packet_size);
+      if (status != VC_CONTAINER_SUCCESS && status != VC_CONTAINER_ERROR_EOS)
+         return status;
+
+      data = module->block + module->block_pos;
+      size = module->block_size - module->block_pos;
+
+      for (i = 0; i < size; i++)
+      {
+         /* Make sure we can check enough packets, unless we're at the end of the stream */
+         if (status == VC_CONTAINER_SUCCESS && size - i < TS_SYNC_PACKETS * packet_size)
+            break;
+         if (data[i] != TS_SYNC_BYTE)
+            continue;
+
+         count = ts_sync_count(data + i, size - i, packet_size);
+         if (count == TS_SYNC_PACKETS || i + count * packet_size >= size)
+         {
+            module->block_pos += i;
+            return VC_CONTAINER_SUCCESS;
+         }
+      }
+
+      if (status != VC_CONTAINER_SUCCESS)
+         return status;
+
+      module->block_pos += i;
+      scanned += i;
+   }
+
+   return VC_CONTAINER_ERROR_CORRUPTED;
+}
+
+/** Get a pointer to the next transport packet in the block */
+static VC_CONTAINER_STATUS_T ts_read_packet( VC_CONTAINER_T *ctx, const uint8_t **p_packet,
+   bool *p_resync )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+
+   /* The trailing bytes of the last packet of the stream (e.g. RS parity) might be missing */
+   status = ts_fill_block(ctx, TS_PACKET_SIZE);
+   if (status != VC_CONTAINER_SUCCESS)
+      return status;
+
+   if (module->block[module->block_pos] != TS_SYNC_BYTE)
+   {
+      LOG_DEBUG(ctx, "lost sync at offset %"PRIu64, module->block_offset + module->block_pos);
+      if ((status = ts_resync(ctx)) != VC_CONTAINER_SUCCESS)
+         return status;
+      if ((status = ts_fill_block(ctx, TS_PACKET_SIZE)) != VC_CONTAINER_SUCCESS)
+         return status;
+      if (p_resync) *p_resync = true;
+   }
+
+   *p_packet = module->block + module->block_pos;
+   module->block_pos += MIN(module->packet_size, module->block_size - module->block_pos);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_TRACK_T *ts_find_track( VC_CONTAINER_T *ctx, unsigned int pid )
+{
+   unsigned int i;
+
+   for (i = 0; i < ctx->tracks_num; i++)
+      if (ctx->tracks[i]->priv->module->pid == pid)
+         return ctx->tracks[i];
+
+   return 0;
+}
+
+/*****************************************************************************/
+static void ts_get_stream_coding( VC_CONTAINER_T *ctx, unsigned int stream_type,
+   const uint8_t *descriptors, unsigned int size,
+   VC_CONTAINER_ES_TYPE_T *p_type, VC_CONTAINER_FOURCC_T *p_codec )
+{
+   VC_CONTAINER_ES_TYPE_T type = VC_CONTAINER_ES_TYPE_UNKNOWN;
+   VC_CONTAINER_FOURCC_T codec = VC_CONTAINER_CODEC_UNKNOWN;
+
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+
+   switch (stream_type)
+   {
+   case 0x01: type = VC_CONTAINER_ES_TYPE_VIDEO; codec = VC_CONTAINER_CODEC_MP1V; break;
+   case 0x02: type = VC_CONTAINER_ES_TYPE_VIDEO; codec = VC_CONTAINER_CODEC_MP2V; break;
+   case 0x10: type = VC_CONTAINER_ES_TYPE_VIDEO; codec = VC_CONTAINER_CODEC_MP4V; break;
+   case 0x1B: type = VC_CONTAINER_ES_TYPE_VIDEO; codec = VC_CONTAINER_CODEC_H264; break;
+   case 0xEA: type = VC_CONTAINER_ES_TYPE_VIDEO; codec = VC_CONTAINER_CODEC_WVC1; break;
+   case 0x03:
+   case 0x04: type = VC_CONTAINER_ES_TYPE_AUDIO; codec = VC_CONTAINER_CODEC_MPGA; break;
+   case 0x0F: type = VC_CONTAINER_ES_TYPE_AUDIO; codec = VC_CONTAINER_CODEC_MP4A; break;
+   case 0x81: type = VC_CONTAINER_ES_TYPE_AUDIO; codec = VC_CONTAINER_CODEC_AC3; break;
+   case 0x87: type = VC_CONTAINER_ES_TYPE_AUDIO; codec = VC_CONTAINER_CODEC_EAC3; break;
+   case 0x06:
+      /* PES private data, the coding is signalled with a descriptor (DVB) */
+      while (size >= 2 && size >= 2u + descriptors[1])
+      {
+         if (descriptors[0] == 0x6A) /* AC-3_descriptor */
+         { type = VC_CONTAINER_ES_TYPE_AUDIO; codec = VC_CONTAINER_CODEC_AC3; break; }
+         if (descriptors[0] == 0x7A) /* enhanced_AC-3_descriptor */
+         { type = VC_CONTAINER_ES_TYPE_AUDIO; codec = VC_CONTAINER_CODEC_EAC3; break; }
+         size -= 2 + descriptors[1];
+         descriptors += 2 + descriptors[1];
+      }
+      break;
+   default: break;
+   }
+
+   *p_type = type;
+   *p_codec = codec;
+}
+
+/** Assemble a PSI section. Returns true once a complete section is available. */
+static bool ts_section_append( TS_SECTION_T *section, bool unit_start,
+   const uint8_t *data, unsigned int size )
+{
+   unsigned int length;
+
+   if (unit_start)
+   {
+      /* Skip the tail of the previous section, we only need one of them */
+      unsigned int pointer_field = data[0];
+      section->started = pointer_field + 1 < size;
+      section->size = 0;
+      if (!section->started) return false;
+      data += pointer_field + 1;
+      size -= pointer_field + 1;
+   }
+
+   if (!section->started)
+      return false;
+
+   size = MIN(size, sizeof(section->data) - section->size);
+   memcpy(section->data + section->size, data, size);
+   section->size += size;
+   if (section->size < 3)
+      return false;
+
+   length = 3 + (((section->data[1] & 0x0F) << 8) | section->data[2]);
+   if (length > sizeof(section->data) || length < 12)
+   {
+      section->started = false;
+      return false;
+   }
+   if (section->size < length)
+      return false;
+
+   section->size = length;
+   section->started = false;
+   return ts_crc32(section->data, length) == 0;
+}
+
+/*****************************************************************************/
+static void ts_parse_pat( VC_CONTAINER_T *ctx, const uint8_t *data, unsigned int size )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   unsigned int i, program_number, pid;
+
+   if (data[0] != 0x00 /* program_association_section */ || !(data[5] & 0x1) /* current_next_indicator */)
+      return;
+
+   for (i = 8; i + 4 <= size - 4; i += 4)
+   {
+      program_number = (data[i] << 8) | data[i+1];
+      pid = ((data[i+2] & 0x1F) << 8) | data[i+3];
+      if (!program_number) continue; /* network_PID */
+
+      if (!module->program_number || module->program_number == program_number)
+      {
+         if (module->pmt_pid != pid)
+            LOG_DEBUG(ctx, "program %u, program_map_PID %u", program_number, pid);
+         module->program_number = program_number;
+         module->pmt_pid = pid;
+         return;
+      }
+   }
+}
+
+/*****************************************************************************/
+static void ts_parse_pmt( VC_CONTAINER_T *ctx, const uint8_t *data, unsigned int size )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   unsigned int i, program_info_length, es_info_length, stream_type, pid;
+   VC_CONTAINER_ES_TYPE_T type;
+   VC_CONTAINER_FOURCC_T codec;
+   VC_CONTAINER_TRACK_T *track;
+
+   if (data[0] != 0x02 /* TS_program_map_section */ || !(data[5] & 0x1) /* current_next_indicator */ ||
+       (unsigned int)((data[3] << 8) | data[4]) != module->program_number)
+      return;
+
+   /* We don't support changes of the program composition on the fly */
+   if (module->pmt_found)
+      return;
+
+   module->pcr_pid = ((data[8] & 0x1F) << 8) | data[9];
+   program_info_length = ((data[10] & 0x0F) << 8) | data[11];
+   size -= 4; /* CRC_32 */
+
+   for (i = 12 + program_info_length; i + 5 <= size; i += 5 + es_info_length)
+   {
+      stream_type = data[i];
+      pid = ((data[i+1] & 0x1F) << 8) | data[i+2];
+      es_info_length = ((data[i+3] & 0x0F) << 8) | data[i+4];
+      if (i + 5 + es_info_length > size) break;
+
+      ts_get_stream_coding(ctx, stream_type, data + i + 5, es_info_length, &type, &codec);
+      LOG_DEBUG(ctx, "elementary_PID %u, stream_type 0x%x (%4.4s)", pid, stream_type, (char *)&codec);
+
+      /* Check that we know what to do with this track */
+      if (type == VC_CONTAINER_ES_TYPE_UNKNOWN || codec == VC_CONTAINER_CODEC_UNKNOWN)
+         continue;
+      if (ctx->tracks_num >= TS_TRACKS_MAX || ts_find_track(ctx, pid))
+         continue;
+
+      /* Allocate and initialise a new track */
+      ctx->tracks[ctx->tracks_num] = track =
+         vc_container_allocate_track(ctx, sizeof(*ctx->tracks[0]->priv->module));
+      if (!track) break;
+
+      track->is_enabled = true;
+      track->format->es_type = type;
+      track->format->codec = codec;
+      track->priv->module->pid = pid;
+      track->priv->module->stream_type = stream_type;
+      track->priv->module->continuity_counter = -1;
+      ctx->tracks_num++;
+
+      /* Pick up the language from the ISO_639_language_descriptor */
+      {
+         const uint8_t *descriptor = data + i + 5;
+         unsigned int left = es_info_length;
+         while (left >= 2 && left >= 2u + descriptor[1])
+         {
+            if (descriptor[0] == 0x0A && descriptor[1] >= 3)
+            {
+               memcpy(track->format->language, descriptor + 2, 3);
+               break;
+            }
+            left -= 2 + descriptor[1];
+            descriptor += 2 + descriptor[1];
+         }
+      }
+   }
+
+   module->pmt_found = true;
+}
+
+/*****************************************************************************/
+static unsigned int ts_track_index( VC_CONTAINER_T *ctx, VC_CONTAINER_TRACK_T *track )
+{
+   unsigned int i;
+
+   for (i = 0; i < ctx->tracks_num; i++)
+      if (ctx->tracks[i] == track) break;
+   vc_container_assert(i < ctx->tracks_num);
+
+   return i;
+}
+
+/** Hand the reassembled PES packet of a track over to the reader */
+static void ts_pes_complete( VC_CONTAINER_T *ctx, VC_CONTAINER_TRACK_T *track )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = track->priv->module;
+   unsigned int max;
+   uint8_t *data;
+
+   vc_container_assert(!module->packet_data_left);
+   track_module->pes_started = false;
+
+   if (!track_module->pes_size || !track->is_enabled)
+      return;
+
+   if (track_module->wait_random_access)
+   {
+      if (!(track_module->pes_flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME))
+         return;
+      track_module->wait_random_access = false;
+   }
+
+   /* Swap buffers so we don't have to copy the data */
+   data = module->packet_data;
+   max = module->packet_max;
+   module->packet_data = track_module->pes;
+   module->packet_max = track_module->pes_max;
+   track_module->pes = data;
+   track_module->pes_max = max;
+
+   module->packet_track = ts_track_index(ctx, track);
+   module->packet_data_size = module->packet_data_left = track_module->pes_size;
+   module->packet_pts = track_module->pes_pts;
+   module->packet_dts = track_module->pes_dts;
+   module->packet_flags = track_module->pes_flags;
+   track_module->pes_size = 0;
+}
+
+/** Parse the header of a PES packet. The header needs to be contained in the
+    first transport packet, which in practice is always the case. */
+static VC_CONTAINER_STATUS_T ts_parse_pes_header( VC_CONTAINER_T *ctx,
+   VC_CONTAINER_TRACK_MODULE_T *track_module, const uint8_t *data, unsigned int *p_size )
+{
+   unsigned int size = *p_size, stream_id, length, header_length, pts_dts;
+   int64_t pts = VC_CONTAINER_TIME_UNKNOWN, dts = VC_CONTAINER_TIME_UNKNOWN;
+
+   if (size < 9 || data[0] != 0x00 || data[1] != 0x00 || data[2] != 0x01)
+      return VC_CONTAINER_ERROR_CORRUPTED;
+
+   stream_id = data[3];
+   length = (data[4] << 8) | data[5];
+
+   if (stream_id == 0xBC /* program_stream_map */ || stream_id == 0xBE /* padding_stream */ ||
+       stream_id == 0xBF /* private_stream_2 */ || stream_id == 0xF0 /* ECM */ ||
+       stream_id == 0xF1 /* EMM */ || stream_id == 0xFF /* program_stream_directory */ ||
+       stream_id == 0xF2 /* DSMCC_stream */ || stream_id == 0xF8 /* ITU-T Rec. H.222.1 type E */)
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+
+   if ((data[6] & 0xC0) != 0x80) /* '10' marker bits */
+      return VC_CONTAINER_ERROR_CORRUPTED;
+
+   pts_dts = data[7] >> 6;
+   header_length = data[8];
+   if (9 + header_length > size)
+      return VC_CONTAINER_ERROR_CORRUPTED;
+
+   if ((pts_dts & 0x2) && header_length >= 5)
+      pts = ts_read_timestamp(data + 9);
+   if (pts_dts == 0x3 && header_length >= 10)
+      dts = ts_read_timestamp(data + 14);
+
+   track_module->pes_pts = ts_pes_time_to_us(ctx, pts);
+   track_module->pes_dts = ts_pes_time_to_us(ctx, dts);
+   track_module->pes_expected = length > 3 + header_length ? length - 3 - header_length : 0;
+
+   *p_size = 9 + header_length;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static void ts_parse_pes( VC_CONTAINER_T *ctx, VC_CONTAINER_TRACK_T *track,
+   const uint8_t *packet, const uint8_t *data, unsigned int size, bool random_access )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = track->priv->module;
+   int continuity_counter = packet[3] & 0x0F;
+   bool unit_start = !!(packet[1] & 0x40);
+   unsigned int header_size;
+
+   /* Check for lost or duplicate packets */
+   if (track_module->continuity_counter >= 0 &&
+       continuity_counter != ((track_module->continuity_counter + 1) & 0x0F))
+   {
+      if (continuity_counter == track_module->continuity_counter)
+         return; /* Duplicate packet */
+
+      LOG_DEBUG(ctx, "pid %u: continuity error (%i -> %i)", track_module->pid,
+         track_module->continuity_counter, continuity_counter);
+      track_module->pes_started = false;
+      track_module->pes_size = 0;
+      track_module->discontinuity = true;
+   }
+   track_module->continuity_counter = continuity_counter;
+
+   if (!track->is_enabled)
+      return;
+
+   if (unit_start)
+   {
+      /* Nothing can be waiting to be read out at this point since this is the
+         first PES packet completed by this transport packet */
+      if (track_module->pes_started)
+         ts_pes_complete(ctx, track);
+      track_module->pes_size = 0;
+
+      header_size = size;
+      if (ts_parse_pes_header(ctx, track_module, data, &header_size) != VC_CONTAINER_SUCCESS)
+         return;
+      data += header_size;
+      size -= header_size;
+
+      track_module->pes_started = true;
+      track_module->pes_flags = 0;
+      if (random_access || track->format->es_type == VC_CONTAINER_ES_TYPE_AUDIO)
+         track_module->pes_flags |= VC_CONTAINER_PACKET_FLAG_KEYFRAME;
+      if (track_module->discontinuity)
+         track_module->pes_flags |= VC_CONTAINER_PACKET_FLAG_DISCONTINUITY;
+      track_module->discontinuity = false;
+   }
+
+   if (!track_module->pes_started)
+      return;
+
+   if (track_module->pes_size + size > track_module->pes_max)
+   {
+      unsigned int max = MAX(track_module->pes_max, TS_PES_SIZE_DEFAULT);
+      uint8_t *pes;
+
+      while (max < track_module->pes_size + size) max <<= 1;
+      if (max > TS_PES_SIZE_MAX || !(pes = realloc(track_module->pes, max)))
+      {
+         LOG_DEBUG(ctx, "pid %u: dropping oversized PES packet", track_module->pid);
+         track_module->pes_started = false;
+         track_module->discontinuity = true;
+         return;
+      }
+      track_module->pes = pes;
+      track_module->pes_max = max;
+   }
+
+   memcpy(track_module->pes + track_module->pes_size, data, size);
+   track_module->pes_size += size;
+
+   /* Don't wait for the next PES packet when we know we've got all the data */
+   if (track_module->pes_expected && track_module->pes_size >= track_module->pes_expected)
+   {
+      track_module->pes_size = track_module->pes_expected;
+      if (module->packet_data_left)
+         module->pes_pending = ts_track_index(ctx, track);
+      else
+         ts_pes_complete(ctx, track);
+   }
+}
+
+/*****************************************************************************/
+static void ts_parse_packet( VC_CONTAINER_T *ctx, const uint8_t *packet )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   unsigned int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+   unsigned int adaptation_field_control = (packet[3] >> 4) & 0x3;
+   const uint8_t *data = packet + 4;
+   bool random_access = false;
+   VC_CONTAINER_TRACK_T *track;
+
+   if (pid == TS_PID_NULL)
+      return;
+
+   if (packet[1] & 0x80) /* transport_error_indicator */
+   {
+      if ((track = ts_find_track(ctx, pid)) != NULL)
+      {
+         track->priv->module->pes_started = false;
+         track->priv->module->discontinuity = true;
+      }
+      return;
+   }
+
+   if (adaptation_field_control & 0x2)
+   {
+      unsigned int length = packet[4];
+      if (length > TS_PACKET_SIZE - 5)
+         return;
+
+      if (length)
+      {
+         unsigned int flags = packet[5];
+         random_access = !!(flags & 0x40);
+
+         if ((flags & 0x10) && length >= 7 && pid == module->pcr_pid)
+         {
+            int64_t pcr = ((int64_t)packet[6] << 25) | (packet[7] << 17) |
+               (packet[8] << 9) | (packet[9] << 1) | (packet[10] >> 7);
+            pcr = pcr * INT64_C(300) + (((packet[10] & 0x1) << 8) | packet[11]);
+            ts_update_pcr(ctx, pcr, !!(flags & 0x80) /* discontinuity_indicator */);
+         }
+      }
+      data += 1 + length;
+   }
+
+   if (!(adaptation_field_control & 0x1) || data >= packet + TS_PACKET_SIZE)
+      return;
+
+   if (module->searching_tracks)
+   {
+      if (pid == TS_PID_PAT)
+      {
+         if (ts_section_append(&module->pat, !!(packet[1] & 0x40), data, packet + TS_PACKET_SIZE - data))
+            ts_parse_pat(ctx, module->pat.data, module->pat.size);
+      }
+      else if (pid == module->pmt_pid)
+      {
+         if (ts_section_append(&module->pmt, !!(packet[1] & 0x40), data, packet + TS_PACKET_SIZE - data))
+            ts_parse_pmt(ctx, module->pmt.data, module->pmt.size);
+      }
+      else if (random_access && (track = ts_find_track(ctx, pid)) != NULL)
+      {
+         track->priv->module->random_access = true;
+      }
+      return;
+   }
+
+   if ((packet[3] & 0xC0) /* transport_scrambling_control */ ||
+       (track = ts_find_track(ctx, pid)) == NULL)
+      return;
+
+   if (random_access)
+      track->priv->module->random_access = true;
+
+   ts_parse_pes(ctx, track, packet, data, packet + TS_PACKET_SIZE - data, random_access);
+}
+
+/** Demux transport packets until a complete PES packet is available */
+static VC_CONTAINER_STATUS_T ts_demux( VC_CONTAINER_T *ctx )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   const uint8_t *packet;
+   bool resync = false;
+   unsigned int i;
+
+   while (!module->packet_data_left)
+   {
+      if (module->pes_pending >= 0)
+      {
+         VC_CONTAINER_TRACK_T *track = ctx->tracks[module->pes_pending];
+         module->pes_pending = -1;
+         ts_pes_complete(ctx, track);
+         continue;
+      }
+
+      status = ts_read_packet(ctx, &packet, &resync);
+      if (status == VC_CONTAINER_ERROR_EOS)
+      {
+         /* Flush whatever is left in the reassembly buffers */
+         for (i = 0; i < ctx->tracks_num && !module->packet_data_left; i++)
+            if (ctx->tracks[i]->priv->module->pes_started)
+               ts_pes_complete(ctx, ctx->tracks[i]);
+         if (module->packet_data_left)
+            break;
+         return status;
+      }
+      if (status != VC_CONTAINER_SUCCESS)
+         return status;
+
+      if (resync)
+      {
+         /* We don't know what we've missed */
+         for (i = 0; i < ctx->tracks_num; i++)
+         {
+            ctx->tracks[i]->priv->module->pes_started = false;
+            ctx->tracks[i]->priv->module->continuity_counter = -1;
+            ctx->tracks[i]->priv->module->discontinuity = true;
+         }
+         resync = false;
+      }
+
+      ts_parse_packet(ctx, packet);
+   }
+
+   return VC_CONTAINER_SUCCESS;
+}
+
+/** Find the first (or last) program_clock_reference within a range of the stream */
+static VC_CONTAINER_STATUS_T ts_find_pcr( VC_CONTAINER_T *ctx, uint64_t offset, uint64_t size,
+   bool last, int64_t *p_pcr, uint64_t *p_pcr_offset )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   uint64_t end = offset + size, packet_offset;
+   const uint8_t *packet;
+   bool found = false;
+
+   ts_reset_block(ctx, offset);
+
+   while (module->block_offset + module->block_pos < end)
+   {
+      if ((status = ts_read_packet(ctx, &packet, 0)) != VC_CONTAINER_SUCCESS)
+         break;
+
+      if ((((packet[1] & 0x1F) << 8) | packet[2]) != module->pcr_pid ||
+          !(packet[3] & 0x20) || packet[4] < 7 || !(packet[5] & 0x10))
+         continue;
+
+      packet_offset = module->block_offset + (packet - module->block);
+      *p_pcr = ((int64_t)packet[6] << 25) | (packet[7] << 17) |
+         (packet[8] << 9) | (packet[9] << 1) | (packet[10] >> 7);
+      *p_pcr = *p_pcr * INT64_C(300) + (((packet[10] & 0x1) << 8) | packet[11]);
+      *p_pcr_offset = packet_offset;
+      found = true;
+      if (!last) break;
+   }
+
+   if (found)
+      return VC_CONTAINER_SUCCESS;
+   return status != VC_CONTAINER_SUCCESS ? status : VC_CONTAINER_ERROR_NOT_FOUND;
+}
+
+/*****************************************************************************/
+static void ts_reset_state( VC_CONTAINER_T *ctx, uint64_t offset )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   unsigned int i;
+
+   ts_reset_block(ctx, offset);
+
+   for (i = 0; i < ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = ctx->tracks[i]->priv->module;
+      track_module->continuity_counter = -1;
+      track_module->pes_started = false;
+      track_module->pes_size = 0;
+      track_module->discontinuity = false;
+      track_module->wait_random_access = false;
+   }
+
+   module->pcr = VC_CONTAINER_TIME_UNKNOWN;
+   module->pes_pending = -1;
+   module->packet_data_left = 0;
+}
+
+/** Interpolation search on the program_clock_reference for the last
+    PCR before the target time (in 27MHz ticks, relative to the first PCR) */
+static void ts_find_position( VC_CONTAINER_T *ctx, int64_t target,
+   uint64_t *p_position, int64_t *p_time )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   uint64_t low = module->data_offset, high = module->data_offset + module->data_size;
+   int64_t low_time = 0, high_time = ctx->duration * INT64_C(27), time, pcr;
+   uint64_t position, pcr_offset;
+   unsigned int i;
+
+   target = MIN(target, high_time);
+
+   for (i = 0; i < TS_SEEK_ITERATIONS_MAX && target > 0 && high > low &&
+        high_time > low_time; i++)
+   {
+      position = low + (uint64_t)((target - low_time) * (double)(high - low) /
+         (high_time - low_time));
+      /* There might not be any PCR left if we get too close to the end */
+      if (position + TS_DURATION_SCAN_MIN > high)
+         position = high > low + TS_DURATION_SCAN_MIN ? high - TS_DURATION_SCAN_MIN : low;
+      position -= (position - module->data_offset) % module->packet_size;
+      if (position <= low && i) break;
+
+      if (ts_find_pcr(ctx, position, TS_SEEK_SCAN_MAX, false, &pcr, &pcr_offset) != VC_CONTAINER_SUCCESS)
+      {
+         high = position;
+         continue;
+      }
+
+      time = ts_pcr_delta(pcr, module->pcr_first);
+      if (time > target)
+      {
+         if (high == position) break;
+         high = position;
+         high_time = time;
+      }
+      else
+      {
+         if (low == pcr_offset) break;
+         low = pcr_offset;
+         low_time = time;
+         if (target - time < TS_SEEK_PRECISION) break;
+      }
+   }
+
+   *p_position = low;
+   *p_time = low_time;
+}
+
+/*****************************************************************************
+Functions exported as part of the Container Module API
+*****************************************************************************/
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T ts_reader_read( VC_CONTAINER_T *ctx,
+   VC_CONTAINER_PACKET_T *p_packet, uint32_t flags )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+
+   vc_container_assert(!module->searching_tracks);
+
+   if (!module->packet_data_left && (status = ts_demux(ctx)) != VC_CONTAINER_SUCCESS)
+      return status;
+
+   p_packet->track = module->packet_track;
+   p_packet->size = module->packet_data_left;
+   p_packet->flags = module->packet_flags;
+   p_packet->pts = module->packet_pts;
+   p_packet->dts = module->packet_dts;
+
+   if (flags & VC_CONTAINER_READ_FLAG_SKIP)
+   {
+      module->packet_data_left = 0;
+      return VC_CONTAINER_SUCCESS;
+   }
+
+   if (flags & VC_CONTAINER_READ_FLAG_INFO)
+      return VC_CONTAINER_SUCCESS;
+
+   p_packet->size = MIN(p_packet->buffer_size, module->packet_data_left);
+   memcpy(p_packet->data, module->packet_data + module->packet_data_size -
+      module->packet_data_left, p_packet->size);
+   module->packet_data_left -= p_packet->size;
+
+   if (module->packet_data_left)
+   {
+      module->packet_pts = module->packet_dts = VC_CONTAINER_TIME_UNKNOWN;
+      module->packet_flags = 0;
+   }
+
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T ts_reader_seek( VC_CONTAINER_T *ctx,
+   int64_t *p_offset, VC_CONTAINER_SEEK_MODE_T mode, VC_CONTAINER_SEEK_FLAGS_T flags )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   int64_t target = *p_offset * INT64_C(27), time = 0, packet_time;
+   uint64_t position;
+   unsigned int i, j;
+
+   VC_CONTAINER_PARAM_UNUSED(flags);
+
+   if (mode != VC_CONTAINER_SEEK_MODE_TIME || !STREAM_SEEKABLE(ctx))
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   if (*p_offset && (!ctx->duration || module->pcr_first == VC_CONTAINER_TIME_UNKNOWN))
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   for (i = 0; i < TS_SEEK_ATTEMPTS_MAX; i++)
+   {
+      ts_find_position(ctx, target, &position, &time);
+
+      /* Don't hand out any video until the next random access point */
+      ts_reset_state(ctx, position);
+      for (j = 0; j < ctx->tracks_num; j++)
+         ctx->tracks[j]->priv->module->wait_random_access =
+            ctx->tracks[j]->priv->module->random_access;
+
+      status = ts_demux(ctx);
+      if (status != VC_CONTAINER_SUCCESS)
+         break;
+
+      /* Timestamps are usually well ahead of the program_clock_reference so
+         we might have to go back a bit further */
+      packet_time = module->packet_pts != VC_CONTAINER_TIME_UNKNOWN ?
+         module->packet_pts : module->packet_dts;
+      if (packet_time == VC_CONTAINER_TIME_UNKNOWN || packet_time <= *p_offset || !time)
+         break;
+      target -= (packet_time - *p_offset) * INT64_C(27);
+   }
+
+   LOG_DEBUG(ctx, "seek to %"PRId64"us, landed at offset %"PRIu64" (%"PRId64"us)",
+      *p_offset, position, time / 27);
+
+   if (status != VC_CONTAINER_SUCCESS && status != VC_CONTAINER_ERROR_EOS)
+      return status;
+
+   if (module->packet_data_left && module->packet_pts != VC_CONTAINER_TIME_UNKNOWN)
+      *p_offset = module->packet_pts;
+   else if (module->packet_data_left && module->packet_dts != VC_CONTAINER_TIME_UNKNOWN)
+      *p_offset = module->packet_dts;
+   else
+      *p_offset = time / INT64_C(27);
+
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T ts_reader_close( VC_CONTAINER_T *ctx )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   unsigned int i;
+
+   for (i = 0; i < ctx->tracks_num; i++)
+   {
+      free(ctx->tracks[i]->priv->module->pes);
+      vc_container_free_track(ctx, ctx->tracks[i]);
+   }
+   free(module->packet_data);
+   free(module);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T ts_reader_open( VC_CONTAINER_T *ctx )
+{
+   static const unsigned int packet_sizes[] = { 188, 192, 204 };
+   VC_CONTAINER_MODULE_T *module = 0;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+   uint8_t probe[(TS_SYNC_PACKETS + 1) * TS_PACKET_SIZE_MAX];
+   unsigned int probe_size, packet_size = 0, offset = 0, i, j;
+   const char *program;
+   const uint8_t *packet;
+
+   /* Look for a run of sync bytes at one of the usual packet strides
+      (188 bytes for plain TS, 192 for M2TS / BDAV and 204 with RS parity) */
+   probe_size = PEEK_BYTES(ctx, probe, sizeof(probe));
+   for (i = 0; i < countof(packet_sizes) && !packet_size; i++)
+   {
+      for (j = 0; j < packet_sizes[i]; j++)
+      {
+         if (j + TS_SYNC_PACKETS * packet_sizes[i] > probe_size)
+            break;
+         if (ts_sync_count(probe + j, probe_size - j, packet_sizes[i]) == TS_SYNC_PACKETS)
+         {
+            packet_size = packet_sizes[i];
+            offset = j;
+            break;
+         }
+      }
+   }
+   if (!packet_size)
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+
+   LOG_DEBUG(ctx, "using ts reader (%u bytes packets)", packet_size);
+
+   module = malloc(sizeof(*module));
+   if(!module) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+   memset(module, 0, sizeof(*module));
+   ctx->priv->module = module;
+   ctx->tracks = module->tracks;
+
+   module->packet_size = packet_size;
+   module->data_offset = STREAM_POSITION(ctx) + offset;
+   module->pmt_pid = module->pcr_pid = TS_PID_NULL;
+   module->pcr_first = module->pcr = VC_CONTAINER_TIME_UNKNOWN;
+   module->pes_pending = -1;
+
+   /* Check if the user has asked for a specific program */
+   if (vc_uri_find_query(ctx->priv->uri, 0, "program", &program) && program)
+      module->program_number = strtoul(program, 0, 0);
+
+   /* Search for tracks and the first program_clock_reference */
+   module->searching_tracks = true;
+   ts_reset_block(ctx, module->data_offset);
+   for (i = 0; i < TS_SCAN_PACKETS_MAX; i++)
+   {
+      if (module->pmt_found && (module->pcr_pid == TS_PID_NULL ||
+          module->pcr_first != VC_CONTAINER_TIME_UNKNOWN))
+         break;
+      if (ts_read_packet(ctx, &packet, 0) != VC_CONTAINER_SUCCESS)
+         break;
+      ts_parse_packet(ctx, packet);
+   }
+   module->searching_tracks = false;
+
+   /* Bail out if we didn't find any tracks */
+   if (!ctx->tracks_num)
+   {
+      status = VC_CONTAINER_ERROR_NO_TRACK_AVAILABLE;
+      goto error;
+   }
+
+   /* Set data size (necessary for seeking) */
+   module->data_size = MAX(ctx->priv->io->size - (int64_t)module->data_offset, INT64_C(0));
+
+   /* Find the last program_clock_reference to work out the duration */
+   if (STREAM_SEEKABLE(ctx) && module->data_size &&
+       module->pcr_first != VC_CONTAINER_TIME_UNKNOWN)
+   {
+      uint64_t size = TS_DURATION_SCAN_MIN, pcr_offset;
+      int64_t pcr;
+
+      for (;;)
+      {
+         uint64_t position = module->data_offset;
+         size = MIN(size, module->data_size);
+         position += module->data_size - size;
+         position -= (position - module->data_offset) % module->packet_size;
+
+         status = ts_find_pcr(ctx, position, size, true, &pcr, &pcr_offset);
+         if (status == VC_CONTAINER_SUCCESS)
+         {
+            ctx->duration = ts_pcr_delta(pcr, module->pcr_first) / INT64_C(27);
+            break;
+         }
+         if (size >= MIN(module->data_size, TS_DURATION_SCAN_MAX))
+            break;
+         size <<= 1;
+      }
+   }
+
+   /* Seek back to the start of data, we're now ready to read data */
+   ts_reset_state(ctx, module->data_offset);
+
+   if (STREAM_SEEKABLE(ctx) && ctx->duration)
+      ctx->capabilities |= VC_CONTAINER_CAPS_CAN_SEEK;
+
+   ctx->priv->pf_close = ts_reader_close;
+   ctx->priv->pf_read = ts_reader_read;
+   ctx->priv->pf_seek = ts_reader_seek;
+
+   return STREAM_ERROR(ctx) ? STREAM_STATUS(ctx) : VC_CONTAINER_SUCCESS;
+
+ error:
+   LOG_DEBUG(ctx, "ts: error opening stream (%i)", status);
+   if(module) ts_reader_close(ctx);
+   return status;
+}
+
+/********************************************************************************
+ Entrypoint function
+ ********************************************************************************/
+
+#if !defined(ENABLE_CONTAINERS_STANDALONE) && defined(__HIGHC__)
+# pragma weak reader_open ts_reader_open
+#endif
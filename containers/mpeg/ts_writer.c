@@ -0,0 +1,968 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "containers/core/containers_private.h"
+#include "containers/core/containers_io_helpers.h"
+#include "containers/core/containers_utils.h"
+#include "containers/core/containers_logging.h"
+
+/******************************************************************************
+Defines.
+******************************************************************************/
+#define TS_TRACKS_MAX 8
+
+#define TS_SYNC_BYTE 0x47
+#define TS_PACKET_SIZE 188
+#define TS_PAYLOAD_SIZE_MAX (TS_PACKET_SIZE - 4)
+
+/** Number of transport packets we build up before handing them to the io layer */
+#define TS_BUFFER_PACKETS 64
+
+#define TS_PID_PAT  0x0000
+#define TS_PID_PMT  0x1000
+#define TS_PID_ES   0x0100  /**< PID of the first elementary stream */
+#define TS_PROGRAM_NUMBER 1
+
+/** Offset added to all timestamps (in 90kHz ticks). This leaves room for the
+    program_clock_reference to run ahead of the decoding timestamps. */
+#define TS_TIME_OFFSET 126000
+#define TS_PCR_DELAY 63000         /**< Delay between PCR and DTS (in 90kHz ticks) */
+#define TS_PCR_INTERVAL 9000       /**< Maximum interval between PCRs (in 90kHz ticks) */
+#define TS_PSI_INTERVAL 9000       /**< Maximum interval between PAT/PMT (in 90kHz ticks) */
+
+#define TS_FRAME_SIZE_DEFAULT (64*1024)
+#define TS_CONFIG_SIZE_MAX 1024
+#define TS_URI_SIZE_MAX 512
+
+/******************************************************************************
+Type definitions
+******************************************************************************/
+typedef struct VC_CONTAINER_TRACK_MODULE_T
+{
+   unsigned int pid;
+   unsigned int stream_type;
+   unsigned int stream_id;          /**< PES stream_id */
+   unsigned int continuity_counter;
+
+   /** Size of the NAL unit length field for AVC1 formatted H.264 (0 for byte stream) */
+   unsigned int nal_length_size;
+
+   /** Codec configuration data in byte stream format (H.264 parameter sets),
+       repeated in front of every random access point */
+   uint8_t config[TS_CONFIG_SIZE_MAX];
+   unsigned int config_size;
+
+   /** AAC frames need an ADTS header */
+   bool adts;
+   unsigned int adts_profile;
+   unsigned int adts_sample_rate_index;
+   unsigned int adts_channels;
+
+   /** Frame being assembled from partial packets */
+   uint8_t *frame;
+   unsigned int frame_size;
+   unsigned int frame_max;
+   int64_t frame_pts;
+   int64_t frame_dts;
+   uint32_t frame_flags;
+
+} VC_CONTAINER_TRACK_MODULE_T;
+
+typedef struct VC_CONTAINER_MODULE_T
+{
+   VC_CONTAINER_TRACK_T *tracks[TS_TRACKS_MAX];
+
+   bool header_done;
+
+   /** Track which carries the program_clock_reference */
+   unsigned int pcr_track;
+
+   /** Track on which segments are cut (first video track if any) */
+   unsigned int segment_track;
+
+   unsigned int pat_continuity_counter;
+   unsigned int pmt_continuity_counter;
+
+   int64_t pcr_time;   /**< DTS at which we last inserted a PCR (90kHz ticks) */
+   int64_t psi_time;   /**< DTS at which we last inserted PAT/PMT (90kHz ticks) */
+   int64_t time;       /**< Most recent DTS (90kHz ticks) */
+
+   /** Segmentation state */
+   int64_t segment_duration;  /**< Target segment duration in microseconds (0 to disable) */
+   int64_t segment_start;     /**< DTS of the start of the current segment in microseconds */
+   unsigned int segment;      /**< Index of the current segment */
+   char segment_base[TS_URI_SIZE_MAX];      /**< Output path without its extension */
+   char segment_extension[TS_URI_SIZE_MAX]; /**< Extension of the output path */
+
+   /** Transport packets waiting to be written */
+   uint8_t buffer[TS_BUFFER_PACKETS * TS_PACKET_SIZE];
+   unsigned int buffer_size;
+
+} VC_CONTAINER_MODULE_T;
+
+/******************************************************************************
+Function prototypes
+******************************************************************************/
+VC_CONTAINER_STATUS_T ts_writer_open( VC_CONTAINER_T * );
+
+/******************************************************************************
+Local Functions
+******************************************************************************/
+static const unsigned int ts_adts_sample_rates[] =
+   {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+
+/*****************************************************************************/
+static uint32_t ts_crc32( const uint8_t *data, unsigned int size )
+{
+   uint32_t crc = 0xFFFFFFFF;
+   unsigned int i;
+
+   while (size--)
+   {
+      crc ^= (uint32_t)*data++ << 24;
+      for (i = 0; i < 8; i++)
+         crc = (crc << 1) ^ (crc & 0x80000000 ? 0x04C11DB7 : 0);
+   }
+
+   return crc;
+}
+
+/*****************************************************************************/
+static int64_t ts_time_to_90khz( int64_t time )
+{
+   return (time * INT64_C(9) / INT64_C(100) + TS_TIME_OFFSET) & ((INT64_C(1) << 33) - 1);
+}
+
+/*****************************************************************************/
+static void ts_write_timestamp( uint8_t *data, unsigned int marker, int64_t time )
+{
+   data[0] = (marker << 4) | ((time >> 29) & 0x0E) | 0x1;
+   data[1] = (time >> 22) & 0xFF;
+   data[2] = ((time >> 14) & 0xFE) | 0x1;
+   data[3] = (time >> 7) & 0xFF;
+   data[4] = ((time << 1) & 0xFE) | 0x1;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T ts_flush( VC_CONTAINER_T *ctx )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+
+   if (!module->buffer_size)
+      return STREAM_STATUS(ctx);
+
+   WRITE_BYTES(ctx, module->buffer, module->buffer_size);
+   ctx->size += module->buffer_size;
+   module->buffer_size = 0;
+   return STREAM_STATUS(ctx);
+}
+
+/** Get a new transport packet from the buffer */
+static uint8_t *ts_new_packet( VC_CONTAINER_T *ctx )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   uint8_t *packet;
+
+   if (module->buffer_size == sizeof(module->buffer))
+      ts_flush(ctx);
+
+   packet = module->buffer + module->buffer_size;
+   module->buffer_size += TS_PACKET_SIZE;
+   return packet;
+}
+
+/** Write a PSI section in a single transport packet */
+static void ts_write_section( VC_CONTAINER_T *ctx, unsigned int pid,
+   unsigned int *continuity_counter, const uint8_t *section, unsigned int size )
+{
+   uint8_t *packet = ts_new_packet(ctx);
+
+   packet[0] = TS_SYNC_BYTE;
+   packet[1] = 0x40 | (pid >> 8); /* payload_unit_start_indicator */
+   packet[2] = pid & 0xFF;
+   packet[3] = 0x10 | *continuity_counter;
+   packet[4] = 0; /* pointer_field */
+   memcpy(packet + 5, section, size);
+   memset(packet + 5 + size, 0xFF, TS_PACKET_SIZE - 5 - size);
+   *continuity_counter = (*continuity_counter + 1) & 0x0F;
+}
+
+/*****************************************************************************/
+static unsigned int ts_finish_section( uint8_t *section, unsigned int size )
+{
+   uint32_t crc;
+
+   /* section_length includes the CRC_32 */
+   section[1] = 0xB0 | ((size + 4 - 3) >> 8);
+   section[2] = (size + 4 - 3) & 0xFF;
+   crc = ts_crc32(section, size);
+   section[size++] = crc >> 24;
+   section[size++] = crc >> 16;
+   section[size++] = crc >> 8;
+   section[size++] = crc;
+   return size;
+}
+
+/** Write the program association and program map tables */
+static void ts_write_psi( VC_CONTAINER_T *ctx )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   uint8_t section[TS_PAYLOAD_SIZE_MAX - 1];
+   unsigned int size, i;
+
+   /* program_association_section */
+   section[0] = 0x00;
+   section[3] = 0x00; section[4] = 0x01; /* transport_stream_id */
+   section[5] = 0xC1; /* version_number 0, current_next_indicator */
+   section[6] = section[7] = 0; /* section_number, last_section_number */
+   section[8] = TS_PROGRAM_NUMBER >> 8;
+   section[9] = TS_PROGRAM_NUMBER & 0xFF;
+   section[10] = 0xE0 | (TS_PID_PMT >> 8);
+   section[11] = TS_PID_PMT & 0xFF;
+   size = ts_finish_section(section, 12);
+   ts_write_section(ctx, TS_PID_PAT, &module->pat_continuity_counter, section, size);
+
+   /* TS_program_map_section */
+   section[0] = 0x02;
+   section[3] = TS_PROGRAM_NUMBER >> 8;
+   section[4] = TS_PROGRAM_NUMBER & 0xFF;
+   section[5] = 0xC1;
+   section[6] = section[7] = 0;
+   section[8] = 0xE0 | (ctx->tracks[module->pcr_track]->priv->module->pid >> 8);
+   section[9] = ctx->tracks[module->pcr_track]->priv->module->pid & 0xFF;
+   section[10] = 0xF0; section[11] = 0; /* program_info_length */
+   size = 12;
+
+   for (i = 0; i < ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_T *track = ctx->tracks[i];
+      bool language = track->format->language[0] != 0;
+
+      section[size++] = track->priv->module->stream_type;
+      section[size++] = 0xE0 | (track->priv->module->pid >> 8);
+      section[size++] = track->priv->module->pid & 0xFF;
+      section[size++] = 0xF0;
+      section[size++] = language ? 6 : 0; /* ES_info_length */
+      if (language)
+      {
+         /* ISO_639_language_descriptor */
+         section[size++] = 0x0A;
+         section[size++] = 4;
+         memcpy(section + size, track->format->language, 3);
+         size += 3;
+         section[size++] = 0; /* audio_type */
+      }
+   }
+   size = ts_finish_section(section, size);
+   ts_write_section(ctx, TS_PID_PMT, &module->pmt_continuity_counter, section, size);
+
+   module->psi_time = module->time;
+}
+
+/** Write an adaptation field only packet carrying a program_clock_reference */
+static void ts_write_pcr( VC_CONTAINER_T *ctx, int64_t dts )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = ctx->tracks[module->pcr_track]->priv->module;
+   int64_t pcr = (dts - TS_PCR_DELAY) & ((INT64_C(1) << 33) - 1);
+   uint8_t *packet = ts_new_packet(ctx);
+
+   packet[0] = TS_SYNC_BYTE;
+   packet[1] = track_module->pid >> 8;
+   packet[2] = track_module->pid & 0xFF;
+   packet[3] = 0x20 | ((track_module->continuity_counter - 1) & 0x0F); /* no payload, counter doesn't change */
+   packet[4] = TS_PACKET_SIZE - 5;
+   packet[5] = 0x10; /* PCR_flag */
+   packet[6] = pcr >> 25;
+   packet[7] = pcr >> 17;
+   packet[8] = pcr >> 9;
+   packet[9] = pcr >> 1;
+   packet[10] = ((pcr & 0x1) << 7) | 0x7E;
+   packet[11] = 0;
+   memset(packet + 12, 0xFF, TS_PACKET_SIZE - 12);
+
+   module->pcr_time = dts;
+}
+
+/** Packetize a PES packet made of a list of buffers into transport packets */
+static void ts_write_pes( VC_CONTAINER_T *ctx, VC_CONTAINER_TRACK_T *track,
+   const uint8_t **data, unsigned int *sizes, unsigned int count,
+   int64_t pts, int64_t dts, bool random_access )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = track->priv->module;
+   bool pcr = track == ctx->tracks[module->pcr_track] && dts != VC_CONTAINER_TIME_UNKNOWN;
+   unsigned int header_size, payload_size = 0, size, left, chunk, i;
+   uint8_t header[19], *packet, *payload;
+
+   for (i = 0; i < count; i++)
+      payload_size += sizes[i];
+
+   /* PES packet header */
+   header[0] = header[1] = 0; header[2] = 1;
+   header[3] = track_module->stream_id;
+   header[6] = 0x84; /* '10' marker bits, data_alignment_indicator */
+   header[7] = 0;
+   header_size = 9;
+   if (pts != VC_CONTAINER_TIME_UNKNOWN)
+   {
+      header[7] = 0x80;
+      ts_write_timestamp(header + header_size, dts != VC_CONTAINER_TIME_UNKNOWN && dts != pts ? 0x3 : 0x2, pts);
+      header_size += 5;
+      if (dts != VC_CONTAINER_TIME_UNKNOWN && dts != pts)
+      {
+         header[7] = 0xC0;
+         ts_write_timestamp(header + header_size, 0x1, dts);
+         header_size += 5;
+      }
+   }
+   header[8] = header_size - 9;
+
+   /* PES_packet_length can be left unbounded for video */
+   size = header_size - 6 + payload_size;
+   if (size > 0xFFFF && track->format->es_type != VC_CONTAINER_ES_TYPE_VIDEO)
+      LOG_DEBUG(ctx, "pid %u: PES packet too big (%u)", track_module->pid, size);
+   if (size > 0xFFFF) size = 0;
+   header[4] = size >> 8;
+   header[5] = size & 0xFF;
+
+   left = header_size + payload_size;
+   for (i = 0; left; )
+   {
+      unsigned int adaptation_size = 0, room;
+      bool first = left == header_size + payload_size;
+
+      packet = ts_new_packet(ctx);
+      packet[0] = TS_SYNC_BYTE;
+      packet[1] = (first ? 0x40 : 0) | (track_module->pid >> 8);
+      packet[2] = track_module->pid & 0xFF;
+      packet[3] = 0x10 | track_module->continuity_counter;
+      track_module->continuity_counter = (track_module->continuity_counter + 1) & 0x0F;
+
+      if (first && (pcr || random_access))
+      {
+         packet[5] = random_access ? 0x40 : 0x00; /* random_access_indicator */
+         adaptation_size = 2;
+         if (pcr)
+         {
+            int64_t value = (dts - TS_PCR_DELAY) & ((INT64_C(1) << 33) - 1);
+            packet[5] |= 0x10; /* PCR_flag */
+            packet[6] = value >> 25;
+            packet[7] = value >> 17;
+            packet[8] = value >> 9;
+            packet[9] = value >> 1;
+            packet[10] = ((value & 0x1) << 7) | 0x7E;
+            packet[11] = 0;
+            adaptation_size += 6;
+            module->pcr_time = dts;
+         }
+      }
+
+      /* Stuff the last packet with the adaptation field */
+      room = TS_PAYLOAD_SIZE_MAX - adaptation_size;
+      if (left < room)
+      {
+         if (!adaptation_size)
+         {
+            adaptation_size = 1;
+            if (left < room - 1)
+            {
+               packet[5] = 0x00;
+               adaptation_size = 2;
+            }
+         }
+         memset(packet + 4 + adaptation_size, 0xFF, TS_PAYLOAD_SIZE_MAX - adaptation_size - left);
+         adaptation_size = TS_PAYLOAD_SIZE_MAX - left;
+      }
+
+      if (adaptation_size)
+      {
+         packet[3] |= 0x20;
+         packet[4] = adaptation_size - 1;
+      }
+
+      payload = packet + 4 + adaptation_size;
+      room = TS_PAYLOAD_SIZE_MAX - adaptation_size;
+      left -= room;
+
+      if (first)
+      {
+         memcpy(payload, header, header_size);
+         payload += header_size;
+         room -= header_size;
+      }
+
+      while (room)
+      {
+         while (!sizes[i]) i++;
+         chunk = MIN(room, sizes[i]);
+         memcpy(payload, data[i], chunk);
+         payload += chunk;
+         room -= chunk;
+         data[i] += chunk;
+         sizes[i] -= chunk;
+      }
+   }
+}
+
+/** Check whether an H.264 byte stream access unit starts with the given NAL unit type,
+    before the first slice */
+static bool ts_h264_has_nal( const uint8_t *data, unsigned int size, unsigned int type )
+{
+   unsigned int i, nal_type;
+
+   for (i = 0; i + 3 < size; i++)
+   {
+      if (data[i] || data[i+1] || data[i+2] != 1)
+         continue;
+
+      nal_type = data[i+3] & 0x1F;
+      if (nal_type == type)
+         return true;
+      if (nal_type >= 1 && nal_type <= 5) /* coded slice */
+         return false;
+      i += 3;
+   }
+
+   return false;
+}
+
+/** Store the codec configuration of a track, converting it to byte stream format if needed */
+static VC_CONTAINER_STATUS_T ts_set_config( VC_CONTAINER_T *ctx, VC_CONTAINER_TRACK_T *track,
+   const uint8_t *data, unsigned int size )
+{
+   VC_CONTAINER_TRACK_MODULE_T *track_module = track->priv->module;
+   unsigned int i, j, count, length;
+
+   if (track->format->codec == VC_CONTAINER_CODEC_MP4A)
+   {
+      unsigned int sample_rate_index;
+
+      /* AudioSpecificConfig */
+      if (size < 2) return VC_CONTAINER_ERROR_FORMAT_INVALID;
+      sample_rate_index = ((data[0] & 0x7) << 1) | (data[1] >> 7);
+      if (sample_rate_index == 0xF)
+      {
+         for (sample_rate_index = 0; sample_rate_index < countof(ts_adts_sample_rates); sample_rate_index++)
+            if (ts_adts_sample_rates[sample_rate_index] == track->format->type->audio.sample_rate) break;
+         if (sample_rate_index == countof(ts_adts_sample_rates))
+         {
+            LOG_DEBUG(ctx, "unsupported AAC sample rate (%u)", track->format->type->audio.sample_rate);
+            return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+         }
+      }
+      track_module->adts = true;
+      track_module->adts_profile = (data[0] >> 3) - 1;
+      track_module->adts_sample_rate_index = sample_rate_index;
+      track_module->adts_channels = (data[1] >> 3) & 0xF;
+      if (track_module->adts_profile > 3)
+         track_module->adts_profile = 1; /* AAC LC */
+      return VC_CONTAINER_SUCCESS;
+   }
+
+   if (track->format->codec != VC_CONTAINER_CODEC_H264)
+      return VC_CONTAINER_SUCCESS;
+
+   if (size >= 7 && data[0] == 1 && track->format->codec_variant == VC_CONTAINER_VARIANT_H264_AVC1)
+   {
+      /* avcC, convert the parameter sets to byte stream format */
+      track_module->nal_length_size = (data[4] & 0x3) + 1;
+      track_module->config_size = 0;
+      for (i = 5, j = 0; j < 2 && i < size; j++)
+      {
+         count = data[i++] & (j ? 0xFF : 0x1F);
+         for (; count && i + 2 <= size; count--)
+         {
+            length = (data[i] << 8) | data[i+1];
+            i += 2;
+            if (i + length > size || track_module->config_size + 4 + length > TS_CONFIG_SIZE_MAX)
+               return VC_CONTAINER_ERROR_FORMAT_INVALID;
+            memcpy(track_module->config + track_module->config_size, "\x00\x00\x00\x01", 4);
+            memcpy(track_module->config + track_module->config_size + 4, data + i, length);
+            track_module->config_size += 4 + length;
+            i += length;
+         }
+      }
+      return VC_CONTAINER_SUCCESS;
+   }
+
+   if (size > TS_CONFIG_SIZE_MAX)
+      return VC_CONTAINER_ERROR_FORMAT_INVALID;
+   memcpy(track_module->config, data, size);
+   track_module->config_size = size;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T ts_write_header( VC_CONTAINER_T *ctx )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   unsigned int i;
+
+   if (!ctx->tracks_num)
+      return VC_CONTAINER_ERROR_NO_TRACK_AVAILABLE;
+
+   /* The first video track carries the clock and drives segmentation */
+   for (i = 0; i < ctx->tracks_num; i++)
+      if (ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) break;
+   module->pcr_track = module->segment_track = i < ctx->tracks_num ? i : 0;
+
+   module->header_done = true;
+   module->time = module->pcr_time = module->psi_time = VC_CONTAINER_TIME_UNKNOWN;
+   module->segment_start = VC_CONTAINER_TIME_UNKNOWN;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/** Move on to the next segment */
+static VC_CONTAINER_STATUS_T ts_next_segment( VC_CONTAINER_T *ctx )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   char uri[TS_URI_SIZE_MAX];
+   VC_CONTAINER_IO_T *io;
+
+   if ((status = ts_flush(ctx)) != VC_CONTAINER_SUCCESS)
+      return status;
+
+   /* Segment N of foo.ts goes to foo.N.ts */
+   if (snprintf(uri, sizeof(uri), "%s.%u%s", module->segment_base, module->segment + 1,
+          module->segment_extension) >= (int)sizeof(uri))
+      return VC_CONTAINER_ERROR_URI_NOT_FOUND;
+
+   LOG_DEBUG(ctx, "starting segment %s", uri);
+   io = vc_container_io_open(uri, VC_CONTAINER_IO_MODE_WRITE, &status);
+   if (!io)
+   {
+      LOG_ERROR(ctx, "error opening segment: %s", uri);
+      return status;
+   }
+
+   /* Swap the i/o, the core will close the last one for us. The uri belongs
+    * to the i/o so it needs swapping as well. */
+   vc_container_io_close(ctx->priv->io);
+   ctx->priv->io = io;
+   ctx->priv->uri = io->uri_parts;
+   module->segment++;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/** Write a complete frame */
+static VC_CONTAINER_STATUS_T ts_write_frame( VC_CONTAINER_T *ctx, VC_CONTAINER_TRACK_T *track,
+   const uint8_t *data, unsigned int size, int64_t pts, int64_t dts, uint32_t flags )
+{
+   static const uint8_t access_unit_delimiter[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xF0 };
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = track->priv->module;
+   bool random_access = !!(flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME);
+   const uint8_t *buffers[3];
+   unsigned int sizes[3], count = 0;
+   uint8_t adts[7];
+
+   if (dts == VC_CONTAINER_TIME_UNKNOWN)
+      dts = pts;
+   if (track->format->es_type == VC_CONTAINER_ES_TYPE_AUDIO)
+      random_access = true;
+
+   /* Cut segments on random access points */
+   if (module->segment_duration && dts != VC_CONTAINER_TIME_UNKNOWN &&
+       track == ctx->tracks[module->segment_track] && random_access)
+   {
+      if (module->segment_start == VC_CONTAINER_TIME_UNKNOWN)
+         module->segment_start = dts;
+      else if (dts - module->segment_start >= module->segment_duration)
+      {
+         VC_CONTAINER_STATUS_T status = ts_next_segment(ctx);
+         if (status != VC_CONTAINER_SUCCESS)
+            return status;
+         module->segment_start = dts;
+         module->psi_time = VC_CONTAINER_TIME_UNKNOWN;
+      }
+   }
+
+   if (pts != VC_CONTAINER_TIME_UNKNOWN) pts = ts_time_to_90khz(pts);
+   if (dts != VC_CONTAINER_TIME_UNKNOWN) module->time = dts = ts_time_to_90khz(dts);
+
+   /* Repeat the PSI tables regularly and in front of video random access points */
+   if (module->psi_time == VC_CONTAINER_TIME_UNKNOWN ||
+       (random_access && track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) ||
+       (module->time != VC_CONTAINER_TIME_UNKNOWN &&
+        ((module->time - module->psi_time) & ((INT64_C(1) << 33) - 1)) >= TS_PSI_INTERVAL))
+      ts_write_psi(ctx);
+
+   /* Make sure the clock doesn't go missing when the PCR track is sparse */
+   if (track != ctx->tracks[module->pcr_track] && dts != VC_CONTAINER_TIME_UNKNOWN &&
+       (module->pcr_time == VC_CONTAINER_TIME_UNKNOWN ||
+        ((dts - module->pcr_time) & ((INT64_C(1) << 33) - 1)) >= TS_PCR_INTERVAL))
+      ts_write_pcr(ctx, dts);
+
+   if (track->format->codec == VC_CONTAINER_CODEC_H264)
+   {
+      if (!ts_h264_has_nal(data, size, 9))
+      {
+         buffers[count] = access_unit_delimiter;
+         sizes[count++] = sizeof(access_unit_delimiter);
+      }
+      if (random_access && track_module->config_size && !ts_h264_has_nal(data, size, 7))
+      {
+         buffers[count] = track_module->config;
+         sizes[count++] = track_module->config_size;
+      }
+   }
+   else if (track_module->adts && !(size >= 2 && data[0] == 0xFF && (data[1] & 0xF6) == 0xF0))
+   {
+      unsigned int length = size + sizeof(adts);
+      adts[0] = 0xFF;
+      adts[1] = 0xF1; /* MPEG-4, no CRC */
+      adts[2] = (track_module->adts_profile << 6) | (track_module->adts_sample_rate_index << 2) |
+         (track_module->adts_channels >> 2);
+      adts[3] = ((track_module->adts_channels & 0x3) << 6) | (length >> 11);
+      adts[4] = (length >> 3) & 0xFF;
+      adts[5] = ((length & 0x7) << 5) | 0x1F;
+      adts[6] = 0xFC;
+      buffers[count] = adts;
+      sizes[count++] = sizeof(adts);
+   }
+
+   buffers[count] = data;
+   sizes[count++] = size;
+
+   ts_write_pes(ctx, track, buffers, sizes, count, pts, dts, random_access);
+   return STREAM_STATUS(ctx);
+}
+
+/** Convert an AVC1 formatted access unit to byte stream format */
+static VC_CONTAINER_STATUS_T ts_avc1_to_byte_stream( VC_CONTAINER_T *ctx,
+   VC_CONTAINER_TRACK_MODULE_T *track_module )
+{
+   unsigned int nal_length_size = track_module->nal_length_size;
+   unsigned int i, j, length, size = 0;
+   uint8_t *data = track_module->frame;
+
+   /* Work out the size of the converted data */
+   for (i = 0; i + nal_length_size <= track_module->frame_size; i += nal_length_size + length)
+   {
+      for (j = 0, length = 0; j < nal_length_size; j++)
+         length = (length << 8) | data[i + j];
+      size += 4 + length;
+   }
+   if (i != track_module->frame_size)
+   {
+      LOG_DEBUG(ctx, "pid %u: invalid AVC1 access unit", track_module->pid);
+      return VC_CONTAINER_ERROR_CORRUPTED;
+   }
+
+   /* Start codes have the same size as 4 bytes NAL unit lengths */
+   if (size != track_module->frame_size)
+   {
+      data = malloc(size);
+      if (!data) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      for (i = 0, size = 0; i < track_module->frame_size; i += nal_length_size + length)
+      {
+         for (j = 0, length = 0; j < nal_length_size; j++)
+            length = (length << 8) | track_module->frame[i + j];
+         memcpy(data + size, "\x00\x00\x00\x01", 4);
+         memcpy(data + size + 4, track_module->frame + i + nal_length_size, length);
+         size += 4 + length;
+      }
+      free(track_module->frame);
+      track_module->frame = data;
+      track_module->frame_size = track_module->frame_max = size;
+      return VC_CONTAINER_SUCCESS;
+   }
+
+   for (i = 0; i < size; i += 4 + length)
+   {
+      length = (data[i] << 24) | (data[i+1] << 16) | (data[i+2] << 8) | data[i+3];
+      data[i] = data[i+1] = data[i+2] = 0;
+      data[i+3] = 1;
+   }
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T ts_writer_add_track( VC_CONTAINER_T *ctx,
+   VC_CONTAINER_ES_FORMAT_T *format )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_TRACK_T *track = NULL;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int stream_type, stream_id, i, video = 0, audio = 0;
+
+   if (module->header_done)
+      return VC_CONTAINER_ERROR_FAILED;
+   if (ctx->tracks_num >= TS_TRACKS_MAX)
+      return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+
+   for (i = 0; i < ctx->tracks_num; i++)
+   {
+      if (ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) video++;
+      if (ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_AUDIO) audio++;
+   }
+
+   switch (format->codec)
+   {
+   case VC_CONTAINER_CODEC_H264: stream_type = 0x1B; stream_id = 0xE0 + video; break;
+   case VC_CONTAINER_CODEC_MP2V: stream_type = 0x02; stream_id = 0xE0 + video; break;
+   case VC_CONTAINER_CODEC_MP4A: stream_type = 0x0F; stream_id = 0xC0 + audio; break;
+   case VC_CONTAINER_CODEC_MPGA:
+      stream_type = format->type->audio.sample_rate && format->type->audio.sample_rate < 32000 ? 0x04 : 0x03;
+      stream_id = 0xC0 + audio; break;
+   case VC_CONTAINER_CODEC_AC3: stream_type = 0x81; stream_id = 0xBD; break;
+   default:
+      return VC_CONTAINER_ERROR_TRACK_FORMAT_NOT_SUPPORTED;
+   }
+
+   /* Allocate and initialise track data */
+   ctx->tracks[ctx->tracks_num] = track =
+      vc_container_allocate_track(ctx, sizeof(*ctx->tracks[0]->priv->module));
+   if (!track)
+      return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+
+   if (format->extradata_size)
+   {
+      status = vc_container_track_allocate_extradata(ctx, track, format->extradata_size);
+      if (status != VC_CONTAINER_SUCCESS)
+         goto error;
+   }
+   vc_container_format_copy(track->format, format, format->extradata_size);
+
+   track->priv->module->pid = TS_PID_ES + ctx->tracks_num;
+   track->priv->module->stream_type = stream_type;
+   track->priv->module->stream_id = stream_id;
+   track->priv->module->frame_pts = track->priv->module->frame_dts = VC_CONTAINER_TIME_UNKNOWN;
+
+   if (format->extradata_size)
+   {
+      status = ts_set_config(ctx, track, format->extradata, format->extradata_size);
+      if (status != VC_CONTAINER_SUCCESS)
+         goto error;
+   }
+   else if (format->codec == VC_CONTAINER_CODEC_MP4A && format->type->audio.sample_rate)
+   {
+      /* Assume AAC LC when we're not given an AudioSpecificConfig */
+      for (i = 0; i < countof(ts_adts_sample_rates); i++)
+         if (ts_adts_sample_rates[i] == format->type->audio.sample_rate) break;
+      if (i < countof(ts_adts_sample_rates))
+      {
+         track->priv->module->adts = true;
+         track->priv->module->adts_profile = 1;
+         track->priv->module->adts_sample_rate_index = i;
+         track->priv->module->adts_channels = format->type->audio.channels;
+      }
+   }
+
+   ctx->tracks_num++;
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   vc_container_free_track(ctx, track);
+   return status;
+}
+
+/*****************************************************************************
+Functions exported as part of the Container Module API
+ *****************************************************************************/
+static VC_CONTAINER_STATUS_T ts_writer_close( VC_CONTAINER_T *ctx )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   unsigned int i;
+
+   ts_flush(ctx);
+
+   for (i = 0; i < ctx->tracks_num; i++)
+   {
+      free(ctx->tracks[i]->priv->module->frame);
+      vc_container_free_track(ctx, ctx->tracks[i]);
+   }
+   free(module);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T ts_writer_write( VC_CONTAINER_T *ctx,
+   VC_CONTAINER_PACKET_T *packet )
+{
+   VC_CONTAINER_MODULE_T *module = ctx->priv->module;
+   VC_CONTAINER_TRACK_T *track = ctx->tracks[packet->track];
+   VC_CONTAINER_TRACK_MODULE_T *track_module = track->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   bool frame_start, frame_end;
+
+   if (!module->header_done && (status = ts_write_header(ctx)) != VC_CONTAINER_SUCCESS)
+      return status;
+
+   if (packet->flags & VC_CONTAINER_PACKET_FLAG_CONFIG)
+      return ts_set_config(ctx, track, packet->data, packet->size);
+
+   /* Packets without any framing information are taken to be complete frames */
+   frame_start = (packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START) ||
+      !(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME);
+   frame_end = (packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_END) ||
+      !(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME);
+
+   /* Write complete frames straight from the packet when we can */
+   if (frame_start && frame_end && !track_module->nal_length_size)
+   {
+      track_module->frame_size = 0;
+      status = ts_write_frame(ctx, track, packet->data, packet->size,
+         packet->pts, packet->dts, packet->flags);
+      goto end;
+   }
+
+   if (frame_start)
+   {
+      track_module->frame_size = 0;
+      track_module->frame_pts = packet->pts;
+      track_module->frame_dts = packet->dts;
+      track_module->frame_flags = packet->flags;
+   }
+
+   if (track_module->frame_size + packet->size > track_module->frame_max)
+   {
+      unsigned int max = MAX(track_module->frame_max, TS_FRAME_SIZE_DEFAULT);
+      uint8_t *frame;
+
+      while (max < track_module->frame_size + packet->size) max <<= 1;
+      frame = realloc(track_module->frame, max);
+      if (!frame) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      track_module->frame = frame;
+      track_module->frame_max = max;
+   }
+   memcpy(track_module->frame + track_module->frame_size, packet->data, packet->size);
+   track_module->frame_size += packet->size;
+
+   if (!frame_end)
+      return VC_CONTAINER_SUCCESS;
+
+   if (track_module->nal_length_size &&
+       (status = ts_avc1_to_byte_stream(ctx, track_module)) != VC_CONTAINER_SUCCESS)
+   {
+      track_module->frame_size = 0;
+      return status;
+   }
+
+   status = ts_write_frame(ctx, track, track_module->frame, track_module->frame_size,
+      track_module->frame_pts, track_module->frame_dts, track_module->frame_flags);
+   track_module->frame_size = 0;
+
+ end:
+   if (status != VC_CONTAINER_SUCCESS)
+      return status;
+   return ts_flush(ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T ts_writer_control( VC_CONTAINER_T *ctx,
+   VC_CONTAINER_CONTROL_T operation, va_list args )
+{
+   VC_CONTAINER_ES_FORMAT_T *format;
+
+   switch (operation)
+   {
+   case VC_CONTAINER_CONTROL_TRACK_ADD:
+      format = (VC_CONTAINER_ES_FORMAT_T *)va_arg(args, VC_CONTAINER_ES_FORMAT_T *);
+      return ts_writer_add_track(ctx, format);
+
+   case VC_CONTAINER_CONTROL_TRACK_ADD_DONE:
+      if (ctx->priv->module->header_done)
+         return VC_CONTAINER_ERROR_FAILED;
+      return ts_write_header(ctx);
+
+   default: return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   }
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T ts_writer_open( VC_CONTAINER_T *ctx )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+   const char *extension = vc_uri_path_extension(ctx->priv->uri);
+   const char *segment = 0;
+   VC_CONTAINER_MODULE_T *module = 0;
+
+   /* Check if the user has specified a container */
+   vc_uri_find_query(ctx->priv->uri, 0, "container", &extension);
+
+   /* Check we're the right writer for this */
+   if(!extension)
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+   if(strcasecmp(extension, "ts"))
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+
+   LOG_DEBUG(ctx, "using ts writer");
+
+   /* Allocate our context */
+   module = malloc(sizeof(*module));
+   if (!module) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+   memset(module, 0, sizeof(*module));
+   ctx->priv->module = module;
+   ctx->tracks = module->tracks;
+
+   /* Check if the user wants the output split into segments. The segment
+    * duration is given in milliseconds and segments are only cut on
+    * random access points. */
+   vc_uri_find_query(ctx->priv->uri, 0, "segment", &segment);
+   if(segment)
+   {
+      const char *path = vc_uri_path(ctx->priv->uri);
+      const char *path_extension = vc_uri_path_extension(ctx->priv->uri);
+      size_t size = strlen(path) - (path_extension ? strlen(path_extension) + 1 : 0);
+
+      if (size >= sizeof(module->segment_base) ||
+          (path_extension && strlen(path_extension) + 1 >= sizeof(module->segment_extension)))
+      { status = VC_CONTAINER_ERROR_URI_NOT_FOUND; goto error; }
+      memcpy(module->segment_base, path, size);
+      if (path_extension)
+         snprintf(module->segment_extension, sizeof(module->segment_extension), ".%s", path_extension);
+
+      module->segment_duration = INT64_C(1000) * strtoul(segment, 0, 0);
+      LOG_DEBUG(ctx, "segmented mode (%"PRIi64"us)", module->segment_duration);
+   }
+
+   ctx->priv->pf_close = ts_writer_close;
+   ctx->priv->pf_write = ts_writer_write;
+   ctx->priv->pf_control = ts_writer_control;
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   LOG_DEBUG(ctx, "ts: error opening stream (%i)", status);
+   free(module);
+   ctx->priv->module = 0;
+   ctx->tracks = 0;
+   return status;
+}
+
+/********************************************************************************
+ Entrypoint function
+ ********************************************************************************/
+
+#if !defined(ENABLE_CONTAINERS_STANDALONE) && defined(__HIGHC__)
+# pragma weak writer_open ts_writer_open
+#endif
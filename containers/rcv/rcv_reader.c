@@ -40,6 +40,8 @@ Defines.
 #define LI32(b) (((b)[3]<<24)|((b)[2]<<16)|((b)[1]<<8)|((b)[0]))
 #define LI24(b) (((b)[2]<<16)|((b)[1]<<8)|((b)[0]))
 
+#define RCV_INDEX_SIZE 512
+
 /******************************************************************************
 Type definitions
 ******************************************************************************/
@@ -289,6 +291,21 @@ static VC_CONTAINER_STATUS_T rcv_reader_seek( VC_CONTAINER_T *p_ctx, int64_t *of
    return status;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T rcv_reader_control( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_CONTROL_T operation, va_list args )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   switch(operation)
+   {
+   case VC_CONTAINER_CONTROL_SET_INDEX_CACHE:
+      return vc_container_index_cache(p_ctx, &module->index, RCV_INDEX_SIZE,
+         VC_FOURCC('r','c','v',' '), va_arg(args, const char *));
+   default: return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   }
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T rcv_reader_close( VC_CONTAINER_T *p_ctx )
 {
@@ -309,6 +326,7 @@ VC_CONTAINER_STATUS_T rcv_reader_open( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_MODULE_T *module = 0;
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+   const char *cache = 0;
    uint8_t dummy[8];
 
    /* Quick check for a valid file header */
@@ -333,15 +351,20 @@ VC_CONTAINER_STATUS_T rcv_reader_open( VC_CONTAINER_T *p_ctx )
 
    LOG_DEBUG(p_ctx, "using rcv reader");
 
-   if(vc_container_index_create(&module->index, 512) == VC_CONTAINER_SUCCESS)
+   if(vc_container_index_create(&module->index, RCV_INDEX_SIZE) == VC_CONTAINER_SUCCESS)
       vc_container_index_add(module->index, 0LL, STREAM_POSITION(p_ctx));
 
+   /* Reuse the index built by a previous session if requested */
+   if(vc_uri_find_query(p_ctx->priv->uri, 0, "index_cache", &cache))
+      vc_container_index_cache(p_ctx, &module->index, RCV_INDEX_SIZE, VC_FOURCC('r','c','v',' '), cache);
+
    if(STREAM_SEEKABLE(p_ctx))
       p_ctx->capabilities |= VC_CONTAINER_CAPS_CAN_SEEK;
 
    p_ctx->priv->pf_close = rcv_reader_close;
    p_ctx->priv->pf_read = rcv_reader_read;
    p_ctx->priv->pf_seek = rcv_reader_seek;
+   p_ctx->priv->pf_control = rcv_reader_control;
    return VC_CONTAINER_SUCCESS;
 
  error:
@@ -0,0 +1,258 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "containers/net/net_sockets.h"
+#include "interface/vcos/vcos.h"
+
+/* Minimal HTTP/1.1 server serving a single file, used to exercise the http i/o
+ * module. It supports HEAD and GET with byte ranges, persistent connections and
+ * several connections at once, and can add a delay before each response to
+ * emulate a link with a long round trip time. */
+
+#define MAX_REQUEST_LEN 4000
+#define MAX_NAME_LEN    256
+#define CHUNK_SIZE      (64*1024)
+#define MAX_CONNECTIONS 32
+
+typedef struct
+{
+   VCOS_THREAD_T thread;
+   volatile int done;
+   char chunk[CHUNK_SIZE];
+
+   VC_CONTAINER_NET_T *sock;
+   const char *path;
+   unsigned int delay_ms;
+   unsigned int id;
+} CONNECTION_T;
+
+static int verbose;
+
+/*****************************************************************************/
+static int send_all(VC_CONTAINER_NET_T *sock, const void *data, size_t size)
+{
+   const char *ptr = data;
+
+   while (size)
+   {
+      size_t sent = vc_container_net_write(sock, ptr, size);
+      if (!sent)
+         return -1;
+      ptr += sent;
+      size -= sent;
+   }
+   return 0;
+}
+
+/*****************************************************************************/
+static int send_response(CONNECTION_T *conn, FILE *file, int64_t file_size, const char *request)
+{
+   char header[512], *range;
+   int64_t start = 0, end = file_size - 1;
+   bool head = !strncmp(request, "HEAD ", 5), partial = false;
+   int len;
+
+   if (!head && strncmp(request, "GET ", 4))
+   {
+      len = snprintf(header, sizeof(header), "HTTP/1.1 501 Not Implemented\r\nContent-Length: 0\r\n\r\n");
+      return send_all(conn->sock, header, len);
+   }
+
+   range = strstr(request, "Range: bytes=");
+   if (!head && range && sscanf(range, "Range: bytes=%"SCNd64"-%"SCNd64, &start, &end) >= 1)
+   {
+      partial = true;
+      if (end >= file_size)
+         end = file_size - 1;
+      if (start > end)
+      {
+         len = snprintf(header, sizeof(header), "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n\r\n");
+         return send_all(conn->sock, header, len);
+      }
+   }
+
+   if (verbose)
+      printf("[%u] %s %"PRId64"-%"PRId64"\n", conn->id, head ? "HEAD" : "GET", start, end);
+
+   if (conn->delay_ms)
+      vcos_sleep(conn->delay_ms);
+
+   len = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Length: %"PRId64"\r\n"
+                  "Accept-Ranges: bytes\r\nConnection: keep-alive\r\n\r\n",
+                  partial ? "206 Partial Content" : "200 OK", end - start + 1);
+   if (send_all(conn->sock, header, len))
+      return -1;
+   if (head)
+      return 0;
+
+   if (fseek(file, start, SEEK_SET))
+      return -1;
+   while (start <= end)
+   {
+      size_t size = (size_t)(end - start + 1 < CHUNK_SIZE ? end - start + 1 : CHUNK_SIZE);
+
+      if (fread(conn->chunk, 1, size, file) != size || send_all(conn->sock, conn->chunk, size))
+         return -1;
+      start += size;
+   }
+
+   return 0;
+}
+
+/*****************************************************************************/
+static void *connection_thread(void *arg)
+{
+   CONNECTION_T *conn = arg;
+   char request[MAX_REQUEST_LEN];
+   size_t used = 0, received;
+   int64_t file_size;
+   FILE *file;
+
+   file = fopen(conn->path, "rb");
+   if (!file)
+      goto end;
+   fseek(file, 0, SEEK_END);
+   file_size = ftell(file);
+
+   while ((received = vc_container_net_read(conn->sock, request + used, sizeof(request) - 1 - used)) != 0)
+   {
+      char *end;
+
+      used += received;
+      request[used] = '\0';
+
+      /* Serve all the complete requests we have received */
+      while ((end = strstr(request, "\r\n\r\n")) != NULL)
+      {
+         end += 4;
+         if (send_response(conn, file, file_size, request))
+            goto end;
+         used -= end - request;
+         memmove(request, end, used + 1);
+      }
+
+      if (used == sizeof(request) - 1)
+         break; /* Request too big */
+   }
+
+ end:
+   if (file)
+      fclose(file);
+   vc_container_net_close(conn->sock);
+   conn->done = 1;
+   return NULL;
+}
+
+int main(int argc, char **argv)
+{
+   CONNECTION_T *connections[MAX_CONNECTIONS] = {0};
+   VC_CONTAINER_NET_T *server_sock, *sock;
+   vc_container_net_status_t status;
+   unsigned int delay_ms = 0, id = 0, ii;
+   char name[MAX_NAME_LEN];
+   unsigned short port;
+
+   if (argc < 3)
+   {
+      printf("Usage:\n%s <port> <file> [<delay_ms>] [-v]\n", argv[0]);
+      return 1;
+   }
+
+   if (argc > 3)
+      sscanf(argv[3], "%u", &delay_ms);
+   verbose = argc > 4 && !strcmp(argv[4], "-v");
+   setvbuf(stdout, NULL, _IOLBF, 0);
+
+   vcos_init();
+
+   server_sock = vc_container_net_open(NULL, argv[1], VC_CONTAINER_NET_OPEN_FLAG_STREAM, &status);
+   if (!server_sock)
+   {
+      printf("vc_container_net_open failed: %d\n", status);
+      return 2;
+   }
+
+   status = vc_container_net_listen(server_sock, 16);
+   if (status != VC_CONTAINER_NET_SUCCESS)
+   {
+      printf("vc_container_net_listen failed: %d\n", status);
+      vc_container_net_close(server_sock);
+      return 3;
+   }
+
+   while (vc_container_net_accept(server_sock, &sock) == VC_CONTAINER_NET_SUCCESS)
+   {
+      CONNECTION_T *conn;
+
+      /* Clean up after the connections which have been closed */
+      for (ii = 0; ii < MAX_CONNECTIONS; ii++)
+      {
+         if (connections[ii] && connections[ii]->done)
+         {
+            vcos_thread_join(&connections[ii]->thread, NULL);
+            free(connections[ii]);
+            connections[ii] = NULL;
+         }
+      }
+      for (ii = 0; ii < MAX_CONNECTIONS && connections[ii]; ii++)
+         ;     /* Everything done in the for */
+
+      conn = ii < MAX_CONNECTIONS ? malloc(sizeof(*conn)) : NULL;
+      if (!conn)
+      {
+         printf("Too many connections\n");
+         vc_container_net_close(sock);
+         continue;
+      }
+      conn->done = 0;
+      conn->sock = sock;
+      conn->path = argv[2];
+      conn->delay_ms = delay_ms;
+      conn->id = id++;
+
+      strcpy(name, "<unknown>");
+      vc_container_net_get_client_name(sock, name, sizeof(name));
+      vc_container_net_get_client_port(sock, &port);
+      if (verbose)
+         printf("[%u] Connection from %s:%hu\n", conn->id, name, port);
+
+      if (vcos_thread_create(&conn->thread, "http_connection", NULL, connection_thread, conn) != VCOS_SUCCESS)
+      {
+         vc_container_net_close(sock);
+         free(conn);
+         continue;
+      }
+      connections[ii] = conn;
+   }
+
+   vc_container_net_close(server_sock);
+   return 0;
+}
@@ -39,6 +39,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define DEFAULT_WIDTH 320
 #define DEFAULT_HEIGHT 240
 
+/* Time between frames (us) when the port format has no frame rate */
+#define UNPACED_FRAME_INTERVAL 10000
+
 /*****************************************************************************/
 typedef struct MMAL_PORT_MODULE_T
 {
@@ -46,6 +49,9 @@ typedef struct MMAL_PORT_MODULE_T
    unsigned int frame_size;
    int count;
 
+   int64_t frame_interval; /**< Time between frames (us) */
+   int64_t frame_time;     /**< Time at which the next frame is due */
+
    MMAL_QUEUE_T *queue;
 
 } MMAL_PORT_MODULE_T;
@@ -54,13 +60,35 @@ typedef struct MMAL_COMPONENT_MODULE_T
 {
    MMAL_STATUS_T status;
 
+   VCOS_TIMER_T timer;       /**< Brings the action back when the next frame is due */
+   MMAL_BOOL_T timer_created;
+
 } MMAL_COMPONENT_MODULE_T;
 
+/*****************************************************************************/
+static void artificial_camera_timer_expired(void *context)
+{
+   mmal_component_action_trigger((MMAL_COMPONENT_T *)context);
+}
+
+/** Check whether a port has a buffer waiting for its next frame */
+static MMAL_BOOL_T artificial_camera_waiting(MMAL_COMPONENT_T *component)
+{
+   unsigned int i;
+
+   for (i = 0; i < component->output_num; i++)
+      if (mmal_queue_length(component->output[i]->priv->module->queue))
+         return MMAL_TRUE;
+   return MMAL_FALSE;
+}
+
 /*****************************************************************************/
 static void artificial_camera_do_processing(MMAL_COMPONENT_T *component)
 {
    MMAL_COMPONENT_MODULE_T *module = component->priv->module;
    MMAL_BUFFER_HEADER_T *buffer;
+   MMAL_BOOL_T waiting = MMAL_FALSE;
+   int64_t now, wait = 0;
    unsigned int i;
 
    if (module->status != MMAL_SUCCESS)
@@ -70,8 +98,22 @@ static void artificial_camera_do_processing(MMAL_COMPONENT_T *component)
    for (i = 0; i < component->output_num; i++)
    {
       MMAL_PORT_T *port = component->output[i];
+      MMAL_PORT_MODULE_T *port_module = port->priv->module;
+
+      if (!mmal_queue_length(port_module->queue))
+         continue;
+
+      /* Not time for the next frame yet */
+      now = vcos_getmicrosecs64();
+      if (now < port_module->frame_time)
+         continue;
+
+      /* Don't try to catch up with frames we were too late for */
+      port_module->frame_time += port_module->frame_interval;
+      if (port_module->frame_time < now - port_module->frame_interval)
+         port_module->frame_time = now;
 
-      buffer = mmal_queue_get(port->priv->module->queue);
+      buffer = mmal_queue_get(port_module->queue);
       if (!buffer)
          continue;
 
@@ -97,6 +139,7 @@ static void artificial_camera_do_processing(MMAL_COMPONENT_T *component)
       buffer->offset = 0;
       buffer->length = port->priv->module->frame_size;
       buffer->type->video = port->priv->module->frame;
+      buffer->pts = buffer->dts = now; /* Capture time */
 
       memset(buffer->data, 0xff, buffer->length);
       if (buffer->type->video.planes > 1)
@@ -108,7 +151,26 @@ static void artificial_camera_do_processing(MMAL_COMPONENT_T *component)
       mmal_port_buffer_header_callback(port, buffer);
    }
 
-   vcos_sleep(10); /* Make sure we don't peg all the resources */
+   /* Come back when the next frame is due on a port which has a buffer for it.
+    * The timer has a resolution of 1ms so shorter waits are rounded up. */
+   now = vcos_getmicrosecs64();
+   for (i = 0; i < component->output_num; i++)
+   {
+      MMAL_PORT_MODULE_T *port_module = component->output[i]->priv->module;
+
+      if (!mmal_queue_length(port_module->queue))
+         continue;
+      if (!waiting || port_module->frame_time - now < wait)
+         wait = port_module->frame_time - now;
+      waiting = MMAL_TRUE;
+   }
+
+   if (!waiting)
+      return;
+   if (wait <= 0)
+      mmal_component_action_trigger(component);
+   else
+      vcos_timer_reset(&module->timer, (VCOS_UNSIGNED)((wait + 999) / 1000));
 }
 
 /** Destroy a previously created component */
@@ -116,6 +178,9 @@ static MMAL_STATUS_T artificial_camera_component_destroy(MMAL_COMPONENT_T *compo
 {
    unsigned int i;
 
+   if (component->priv->module->timer_created)
+      vcos_timer_delete(&component->priv->module->timer);
+
    for (i = 0; i < component->output_num; i++)
       if (component->output[i]->priv->module->queue)
          mmal_queue_destroy(component->output[i]->priv->module->queue);
@@ -130,23 +195,36 @@ static MMAL_STATUS_T artificial_camera_component_destroy(MMAL_COMPONENT_T *compo
 /** Enable processing on a port */
 static MMAL_STATUS_T artificial_camera_port_enable(MMAL_PORT_T *port, MMAL_PORT_BH_CB_T cb)
 {
-   MMAL_PARAM_UNUSED(port);
    MMAL_PARAM_UNUSED(cb);
+   port->priv->module->frame_time = 0;
    return MMAL_SUCCESS;
 }
 
 /** Flush a port */
 static MMAL_STATUS_T artificial_camera_port_flush(MMAL_PORT_T *port)
 {
-   MMAL_PARAM_UNUSED(port);
+   MMAL_BUFFER_HEADER_T *buffer;
+
+   /* Return the buffers we are holding on to */
+   while ((buffer = mmal_queue_get(port->priv->module->queue)) != NULL)
+   {
+      buffer->length = 0;
+      mmal_port_buffer_header_callback(port, buffer);
+   }
    return MMAL_SUCCESS;
 }
 
 /** Disable processing on a port */
 static MMAL_STATUS_T artificial_camera_port_disable(MMAL_PORT_T *port)
 {
-   MMAL_PARAM_UNUSED(port);
-   return MMAL_SUCCESS;
+   MMAL_COMPONENT_T *component = port->component;
+   MMAL_STATUS_T status;
+
+   /* The action is locked by the core so it can't re-arm the timer behind our back */
+   status = artificial_camera_port_flush(port);
+   if (!artificial_camera_waiting(component))
+      vcos_timer_cancel(&component->priv->module->timer);
+   return status;
 }
 
 /** Send a buffer header to a port */
@@ -200,6 +278,13 @@ static MMAL_STATUS_T artificial_camera_port_format_commit(MMAL_PORT_T *port)
    }
 
    port->buffer_size_min = port->buffer_size_recommended = port_module->frame_size;
+
+   /* Frames are produced at the requested frame rate, if any */
+   if (port->format->es->video.frame_rate.num > 0 && port->format->es->video.frame_rate.den > 0)
+      port_module->frame_interval = INT64_C(1000000) *
+         port->format->es->video.frame_rate.den / port->format->es->video.frame_rate.num;
+   else
+      port_module->frame_interval = UNPACED_FRAME_INTERVAL;
    return MMAL_SUCCESS;
 }
 
@@ -269,6 +354,12 @@ static MMAL_STATUS_T mmal_component_create_artificial_camera(const char *name, M
          goto error;
    }
 
+   if (vcos_timer_create(&component->priv->module->timer, "artificial camera",
+                         artificial_camera_timer_expired, component) != VCOS_SUCCESS)
+      goto error;
+   component->priv->module->timer_created = MMAL_TRUE;
+
+   component->priv->action_shared = MMAL_TRUE;
    status = mmal_component_action_register(component, artificial_camera_do_processing);
    if (status != MMAL_SUCCESS)
       goto error;
@@ -25,6 +25,9 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <stdlib.h>
+#include <unistd.h>
+
 #include "mmal.h"
 #include "core/mmal_component_private.h"
 #include "core/mmal_port_private.h"
@@ -54,6 +57,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define DEFAULT_WIDTH 320
 #define DEFAULT_HEIGHT 240
 
+/* Decoding threads */
+#define AVCODEC_THREADS_MAX 16
+
+/* Number of frames the decoder can render into. This needs to cover the
+ * reference frames, the frames being decoded by each thread and the frames
+ * held by the client. The payloads are only allocated when first used. */
+#define AVCODEC_FRAMES_NUM (32 + AVCODEC_THREADS_MAX)
+
+/* Alignment of the pitch of the frames the decoder renders into */
+#define AVCODEC_PITCH_ALIGN 64
+
 static uint32_t encoding_to_codecid(uint32_t encoding);
 static uint32_t pixfmt_to_encoding(enum PixelFormat);
 
@@ -73,6 +87,13 @@ typedef struct MMAL_COMPONENT_MODULE_T
    AVCodecContext *codec_context;
    AVCodec *codec;
 
+   MMAL_BOOL_T direct_rendering; /**< The decoder renders into our frames */
+   MMAL_POOL_T *frames;          /**< Frames the decoder renders into */
+   MMAL_BUFFER_HEADER_T *frame;  /**< Frame of the picture waiting to be sent */
+   VCOS_MUTEX_T frames_lock;     /**< Protects frames_release */
+   MMAL_BOOL_T frames_lock_created;
+   MMAL_BOOL_T frames_release;   /**< Free the payload of frames as they get released */
+
    int width;
    int height;
    enum PixelFormat pix_fmt;
@@ -89,6 +110,8 @@ static MMAL_STATUS_T avcodec_component_destroy(MMAL_COMPONENT_T *component)
 {
    MMAL_COMPONENT_MODULE_T *module = component->priv->module;
 
+   if (module->frame)
+      mmal_buffer_header_release(module->frame);
    if (module->picture)
       av_free(module->picture);
    if (module->codec_context)
@@ -98,6 +121,11 @@ static MMAL_STATUS_T avcodec_component_destroy(MMAL_COMPONENT_T *component)
       av_free(module->codec_context);
    }
 
+   /* All the payloads have been freed by now since they hold a reference
+    * on the output port */
+   if(module->frames) mmal_pool_destroy(module->frames);
+   if(module->frames_lock_created) vcos_mutex_delete(&module->frames_lock);
+
    if(module->queue_in) mmal_queue_destroy(module->queue_in);
    if(module->queue_out) mmal_queue_destroy(module->queue_out);
    vcos_free(module);
@@ -106,6 +134,193 @@ static MMAL_STATUS_T avcodec_component_destroy(MMAL_COMPONENT_T *component)
    return MMAL_SUCCESS;
 }
 
+/** Number of threads used for decoding */
+static int avcodec_threads_num(void)
+{
+   const char *value = getenv("MMAL_AVCODEC_THREADS");
+   long num = 0;
+
+   if (value)
+      num = strtol(value, NULL, 0);
+#if defined(_SC_NPROCESSORS_ONLN)
+   if (num <= 0)
+      num = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+   if (num <= 0)
+      num = 1;
+   return num > AVCODEC_THREADS_MAX ? AVCODEC_THREADS_MAX : (int)num;
+}
+
+/** Dimensions of the frames the decoder renders into */
+static void avcodec_frame_dimensions(AVCodecContext *context, int *width, int *height)
+{
+   *width = context->width;
+   *height = context->height;
+   avcodec_align_dimensions(context, width, height);
+   *width = VCOS_ALIGN_UP(*width, AVCODEC_PITCH_ALIGN);
+}
+
+/** Layout of the frames the decoder renders into.
+ * Returns the size of a frame or a negative value on error. */
+static int avcodec_frame_layout(AVCodecContext *context, AVPicture *layout)
+{
+   int width, height;
+   avcodec_frame_dimensions(context, &width, &height);
+   return avpicture_fill(layout, 0, context->pix_fmt, width, height);
+}
+
+/** Give back the payload of a frame */
+static void avcodec_frame_free(MMAL_COMPONENT_T *component, MMAL_BUFFER_HEADER_T *frame)
+{
+   if (frame->data)
+      mmal_port_payload_free(component->output[0], frame->data);
+   frame->data = NULL;
+   frame->alloc_size = 0;
+}
+
+/** Called when a frame is not used by the decoder or the client anymore */
+static MMAL_BOOL_T avcodec_frame_released(MMAL_POOL_T *pool, MMAL_BUFFER_HEADER_T *frame,
+   void *userdata)
+{
+   MMAL_COMPONENT_T *component = (MMAL_COMPONENT_T *)userdata;
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   uint8_t *payload = NULL;
+
+   vcos_mutex_lock(&module->frames_lock);
+   if (module->frames_release)
+   {
+      payload = frame->data;
+      frame->data = NULL;
+      frame->alloc_size = 0;
+   }
+   mmal_queue_put(pool->queue, frame);
+   vcos_mutex_unlock(&module->frames_lock);
+
+   /* This can be the last reference on the output port, in which case a
+    * pending destruction of the component will happen now */
+   if (payload)
+      mmal_port_payload_free(component->output[0], payload);
+   return MMAL_FALSE;
+}
+
+/** Free the payloads of all the frames.
+ * This is done once both ports are disabled since the payloads hold a reference
+ * on the output port which would otherwise prevent the component from being
+ * destroyed. */
+static void avcodec_frames_release(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   MMAL_BUFFER_HEADER_T *frame;
+   unsigned int i;
+
+   if (module->frame)
+      mmal_buffer_header_release(module->frame);
+   module->frame = NULL;
+   module->picture_available = 0;
+
+   /* Get the decoder to release all its pictures */
+   if (module->codec_context->codec)
+      avcodec_flush_buffers(module->codec_context);
+
+   vcos_mutex_lock(&module->frames_lock);
+   module->frames_release = 1;
+   for (i = mmal_queue_length(module->frames->queue); i; i--)
+   {
+      frame = mmal_queue_get(module->frames->queue);
+      avcodec_frame_free(component, frame);
+      mmal_queue_put(module->frames->queue, frame);
+   }
+   vcos_mutex_unlock(&module->frames_lock);
+}
+
+/** Allocate a picture for the decoder to render into.
+ * The picture is rendered directly into the payload of one of our frames so it
+ * can be sent on the output port without being copied. */
+static int avcodec_get_buffer(AVCodecContext *context, AVFrame *picture)
+{
+   MMAL_COMPONENT_T *component = (MMAL_COMPONENT_T *)context->opaque;
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   MMAL_BUFFER_HEADER_T *frame;
+   AVPicture layout;
+   int i, size;
+
+   /* Pictures which can't be described on the output port are left to libavcodec */
+   if (pixfmt_to_encoding(context->pix_fmt) == MMAL_ENCODING_UNKNOWN)
+      return avcodec_default_get_buffer(context, picture);
+
+   size = avcodec_frame_layout(context, &layout);
+   if (size < 0)
+      return -1;
+
+   frame = mmal_queue_get(module->frames->queue);
+   if (!frame)
+   {
+      LOG_ERROR("no frame available for decoding");
+      return -1;
+   }
+
+   if (frame->alloc_size < (uint32_t)size)
+   {
+      avcodec_frame_free(component, frame);
+      frame->data = mmal_port_payload_alloc(component->output[0], size);
+      if (!frame->data)
+      {
+         LOG_ERROR("could not allocate frame (%i bytes)", size);
+         mmal_queue_put(module->frames->queue, frame);
+         return -1;
+      }
+      frame->alloc_size = size;
+   }
+   frame->length = size;
+
+   for (i = 0; i < 4; i++)
+   {
+      picture->data[i] = layout.linesize[i] ?
+         frame->data + (layout.data[i] - layout.data[0]) : NULL;
+      picture->linesize[i] = layout.linesize[i];
+   }
+
+   picture->type = FF_BUFFER_TYPE_USER;
+   picture->opaque = frame;
+   picture->age = 256*256*256*64; /* Content of the frame is unknown */
+   picture->reordered_opaque = context->reordered_opaque;
+   return 0;
+}
+
+/** Release a picture allocated by avcodec_get_buffer */
+static void avcodec_release_buffer(AVCodecContext *context, AVFrame *picture)
+{
+   int i;
+
+   if (picture->type != FF_BUFFER_TYPE_USER)
+   {
+      avcodec_default_release_buffer(context, picture);
+      return;
+   }
+
+   mmal_buffer_header_release((MMAL_BUFFER_HEADER_T *)picture->opaque);
+   for (i = 0; i < 4; i++)
+      picture->data[i] = NULL;
+}
+
+/** Fill in the format of the pictures output by the decoder */
+static void avcodec_output_format_fill(MMAL_COMPONENT_MODULE_T *module, MMAL_ES_FORMAT_T *format)
+{
+   AVCodecContext *context = module->codec_context;
+   int width = context->width, height = context->height;
+
+   /* The frames the decoder renders into are bigger than the pictures */
+   if (module->direct_rendering && width && height)
+      avcodec_frame_dimensions(context, &width, &height);
+
+   format->encoding = pixfmt_to_encoding(context->pix_fmt);
+   format->es->video.width = width;
+   format->es->video.height = height;
+   format->es->video.crop.x = format->es->video.crop.y = 0;
+   format->es->video.crop.width = context->width;
+   format->es->video.crop.height = context->height;
+}
+
 /** Set format on a port */
 static MMAL_STATUS_T avcodec_input_port_set_format(MMAL_PORT_T *port)
 {
@@ -138,6 +353,24 @@ static MMAL_STATUS_T avcodec_input_port_set_format(MMAL_PORT_T *port)
    if (codec->capabilities & CODEC_CAP_TRUNCATED)
       module->codec_context->flags |= CODEC_FLAG_TRUNCATED;
 
+   /* Let the decoder render straight into the payloads sent on the output port */
+   module->direct_rendering = !!(codec->capabilities & CODEC_CAP_DR1);
+   if (module->direct_rendering)
+   {
+      module->codec_context->opaque = port->component;
+      module->codec_context->get_buffer = avcodec_get_buffer;
+      module->codec_context->release_buffer = avcodec_release_buffer;
+      module->codec_context->flags |= CODEC_FLAG_EMU_EDGE;
+   }
+
+#ifdef FF_THREAD_FRAME
+   /* Decode on several threads. Our buffer callbacks can be called from
+    * any of those threads. */
+   module->codec_context->thread_count = avcodec_threads_num();
+   module->codec_context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+   module->codec_context->thread_safe_callbacks = 1;
+#endif
+
    if (avcodec_open(module->codec_context, codec) < 0)
    {
       LOG_ERROR("could not open codec");
@@ -154,7 +387,7 @@ static MMAL_STATUS_T avcodec_input_port_set_format(MMAL_PORT_T *port)
    port->format->es->video.width = module->codec_context->width;
    port->format->es->video.height = module->codec_context->height;
    mmal_format_copy(component->output[0]->format, port->format);
-   component->output[0]->format->encoding = pixfmt_to_encoding(module->codec_context->pix_fmt);
+   avcodec_output_format_fill(module, component->output[0]->format);
    if (!component->output[0]->format->es->video.width)
       component->output[0]->format->es->video.width = DEFAULT_WIDTH;
    if (!component->output[0]->format->es->video.height)
@@ -176,8 +409,10 @@ static MMAL_STATUS_T avcodec_output_port_set_format(MMAL_PORT_T *port)
       return MMAL_EINVAL;
 
    module->pix_fmt = module->codec_context->pix_fmt;
-   module->width = port->format->es->video.width;
-   module->height = port->format->es->video.height;
+   module->width = port->format->es->video.crop.width ?
+      (int)port->format->es->video.crop.width : (int)port->format->es->video.width;
+   module->height = port->format->es->video.crop.height ?
+      (int)port->format->es->video.crop.height : (int)port->format->es->video.height;
 
    module->frame_size =
       avpicture_fill(&module->layout, 0, module->pix_fmt, module->width, module->height);
@@ -185,11 +420,15 @@ static MMAL_STATUS_T avcodec_output_port_set_format(MMAL_PORT_T *port)
       return MMAL_EINVAL;
 
    /* Calculate the number of planes for this format */
-   for (module->planes = 0; module->planes < 4; )
-      if (!module->layout.data[module->planes++])
+   for (module->planes = 0; module->planes < 4; module->planes++)
+      if (!module->layout.linesize[module->planes])
          break;
 
-   port->buffer_size_min = module->frame_size;
+   /* With direct rendering the payloads of the output buffers are replaced by
+    * the frames the decoder rendered into so the client doesn't need to
+    * allocate any */
+   port->buffer_size_min = module->direct_rendering ? 0 : module->frame_size;
+   port->buffer_size_recommended = port->buffer_size_min;
    port->component->priv->module->output_needs_configuring = 0;
    mmal_component_action_trigger(port->component);
 
@@ -199,8 +438,12 @@ static MMAL_STATUS_T avcodec_output_port_set_format(MMAL_PORT_T *port)
 /** Enable processing on a port */
 static MMAL_STATUS_T avcodec_port_enable(MMAL_PORT_T *port, MMAL_PORT_BH_CB_T cb)
 {
-   MMAL_PARAM_UNUSED(port);
+   MMAL_COMPONENT_MODULE_T *module = port->component->priv->module;
    MMAL_PARAM_UNUSED(cb);
+
+   vcos_mutex_lock(&module->frames_lock);
+   module->frames_release = 0;
+   vcos_mutex_unlock(&module->frames_lock);
    return MMAL_SUCCESS;
 }
 
@@ -239,6 +482,9 @@ static MMAL_STATUS_T avcodec_port_disable(MMAL_PORT_T *port)
    if(status != MMAL_SUCCESS)
       return status;
 
+   if(!port->component->input[0]->is_enabled && !port->component->output[0]->is_enabled)
+      avcodec_frames_release(port->component);
+
    return MMAL_SUCCESS;
 }
 
@@ -260,13 +506,12 @@ static void avcodec_send_event_format_changed(MMAL_COMPONENT_T *component, MMAL_
 
    /* Fill in the new format */
    mmal_format_copy(event->format, port->format);
-   event->format->es->video.width = module->codec_context->width;
-   event->format->es->video.height = module->codec_context->height;
-   event->format->encoding = pixfmt_to_encoding(module->codec_context->pix_fmt);
+   avcodec_output_format_fill(module, event->format);
 
    /* Pass on the buffer requirements */
    event->buffer_num_min = port->buffer_num_min;
-   event->buffer_size_min = module->codec_context->width * module->codec_context->height * 2;
+   event->buffer_size_min = module->direct_rendering ? 0 :
+      module->codec_context->width * module->codec_context->height * 2;
    event->buffer_size_recommended = event->buffer_size_min;
    event->buffer_num_recommended = port->buffer_num_recommended;
 
@@ -309,6 +554,35 @@ static MMAL_STATUS_T avcodec_send_picture(MMAL_COMPONENT_T *component, MMAL_PORT
    if (!out)
       return MMAL_EAGAIN;
 
+   /* The picture was rendered into one of our frames so we just need to
+    * reference it from the output buffer */
+   if (module->frame)
+   {
+      if (mmal_buffer_header_replicate(out, module->frame) != MMAL_SUCCESS)
+      {
+         mmal_queue_put_back(module->queue_out, out);
+         LOG_ERROR("could not replicate frame into buffer %p", out);
+         mmal_event_error_send(component, MMAL_EINVAL);
+         return MMAL_EINVAL;
+      }
+      mmal_buffer_header_release(module->frame);
+      module->frame = NULL;
+
+      out->pts    = module->pts;
+      out->flags  = 0;
+
+      out->type->video.planes = module->planes;
+      for (i = 0; i < 4; i++)
+      {
+         out->type->video.offset[i] = module->picture->data[i] ?
+            module->picture->data[i] - out->data : 0;
+         out->type->video.pitch[i] = module->picture->linesize[i];
+      }
+
+      mmal_port_buffer_header_callback(port, out);
+      return MMAL_SUCCESS;
+   }
+
    size = avpicture_layout((AVPicture *)module->picture, module->pix_fmt,
                            module->width, module->height, out->data, out->alloc_size);
    if (size < 0)
@@ -393,6 +667,14 @@ static MMAL_BOOL_T avcodec_do_processing(MMAL_COMPONENT_T *component)
       module->pts = module->picture->reordered_opaque;
       if (module->pts == MMAL_TIME_UNKNOWN)
          module->pts = in->dts;
+
+      /* Hold on to the frame until the picture is sent since the decoder
+       * might not keep it */
+      if (module->direct_rendering && module->picture->type == FF_BUFFER_TYPE_USER)
+      {
+         module->frame = (MMAL_BUFFER_HEADER_T *)module->picture->opaque;
+         mmal_buffer_header_acquire(module->frame);
+      }
    }
 
  end:
@@ -475,6 +757,12 @@ static MMAL_STATUS_T mmal_component_create_avcodec(const char *name, MMAL_COMPON
    module->codec_context = avcodec_alloc_context();
    if(!module->codec_context) goto error;
 
+   if(vcos_mutex_create(&module->frames_lock, "avcodec frames") != VCOS_SUCCESS) goto error;
+   module->frames_lock_created = 1;
+   module->frames = mmal_pool_create(AVCODEC_FRAMES_NUM, 0);
+   if(!module->frames) goto error;
+   mmal_pool_callback_set(module->frames, avcodec_frame_released, component);
+
    component->input[0]->priv->pf_set_format = avcodec_input_port_set_format;
    component->input[0]->priv->pf_enable = avcodec_port_enable;
    component->input[0]->priv->pf_disable = avcodec_port_disable;
@@ -44,8 +44,25 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define READER_RECOMMENDED_BUFFER_SIZE (32*1024)
 #define READER_RECOMMENDED_BUFFER_NUM 10
 
+/* Default read-ahead budget */
+#define READER_READ_AHEAD_BYTES (4*1024*1024)
+#define READER_READ_AHEAD_DURATION INT64_C(2000000)
+/* Amount of data read at once when the container doesn't tell us the size of a packet */
+#define READER_READ_AHEAD_CHUNK (64*1024)
+
 /*****************************************************************************/
 
+/** Packet read ahead by the reading thread */
+typedef struct READER_PACKET_T
+{
+   struct READER_PACKET_T *next;
+   int64_t pts;
+   int64_t dts;
+   uint32_t flags;      /**< MMAL_BUFFER_HEADER_FLAG_* flags of the packet */
+   uint32_t size;       /**< Size of the data following this structure */
+   uint32_t offset;     /**< Amount of data already sent */
+} READER_PACKET_T;
+
 /** Private context for this component */
 typedef struct MMAL_COMPONENT_MODULE_T
 {
@@ -59,6 +76,19 @@ typedef struct MMAL_COMPONENT_MODULE_T
    /* Reader specific */
    MMAL_BOOL_T packet_logged;
 
+   /* Read-ahead */
+   uint32_t read_ahead_bytes;       /**< Byte budget, 0 if read-ahead is disabled */
+   int64_t read_ahead_duration;     /**< Duration to read ahead on each track */
+   MMAL_BOOL_T read_ahead;          /**< The reading thread is running */
+   VCOS_THREAD_T thread;            /**< Thread reading ahead from the container */
+   VCOS_SEMAPHORE_T wake;           /**< Wakes up the reading thread */
+   VCOS_MUTEX_T read_lock;          /**< Serialises accesses to the container */
+   VCOS_MUTEX_T lock;               /**< Protects the read-ahead queues */
+   MMAL_BOOL_T locks_created;
+   MMAL_BOOL_T quit;                /**< The reading thread must exit */
+   VC_CONTAINER_STATUS_T read_status; /**< Status of the last read by the reading thread */
+   uint32_t bytes_buffered;         /**< Amount of data read ahead on all tracks */
+
    /* Writer specific */
    unsigned int port_last_used;
    unsigned int port_writing_frame;
@@ -75,6 +105,12 @@ typedef struct MMAL_PORT_MODULE_T
 
    VC_CONTAINER_ES_FORMAT_T *format; /**< Format description for the elementary stream */
 
+   /* Read-ahead queue of the track */
+   READER_PACKET_T *first;
+   READER_PACKET_T **last;
+   int64_t time_first;              /**< Timestamp of the oldest packet queued */
+   int64_t time_last;               /**< Timestamp of the newest packet queued */
+
 } MMAL_PORT_MODULE_T;
 
 /*****************************************************************************/
@@ -335,6 +371,384 @@ static MMAL_STATUS_T mmal_to_container_format(VC_CONTAINER_ES_FORMAT_T *containe
    return MMAL_SUCCESS;
 }
 
+/*****************************************************************************/
+static uint32_t container_to_mmal_buffer_flags(uint32_t packet_flags)
+{
+   uint32_t flags = 0;
+
+   if(packet_flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME)
+      flags |= MMAL_BUFFER_HEADER_FLAG_KEYFRAME;
+   if(packet_flags & VC_CONTAINER_PACKET_FLAG_FRAME_START)
+      flags |= MMAL_BUFFER_HEADER_FLAG_FRAME_START;
+   if(packet_flags & VC_CONTAINER_PACKET_FLAG_FRAME_END)
+      flags |= MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+#ifdef VC_CONTAINER_PACKET_FLAG_CONFIG
+   if(packet_flags & VC_CONTAINER_PACKET_FLAG_CONFIG)
+      flags |= MMAL_BUFFER_HEADER_FLAG_CONFIG;
+#endif
+   return flags;
+}
+
+/*****************************************************************************
+ * Read-ahead.
+ * A background thread reads packets from the container into a queue per track
+ * so that stalls in the I/O don't starve the output ports. The action thread
+ * copies the queued packets into the buffers of the output ports.
+ *****************************************************************************/
+static int64_t reader_packet_time(const READER_PACKET_T *packet)
+{
+   return packet->dts != MMAL_TIME_UNKNOWN ? packet->dts : packet->pts;
+}
+
+/** Duration of the data queued on a port. Must be called with the lock held. */
+static int64_t reader_queue_duration(MMAL_PORT_MODULE_T *port_module)
+{
+   if(!port_module->first || port_module->time_first == MMAL_TIME_UNKNOWN ||
+      port_module->time_last == MMAL_TIME_UNKNOWN ||
+      port_module->time_last < port_module->time_first)
+      return 0;
+   return port_module->time_last - port_module->time_first;
+}
+
+/** Shortest duration of data queued on the enabled ports.
+ * Must be called with the lock held. */
+static int64_t reader_queue_duration_min(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   int64_t duration, duration_min = -1;
+   unsigned int i;
+
+   for(i = 0; i < module->ports; i++)
+   {
+      if(!component->output[i]->is_enabled)
+         continue;
+      duration = reader_queue_duration(component->output[i]->priv->module);
+      if(duration_min < 0 || duration < duration_min)
+         duration_min = duration;
+   }
+   return duration_min;
+}
+
+/** Check whether the read-ahead budget has been used up */
+static MMAL_BOOL_T reader_queue_full(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   MMAL_BOOL_T full;
+   int64_t duration;
+
+   vcos_mutex_lock(&module->lock);
+   duration = reader_queue_duration_min(component);
+   full = module->bytes_buffered >= module->read_ahead_bytes || duration < 0 ||
+      (module->read_ahead_duration && duration >= module->read_ahead_duration);
+   vcos_mutex_unlock(&module->lock);
+   return full;
+}
+
+/** Remove the first packet queued on a port. Must be called with the lock held. */
+static void reader_queue_pop(MMAL_COMPONENT_MODULE_T *module, MMAL_PORT_MODULE_T *port_module)
+{
+   READER_PACKET_T *packet = port_module->first;
+
+   port_module->first = packet->next;
+   if(!port_module->first)
+   {
+      port_module->last = &port_module->first;
+      port_module->time_first = port_module->time_last = MMAL_TIME_UNKNOWN;
+   }
+   else if(reader_packet_time(port_module->first) != MMAL_TIME_UNKNOWN)
+      port_module->time_first = reader_packet_time(port_module->first);
+
+   module->bytes_buffered -= packet->size;
+   vcos_free(packet);
+}
+
+/** Drop all the packets queued on a port */
+static void reader_queue_flush(MMAL_COMPONENT_MODULE_T *module, MMAL_PORT_MODULE_T *port_module)
+{
+   vcos_mutex_lock(&module->lock);
+   while(port_module->first)
+      reader_queue_pop(module, port_module);
+   vcos_mutex_unlock(&module->lock);
+}
+
+/** Read the next packet from the container into the queue of its port.
+ * Must be called with the read lock held. */
+static VC_CONTAINER_STATUS_T reader_read_ahead_packet(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   MMAL_PORT_MODULE_T *port_module;
+   VC_CONTAINER_STATUS_T cstatus;
+   VC_CONTAINER_PACKET_T packet;
+   READER_PACKET_T *queued;
+   unsigned int i;
+
+   memset(&packet, 0, sizeof(packet));
+   cstatus = vc_container_read(module->container, &packet, VC_CONTAINER_READ_FLAG_INFO);
+   if(cstatus != VC_CONTAINER_SUCCESS)
+      return cstatus;
+
+   /* Find the port corresponding to that track */
+   for(i = 0; i < module->ports; i++)
+      if(component->output[i]->priv->module->track == packet.track &&
+         module->container->tracks[packet.track]->is_enabled)
+         break;
+   if(i == module->ports)
+      return vc_container_read(module->container, 0, VC_CONTAINER_READ_FLAG_SKIP);
+   port_module = component->output[i]->priv->module;
+
+   /* Some containers don't know the size of their packets in advance, and the size
+    * of the others comes from the file. Packets of unknown or large size are read
+    * in chunks, the same way we would read them into buffers. */
+   packet.buffer_size = packet.size && packet.size <= READER_READ_AHEAD_CHUNK ?
+      packet.size : READER_READ_AHEAD_CHUNK;
+   queued = vcos_malloc(sizeof(*queued) + packet.buffer_size, "mmal reader packet");
+   if(!queued)
+      return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+
+   packet.data = (uint8_t *)&queued[1];
+   packet.size = 0;
+   cstatus = vc_container_read(module->container, &packet, 0);
+   if(cstatus != VC_CONTAINER_SUCCESS || !packet.size)
+   {
+      vcos_free(queued);
+      return cstatus;
+   }
+
+   /* Don't hold on to a whole chunk when the container gave us less data, since the
+    * read ahead budget only accounts for the data we queue */
+   if(packet.size < packet.buffer_size)
+   {
+      READER_PACKET_T *shrunk = vcos_malloc(sizeof(*shrunk) + packet.size, "mmal reader packet");
+      if(shrunk)
+      {
+         memcpy(&shrunk[1], &queued[1], packet.size);
+         vcos_free(queued);
+         queued = shrunk;
+      }
+   }
+
+   queued->next = NULL;
+   queued->pts = packet.pts == VC_CONTAINER_TIME_UNKNOWN ? MMAL_TIME_UNKNOWN : packet.pts;
+   queued->dts = packet.dts == VC_CONTAINER_TIME_UNKNOWN ? MMAL_TIME_UNKNOWN : packet.dts;
+   queued->flags = container_to_mmal_buffer_flags(packet.flags);
+   queued->size = packet.size;
+   queued->offset = 0;
+
+   vcos_mutex_lock(&module->lock);
+   if(reader_packet_time(queued) != MMAL_TIME_UNKNOWN)
+   {
+      if(!port_module->first || port_module->time_first == MMAL_TIME_UNKNOWN)
+         port_module->time_first = reader_packet_time(queued);
+      port_module->time_last = reader_packet_time(queued);
+   }
+   *port_module->last = queued;
+   port_module->last = &queued->next;
+   module->bytes_buffered += queued->size;
+   vcos_mutex_unlock(&module->lock);
+
+   mmal_component_action_trigger(component);
+   return VC_CONTAINER_SUCCESS;
+}
+
+static void *reader_read_ahead_thread(void *arg)
+{
+   MMAL_COMPONENT_T *component = (MMAL_COMPONENT_T *)arg;
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   VC_CONTAINER_STATUS_T cstatus;
+
+   while(1)
+   {
+      vcos_semaphore_wait(&module->wake);
+      if(module->quit)
+         break;
+
+      /* Read until the budget is used up. The read lock is released between
+       * packets so seeking and enabling tracks isn't held up for long. */
+      while(!module->quit && !reader_queue_full(component))
+      {
+         vcos_mutex_lock(&module->read_lock);
+         if(module->read_status != VC_CONTAINER_SUCCESS)
+         {
+            vcos_mutex_unlock(&module->read_lock);
+            break;
+         }
+
+         cstatus = reader_read_ahead_packet(component);
+         if(cstatus != VC_CONTAINER_SUCCESS && cstatus != VC_CONTAINER_ERROR_CONTINUE)
+         {
+            LOG_DEBUG("read ahead stopped (%i)", cstatus);
+            vcos_mutex_lock(&module->lock);
+            module->read_status = cstatus;
+            vcos_mutex_unlock(&module->lock);
+            mmal_component_action_trigger(component);
+         }
+         vcos_mutex_unlock(&module->read_lock);
+      }
+   }
+
+   return NULL;
+}
+
+static void reader_read_ahead_wake(MMAL_COMPONENT_MODULE_T *module)
+{
+   if(module->read_ahead)
+      vcos_semaphore_post(&module->wake);
+}
+
+static MMAL_STATUS_T reader_read_ahead_start(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+
+   if(vcos_semaphore_create(&module->wake, "mmal reader", 0) != VCOS_SUCCESS)
+      return MMAL_ENOSPC;
+   if(vcos_thread_create(&module->thread, "mmal reader", NULL,
+                         reader_read_ahead_thread, component) != VCOS_SUCCESS)
+   {
+      vcos_semaphore_delete(&module->wake);
+      return MMAL_ENOSPC;
+   }
+
+   module->read_ahead = MMAL_TRUE;
+   return MMAL_SUCCESS;
+}
+
+static void reader_read_ahead_stop(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   unsigned int i;
+
+   if(!module->read_ahead)
+      return;
+
+   module->quit = MMAL_TRUE;
+   vcos_semaphore_post(&module->wake);
+   vcos_thread_join(&module->thread, NULL);
+   vcos_semaphore_delete(&module->wake);
+   module->read_ahead = MMAL_FALSE;
+
+   for(i = 0; i < component->output_num; i++)
+      reader_queue_flush(module, component->output[i]->priv->module);
+}
+
+/** Send the packets read ahead to the output ports */
+static void reader_read_ahead_do_processing(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   VC_CONTAINER_STATUS_T read_status;
+   MMAL_BUFFER_HEADER_T *buffer;
+   MMAL_BOOL_T wake = MMAL_FALSE;
+   READER_PACKET_T *packet;
+   MMAL_STATUS_T status;
+   unsigned int i;
+   uint32_t size;
+
+   for(i = 0; i < module->ports; i++)
+   {
+      MMAL_PORT_T *port = component->output[i];
+      MMAL_PORT_MODULE_T *port_module = port->priv->module;
+
+      if(!port->is_enabled)
+         continue;
+
+      /* Only this thread removes packets so the first packet stays valid
+       * once we've got it */
+      while((buffer = mmal_queue_get(port_module->queue)) != NULL)
+      {
+         vcos_mutex_lock(&module->lock);
+         packet = port_module->first;
+         vcos_mutex_unlock(&module->lock);
+         if(!packet)
+         {
+            /* The port is starved, make sure the reading thread is running */
+            mmal_queue_put_back(port_module->queue, buffer);
+            wake = MMAL_TRUE;
+            break;
+         }
+
+         if(port_module->flush)
+         {
+            buffer->length = 0;
+            port_module->flush = MMAL_FALSE;
+         }
+
+         if(!buffer->length)
+         {
+            /* Packets split across buffers only carry their timestamps
+             * and start flags in the first buffer */
+            buffer->pts = packet->offset ? MMAL_TIME_UNKNOWN : packet->pts;
+            buffer->dts = packet->offset ? MMAL_TIME_UNKNOWN : packet->dts;
+            buffer->flags = packet->offset ? 0 : packet->flags &
+               (MMAL_BUFFER_HEADER_FLAG_KEYFRAME|MMAL_BUFFER_HEADER_FLAG_FRAME_START);
+         }
+         buffer->flags |= packet->flags & MMAL_BUFFER_HEADER_FLAG_CONFIG;
+
+         size = MMAL_MIN(packet->size - packet->offset, buffer->alloc_size - buffer->length);
+         mmal_buffer_header_mem_lock(buffer);
+         memcpy(buffer->data + buffer->length, (uint8_t *)&packet[1] + packet->offset, size);
+         mmal_buffer_header_mem_unlock(buffer);
+         buffer->length += size;
+         packet->offset += size;
+
+         if(packet->offset == packet->size)
+         {
+            buffer->flags |= packet->flags & MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+            vcos_mutex_lock(&module->lock);
+            reader_queue_pop(module, port_module);
+            vcos_mutex_unlock(&module->lock);
+            wake = MMAL_TRUE;
+         }
+
+         if((port->format->flags & MMAL_ES_FORMAT_FLAG_FRAMED) &&
+            buffer->length != buffer->alloc_size &&
+            !(buffer->flags & MMAL_BUFFER_HEADER_FLAG_FRAME_END))
+         {
+            mmal_queue_put_back(port_module->queue, buffer);
+            continue;
+         }
+
+         /* Send buffer back */
+         mmal_port_buffer_header_callback(port, buffer);
+      }
+   }
+
+   /* Let the reading thread refill the queues */
+   if(wake)
+      reader_read_ahead_wake(module);
+
+   vcos_mutex_lock(&module->lock);
+   read_status = module->read_status;
+   vcos_mutex_unlock(&module->lock);
+
+   if(read_status == VC_CONTAINER_ERROR_EOS)
+   {
+      /* Send an empty EOS buffer for each port once its queue is empty */
+      for(i = 0; i < component->output_num; i++)
+      {
+         MMAL_PORT_T *port = component->output[i];
+         if(!port->is_enabled || port->priv->module->eos || port->priv->module->first)
+            continue;
+         buffer = mmal_queue_get(port->priv->module->queue);
+         if(!buffer)
+            continue; /* Try again next time */
+         buffer->length = 0;
+         buffer->pts = buffer->dts = MMAL_TIME_UNKNOWN;
+         buffer->flags = MMAL_BUFFER_HEADER_FLAG_EOS;
+         port->priv->module->eos = 1;
+         mmal_port_buffer_header_callback(port, buffer);
+      }
+   }
+   else if(read_status != VC_CONTAINER_SUCCESS && !module->error)
+   {
+      status = mmal_event_error_send(component, container_map_to_mmal_status(read_status));
+      if (status != MMAL_SUCCESS)
+      {
+         LOG_ERROR("unable to send an error event buffer (%i)", (int)status);
+         return;
+      }
+      module->error = 1;
+   }
+}
+
 /*****************************************************************************/
 static void reader_do_processing(MMAL_COMPONENT_T *component)
 {
@@ -345,6 +759,12 @@ static void reader_do_processing(MMAL_COMPONENT_T *component)
    MMAL_STATUS_T status;
    unsigned int i;
 
+   if(module->read_ahead)
+   {
+      reader_read_ahead_do_processing(component);
+      return;
+   }
+
    memset(&packet, 0, sizeof(packet));
 
    while(1)
@@ -610,6 +1030,13 @@ static MMAL_STATUS_T container_component_destroy(MMAL_COMPONENT_T *component)
    MMAL_COMPONENT_MODULE_T *module = component->priv->module;
    unsigned int i;
 
+   reader_read_ahead_stop(component);
+   if(module->locks_created)
+   {
+      vcos_mutex_delete(&module->read_lock);
+      vcos_mutex_delete(&module->lock);
+   }
+
    if(module->container)
       vc_container_close(module->container);
 
@@ -662,7 +1089,14 @@ static MMAL_STATUS_T container_port_enable(MMAL_PORT_T *port, MMAL_PORT_BH_CB_T
       LOG_ERROR("error 1 adding track %4.4s (%i/%i)", (char *)&port->format->encoding, port_module->track, module->container->tracks_num);
       return MMAL_EINVAL;
       }
+
+   if(module->read_ahead)
+      vcos_mutex_lock(&module->read_lock);
    module->container->tracks[port_module->track]->is_enabled = 1;
+   if(module->read_ahead)
+      vcos_mutex_unlock(&module->read_lock);
+
+   reader_read_ahead_wake(module);
    return MMAL_SUCCESS;
 }
 
@@ -703,7 +1137,15 @@ static MMAL_STATUS_T container_port_disable(MMAL_PORT_T *port)
    if(status != MMAL_SUCCESS)
       return status;
 
+   if(module->read_ahead)
+      vcos_mutex_lock(&module->read_lock);
    module->container->tracks[track]->is_enabled = 0;
+   if(module->read_ahead)
+   {
+      vcos_mutex_unlock(&module->read_lock);
+      reader_queue_flush(module, port->priv->module);
+      reader_read_ahead_wake(module);
+   }
    return MMAL_SUCCESS;
 }
 
@@ -797,6 +1239,8 @@ static MMAL_STATUS_T reader_container_open(MMAL_COMPONENT_T *component, const ch
       component->output[i]->format->encoding = MMAL_ENCODING_UNKNOWN;
    }
 
+   if(module->read_ahead_bytes)
+      return reader_read_ahead_start(component);
    return MMAL_SUCCESS;
 }
 
@@ -814,12 +1258,25 @@ static MMAL_STATUS_T reader_container_seek(MMAL_COMPONENT_T *component, const MM
       flags |= VC_CONTAINER_SEEK_FLAG_FORWARD;
 
    mmal_component_action_lock(component);
+   if(module->read_ahead)
+      vcos_mutex_lock(&module->read_lock);
    for(i = 0; i < component->output_num; i++)
    {
       component->output[i]->priv->module->eos = MMAL_FALSE;
       component->output[i]->priv->module->flush = MMAL_TRUE;
    }
    cstatus = vc_container_seek( module->container, &offset, VC_CONTAINER_SEEK_MODE_TIME, flags);
+   if(module->read_ahead)
+   {
+      /* Drop what was read ahead from the old position */
+      for(i = 0; i < component->output_num; i++)
+         reader_queue_flush(module, component->output[i]->priv->module);
+      vcos_mutex_lock(&module->lock);
+      module->read_status = VC_CONTAINER_SUCCESS;
+      vcos_mutex_unlock(&module->lock);
+      vcos_mutex_unlock(&module->read_lock);
+      reader_read_ahead_wake(module);
+   }
    mmal_component_action_unlock(component);
    return container_map_to_mmal_status(cstatus);
 }
@@ -845,6 +1302,23 @@ static MMAL_STATUS_T reader_parameter_set(MMAL_PORT_T *port, const MMAL_PARAMETE
 
       return reader_container_seek(component, (const MMAL_PARAMETER_SEEK_T *)param);
 
+   case MMAL_PARAMETER_READ_AHEAD:
+      {
+         const MMAL_PARAMETER_READ_AHEAD_T *read_ahead = (const MMAL_PARAMETER_READ_AHEAD_T *)param;
+         if(param->size < sizeof(*read_ahead) || read_ahead->duration < 0)
+            return MMAL_EINVAL;
+         /* Read-ahead can't be turned on or off once the container is open */
+         if(module->container && !read_ahead->bytes != !module->read_ahead)
+            return MMAL_EINVAL;
+
+         vcos_mutex_lock(&module->lock);
+         module->read_ahead_bytes = read_ahead->bytes;
+         module->read_ahead_duration = read_ahead->duration;
+         vcos_mutex_unlock(&module->lock);
+         reader_read_ahead_wake(module);
+         return MMAL_SUCCESS;
+      }
+
    default:
       return MMAL_ENOSYS;
    }
@@ -852,6 +1326,33 @@ static MMAL_STATUS_T reader_parameter_set(MMAL_PORT_T *port, const MMAL_PARAMETE
    return MMAL_SUCCESS;
 }
 
+static MMAL_STATUS_T reader_parameter_get(MMAL_PORT_T *port, MMAL_PARAMETER_HEADER_T *param)
+{
+   MMAL_COMPONENT_T *component = port->component;
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+
+   switch(param->id)
+   {
+   case MMAL_PARAMETER_READ_AHEAD:
+      {
+         MMAL_PARAMETER_READ_AHEAD_T *read_ahead = (MMAL_PARAMETER_READ_AHEAD_T *)param;
+         if(param->size < sizeof(*read_ahead))
+            return MMAL_EINVAL;
+
+         vcos_mutex_lock(&module->lock);
+         read_ahead->bytes = module->read_ahead_bytes;
+         read_ahead->bytes_buffered = module->bytes_buffered;
+         read_ahead->duration = module->read_ahead_duration;
+         read_ahead->duration_buffered = MMAL_MAX(reader_queue_duration_min(component), 0);
+         vcos_mutex_unlock(&module->lock);
+         return MMAL_SUCCESS;
+      }
+
+   default:
+      return MMAL_ENOSYS;
+   }
+}
+
 /** Create an instance of a component  */
 static MMAL_STATUS_T mmal_component_create_reader(const char *name, MMAL_COMPONENT_T *component)
 {
@@ -868,6 +1369,17 @@ static MMAL_STATUS_T mmal_component_create_reader(const char *name, MMAL_COMPONE
 
    component->priv->pf_destroy = container_component_destroy;
 
+   module->read_ahead_bytes = READER_READ_AHEAD_BYTES;
+   module->read_ahead_duration = READER_READ_AHEAD_DURATION;
+   if(vcos_mutex_create(&module->read_lock, "mmal reader") != VCOS_SUCCESS)
+      goto error;
+   if(vcos_mutex_create(&module->lock, "mmal reader queues") != VCOS_SUCCESS)
+   {
+      vcos_mutex_delete(&module->read_lock);
+      goto error;
+   }
+   module->locks_created = MMAL_TRUE;
+
    /* Create 3 tracks for now (audio/video/subpicture).
     * FIXME: ideally we should create 1 track per elementary stream. */
    outputs_num = 3;
@@ -889,8 +1401,10 @@ static MMAL_STATUS_T mmal_component_create_reader(const char *name, MMAL_COMPONE
       component->output[i]->priv->module->queue = mmal_queue_create();
       if(!component->output[i]->priv->module->queue)
          goto error;
+      component->output[i]->priv->module->last = &component->output[i]->priv->module->first;
    }
    component->control->priv->pf_parameter_set = reader_parameter_set;
+   component->control->priv->pf_parameter_get = reader_parameter_get;
 
    status = mmal_component_action_register(component, reader_do_processing);
    if (status != MMAL_SUCCESS)
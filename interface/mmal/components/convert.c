@@ -0,0 +1,493 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "mmal.h"
+#include "core/mmal_component_private.h"
+#include "core/mmal_port_private.h"
+#include "core/mmal_executor_private.h"
+#include "mmal_logging.h"
+#include "convert_kernels.h"
+
+/* Host-side pixel format conversion and scaling.
+ * The output port follows the format of the input port until a format is
+ * committed on the output port, at which point the frames get converted (and
+ * scaled) to that format. Large frames are split in slices of rows which are
+ * converted in parallel on the shared executor. */
+
+/** Number of pixels per slice above which frames get split across threads */
+#define CONVERT_SLICE_PIXELS (256*1024)
+
+/*****************************************************************************/
+typedef struct MMAL_COMPONENT_MODULE_T
+{
+   MMAL_STATUS_T status; /**< current status of the component */
+
+   MMAL_CONVERT_CONTEXT_T *context; /**< Conversion context for the current formats */
+   MMAL_BOOL_T context_dirty;       /**< Formats have changed since the context was created */
+   MMAL_CONVERT_FRAME_T src;        /**< Frame being converted */
+   MMAL_CONVERT_FRAME_T dst;        /**< Frame being converted into */
+
+   VCOS_MUTEX_T lock;               /**< Protects the slices of the frame being converted */
+   VCOS_SEMAPHORE_T done;           /**< Posted when the last slice of a frame is converted */
+   unsigned int slices;             /**< Number of slices in the frame being converted */
+   unsigned int next_slice;         /**< Next slice to convert */
+   unsigned int slices_done;        /**< Number of slices converted */
+
+   /** Tasks helping with the conversion of the slices */
+   MMAL_EXECUTOR_TASK_T tasks[MMAL_CONVERT_SLICES_MAX - 1];
+   unsigned int tasks_num;
+   MMAL_BOOL_T lock_created, done_created;
+
+} MMAL_COMPONENT_MODULE_T;
+
+typedef struct MMAL_PORT_MODULE_T
+{
+   MMAL_QUEUE_T *queue; /**< queue for the buffers sent to the ports */
+   MMAL_BOOL_T needs_configuring; /**< port is waiting for a format commit */
+   MMAL_BOOL_T configured; /**< a format was committed on the output port */
+
+} MMAL_PORT_MODULE_T;
+
+/*****************************************************************************/
+
+/** Convert slices of the current frame until there are none left.
+ * This is run by the thread processing the buffers as well as by the slice
+ * tasks so the frame gets converted even if no other worker is available. */
+static void convert_slices_run(void *context)
+{
+   MMAL_COMPONENT_MODULE_T *module = context;
+   unsigned int slice;
+
+   while (1)
+   {
+      vcos_mutex_lock(&module->lock);
+      if (module->next_slice >= module->slices)
+      {
+         vcos_mutex_unlock(&module->lock);
+         return;
+      }
+      slice = module->next_slice++;
+      vcos_mutex_unlock(&module->lock);
+
+      mmal_convert_slice(module->context, &module->src, &module->dst, slice);
+
+      vcos_mutex_lock(&module->lock);
+      if (++module->slices_done == module->slices)
+         vcos_semaphore_post(&module->done);
+      vcos_mutex_unlock(&module->lock);
+   }
+}
+
+/** Convert the current frame */
+static void convert_frame(MMAL_COMPONENT_MODULE_T *module)
+{
+   unsigned int i, slices = mmal_convert_context_slices(module->context);
+
+   vcos_mutex_lock(&module->lock);
+   module->slices = slices;
+   module->next_slice = 0;
+   module->slices_done = 0;
+   vcos_mutex_unlock(&module->lock);
+
+   for (i = 0; i + 1 < slices && i < module->tasks_num; i++)
+      mmal_executor_task_trigger(&module->tasks[i]);
+
+   convert_slices_run(module);
+   vcos_semaphore_wait(&module->done);
+}
+
+/** Get the conversion context for the current formats */
+static MMAL_STATUS_T convert_context_update(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   MMAL_CONVERT_FRAME_T src, dst;
+   uint32_t size;
+   unsigned int slices;
+
+   if (module->context && !module->context_dirty)
+      return MMAL_SUCCESS;
+
+   mmal_convert_context_destroy(module->context);
+   module->context = NULL;
+   module->context_dirty = 0;
+
+   if (mmal_convert_frame_init(&src, component->input[0]->format, NULL, &size) != MMAL_SUCCESS ||
+       mmal_convert_frame_init(&dst, component->output[0]->format, NULL, &size) != MMAL_SUCCESS)
+      return MMAL_EINVAL;
+
+   slices = 1 + dst.width * dst.height / CONVERT_SLICE_PIXELS;
+   module->context = mmal_convert_context_create(&src, &dst, MMAL_CONVERT_SCALE_NONE, slices, 1);
+   return module->context ? MMAL_SUCCESS : MMAL_ENOMEM;
+}
+
+/** Actual processing function */
+static MMAL_BOOL_T convert_do_processing(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   MMAL_PORT_T *port_in = component->input[0];
+   MMAL_PORT_T *port_out = component->output[0];
+   MMAL_BUFFER_HEADER_T *in, *out;
+   uint32_t src_size, dst_size;
+
+   if (port_out->priv->module->needs_configuring)
+      return 0;
+
+   in = mmal_queue_get(port_in->priv->module->queue);
+   if (!in)
+      return 0;
+
+   /* Handle event buffers */
+   if (in->cmd)
+   {
+      MMAL_EVENT_FORMAT_CHANGED_T *event = mmal_event_format_changed_get(in);
+      if (event)
+      {
+         module->status = mmal_format_full_copy(port_in->format, event->format);
+         if (module->status == MMAL_SUCCESS)
+            module->status = port_in->priv->pf_set_format(port_in);
+         if (module->status != MMAL_SUCCESS)
+         {
+            LOG_ERROR("format not set on port %s %p (%i)", port_in->name, port_in, module->status);
+            if (mmal_event_error_send(component, module->status) != MMAL_SUCCESS)
+               LOG_ERROR("unable to send an error event buffer");
+         }
+      }
+      else
+      {
+         LOG_ERROR("discarding event %i on port %s %p", (int)in->cmd, port_in->name, port_in);
+      }
+
+      in->length = 0;
+      mmal_port_buffer_header_callback(port_in, in);
+      return 1;
+   }
+
+   /* Don't do anything if we've already seen an error */
+   if (module->status != MMAL_SUCCESS)
+   {
+      mmal_queue_put_back(port_in->priv->module->queue, in);
+      return 0;
+   }
+
+   out = mmal_queue_get(port_out->priv->module->queue);
+   if (!out)
+   {
+      mmal_queue_put_back(port_in->priv->module->queue, in);
+      return 0;
+   }
+
+   module->status = convert_context_update(component);
+   if (module->status == MMAL_SUCCESS)
+      module->status = mmal_convert_frame_init(&module->src, port_in->format,
+         in->data + in->offset, &src_size);
+   if (module->status == MMAL_SUCCESS)
+      module->status = mmal_convert_frame_init(&module->dst, port_out->format,
+         out->data, &dst_size);
+
+   /* Sanity check the output buffer is big enough */
+   if (module->status == MMAL_SUCCESS && out->alloc_size < dst_size)
+      module->status = MMAL_EINVAL;
+
+   if (module->status != MMAL_SUCCESS)
+   {
+      mmal_queue_put_back(port_in->priv->module->queue, in);
+      mmal_queue_put_back(port_out->priv->module->queue, out);
+      if (mmal_event_error_send(component, module->status) != MMAL_SUCCESS)
+         LOG_ERROR("unable to send an error event buffer");
+      return 0;
+   }
+
+   /* Buffers which don't contain a full frame (e.g. end of stream) only carry
+    * their flags */
+   out->length = 0;
+   if (in->length >= src_size)
+   {
+      mmal_buffer_header_mem_lock(out);
+      mmal_buffer_header_mem_lock(in);
+      convert_frame(module);
+      mmal_buffer_header_mem_unlock(in);
+      mmal_buffer_header_mem_unlock(out);
+      out->length = dst_size;
+   }
+   else if (in->length)
+   {
+      LOG_ERROR("%s: buffer too small for a frame (%i/%i)", port_in->name,
+                (int)in->length, (int)src_size);
+   }
+
+   out->offset     = 0;
+   out->flags      = in->flags;
+   out->pts        = in->pts;
+   out->dts        = in->dts;
+   *out->type      = *in->type;
+
+   /* Send buffers back */
+   in->length = 0;
+   mmal_port_buffer_header_callback(port_in, in);
+   mmal_port_buffer_header_callback(port_out, out);
+   return 1;
+}
+
+/*****************************************************************************/
+static void convert_do_processing_loop(MMAL_COMPONENT_T *component)
+{
+   while (convert_do_processing(component));
+}
+
+/** Destroy a previously created component */
+static MMAL_STATUS_T convert_component_destroy(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   unsigned int i;
+
+   for(i = 0; i < module->tasks_num; i++)
+      mmal_executor_task_deregister(&module->tasks[i]);
+   mmal_convert_context_destroy(module->context);
+   if(module->done_created)
+      vcos_semaphore_delete(&module->done);
+   if(module->lock_created)
+      vcos_mutex_delete(&module->lock);
+
+   for(i = 0; i < component->input_num; i++)
+      if(component->input[i]->priv->module->queue)
+         mmal_queue_destroy(component->input[i]->priv->module->queue);
+   if(component->input_num)
+      mmal_ports_free(component->input, component->input_num);
+
+   for(i = 0; i < component->output_num; i++)
+      if(component->output[i]->priv->module->queue)
+         mmal_queue_destroy(component->output[i]->priv->module->queue);
+   if(component->output_num)
+      mmal_ports_free(component->output, component->output_num);
+
+   vcos_free(component->priv->module);
+   return MMAL_SUCCESS;
+}
+
+/** Enable processing on a port */
+static MMAL_STATUS_T convert_port_enable(MMAL_PORT_T *port, MMAL_PORT_BH_CB_T cb)
+{
+   MMAL_PARAM_UNUSED(cb);
+   MMAL_PARAM_UNUSED(port);
+   return MMAL_SUCCESS;
+}
+
+/** Flush a port */
+static MMAL_STATUS_T convert_port_flush(MMAL_PORT_T *port)
+{
+   MMAL_PORT_MODULE_T *port_module = port->priv->module;
+   MMAL_BUFFER_HEADER_T *buffer;
+
+   /* Flush buffers that our component is holding on to */
+   buffer = mmal_queue_get(port_module->queue);
+   while(buffer)
+   {
+      mmal_port_buffer_header_callback(port, buffer);
+      buffer = mmal_queue_get(port_module->queue);
+   }
+
+   return MMAL_SUCCESS;
+}
+
+/** Disable processing on a port */
+static MMAL_STATUS_T convert_port_disable(MMAL_PORT_T *port)
+{
+   /* We just need to flush our internal queue */
+   return convert_port_flush(port);
+}
+
+/** Send a buffer header to a port */
+static MMAL_STATUS_T convert_port_send(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
+{
+   mmal_queue_put(port->priv->module->queue, buffer);
+   mmal_component_action_trigger(port->component);
+   return MMAL_SUCCESS;
+}
+
+/** Check a format and get the size of its frames */
+static MMAL_STATUS_T convert_format_check(MMAL_PORT_T *port, uint32_t *size)
+{
+   MMAL_CONVERT_FRAME_T frame;
+
+   if (!mmal_convert_encoding_supported(port->format->encoding))
+   {
+      LOG_ERROR("%s: unsupported encoding %4.4s", port->name, (char *)&port->format->encoding);
+      return MMAL_ENOSYS;
+   }
+   return mmal_convert_frame_init(&frame, port->format, NULL, size);
+}
+
+/** Set format on input port */
+static MMAL_STATUS_T convert_input_port_format_commit(MMAL_PORT_T *in)
+{
+   MMAL_COMPONENT_T *component = in->component;
+   MMAL_PORT_T *out = component->output[0];
+   MMAL_EVENT_FORMAT_CHANGED_T *event;
+   MMAL_BUFFER_HEADER_T *buffer;
+   MMAL_STATUS_T status;
+   uint32_t size;
+
+   status = convert_format_check(in, &size);
+   if (status != MMAL_SUCCESS)
+      return status;
+
+   in->buffer_size_min = in->buffer_size_recommended = size;
+   component->priv->module->context_dirty = 1;
+
+   /* The output port follows the input port until it is configured */
+   if (out->priv->module->configured || !mmal_format_compare(in->format, out->format))
+      return MMAL_SUCCESS;
+
+   /* If the output port is not enabled we just need to update its format.
+    * Otherwise we'll have to trigger a format changed event for it. */
+   if (!out->is_enabled)
+   {
+      out->buffer_size_min = out->buffer_size_recommended = size;
+      return mmal_format_full_copy(out->format, in->format);
+   }
+
+   /* Send an event on the output port */
+   status = mmal_port_event_get(out, &buffer, MMAL_EVENT_FORMAT_CHANGED);
+   if (status != MMAL_SUCCESS)
+   {
+      LOG_ERROR("unable to get an event buffer");
+      return status;
+   }
+
+   event = mmal_event_format_changed_get(buffer);
+   mmal_format_copy(event->format, in->format);
+
+   /* Pass on the buffer requirements */
+   event->buffer_num_min = out->buffer_num_min;
+   event->buffer_num_recommended = out->buffer_num_recommended;
+   event->buffer_size_min = event->buffer_size_recommended = size;
+
+   out->priv->module->needs_configuring = 1;
+   mmal_port_event_send(out, buffer);
+   return status;
+}
+
+/** Set format on output port */
+static MMAL_STATUS_T convert_output_port_format_commit(MMAL_PORT_T *out)
+{
+   MMAL_COMPONENT_T *component = out->component;
+   MMAL_STATUS_T status;
+   uint32_t size;
+
+   status = convert_format_check(out, &size);
+   if (status != MMAL_SUCCESS)
+      return status;
+
+   out->buffer_size_min = out->buffer_size_recommended = size;
+   out->priv->module->configured = 1;
+   out->priv->module->needs_configuring = 0;
+   component->priv->module->context_dirty = 1;
+   mmal_component_action_trigger(component);
+   return MMAL_SUCCESS;
+}
+
+/** Create an instance of a component  */
+static MMAL_STATUS_T mmal_component_create_convert(const char *name, MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module;
+   MMAL_STATUS_T status = MMAL_ENOMEM;
+   unsigned int i;
+   MMAL_PARAM_UNUSED(name);
+
+   /* Allocate the context for our module */
+   component->priv->module = module = vcos_malloc(sizeof(*module), "mmal module");
+   if (!module)
+      return MMAL_ENOMEM;
+   memset(module, 0, sizeof(*module));
+
+   component->priv->pf_destroy = convert_component_destroy;
+
+   module->lock_created = vcos_mutex_create(&module->lock, "mmal convert") == VCOS_SUCCESS;
+   if (!module->lock_created)
+      goto error;
+   module->done_created = vcos_semaphore_create(&module->done, "mmal convert", 0) == VCOS_SUCCESS;
+   if (!module->done_created)
+      goto error;
+
+   /* Allocate and initialise all the ports for this component */
+   component->input = mmal_ports_alloc(component, 1, MMAL_PORT_TYPE_INPUT, sizeof(MMAL_PORT_MODULE_T));
+   if(!component->input)
+      goto error;
+   component->input_num = 1;
+   component->input[0]->priv->pf_enable = convert_port_enable;
+   component->input[0]->priv->pf_disable = convert_port_disable;
+   component->input[0]->priv->pf_flush = convert_port_flush;
+   component->input[0]->priv->pf_send = convert_port_send;
+   component->input[0]->priv->pf_set_format = convert_input_port_format_commit;
+   component->input[0]->buffer_num_min = 1;
+   component->input[0]->buffer_num_recommended = 0;
+   component->input[0]->format->type = MMAL_ES_TYPE_VIDEO;
+   component->input[0]->priv->module->queue = mmal_queue_create();
+   if(!component->input[0]->priv->module->queue)
+      goto error;
+
+   component->output = mmal_ports_alloc(component, 1, MMAL_PORT_TYPE_OUTPUT, sizeof(MMAL_PORT_MODULE_T));
+   if(!component->output)
+      goto error;
+   component->output_num = 1;
+   component->output[0]->priv->pf_enable = convert_port_enable;
+   component->output[0]->priv->pf_disable = convert_port_disable;
+   component->output[0]->priv->pf_flush = convert_port_flush;
+   component->output[0]->priv->pf_send = convert_port_send;
+   component->output[0]->priv->pf_set_format = convert_output_port_format_commit;
+   component->output[0]->buffer_num_min = 1;
+   component->output[0]->buffer_num_recommended = 0;
+   component->output[0]->format->type = MMAL_ES_TYPE_VIDEO;
+   component->output[0]->priv->module->queue = mmal_queue_create();
+   if(!component->output[0]->priv->module->queue)
+      goto error;
+
+   for (i = 0; i < MMAL_CONVERT_SLICES_MAX - 1; i++)
+   {
+      status = mmal_executor_task_register(&module->tasks[i], convert_slices_run, module);
+      if (status != MMAL_SUCCESS)
+         goto error;
+      module->tasks_num++;
+   }
+
+   component->priv->action_shared = MMAL_TRUE;
+   status = mmal_component_action_register(component, convert_do_processing_loop);
+   if (status != MMAL_SUCCESS)
+      goto error;
+
+   return MMAL_SUCCESS;
+
+ error:
+   convert_component_destroy(component);
+   return status;
+}
+
+MMAL_CONSTRUCTOR(mmal_register_component_convert);
+void mmal_register_component_convert(void)
+{
+   mmal_component_supplier_register("convert", mmal_component_create_convert);
+}
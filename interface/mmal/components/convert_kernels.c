@@ -0,0 +1,805 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+
+#include "mmal.h"
+#include "mmal_logging.h"
+#include "util/mmal_util.h"
+#include "convert_kernels.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+# define CONVERT_SSE2 1
+#endif
+
+/** Maximum scaling ratio supported by area scaling (limited by the 16 bits accumulators) */
+#define CONVERT_AREA_RATIO_MAX 256
+
+/** Number of rows of scratch memory each slice needs */
+#define CONVERT_SCRATCH_ROWS 9
+#define CONVERT_ROW_TMP  6  /**< Scratch row used for vertical interpolation */
+#define CONVERT_ROW_ACC  7  /**< Scratch rows used for the area accumulator (2 rows) */
+
+/*****************************************************************************/
+typedef enum {
+   CONVERT_CLASS_YUV420,
+   CONVERT_CLASS_RGB
+} CONVERT_CLASS_T;
+
+/** Description of the memory layout of an encoding */
+typedef struct CONVERT_ENCODING_T
+{
+   uint32_t encoding;
+   CONVERT_CLASS_T class;
+   unsigned int planes;
+   unsigned int bpp;    /**< Bytes per pixel in the first plane */
+   unsigned int u, v;   /**< Planar YUV: plane of U and V. Semi-planar YUV: offset of U and V in the chroma plane */
+   unsigned int r, g, b;/**< RGB: offset of each component */
+   int a;               /**< RGB: offset of the alpha component or -1 */
+} CONVERT_ENCODING_T;
+
+static const CONVERT_ENCODING_T convert_encodings[] =
+{
+   {MMAL_ENCODING_I420,  CONVERT_CLASS_YUV420, 3, 1, 1, 2, 0, 0, 0, -1},
+   {MMAL_ENCODING_YV12,  CONVERT_CLASS_YUV420, 3, 1, 2, 1, 0, 0, 0, -1},
+   {MMAL_ENCODING_NV12,  CONVERT_CLASS_YUV420, 2, 1, 0, 1, 0, 0, 0, -1},
+   {MMAL_ENCODING_NV21,  CONVERT_CLASS_YUV420, 2, 1, 1, 0, 0, 0, 0, -1},
+   {MMAL_ENCODING_RGB24, CONVERT_CLASS_RGB,    1, 3, 0, 0, 0, 1, 2, -1},
+   {MMAL_ENCODING_BGR24, CONVERT_CLASS_RGB,    1, 3, 0, 0, 2, 1, 0, -1},
+   {MMAL_ENCODING_RGBA,  CONVERT_CLASS_RGB,    1, 4, 0, 0, 0, 1, 2,  3},
+   {MMAL_ENCODING_BGRA,  CONVERT_CLASS_RGB,    1, 4, 0, 0, 2, 1, 0,  3},
+   {MMAL_ENCODING_UNKNOWN}
+};
+
+/** Scaling of one type of plane */
+typedef struct CONVERT_SCALER_T
+{
+   unsigned int src_width, src_height;
+   unsigned int dst_width, dst_height;
+   unsigned int channels;  /**< Bytes per pixel */
+   uint32_t *x_index;      /**< Offset of the first source pixel used for each destination pixel */
+   uint32_t *x_weight;     /**< Bilinear: weight (/256) of the second source pixel. Area: number of source pixels */
+} CONVERT_SCALER_T;
+
+/** Kernels */
+typedef void (*CONVERT_INTERLEAVE_T)(uint8_t *out, const uint8_t *first, const uint8_t *second, unsigned int n);
+typedef void (*CONVERT_DEINTERLEAVE_T)(uint8_t *first, uint8_t *second, const uint8_t *in, unsigned int n);
+typedef void (*CONVERT_YUV_TO_RGB_T)(uint8_t *out, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+   unsigned int width, const CONVERT_ENCODING_T *encoding);
+
+struct MMAL_CONVERT_CONTEXT_T
+{
+   const CONVERT_ENCODING_T *src;
+   const CONVERT_ENCODING_T *dst;
+   unsigned int width, height;      /**< Size of the destination */
+
+   MMAL_CONVERT_SCALE_T scale;
+   CONVERT_SCALER_T scaler[2];      /**< Luma or RGB plane, chroma planes */
+
+   unsigned int slices;
+   unsigned int slice_rows;         /**< Number of destination rows in each slice */
+   unsigned int row_size;           /**< Size of a scratch row */
+   uint8_t *scratch[MMAL_CONVERT_SLICES_MAX];
+
+   CONVERT_INTERLEAVE_T pf_interleave;
+   CONVERT_DEINTERLEAVE_T pf_deinterleave;
+   CONVERT_YUV_TO_RGB_T pf_yuv_to_rgb;
+};
+
+/*****************************************************************************
+ * Reference kernels
+ *****************************************************************************/
+/* The vertical scaling kernels have no SIMD versions since the compiler
+ * vectorises these loops as well as hand written code does */
+static void convert_blend_c(uint8_t *out, const uint8_t *a, const uint8_t *b,
+   unsigned int n, unsigned int weight)
+{
+   unsigned int i;
+   for (i = 0; i < n; i++)
+      out[i] = (a[i] * (256 - weight) + b[i] * weight + 128) >> 8;
+}
+
+static void convert_acc_init_c(uint16_t *acc, const uint8_t *row, unsigned int n)
+{
+   unsigned int i;
+   for (i = 0; i < n; i++)
+      acc[i] = row[i];
+}
+
+static void convert_acc_add_c(uint16_t *acc, const uint8_t *row, unsigned int n)
+{
+   unsigned int i;
+   for (i = 0; i < n; i++)
+      acc[i] += row[i];
+}
+
+static void convert_interleave_c(uint8_t *out, const uint8_t *first, const uint8_t *second,
+   unsigned int n)
+{
+   unsigned int i;
+   for (i = 0; i < n; i++)
+   {
+      out[2 * i] = first[i];
+      out[2 * i + 1] = second[i];
+   }
+}
+
+static void convert_deinterleave_c(uint8_t *first, uint8_t *second, const uint8_t *in,
+   unsigned int n)
+{
+   unsigned int i;
+   for (i = 0; i < n; i++)
+   {
+      first[i] = in[2 * i];
+      second[i] = in[2 * i + 1];
+   }
+}
+
+/* The YUV to RGB conversion (BT.601, limited range) uses 16 bits fixed point
+ * arithmetic with saturation so the SIMD kernels can produce exactly the same
+ * results as the reference one. */
+#define CONVERT_Y_SCALE  74
+#define CONVERT_RV       102
+#define CONVERT_GU       (-25)
+#define CONVERT_GV       (-52)
+#define CONVERT_BU       129
+
+static int convert_sat16(int value)
+{
+   return value < -32768 ? -32768 : value > 32767 ? 32767 : value;
+}
+
+static uint8_t convert_clip8(int value)
+{
+   value >>= 6;
+   return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static void convert_yuv_to_rgb_c(uint8_t *out, const uint8_t *y, const uint8_t *u,
+   const uint8_t *v, unsigned int width, const CONVERT_ENCODING_T *encoding)
+{
+   unsigned int x, bpp = encoding->bpp;
+
+   for (x = 0; x < width; x++, out += bpp)
+   {
+      int c = (y[x] - 16) * CONVERT_Y_SCALE;
+      int d = u[x / 2] - 128, e = v[x / 2] - 128;
+
+      out[encoding->r] = convert_clip8(convert_sat16(convert_sat16(c + CONVERT_RV * e) + 32));
+      out[encoding->g] = convert_clip8(convert_sat16(convert_sat16(convert_sat16(
+         c + CONVERT_GU * d) + CONVERT_GV * e) + 32));
+      out[encoding->b] = convert_clip8(convert_sat16(convert_sat16(c + CONVERT_BU * d) + 32));
+      if (encoding->a >= 0)
+         out[encoding->a] = 0xff;
+   }
+}
+
+/*****************************************************************************
+ * SSE2 kernels
+ *****************************************************************************/
+#if defined(CONVERT_SSE2)
+static void convert_interleave_sse2(uint8_t *out, const uint8_t *first, const uint8_t *second,
+   unsigned int n)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= n; i += 16)
+   {
+      __m128i a = _mm_loadu_si128((const __m128i *)(first + i));
+      __m128i b = _mm_loadu_si128((const __m128i *)(second + i));
+      _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(a, b));
+      _mm_storeu_si128((__m128i *)(out + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+   }
+   convert_interleave_c(out + 2 * i, first + i, second + i, n - i);
+}
+
+static void convert_deinterleave_sse2(uint8_t *first, uint8_t *second, const uint8_t *in,
+   unsigned int n)
+{
+   const __m128i mask = _mm_set1_epi16(0xff);
+   unsigned int i;
+
+   for (i = 0; i + 16 <= n; i += 16)
+   {
+      __m128i a = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+      __m128i b = _mm_loadu_si128((const __m128i *)(in + 2 * i + 16));
+      _mm_storeu_si128((__m128i *)(first + i),
+                       _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+      _mm_storeu_si128((__m128i *)(second + i),
+                       _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+   }
+   convert_deinterleave_c(first + i, second + i, in + 2 * i, n - i);
+}
+
+/** Load 4 chroma samples and duplicate them horizontally */
+static __m128i convert_load_chroma_sse2(const uint8_t *p)
+{
+   int32_t value;
+   __m128i v;
+
+   memcpy(&value, p, sizeof(value));
+   v = _mm_cvtsi32_si128(value);
+   v = _mm_unpacklo_epi8(v, v);
+   return _mm_sub_epi16(_mm_unpacklo_epi8(v, _mm_setzero_si128()), _mm_set1_epi16(128));
+}
+
+static void convert_yuv_to_rgb_sse2(uint8_t *out, const uint8_t *y, const uint8_t *u,
+   const uint8_t *v, unsigned int width, const CONVERT_ENCODING_T *encoding)
+{
+   const __m128i zero = _mm_setzero_si128(), round = _mm_set1_epi16(32);
+   unsigned int x, i, bpp = encoding->bpp;
+
+   for (x = 0; x + 8 <= width; x += 8, out += 8 * bpp)
+   {
+      __m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y + x)), zero);
+      __m128i d = convert_load_chroma_sse2(u + x / 2);
+      __m128i e = convert_load_chroma_sse2(v + x / 2);
+      __m128i r, g, b, rgba[4];
+
+      c = _mm_mullo_epi16(_mm_sub_epi16(c, _mm_set1_epi16(16)), _mm_set1_epi16(CONVERT_Y_SCALE));
+      r = _mm_adds_epi16(c, _mm_mullo_epi16(e, _mm_set1_epi16(CONVERT_RV)));
+      g = _mm_adds_epi16(c, _mm_mullo_epi16(d, _mm_set1_epi16(CONVERT_GU)));
+      g = _mm_adds_epi16(g, _mm_mullo_epi16(e, _mm_set1_epi16(CONVERT_GV)));
+      b = _mm_adds_epi16(c, _mm_mullo_epi16(d, _mm_set1_epi16(CONVERT_BU)));
+      r = _mm_srai_epi16(_mm_adds_epi16(r, round), 6);
+      g = _mm_srai_epi16(_mm_adds_epi16(g, round), 6);
+      b = _mm_srai_epi16(_mm_adds_epi16(b, round), 6);
+
+      rgba[encoding->r] = _mm_packus_epi16(r, r);
+      rgba[encoding->g] = _mm_packus_epi16(g, g);
+      rgba[encoding->b] = _mm_packus_epi16(b, b);
+
+      if (bpp == 4)
+      {
+         __m128i lo, hi;
+         rgba[encoding->a] = _mm_set1_epi8((char)0xff);
+         lo = _mm_unpacklo_epi8(rgba[0], rgba[1]);
+         hi = _mm_unpacklo_epi8(rgba[2], rgba[3]);
+         _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(lo, hi));
+         _mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi16(lo, hi));
+      }
+      else
+      {
+         uint8_t planes[3][16];
+         for (i = 0; i < 3; i++)
+            _mm_storeu_si128((__m128i *)planes[i], rgba[i]);
+         for (i = 0; i < 8; i++)
+         {
+            out[3 * i] = planes[0][i];
+            out[3 * i + 1] = planes[1][i];
+            out[3 * i + 2] = planes[2][i];
+         }
+      }
+   }
+   convert_yuv_to_rgb_c(out, y + x, u + x / 2, v + x / 2, width - x, encoding);
+}
+#endif /* CONVERT_SSE2 */
+
+/*****************************************************************************
+ * RGB conversions (reference only)
+ *****************************************************************************/
+static void convert_rgb_to_rgb(uint8_t *out, const uint8_t *in, unsigned int width,
+   const CONVERT_ENCODING_T *src, const CONVERT_ENCODING_T *dst)
+{
+   unsigned int x;
+
+   if (src == dst)
+   {
+      memcpy(out, in, width * src->bpp);
+      return;
+   }
+
+   for (x = 0; x < width; x++, in += src->bpp, out += dst->bpp)
+   {
+      out[dst->r] = in[src->r];
+      out[dst->g] = in[src->g];
+      out[dst->b] = in[src->b];
+      if (dst->a >= 0)
+         out[dst->a] = src->a >= 0 ? in[src->a] : 0xff;
+   }
+}
+
+/** Convert 2 rows of RGB into 2 rows of luma and 1 row of chroma.
+ * The chroma is the average of each 2x2 block. row1 is NULL for the last row
+ * of frames with an odd height. */
+static void convert_rgb_to_yuv(uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+   unsigned int chroma_step, const uint8_t *row0, const uint8_t *row1,
+   unsigned int width, const CONVERT_ENCODING_T *src)
+{
+   unsigned int x, i, bpp = src->bpp;
+
+   for (x = 0; x < width; x += 2)
+   {
+      int r = 0, g = 0, b = 0, n = 0;
+      const uint8_t *rows[2];
+      uint8_t *lumas[2];
+
+      rows[0] = row0; rows[1] = row1;
+      lumas[0] = y0; lumas[1] = y1;
+      for (i = 0; i < 2; i++)
+      {
+         const uint8_t *p;
+         if (!rows[i])
+            continue;
+
+         p = rows[i] + x * bpp;
+         lumas[i][x] = ((66 * p[src->r] + 129 * p[src->g] + 25 * p[src->b] + 128) >> 8) + 16;
+         r += p[src->r]; g += p[src->g]; b += p[src->b]; n++;
+         if (x + 1 < width)
+         {
+            p += bpp;
+            lumas[i][x + 1] = ((66 * p[src->r] + 129 * p[src->g] + 25 * p[src->b] + 128) >> 8) + 16;
+            r += p[src->r]; g += p[src->g]; b += p[src->b]; n++;
+         }
+      }
+
+      r = (r + n / 2) / n; g = (g + n / 2) / n; b = (b + n / 2) / n;
+      u[x / 2 * chroma_step] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+      v[x / 2 * chroma_step] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+   }
+}
+
+/*****************************************************************************
+ * Scaling
+ *****************************************************************************/
+static MMAL_STATUS_T convert_scaler_init(CONVERT_SCALER_T *scaler, MMAL_CONVERT_SCALE_T scale,
+   unsigned int src_width, unsigned int src_height, unsigned int dst_width,
+   unsigned int dst_height, unsigned int channels)
+{
+   unsigned int x;
+
+   scaler->src_width = src_width;
+   scaler->src_height = src_height;
+   scaler->dst_width = dst_width;
+   scaler->dst_height = dst_height;
+   scaler->channels = channels;
+
+   scaler->x_index = vcos_calloc(dst_width, sizeof(*scaler->x_index), "mmal convert");
+   scaler->x_weight = vcos_calloc(dst_width, sizeof(*scaler->x_weight), "mmal convert");
+   if (!scaler->x_index || !scaler->x_weight)
+      return MMAL_ENOMEM;
+
+   for (x = 0; x < dst_width; x++)
+   {
+      if (scale == MMAL_CONVERT_SCALE_AREA)
+      {
+         uint32_t start = (uint64_t)x * src_width / dst_width;
+         uint32_t end = (uint64_t)(x + 1) * src_width / dst_width;
+         scaler->x_index[x] = start * channels;
+         scaler->x_weight[x] = end > start ? end - start : 1;
+      }
+      else
+      {
+         /* Position of the centre of the destination pixel in the source, in 1/256 */
+         int64_t pos = ((int64_t)(2 * x + 1) * src_width - dst_width) * 256 / (2 * dst_width);
+         uint32_t index;
+         if (pos < 0)
+            pos = 0;
+         index = pos >> 8;
+         scaler->x_weight[x] = pos & 0xff;
+         if (index >= src_width - 1)
+         {
+            index = src_width - 1;
+            scaler->x_weight[x] = 0;
+         }
+         scaler->x_index[x] = index * channels;
+      }
+   }
+
+   return MMAL_SUCCESS;
+}
+
+static void convert_scaler_deinit(CONVERT_SCALER_T *scaler)
+{
+   vcos_free(scaler->x_index);
+   vcos_free(scaler->x_weight);
+}
+
+/** Get a row of a plane scaled to the destination size */
+static const uint8_t *convert_get_row(MMAL_CONVERT_CONTEXT_T *ctx, const CONVERT_SCALER_T *scaler,
+   const uint8_t *plane, unsigned int pitch, unsigned int y, uint8_t *out, uint8_t *scratch)
+{
+   unsigned int channels = scaler->channels, n = scaler->src_width * channels;
+   unsigned int x, k;
+
+   if (ctx->scale == MMAL_CONVERT_SCALE_NONE)
+      return plane + y * pitch;
+
+   if (ctx->scale == MMAL_CONVERT_SCALE_AREA)
+   {
+      uint16_t *acc = (uint16_t *)(scratch + CONVERT_ROW_ACC * ctx->row_size);
+      uint32_t start = (uint64_t)y * scaler->src_height / scaler->dst_height;
+      uint32_t end = (uint64_t)(y + 1) * scaler->src_height / scaler->dst_height;
+      unsigned int rows, row;
+
+      if (end <= start)
+         end = start + 1;
+      rows = end - start;
+
+      convert_acc_init_c(acc, plane + start * pitch, n);
+      for (row = start + 1; row < end; row++)
+         convert_acc_add_c(acc, plane + row * pitch, n);
+
+      for (x = 0; x < scaler->dst_width; x++)
+      {
+         const uint16_t *p = acc + scaler->x_index[x];
+         unsigned int count = scaler->x_weight[x], div = count * rows, i;
+         for (k = 0; k < channels; k++)
+         {
+            uint32_t sum = 0;
+            for (i = 0; i < count; i++)
+               sum += p[i * channels + k];
+            out[x * channels + k] = (sum + div / 2) / div;
+         }
+      }
+      return out;
+   }
+   else
+   {
+      int64_t pos = ((int64_t)(2 * y + 1) * scaler->src_height - scaler->dst_height) * 256 /
+         (2 * scaler->dst_height);
+      const uint8_t *row;
+      unsigned int index, weight;
+
+      if (pos < 0)
+         pos = 0;
+      index = pos >> 8;
+      weight = pos & 0xff;
+      if (index >= scaler->src_height - 1)
+      {
+         index = scaler->src_height - 1;
+         weight = 0;
+      }
+
+      row = plane + index * pitch;
+      if (weight)
+      {
+         uint8_t *tmp = scratch + CONVERT_ROW_TMP * ctx->row_size;
+         convert_blend_c(tmp, row, row + pitch, n, weight);
+         row = tmp;
+      }
+
+      if (scaler->src_width == scaler->dst_width)
+         return row;
+
+      for (x = 0; x < scaler->dst_width; x++)
+      {
+         const uint8_t *p = row + scaler->x_index[x];
+         unsigned int w = scaler->x_weight[x];
+         for (k = 0; k < channels; k++)
+            out[x * channels + k] = (p[k] * (256 - w) + p[k + (w ? channels : 0)] * w + 128) >> 8;
+      }
+      return out;
+   }
+}
+
+/*****************************************************************************
+ * Conversion of a slice
+ *****************************************************************************/
+static void convert_slice_from_yuv(MMAL_CONVERT_CONTEXT_T *ctx, const MMAL_CONVERT_FRAME_T *src,
+   const MMAL_CONVERT_FRAME_T *dst, unsigned int y, unsigned int end, uint8_t *scratch)
+{
+   const CONVERT_ENCODING_T *se = ctx->src, *de = ctx->dst;
+   unsigned int width = ctx->width, chroma_width = (width + 1) / 2;
+   uint8_t *rows[6];
+   unsigned int i;
+
+   for (i = 0; i < 6; i++)
+      rows[i] = scratch + i * ctx->row_size;
+
+   for (; y < end; y += 2)
+   {
+      const uint8_t *y0, *y1 = NULL, *u, *v, *uv = NULL;
+      unsigned int cy = y / 2;
+
+      y0 = convert_get_row(ctx, &ctx->scaler[0], src->plane[0], src->pitch[0], y, rows[0], scratch);
+      if (y + 1 < ctx->height)
+         y1 = convert_get_row(ctx, &ctx->scaler[0], src->plane[0], src->pitch[0], y + 1, rows[1], scratch);
+
+      if (se->planes == 3)
+      {
+         u = convert_get_row(ctx, &ctx->scaler[1], src->plane[se->u], src->pitch[se->u], cy, rows[2], scratch);
+         v = convert_get_row(ctx, &ctx->scaler[1], src->plane[se->v], src->pitch[se->v], cy, rows[3], scratch);
+      }
+      else
+      {
+         uv = convert_get_row(ctx, &ctx->scaler[1], src->plane[1], src->pitch[1], cy, rows[2], scratch);
+         u = se->u ? rows[5] : rows[4];
+         v = se->u ? rows[4] : rows[5];
+      }
+
+      if (de->class == CONVERT_CLASS_RGB)
+      {
+         if (uv)
+            ctx->pf_deinterleave(rows[4], rows[5], uv, chroma_width);
+         ctx->pf_yuv_to_rgb(dst->plane[0] + y * dst->pitch[0], y0, u, v, width, de);
+         if (y1)
+            ctx->pf_yuv_to_rgb(dst->plane[0] + (y + 1) * dst->pitch[0], y1, u, v, width, de);
+         continue;
+      }
+
+      memcpy(dst->plane[0] + y * dst->pitch[0], y0, width);
+      if (y1)
+         memcpy(dst->plane[0] + (y + 1) * dst->pitch[0], y1, width);
+
+      if (de->planes == 3)
+      {
+         uint8_t *du = dst->plane[de->u] + cy * dst->pitch[de->u];
+         uint8_t *dv = dst->plane[de->v] + cy * dst->pitch[de->v];
+         if (uv)
+            ctx->pf_deinterleave(se->u ? dv : du, se->u ? du : dv, uv, chroma_width);
+         else
+         {
+            memcpy(du, u, chroma_width);
+            memcpy(dv, v, chroma_width);
+         }
+      }
+      else
+      {
+         uint8_t *duv = dst->plane[1] + cy * dst->pitch[1];
+         if (uv && se->u == de->u)
+            memcpy(duv, uv, chroma_width * 2);
+         else
+         {
+            if (uv)
+               ctx->pf_deinterleave(rows[4], rows[5], uv, chroma_width);
+            ctx->pf_interleave(duv, de->u ? v : u, de->u ? u : v, chroma_width);
+         }
+      }
+   }
+}
+
+static void convert_slice_from_rgb(MMAL_CONVERT_CONTEXT_T *ctx, const MMAL_CONVERT_FRAME_T *src,
+   const MMAL_CONVERT_FRAME_T *dst, unsigned int y, unsigned int end, uint8_t *scratch)
+{
+   const CONVERT_ENCODING_T *se = ctx->src, *de = ctx->dst;
+   unsigned int width = ctx->width;
+   uint8_t *row0 = scratch, *row1 = scratch + ctx->row_size;
+
+   if (de->class == CONVERT_CLASS_RGB)
+   {
+      for (; y < end; y++)
+         convert_rgb_to_rgb(dst->plane[0] + y * dst->pitch[0],
+            convert_get_row(ctx, &ctx->scaler[0], src->plane[0], src->pitch[0], y, row0, scratch),
+            width, se, de);
+      return;
+   }
+
+   for (; y < end; y += 2)
+   {
+      const uint8_t *r0, *r1 = NULL;
+      unsigned int cy = y / 2, step = de->planes == 3 ? 1 : 2;
+      uint8_t *u, *v;
+
+      r0 = convert_get_row(ctx, &ctx->scaler[0], src->plane[0], src->pitch[0], y, row0, scratch);
+      if (y + 1 < ctx->height)
+         r1 = convert_get_row(ctx, &ctx->scaler[0], src->plane[0], src->pitch[0], y + 1, row1, scratch);
+
+      if (de->planes == 3)
+      {
+         u = dst->plane[de->u] + cy * dst->pitch[de->u];
+         v = dst->plane[de->v] + cy * dst->pitch[de->v];
+      }
+      else
+      {
+         u = dst->plane[1] + cy * dst->pitch[1] + de->u;
+         v = dst->plane[1] + cy * dst->pitch[1] + de->v;
+      }
+
+      convert_rgb_to_yuv(dst->plane[0] + y * dst->pitch[0],
+         r1 ? dst->plane[0] + (y + 1) * dst->pitch[0] : NULL, u, v, step, r0, r1, width, se);
+   }
+}
+
+/*****************************************************************************
+ * Public API
+ *****************************************************************************/
+static const CONVERT_ENCODING_T *convert_encoding_get(uint32_t encoding)
+{
+   unsigned int i;
+
+   for (i = 0; convert_encodings[i].encoding != MMAL_ENCODING_UNKNOWN; i++)
+      if (convert_encodings[i].encoding == encoding)
+         return &convert_encodings[i];
+   return NULL;
+}
+
+MMAL_BOOL_T mmal_convert_encoding_supported(uint32_t encoding)
+{
+   return convert_encoding_get(encoding) != NULL;
+}
+
+MMAL_BOOL_T mmal_convert_simd_available(void)
+{
+#if defined(CONVERT_SSE2)
+   return 1;
+#else
+   return 0;
+#endif
+}
+
+MMAL_STATUS_T mmal_convert_frame_init(MMAL_CONVERT_FRAME_T *frame,
+   const MMAL_ES_FORMAT_T *format, uint8_t *data, uint32_t *size)
+{
+   const CONVERT_ENCODING_T *encoding = convert_encoding_get(format->encoding);
+   const MMAL_VIDEO_FORMAT_T *video = &format->es->video;
+   unsigned int width = video->width, height = video->height;
+   unsigned int offset[3] = {0, 0, 0};
+   MMAL_RECT_T crop = video->crop;
+   unsigned int i;
+
+   if (!encoding || !width || !height)
+      return MMAL_EINVAL;
+   if (!crop.width || !crop.height)
+   {
+      crop.x = crop.y = 0;
+      crop.width = width;
+      crop.height = height;
+   }
+   if (crop.x < 0 || crop.y < 0 || (unsigned int)(crop.x + crop.width) > width ||
+       (unsigned int)(crop.y + crop.height) > height)
+      return MMAL_EINVAL;
+
+   memset(frame, 0, sizeof(*frame));
+   frame->encoding = format->encoding;
+   frame->width = crop.width;
+   frame->height = crop.height;
+   frame->pitch[0] = mmal_encoding_width_to_stride(format->encoding, width);
+   offset[0] = crop.y * frame->pitch[0] + crop.x * encoding->bpp;
+   *size = frame->pitch[0] * height;
+
+   if (encoding->class == CONVERT_CLASS_YUV420)
+   {
+      /* The chroma planes need to line up with the luma plane */
+      if ((width & 1) || (height & 1) || (crop.x & 1) || (crop.y & 1))
+         return MMAL_EINVAL;
+
+      for (i = 1; i < encoding->planes; i++)
+      {
+         frame->pitch[i] = encoding->planes == 3 ? frame->pitch[0] / 2 : frame->pitch[0];
+         offset[i] = *size + crop.y / 2 * frame->pitch[i] +
+            (encoding->planes == 3 ? crop.x / 2 : crop.x);
+         *size += frame->pitch[i] * height / 2;
+      }
+   }
+
+   if (data)
+      for (i = 0; i < encoding->planes; i++)
+         frame->plane[i] = data + offset[i];
+
+   return MMAL_SUCCESS;
+}
+
+MMAL_CONVERT_CONTEXT_T *mmal_convert_context_create(const MMAL_CONVERT_FRAME_T *src,
+   const MMAL_CONVERT_FRAME_T *dst, MMAL_CONVERT_SCALE_T scale, unsigned int slices,
+   MMAL_BOOL_T simd)
+{
+   MMAL_CONVERT_CONTEXT_T *ctx;
+   unsigned int i, max_width;
+
+   if (!convert_encoding_get(src->encoding) || !convert_encoding_get(dst->encoding) ||
+       !src->width || !src->height || !dst->width || !dst->height)
+      return NULL;
+
+   ctx = vcos_calloc(1, sizeof(*ctx), "mmal convert");
+   if (!ctx)
+      return NULL;
+
+   ctx->src = convert_encoding_get(src->encoding);
+   ctx->dst = convert_encoding_get(dst->encoding);
+   ctx->width = dst->width;
+   ctx->height = dst->height;
+
+   /* Pick the scaling method */
+   if (src->width == dst->width && src->height == dst->height)
+      scale = MMAL_CONVERT_SCALE_NONE;
+   else if (scale == MMAL_CONVERT_SCALE_NONE)
+      scale = (src->width >= 2 * dst->width || src->height >= 2 * dst->height) ?
+         MMAL_CONVERT_SCALE_AREA : MMAL_CONVERT_SCALE_BILINEAR;
+   if (scale == MMAL_CONVERT_SCALE_AREA &&
+       (src->width > CONVERT_AREA_RATIO_MAX * dst->width ||
+        src->height > CONVERT_AREA_RATIO_MAX * dst->height))
+      scale = MMAL_CONVERT_SCALE_BILINEAR;
+   ctx->scale = scale;
+
+   if (scale != MMAL_CONVERT_SCALE_NONE)
+   {
+      if (convert_scaler_init(&ctx->scaler[0], scale, src->width, src->height,
+             dst->width, dst->height, ctx->src->bpp) != MMAL_SUCCESS)
+         goto error;
+      if (ctx->src->class == CONVERT_CLASS_YUV420 &&
+          convert_scaler_init(&ctx->scaler[1], scale, (src->width + 1) / 2, (src->height + 1) / 2,
+             (dst->width + 1) / 2, (dst->height + 1) / 2, ctx->src->planes == 3 ? 1 : 2) != MMAL_SUCCESS)
+         goto error;
+   }
+
+   /* Split the frame in slices with an even number of rows */
+   slices = MMAL_MAX(1, MMAL_MIN(slices, MMAL_CONVERT_SLICES_MAX));
+   ctx->slice_rows = ((dst->height + slices - 1) / slices + 1) & ~1;
+   ctx->slices = (dst->height + ctx->slice_rows - 1) / ctx->slice_rows;
+
+   max_width = MMAL_MAX(src->width, dst->width);
+   ctx->row_size = VCOS_ALIGN_UP(max_width * 4 + 32, 32);
+   for (i = 0; i < ctx->slices; i++)
+   {
+      ctx->scratch[i] = vcos_malloc(ctx->row_size * CONVERT_SCRATCH_ROWS, "mmal convert");
+      if (!ctx->scratch[i])
+         goto error;
+   }
+
+   ctx->pf_interleave = convert_interleave_c;
+   ctx->pf_deinterleave = convert_deinterleave_c;
+   ctx->pf_yuv_to_rgb = convert_yuv_to_rgb_c;
+#if defined(CONVERT_SSE2)
+   if (simd)
+   {
+      ctx->pf_interleave = convert_interleave_sse2;
+      ctx->pf_deinterleave = convert_deinterleave_sse2;
+      ctx->pf_yuv_to_rgb = convert_yuv_to_rgb_sse2;
+   }
+#else
+   MMAL_PARAM_UNUSED(simd);
+#endif
+
+   return ctx;
+
+ error:
+   mmal_convert_context_destroy(ctx);
+   return NULL;
+}
+
+void mmal_convert_context_destroy(MMAL_CONVERT_CONTEXT_T *ctx)
+{
+   unsigned int i;
+
+   if (!ctx)
+      return;
+
+   for (i = 0; i < MMAL_CONVERT_SLICES_MAX; i++)
+      vcos_free(ctx->scratch[i]);
+   convert_scaler_deinit(&ctx->scaler[0]);
+   convert_scaler_deinit(&ctx->scaler[1]);
+   vcos_free(ctx);
+}
+
+unsigned int mmal_convert_context_slices(MMAL_CONVERT_CONTEXT_T *ctx)
+{
+   return ctx->slices;
+}
+
+void mmal_convert_slice(MMAL_CONVERT_CONTEXT_T *ctx, const MMAL_CONVERT_FRAME_T *src,
+   const MMAL_CONVERT_FRAME_T *dst, unsigned int slice)
+{
+   unsigned int start = slice * ctx->slice_rows;
+   unsigned int end = MMAL_MIN(start + ctx->slice_rows, ctx->height);
+
+   if (ctx->src->class == CONVERT_CLASS_YUV420)
+      convert_slice_from_yuv(ctx, src, dst, start, end, ctx->scratch[slice]);
+   else
+      convert_slice_from_rgb(ctx, src, dst, start, end, ctx->scratch[slice]);
+}
@@ -0,0 +1,136 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MMAL_CONVERT_KERNELS_H
+#define MMAL_CONVERT_KERNELS_H
+
+#include "interface/mmal/mmal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \defgroup MmalConvertKernels Pixel format conversion and scaling
+ * Row based kernels used by the convert component. Frames are processed in
+ * slices of rows so the work can be split across threads. Each kernel has a
+ * portable C implementation, which is used as the reference, and an SSE2
+ * implementation which is used when available. */
+/* @{ */
+
+/** Maximum number of slices a frame can be split into */
+#define MMAL_CONVERT_SLICES_MAX 8
+
+/** Description of a frame in memory */
+typedef struct MMAL_CONVERT_FRAME_T
+{
+   uint32_t encoding;
+   unsigned int width;        /**< Width of the visible area */
+   unsigned int height;       /**< Height of the visible area */
+   uint8_t *plane[3];         /**< Start of the visible area in each plane */
+   unsigned int pitch[3];     /**< Distance in bytes between two rows of each plane */
+} MMAL_CONVERT_FRAME_T;
+
+/** Scaling methods */
+typedef enum {
+   MMAL_CONVERT_SCALE_NONE,
+   MMAL_CONVERT_SCALE_BILINEAR,
+   MMAL_CONVERT_SCALE_AREA,      /**< Average of the covered pixels, for downscaling */
+} MMAL_CONVERT_SCALE_T;
+
+typedef struct MMAL_CONVERT_CONTEXT_T MMAL_CONVERT_CONTEXT_T;
+
+/** Check whether an encoding is supported by the kernels.
+ *
+ * @param encoding encoding to check
+ * @return 1 if supported, 0 otherwise
+ */
+MMAL_BOOL_T mmal_convert_encoding_supported(uint32_t encoding);
+
+/** Describe a frame laid out the way MMAL lays out video frames in a buffer.
+ *
+ * @param frame     frame to describe
+ * @param format    format of the frame. The planes are video.width by video.height
+ *                  and the visible area is given by video.crop, or the whole
+ *                  frame if the crop is empty.
+ * @param data      start of the frame in memory, or NULL to only get the size
+ * @param size      returns the size of the frame in bytes
+ * @return MMAL_SUCCESS or MMAL_EINVAL if the format isn't supported
+ */
+MMAL_STATUS_T mmal_convert_frame_init(MMAL_CONVERT_FRAME_T *frame,
+   const MMAL_ES_FORMAT_T *format, uint8_t *data, uint32_t *size);
+
+/** Create a context for converting and scaling frames of a given size and
+ * encoding into frames of another size and encoding.
+ *
+ * @param src      format of the source frames (only the encoding and visible size are used)
+ * @param dst      format of the destination frames (only the encoding and visible size are used)
+ * @param scale    scaling method, MMAL_CONVERT_SCALE_NONE to pick one based on the sizes
+ * @param slices   number of slices the frames will be split into
+ * @param simd     use the SIMD kernels when available (scaling always uses the C code)
+ * @return the context or NULL on failure
+ */
+MMAL_CONVERT_CONTEXT_T *mmal_convert_context_create(const MMAL_CONVERT_FRAME_T *src,
+   const MMAL_CONVERT_FRAME_T *dst, MMAL_CONVERT_SCALE_T scale, unsigned int slices,
+   MMAL_BOOL_T simd);
+
+/** Destroy a context.
+ *
+ * @param context context to destroy
+ */
+void mmal_convert_context_destroy(MMAL_CONVERT_CONTEXT_T *context);
+
+/** Get the number of slices a context splits frames into.
+ *
+ * @param context context
+ * @return number of slices
+ */
+unsigned int mmal_convert_context_slices(MMAL_CONVERT_CONTEXT_T *context);
+
+/** Convert one slice of a frame.
+ * Different slices can be converted concurrently.
+ *
+ * @param context context
+ * @param src     source frame
+ * @param dst     destination frame
+ * @param slice   index of the slice to convert
+ */
+void mmal_convert_slice(MMAL_CONVERT_CONTEXT_T *context, const MMAL_CONVERT_FRAME_T *src,
+   const MMAL_CONVERT_FRAME_T *dst, unsigned int slice);
+
+/** Check whether SIMD kernels are available on this platform.
+ *
+ * @return 1 if available, 0 otherwise
+ */
+MMAL_BOOL_T mmal_convert_simd_available(void);
+
+/* @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MMAL_CONVERT_KERNELS_H */
@@ -466,6 +466,7 @@ static MMAL_STATUS_T mmal_component_create_scheduler(const char *name, MMAL_COMP
       goto error;
    component->clock_num = SCHEDULER_CLOCK_PORTS_NUM;
 
+   component->priv->action_shared = MMAL_TRUE;
    status = mmal_component_action_register(component, scheduler_component_action);
    if (status != MMAL_SUCCESS)
       goto error;
@@ -462,6 +462,7 @@ static MMAL_STATUS_T mmal_component_create_spdif(const char *name, MMAL_COMPONEN
    if(!component->output[0]->priv->module->queue)
       goto error;
 
+   component->priv->action_shared = MMAL_TRUE;
    status = mmal_component_action_register(component, spdif_do_processing_loop);
    if (status != MMAL_SUCCESS)
       goto error;
@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mmal_logging.h"
 
 #define SPLITTER_OUTPUT_PORTS_NUM 4 /* 4 should do for now */
+#define SPLITTER_BACKLOG_MAX 16 /* Maximum number of buffers queued for an output port */
 
 /*****************************************************************************/
 typedef struct MMAL_COMPONENT_MODULE_T
@@ -39,12 +40,37 @@ typedef struct MMAL_COMPONENT_MODULE_T
    uint32_t sent_flags;    /**< Flags indicating which output port we've already sent data to */
    MMAL_BOOL_T error;      /**< Error state */
 
+   VCOS_MUTEX_T lock;      /**< Protects the state of the component and its ports */
+   MMAL_BOOL_T busy;       /**< A thread is processing the buffers */
+   MMAL_BOOL_T pending;    /**< Buffers were received while busy */
+
 } MMAL_COMPONENT_MODULE_T;
 
+/** Input buffer waiting for an output port. We hold a reference to the input
+ * buffer header but it gets consumed once all the output ports have been
+ * served, so we keep a copy of the fields we need. */
+typedef struct SPLITTER_BACKLOG_ENTRY_T
+{
+   MMAL_BUFFER_HEADER_T *buffer;
+   uint32_t offset;
+   uint32_t length;
+   uint32_t flags;
+   int64_t pts;
+   int64_t dts;
+} SPLITTER_BACKLOG_ENTRY_T;
+
 typedef struct MMAL_PORT_MODULE_T
 {
    MMAL_QUEUE_T *queue; /**< queue for the buffers sent to the ports */
 
+   MMAL_OUTPUT_POLICY_T policy; /**< What to do when the output port has no buffer available */
+   unsigned int depth;          /**< Maximum number of buffers in the backlog */
+   uint32_t dropped;            /**< Number of buffers dropped for this output port */
+
+   SPLITTER_BACKLOG_ENTRY_T backlog[SPLITTER_BACKLOG_MAX]; /**< Buffers waiting for the output port */
+   unsigned int backlog_first;  /**< Index of the oldest buffer in the backlog */
+   unsigned int backlog_num;    /**< Number of buffers in the backlog */
+
 } MMAL_PORT_MODULE_T;
 
 /*****************************************************************************/
@@ -66,13 +92,42 @@ static MMAL_STATUS_T splitter_component_destroy(MMAL_COMPONENT_T *component)
    if(component->output_num)
       mmal_ports_free(component->output, component->output_num);
 
+   vcos_mutex_delete(&component->priv->module->lock);
    vcos_free(component->priv->module);
    return MMAL_SUCCESS;
 }
 
+/** Add an input buffer to the backlog of an output port. Must be called with the lock held. */
+static void splitter_backlog_push(MMAL_PORT_MODULE_T *port_module, const SPLITTER_BACKLOG_ENTRY_T *entry)
+{
+   unsigned int index = (port_module->backlog_first + port_module->backlog_num++) % SPLITTER_BACKLOG_MAX;
+
+   mmal_buffer_header_acquire(entry->buffer);
+   port_module->backlog[index] = *entry;
+}
+
+/** Remove the oldest input buffer from the backlog of an output port. Must be called with the
+ * lock held. The caller is responsible for releasing the reference to the buffer header. */
+static void splitter_backlog_pop(MMAL_PORT_MODULE_T *port_module, SPLITTER_BACKLOG_ENTRY_T *entry)
+{
+   *entry = port_module->backlog[port_module->backlog_first];
+   port_module->backlog_first = (port_module->backlog_first + 1) % SPLITTER_BACKLOG_MAX;
+   port_module->backlog_num--;
+}
+
+/** Put an input buffer popped from the backlog of an output port back at its front. Must be
+ * called with the lock held. The reference to the buffer header is handed back to the backlog. */
+static void splitter_backlog_unpop(MMAL_PORT_MODULE_T *port_module, const SPLITTER_BACKLOG_ENTRY_T *entry)
+{
+   port_module->backlog_first = (port_module->backlog_first + SPLITTER_BACKLOG_MAX - 1) % SPLITTER_BACKLOG_MAX;
+   port_module->backlog_num++;
+   port_module->backlog[port_module->backlog_first] = *entry;
+}
+
 /** Enable processing on a port */
 static MMAL_STATUS_T splitter_port_enable(MMAL_PORT_T *port, MMAL_PORT_BH_CB_T cb)
 {
+   MMAL_COMPONENT_MODULE_T *module = port->component->priv->module;
 #if 0
    MMAL_COMPONENT_T *component = port->component;
    uint32_t buffer_num, buffer_size;
@@ -96,18 +151,46 @@ static MMAL_STATUS_T splitter_port_enable(MMAL_PORT_T *port, MMAL_PORT_BH_CB_T c
 #endif
 
    MMAL_PARAM_UNUSED(cb);
+   vcos_mutex_lock(&module->lock);
    if (port->buffer_size)
    if (port->type == MMAL_PORT_TYPE_OUTPUT)
-      port->component->priv->module->enabled_flags |= (1<<port->index);
+      module->enabled_flags |= (1<<port->index);
+   vcos_mutex_unlock(&module->lock);
    return MMAL_SUCCESS;
 }
 
 /** Flush a port */
 static MMAL_STATUS_T splitter_port_flush(MMAL_PORT_T *port)
 {
+   MMAL_COMPONENT_T *component = port->component;
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
    MMAL_PORT_MODULE_T *port_module = port->priv->module;
+   SPLITTER_BACKLOG_ENTRY_T backlog[SPLITTER_BACKLOG_MAX * SPLITTER_OUTPUT_PORTS_NUM];
+   unsigned int i, backlog_num = 0;
    MMAL_BUFFER_HEADER_T *buffer;
 
+   vcos_mutex_lock(&module->lock);
+   if (port->type == MMAL_PORT_TYPE_INPUT)
+   {
+      /* The backlogs of the output ports hold references to our input buffers
+       * which need to be returned as well */
+      for (i = 0; i < component->output_num; i++)
+         while (component->output[i]->priv->module->backlog_num)
+            splitter_backlog_pop(component->output[i]->priv->module, &backlog[backlog_num++]);
+      module->sent_flags = 0;
+   }
+   else
+   {
+      while (port_module->backlog_num)
+         splitter_backlog_pop(port_module, &backlog[backlog_num++]);
+   }
+   vcos_mutex_unlock(&module->lock);
+
+   /* Release the buffers which were waiting for the output ports. This is done without
+    * holding the lock since it can result in buffers being sent back to us. */
+   for (i = 0; i < backlog_num; i++)
+      mmal_buffer_header_release(backlog[i].buffer);
+
    /* Flush buffers that our component is holding on to */
    buffer = mmal_queue_get(port_module->queue);
    while(buffer)
@@ -116,95 +199,193 @@ static MMAL_STATUS_T splitter_port_flush(MMAL_PORT_T *port)
       buffer = mmal_queue_get(port_module->queue);
    }
 
-   if (port->type == MMAL_PORT_TYPE_INPUT)
-      port->component->priv->module->sent_flags = 0;
-
    return MMAL_SUCCESS;
 }
 
 /** Disable processing on a port */
 static MMAL_STATUS_T splitter_port_disable(MMAL_PORT_T *port)
 {
+   MMAL_COMPONENT_MODULE_T *module = port->component->priv->module;
+
+   vcos_mutex_lock(&module->lock);
    if (port->type == MMAL_PORT_TYPE_OUTPUT)
-      port->component->priv->module->enabled_flags &= ~(1<<port->index);
+      module->enabled_flags &= ~(1<<port->index);
+   vcos_mutex_unlock(&module->lock);
 
    /* We just need to flush our internal queue */
    return splitter_port_flush(port);
 }
 
-/** Send a buffer header to a port */
-static MMAL_STATUS_T splitter_send_output(MMAL_BUFFER_HEADER_T *buffer, MMAL_PORT_T *out_port)
+/** Send a replica of an input buffer to an output port.
+ * Must be called with the lock held, which is released while handing over the buffer.
+ * If release is set, the entry was popped from the backlog of the output port and the reference
+ * to the input buffer is released once it has been sent, or the entry is put back in the backlog
+ * if it can't be sent. */
+static MMAL_STATUS_T splitter_send_output(MMAL_PORT_T *out_port, MMAL_BUFFER_HEADER_T *out,
+   const SPLITTER_BACKLOG_ENTRY_T *entry, MMAL_BOOL_T release)
 {
-   MMAL_BUFFER_HEADER_T *out;
+   MMAL_COMPONENT_MODULE_T *module = out_port->component->priv->module;
    MMAL_STATUS_T status;
 
-   /* Get a buffer header from output port */
-   out = mmal_queue_get(out_port->priv->module->queue);
-   if (!out)
-      return MMAL_EAGAIN;
-
    /* Copy our input buffer header */
-   status = mmal_buffer_header_replicate(out, buffer);
-   if (status != MMAL_SUCCESS)
-      goto error;
+   status = mmal_buffer_header_replicate(out, entry->buffer);
+   if (status == MMAL_SUCCESS)
+   {
+      out->offset = entry->offset;
+      out->length = entry->length;
+      out->flags = entry->flags;
+      out->pts = entry->pts;
+      out->dts = entry->dts;
+   }
+   else
+   {
+      mmal_queue_put_back(out_port->priv->module->queue, out);
+      if (release)
+         splitter_backlog_unpop(out_port->priv->module, entry);
+      return status;
+   }
 
    /* Send buffer back */
+   vcos_mutex_unlock(&module->lock);
    mmal_port_buffer_header_callback(out_port, out);
-   return MMAL_SUCCESS;
+   if (release)
+      mmal_buffer_header_release(entry->buffer);
+   vcos_mutex_lock(&module->lock);
 
- error:
-   mmal_queue_put_back(out_port->priv->module->queue, out);
    return status;
 }
 
-/** Send a buffer header to a port */
-static MMAL_STATUS_T splitter_port_send(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
+/** Serve the output ports with the input buffers we have received.
+ * Must be called with the lock held. */
+static MMAL_STATUS_T splitter_process(MMAL_COMPONENT_T *component)
 {
-   MMAL_COMPONENT_T *component = port->component;
    MMAL_COMPONENT_MODULE_T *module = component->priv->module;
-   MMAL_PORT_T *in_port, *out_port;
-   MMAL_BUFFER_HEADER_T *in;
+   MMAL_PORT_T *in_port = component->input[0], *out_port;
+   MMAL_PORT_MODULE_T *port_module;
+   SPLITTER_BACKLOG_ENTRY_T entry, dropped;
+   MMAL_BUFFER_HEADER_T *in, *out;
    MMAL_STATUS_T status;
    unsigned int i;
 
-   mmal_queue_put(port->priv->module->queue, buffer);
+   while (1)
+   {
+      /* Buffers waiting for an output port go first to preserve ordering */
+      for (i = 0; i < component->output_num; i++)
+      {
+         port_module = component->output[i]->priv->module;
+         while (port_module->backlog_num && (out = mmal_queue_get(port_module->queue)) != NULL)
+         {
+            splitter_backlog_pop(port_module, &entry);
+            status = splitter_send_output(component->output[i], out, &entry, 1);
+            if (status != MMAL_SUCCESS)
+               return status;
+         }
+      }
 
-   if (module->error)
-      return MMAL_SUCCESS; /* Just do nothing */
+      /* Get input buffer header */
+      in = mmal_queue_get(in_port->priv->module->queue);
+      if (!in)
+         return MMAL_SUCCESS; /* Nothing to do */
 
-   /* Get input buffer header */
-   in_port = component->input[0];
-   in = mmal_queue_get(in_port->priv->module->queue);
-   if (!in)
-      return MMAL_SUCCESS; /* Nothing to do */
+      entry.buffer = in;
+      entry.offset = in->offset;
+      entry.length = in->length;
+      entry.flags = in->flags;
+      entry.pts = in->pts;
+      entry.dts = in->dts;
 
-   for (i = 0; i < component->output_num; i++)
-   {
-      out_port = component->output[i];
-      status = splitter_send_output(in, out_port);
+      for (i = 0; i < component->output_num; i++)
+      {
+         if (!(module->enabled_flags & (1<<i)) || (module->sent_flags & (1<<i)))
+            continue;
 
-      if (status != MMAL_SUCCESS && status != MMAL_EAGAIN)
-         goto error;
+         out_port = component->output[i];
+         port_module = out_port->priv->module;
+
+         if (!port_module->backlog_num && (out = mmal_queue_get(port_module->queue)) != NULL)
+         {
+            status = splitter_send_output(out_port, out, &entry, 0);
+            if (status != MMAL_SUCCESS)
+            {
+               mmal_queue_put_back(in_port->priv->module->queue, in);
+               return status;
+            }
+         }
+         else if (port_module->backlog_num < port_module->depth)
+         {
+            splitter_backlog_push(port_module, &entry);
+         }
+         else if (port_module->policy == MMAL_OUTPUT_POLICY_DROP_NEWEST)
+         {
+            port_module->dropped++;
+         }
+         else if (port_module->policy == MMAL_OUTPUT_POLICY_DROP_OLDEST)
+         {
+            splitter_backlog_pop(port_module, &dropped);
+            splitter_backlog_push(port_module, &entry);
+            port_module->dropped++;
+
+            vcos_mutex_unlock(&module->lock);
+            mmal_buffer_header_release(dropped.buffer);
+            vcos_mutex_lock(&module->lock);
+         }
+         else
+         {
+            continue; /* Wait for the output port to give us a buffer */
+         }
 
-      if (status == MMAL_SUCCESS)
          module->sent_flags |= (1<<i);
-   }
+      }
 
-   /* Check if we're done with the input buffer */
-   if ((module->sent_flags & module->enabled_flags) == module->enabled_flags)
-   {
+      /* Check if we're done with the input buffer */
+      if ((module->sent_flags & module->enabled_flags) != module->enabled_flags)
+      {
+         /* We're not done yet so put the buffer back in the queue */
+         mmal_queue_put_back(in_port->priv->module->queue, in);
+         return MMAL_SUCCESS;
+      }
+
+      module->sent_flags = 0;
       in->length = 0; /* Consume the input buffer */
+      vcos_mutex_unlock(&module->lock);
       mmal_port_buffer_header_callback(in_port, in);
-      module->sent_flags = 0;
+      vcos_mutex_lock(&module->lock);
+   }
+}
+
+/** Send a buffer header to a port */
+static MMAL_STATUS_T splitter_port_send(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
+{
+   MMAL_COMPONENT_T *component = port->component;
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   MMAL_STATUS_T status = MMAL_SUCCESS;
+
+   mmal_queue_put(port->priv->module->queue, buffer);
+
+   vcos_mutex_lock(&module->lock);
+
+   /* Only one thread processes the buffers at any one time. This also takes care
+    * of buffers being sent to us from within the callbacks we trigger. */
+   if (module->busy)
+   {
+      module->pending = 1;
+      vcos_mutex_unlock(&module->lock);
       return MMAL_SUCCESS;
    }
 
-   /* We're not done yet so put the buffer back in the queue */
-   mmal_queue_put(in_port->priv->module->queue, in);
-   return MMAL_SUCCESS;
+   module->busy = 1;
+   do
+   {
+      module->pending = 0;
+      if (!module->error)
+         status = splitter_process(component);
+   } while (module->pending && status == MMAL_SUCCESS);
+   module->busy = 0;
 
- error:
-   mmal_queue_put(in_port->priv->module->queue, in);
+   vcos_mutex_unlock(&module->lock);
+
+   if (status == MMAL_SUCCESS)
+      return MMAL_SUCCESS;
 
    status = mmal_event_error_send(port->component, status);
    if (status != MMAL_SUCCESS)
@@ -272,6 +453,53 @@ static MMAL_STATUS_T splitter_port_parameter_set(MMAL_PORT_T *port, const MMAL_P
       }
       return MMAL_SUCCESS;
 
+   case MMAL_PARAMETER_OUTPUT_POLICY:
+      {
+         const MMAL_PARAMETER_OUTPUT_POLICY_T *policy = (const MMAL_PARAMETER_OUTPUT_POLICY_T *)param;
+         MMAL_PORT_MODULE_T *port_module = port->priv->module;
+
+         if (port->type != MMAL_PORT_TYPE_OUTPUT || param->size < sizeof(*policy) ||
+             policy->policy > MMAL_OUTPUT_POLICY_BOUNDED_LAG || policy->depth > SPLITTER_BACKLOG_MAX)
+            return MMAL_EINVAL;
+
+         vcos_mutex_lock(&component->priv->module->lock);
+         port_module->policy = policy->policy;
+         port_module->depth = policy->depth;
+         if (policy->policy == MMAL_OUTPUT_POLICY_LOCKSTEP)
+            port_module->depth = 0;
+         else if (policy->policy == MMAL_OUTPUT_POLICY_DROP_OLDEST && !policy->depth)
+            port_module->depth = 1; /* We need to keep at least the newest buffer */
+         vcos_mutex_unlock(&component->priv->module->lock);
+      }
+      return MMAL_SUCCESS;
+
+   default:
+      return MMAL_ENOSYS;
+   }
+}
+
+static MMAL_STATUS_T splitter_port_parameter_get(MMAL_PORT_T *port, MMAL_PARAMETER_HEADER_T *param)
+{
+   MMAL_COMPONENT_T *component = port->component;
+
+   switch (param->id)
+   {
+   case MMAL_PARAMETER_OUTPUT_POLICY:
+      {
+         MMAL_PARAMETER_OUTPUT_POLICY_T *policy = (MMAL_PARAMETER_OUTPUT_POLICY_T *)param;
+         MMAL_PORT_MODULE_T *port_module = port->priv->module;
+
+         if (port->type != MMAL_PORT_TYPE_OUTPUT || param->size < sizeof(*policy))
+            return MMAL_EINVAL;
+
+         vcos_mutex_lock(&component->priv->module->lock);
+         policy->policy = port_module->policy;
+         policy->depth = port_module->depth;
+         policy->dropped = port_module->dropped;
+         vcos_mutex_unlock(&component->priv->module->lock);
+      }
+      return MMAL_SUCCESS;
+
    default:
       return MMAL_ENOSYS;
    }
@@ -290,6 +518,11 @@ static MMAL_STATUS_T mmal_component_create_splitter(const char *name, MMAL_COMPO
    if (!module)
       return MMAL_ENOMEM;
    memset(module, 0, sizeof(*module));
+   if (vcos_mutex_create(&module->lock, "mmal splitter") != VCOS_SUCCESS)
+   {
+      vcos_free(module);
+      return MMAL_ENOMEM;
+   }
 
    component->priv->pf_destroy = splitter_component_destroy;
 
@@ -323,6 +556,7 @@ static MMAL_STATUS_T mmal_component_create_splitter(const char *name, MMAL_COMPO
       component->output[i]->priv->pf_send = splitter_port_send;
       component->output[i]->priv->pf_set_format = splitter_port_format_commit;
       component->output[i]->priv->pf_parameter_set = splitter_port_parameter_set;
+      component->output[i]->priv->pf_parameter_get = splitter_port_parameter_get;
       component->output[i]->buffer_num_min = 1;
       component->output[i]->buffer_num_recommended = 0;
       component->output[i]->capabilities = MMAL_PORT_CAPABILITY_PASSTHROUGH;
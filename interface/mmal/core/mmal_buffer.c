@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mmal.h"
 #include "mmal_buffer.h"
 #include "core/mmal_buffer_private.h"
+#include "core/mmal_core_private.h"
 #include "mmal_logging.h"
 
 #define ROUND_UP(s,align) ((((unsigned long)(s)) & ~((align)-1)) + (align))
@@ -40,7 +41,13 @@ void mmal_buffer_header_acquire(MMAL_BUFFER_HEADER_T *header)
 #ifdef ENABLE_MMAL_EXTRA_LOGGING
    LOG_TRACE("%p (%i)", header, (int)header->priv->refcount+1);
 #endif
+#if MMAL_ATOMICS_SUPPORTED
+   /* References can be dropped concurrently by different threads (e.g. a client
+    * releasing a replicated buffer while a component drops its own reference) */
+   __atomic_add_fetch(&header->priv->refcount, 1, __ATOMIC_RELAXED);
+#else
    header->priv->refcount++;
+#endif
 }
 
 /** Reset a buffer header */
@@ -60,8 +67,13 @@ void mmal_buffer_header_release(MMAL_BUFFER_HEADER_T *header)
    LOG_TRACE("%p (%i)", header, (int)header->priv->refcount-1);
 #endif
 
+#if MMAL_ATOMICS_SUPPORTED
+   if(__atomic_sub_fetch(&header->priv->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+      return;
+#else
    if(--header->priv->refcount != 0)
       return;
+#endif
 
    if (header->priv->pf_pre_release)
    {
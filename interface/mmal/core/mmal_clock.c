@@ -49,7 +49,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define Q16_ONE  (1 << 16)
 
 /* Maximum number of pending requests */
-#define CLOCK_REQUEST_SLOTS  32
+#define CLOCK_REQUEST_SLOTS  128
 
 /* Number of microseconds the clock tries to service requests early
  * to account for processing overhead */
@@ -100,6 +100,8 @@ typedef struct MMAL_CLOCK_REQUEST_T
    int64_t media_time_adj;   /**< adjusted media-time at which the request will
                                   be serviced in microseconds (this takes
                                   CLOCK_TARGET_OFFSET into account) */
+   uint32_t sequence;        /**< order of arrival, used to service requests due
+                                  at the same time in the order they were added */
 } MMAL_CLOCK_REQUEST_T;
 
 typedef struct MMAL_CLOCK_PRIVATE_T
@@ -152,10 +154,15 @@ typedef struct MMAL_CLOCK_PRIVATE_T
    struct
    {
       MMAL_LIST_T* list_free;
-      MMAL_LIST_T* list_pending;
+      /** Binary heap of pending requests, the next request due is at the top */
+      MMAL_CLOCK_REQUEST_T *pending[CLOCK_REQUEST_SLOTS];
+      unsigned int pending_num;
+      uint32_t sequence;    /**< sequence number of the next request */
       MMAL_CLOCK_REQUEST_T pool[CLOCK_REQUEST_SLOTS];
    } request;
 
+   MMAL_CLOCK_REQUEST_STATS_T stats; /**< statistics about the servicing of requests */
+
 } MMAL_CLOCK_PRIVATE_T;
 
 
@@ -252,61 +259,142 @@ static int64_t mmal_clock_media_time_get_locked(MMAL_CLOCK_PRIVATE_T *private)
    return private->media_time;
 }
 
-/* Comparison function used for inserting a request into
- * the list of pending requests when clock scale is positive. */
-static int mmal_clock_request_compare_pos(MMAL_LIST_ELEMENT_T *lhs, MMAL_LIST_ELEMENT_T *rhs)
+/* Return TRUE if request a is due before request b. The order depends on
+ * the direction of the clock. */
+static inline MMAL_BOOL_T mmal_clock_request_before(MMAL_CLOCK_PRIVATE_T *private,
+      const MMAL_CLOCK_REQUEST_T *a, const MMAL_CLOCK_REQUEST_T *b)
 {
-   return ((MMAL_CLOCK_REQUEST_T*)lhs)->media_time_adj < ((MMAL_CLOCK_REQUEST_T*)rhs)->media_time_adj;
+   if (a->media_time_adj != b->media_time_adj)
+      return (private->scale >= 0) ? (a->media_time_adj < b->media_time_adj) :
+                                     (a->media_time_adj > b->media_time_adj);
+   return (int32_t)(a->sequence - b->sequence) < 0;
 }
 
-/* Comparison function used for inserting a request into
- * the list of pending requests when clock scale is negative. */
-static int mmal_clock_request_compare_neg(MMAL_LIST_ELEMENT_T *lhs, MMAL_LIST_ELEMENT_T *rhs)
+/* Move a request up the heap of pending requests until its parent is due before it */
+static void mmal_clock_request_sift_up(MMAL_CLOCK_PRIVATE_T *private, unsigned int index)
 {
-   return ((MMAL_CLOCK_REQUEST_T*)lhs)->media_time_adj > ((MMAL_CLOCK_REQUEST_T*)rhs)->media_time_adj;
+   MMAL_CLOCK_REQUEST_T **heap = private->request.pending;
+   MMAL_CLOCK_REQUEST_T *request = heap[index];
+
+   while (index)
+   {
+      unsigned int parent = (index - 1) / 2;
+      if (!mmal_clock_request_before(private, request, heap[parent]))
+         break;
+      heap[index] = heap[parent];
+      index = parent;
+   }
+   heap[index] = request;
 }
 
-/* Insert a new request into the list of pending requests */
+/* Move a request down the heap of pending requests until it is due before its children */
+static void mmal_clock_request_sift_down(MMAL_CLOCK_PRIVATE_T *private, unsigned int index)
+{
+   MMAL_CLOCK_REQUEST_T **heap = private->request.pending;
+   MMAL_CLOCK_REQUEST_T *request = heap[index];
+   unsigned int num = private->request.pending_num;
+
+   while (1)
+   {
+      unsigned int child = 2 * index + 1;
+      if (child >= num)
+         break;
+      if (child + 1 < num && mmal_clock_request_before(private, heap[child + 1], heap[child]))
+         child++;
+      if (!mmal_clock_request_before(private, heap[child], request))
+         break;
+      heap[index] = heap[child];
+      index = child;
+   }
+   heap[index] = request;
+}
+
+/* Rebuild the heap of pending requests, e.g. after the direction of the clock changed */
+static void mmal_clock_request_heapify(MMAL_CLOCK_PRIVATE_T *private)
+{
+   unsigned int i = private->request.pending_num / 2;
+
+   while (i--)
+      mmal_clock_request_sift_down(private, i);
+}
+
+/* Return the next request due without removing it from the pending requests */
+static inline MMAL_CLOCK_REQUEST_T *mmal_clock_request_peek(MMAL_CLOCK_PRIVATE_T *private)
+{
+   return private->request.pending_num ? private->request.pending[0] : NULL;
+}
+
+/* Remove the next request due from the pending requests */
+static MMAL_CLOCK_REQUEST_T *mmal_clock_request_pop(MMAL_CLOCK_PRIVATE_T *private)
+{
+   MMAL_CLOCK_REQUEST_T **heap = private->request.pending;
+   MMAL_CLOCK_REQUEST_T *request;
+
+   if (!private->request.pending_num)
+      return NULL;
+
+   request = heap[0];
+   heap[0] = heap[--private->request.pending_num];
+   if (private->request.pending_num)
+      mmal_clock_request_sift_down(private, 0);
+   return request;
+}
+
+/* Insert a new request into the pending requests.
+ * Returns TRUE if the request is now the next one due. */
 static MMAL_BOOL_T mmal_clock_request_insert(MMAL_CLOCK_PRIVATE_T *private, MMAL_CLOCK_REQUEST_T *request)
 {
-   MMAL_LIST_T *list = private->request.list_pending;
-   MMAL_CLOCK_REQUEST_T *pending;
+   unsigned int index;
 
    if (private->stop_thread)
       return MMAL_FALSE; /* the clock is being destroyed */
 
-   if (list->length == 0)
-   {
-      mmal_list_push_front(list, &request->link);
-      return MMAL_TRUE;
-   }
+   /* There are as many heap entries as request slots so this can't overflow */
+   request->sequence = private->request.sequence++;
+   index = private->request.pending_num++;
+   private->request.pending[index] = request;
+   mmal_clock_request_sift_up(private, index);
 
-   /* It is more likely for requests to be received in sequence,
-    * so try adding to the back of the list first before doing
-    * a more expensive list insert. */
-   pending = (MMAL_CLOCK_REQUEST_T*)list->last;
-   if ((private->scale >= 0 && (request->media_time_adj >= pending->media_time_adj)) ||
-       (private->scale <  0 && (request->media_time_adj <= pending->media_time_adj)))
-   {
-      mmal_list_push_back(list, &request->link);
-   }
-   else
-   {
-      mmal_list_insert(list, &request->link,
-            (private->scale >= 0) ? mmal_clock_request_compare_pos : mmal_clock_request_compare_neg);
-   }
-   return MMAL_TRUE;
+   if (private->request.pending_num > private->stats.pending_max)
+      private->stats.pending_max = private->request.pending_num;
+
+   return private->request.pending[0] == request;
+}
+
+/* Record the delay between the time a request was due and the time it was serviced */
+static void mmal_clock_request_latency_record(MMAL_CLOCK_PRIVATE_T *private,
+      const MMAL_CLOCK_REQUEST_T *request, int64_t media_time_now)
+{
+   MMAL_CLOCK_REQUEST_STATS_T *stats = &private->stats;
+   int64_t latency = media_time_now - request->media_time;
+   unsigned int bucket = 0;
+
+   /* Convert the media-time difference into wall-time */
+   if (private->scale < 0)
+      latency = -latency;
+   if (private->scale != 0)
+      latency = (latency * ABS_VALUE((int64_t)private->scale_inv)) >> 16;
+
+   if (!stats->requests || latency < stats->latency_min)
+      stats->latency_min = latency;
+   if (!stats->requests || latency > stats->latency_max)
+      stats->latency_max = latency;
+   stats->latency_total += latency;
+   stats->requests++;
+
+   for (; latency > 0 && bucket < MMAL_CLOCK_LATENCY_BUCKETS - 1; latency >>= 1)
+      bucket++;
+   stats->latency_histogram[bucket]++;
 }
 
 /* Flush all pending requests */
 static MMAL_STATUS_T mmal_clock_request_flush_locked(MMAL_CLOCK_PRIVATE_T *private,
                                                      int64_t media_time)
 {
-   MMAL_LIST_T *pending = private->request.list_pending;
    MMAL_LIST_T *list_free = private->request.list_free;
    MMAL_CLOCK_REQUEST_T *request;
 
-   while ((request = (MMAL_CLOCK_REQUEST_T *)mmal_list_pop_front(pending)) != NULL)
+   while ((request = mmal_clock_request_pop(private)) != NULL)
    {
       /* Inform the client */
       request->cb(&private->clock, media_time, request->cb_data, request->priv);
@@ -324,14 +412,17 @@ static void mmal_clock_process_requests(MMAL_CLOCK_PRIVATE_T *private)
 {
    int64_t media_time_now;
    MMAL_LIST_T* free = private->request.list_free;
-   MMAL_LIST_T* pending = private->request.list_pending;
    MMAL_CLOCK_REQUEST_T *next;
-
-   if (pending->length == 0 || !private->is_active)
-      return;
+   MMAL_BOOL_T serviced = MMAL_FALSE;
 
    LOCK(private);
 
+   if (private->request.pending_num == 0 || !private->is_active)
+   {
+      UNLOCK(private);
+      return;
+   }
+
    /* Detect discontinuity */
    if (private->media_time_at_timer != 0)
    {
@@ -340,8 +431,8 @@ static void mmal_clock_process_requests(MMAL_CLOCK_PRIVATE_T *private)
       if (private->scale > 0 &&
           media_time_now + private->discont_threshold < private->media_time_at_timer)
       {
-         LOG_INFO("discontinuity: was=%" PRIi64 " now=%" PRIi64 " pending=%d",
-                  private->media_time_at_timer, media_time_now, pending->length);
+         LOG_INFO("discontinuity: was=%" PRIi64 " now=%" PRIi64 " pending=%u",
+                  private->media_time_at_timer, media_time_now, private->request.pending_num);
 
          /* It's likely that packets from before the discontinuity will continue to arrive for
           * a short time. Ensure these are detected and the requests fired immediately. */
@@ -354,10 +445,13 @@ static void mmal_clock_process_requests(MMAL_CLOCK_PRIVATE_T *private)
       }
    }
 
-   /* Earliest request is always at the front */
-   next = (MMAL_CLOCK_REQUEST_T*)mmal_list_pop_front(pending);
+   /* Earliest request is always at the top of the heap. All the requests which
+    * fall due within MIN_TIMER_DELAY are serviced in this single wakeup. */
+   next = mmal_clock_request_peek(private);
    while (next)
    {
+      MMAL_BOOL_T discont;
+
       media_time_now = mmal_clock_media_time_get_locked(private);
 
       if (private->discont_expiry != 0 && private->wall_time > private->discont_expiry)
@@ -365,19 +459,24 @@ static void mmal_clock_process_requests(MMAL_CLOCK_PRIVATE_T *private)
 
       /* Fire the request if it matches the pending discontinuity or if its requested media time
        * has been reached. */
-      if ((private->discont_expiry != 0 &&
+      discont = private->discont_expiry != 0 &&
            next->media_time_adj >= private->discont_start &&
-           next->media_time_adj < private->discont_end) ||
+           next->media_time_adj < private->discont_end;
+      if (discont ||
           (private->scale > 0 && ((media_time_now + MIN_TIMER_DELAY) >= next->media_time_adj)) ||
           (private->scale < 0 && ((media_time_now - MIN_TIMER_DELAY) <= next->media_time_adj)))
       {
          LOG_TRACE("servicing request: next %"PRIi64" now %"PRIi64, next->media_time_adj, media_time_now);
+         mmal_clock_request_pop(private);
+         if (!discont)
+            mmal_clock_request_latency_record(private, next, media_time_now);
+         serviced = MMAL_TRUE;
          /* Inform the client */
          next->cb(&private->clock, media_time_now, next->cb_data, next->priv);
          /* Recycle the request slot */
          mmal_list_push_back(free, &next->link);
          /* Move onto next pending request */
-         next = (MMAL_CLOCK_REQUEST_T*)mmal_list_pop_front(pending);
+         next = mmal_clock_request_peek(private);
       }
       else
       {
@@ -389,8 +488,6 @@ static void mmal_clock_process_requests(MMAL_CLOCK_PRIVATE_T *private)
          if (private->scale == 0)
             wall_time_delay = CLOCK_WAIT_TIME; /* Clock is paused */
 
-         /* Put next request back into pending list */
-         mmal_list_push_front(pending, &next->link);
          next = NULL;
 
          /* Set the timer */
@@ -401,6 +498,9 @@ static void mmal_clock_process_requests(MMAL_CLOCK_PRIVATE_T *private)
       }
    }
 
+   if (serviced)
+      private->stats.wakeups++;
+
    UNLOCK(private);
 }
 
@@ -462,10 +562,9 @@ static MMAL_STATUS_T mmal_clock_create_scheduling(MMAL_CLOCK_PRIVATE_T *private)
    }
 
    private->request.list_free = mmal_list_create();
-   private->request.list_pending = mmal_list_create();
-   if (!private->request.list_free || !private->request.list_pending)
+   if (!private->request.list_free)
    {
-      LOG_ERROR("failed to create list %p %p", private->request.list_free, private->request.list_pending);
+      LOG_ERROR("failed to create list");
       goto error;
    }
 
@@ -490,7 +589,7 @@ error:
    if (event_status == VCOS_SUCCESS) vcos_semaphore_delete(&private->event);
    if (timer_status) mmal_clock_timer_destroy(&private->timer);
    if (private->request.list_free) mmal_list_destroy(private->request.list_free);
-   if (private->request.list_pending) mmal_list_destroy(private->request.list_pending);
+   private->request.list_free = NULL;
    return MMAL_ENOSPC;
 }
 
@@ -502,7 +601,6 @@ static void mmal_clock_destroy_scheduling(MMAL_CLOCK_PRIVATE_T *private)
    mmal_clock_request_flush(&private->clock);
 
    mmal_list_destroy(private->request.list_free);
-   mmal_list_destroy(private->request.list_pending);
 
    vcos_semaphore_delete(&private->event);
 
@@ -643,6 +741,9 @@ MMAL_STATUS_T mmal_clock_request_add(MMAL_CLOCK_T *clock, int64_t media_time,
    request->media_time = media_time;
    request->media_time_adj = media_time - (int64_t)(private->scale * CLOCK_TARGET_OFFSET >> 16);
 
+   /* The worker thread only needs waking up if the new request is due before
+    * the one it is currently waiting for. Other requests get serviced in the
+    * same wakeup as the requests due around the same time. */
    if (mmal_clock_request_insert(private, request))
       wake_thread = private->is_active;
 
@@ -739,6 +840,8 @@ MMAL_STATUS_T mmal_clock_media_time_set(MMAL_CLOCK_T *clock, int64_t media_time)
 MMAL_STATUS_T mmal_clock_scale_set(MMAL_CLOCK_T *clock, MMAL_RATIONAL_T scale)
 {
    MMAL_CLOCK_PRIVATE_T *private = (MMAL_CLOCK_PRIVATE_T*)clock;
+   MMAL_BOOL_T reverse;
+   int32_t new_scale;
 
    LOG_TRACE("new scale %d/%d", scale.num, scale.den);
 
@@ -747,7 +850,14 @@ MMAL_STATUS_T mmal_clock_scale_set(MMAL_CLOCK_T *clock, MMAL_RATIONAL_T scale)
    mmal_clock_update_local_time_locked(private);
 
    private->scale_rational = scale;
-   private->scale = mmal_rational_to_fixed_16_16(scale);
+   new_scale = mmal_rational_to_fixed_16_16(scale);
+   reverse = (private->scale < 0) != (new_scale < 0);
+   private->scale = new_scale;
+
+   /* The pending requests are due in the reverse order when the direction
+    * of the clock changes */
+   if (reverse)
+      mmal_clock_request_heapify(private);
 
    if (private->scale)
       private->scale_inv = (int32_t)((1LL << 32) / (int64_t)private->scale);
@@ -890,3 +1000,28 @@ MMAL_STATUS_T mmal_clock_request_threshold_set(MMAL_CLOCK_T *clock, const MMAL_C
 
    return MMAL_SUCCESS;
 }
+
+/* Get the clock's request statistics */
+MMAL_STATUS_T mmal_clock_request_stats_get(MMAL_CLOCK_T *clock, MMAL_CLOCK_REQUEST_STATS_T *stats)
+{
+   MMAL_CLOCK_PRIVATE_T *private = (MMAL_CLOCK_PRIVATE_T *)clock;
+
+   LOCK(private);
+   *stats = private->stats;
+   UNLOCK(private);
+
+   return MMAL_SUCCESS;
+}
+
+/* Reset the clock's request statistics */
+MMAL_STATUS_T mmal_clock_request_stats_reset(MMAL_CLOCK_T *clock)
+{
+   MMAL_CLOCK_PRIVATE_T *private = (MMAL_CLOCK_PRIVATE_T *)clock;
+
+   LOCK(private);
+   memset(&private->stats, 0, sizeof(private->stats));
+   private->stats.pending_max = private->request.pending_num;
+   UNLOCK(private);
+
+   return MMAL_SUCCESS;
+}
@@ -197,6 +197,23 @@ MMAL_STATUS_T mmal_clock_request_threshold_get(MMAL_CLOCK_T *clock, MMAL_CLOCK_R
  */
 MMAL_STATUS_T mmal_clock_request_threshold_set(MMAL_CLOCK_T *clock, const MMAL_CLOCK_REQUEST_THRESHOLD_T *req);
 
+/** Get the statistics about the servicing of client requests.
+ *
+ * @param clock      The clock
+ * @param stats      Pointer to the statistics to fill
+ *
+ * @return MMAL_SUCCESS on success
+ */
+MMAL_STATUS_T mmal_clock_request_stats_get(MMAL_CLOCK_T *clock, MMAL_CLOCK_REQUEST_STATS_T *stats);
+
+/** Reset the statistics about the servicing of client requests.
+ *
+ * @param clock      The clock
+ *
+ * @return MMAL_SUCCESS on success
+ */
+MMAL_STATUS_T mmal_clock_request_stats_reset(MMAL_CLOCK_T *clock);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "core/mmal_component_private.h"
 #include "core/mmal_port_private.h"
 #include "core/mmal_core_private.h"
+#include "core/mmal_executor_private.h"
 #include "mmal_logging.h"
 
 /* Minimum number of buffers that will be available on the control port */
@@ -42,7 +43,11 @@ typedef struct
    /** Action registered by component and run when buffers are received by any of the ports */
    void (*pf_action)(MMAL_COMPONENT_T *component);
 
-   /** Action thread */
+   /** Action run by the shared executor */
+   MMAL_EXECUTOR_TASK_T action_task;
+
+   /** Dedicated action thread, for components which don't use the executor */
+   MMAL_BOOL_T action_dedicated;
    VCOS_THREAD_T action_thread;
    VCOS_EVENT_T action_event;
    VCOS_MUTEX_T action_mutex;
@@ -542,7 +547,18 @@ MMAL_STATUS_T mmal_port_release(MMAL_PORT_T *port)
  * Actions support
  *****************************************************************************/
 
-/** Registers an action with the core */
+/** Runs the action of a component */
+static void mmal_component_action_run(void *arg)
+{
+   MMAL_COMPONENT_T *component = (MMAL_COMPONENT_T *)arg;
+   MMAL_COMPONENT_CORE_PRIVATE_T *private = (MMAL_COMPONENT_CORE_PRIVATE_T *)component->priv;
+
+   vcos_mutex_lock(&private->action_mutex);
+   private->pf_action(component);
+   vcos_mutex_unlock(&private->action_mutex);
+}
+
+/** Dedicated action thread */
 static void *mmal_component_action_thread_func(void *arg)
 {
    MMAL_COMPONENT_T *component = (MMAL_COMPONENT_T *)arg;
@@ -560,9 +576,7 @@ static void *mmal_component_action_thread_func(void *arg)
       if (!vcos_verify(status == VCOS_SUCCESS))
          break;
 
-      vcos_mutex_lock(&private->action_mutex);
-      private->pf_action(component);
-      vcos_mutex_unlock(&private->action_mutex);
+      mmal_component_action_run(component);
    }
    return 0;
 }
@@ -578,17 +592,35 @@ MMAL_STATUS_T mmal_component_action_register(MMAL_COMPONENT_T *component,
    if (private->pf_action)
       return MMAL_EINVAL;
 
-   status = vcos_event_create(&private->action_event, component->name);
+   status = vcos_mutex_create(&private->action_mutex, component->name);
    if (status != VCOS_SUCCESS)
       return MMAL_ENOMEM;
 
-   status = vcos_mutex_create(&private->action_mutex, component->name);
+   /* Actions which might block get their own thread, as do the ones which
+    * need a specific priority. The others are run by the shared executor. */
+   private->action_dedicated = !private->private.action_shared ||
+      private->private.priority != VCOS_THREAD_PRI_NORMAL;
+   if (!private->action_dedicated)
+   {
+      if (mmal_executor_task_register(&private->action_task, mmal_component_action_run,
+                                      component) != MMAL_SUCCESS)
+      {
+         vcos_mutex_delete(&private->action_mutex);
+         return MMAL_ENOMEM;
+      }
+      private->pf_action = pf_action;
+      return MMAL_SUCCESS;
+   }
+
+   status = vcos_event_create(&private->action_event, component->name);
    if (status != VCOS_SUCCESS)
    {
-      vcos_event_delete(&private->action_event);
+      vcos_mutex_delete(&private->action_mutex);
       return MMAL_ENOMEM;
    }
 
+   private->pf_action = pf_action;
+
    vcos_thread_attr_init(&attrs);
    vcos_thread_attr_setpriority(&attrs,
                                 private->private.priority);
@@ -596,12 +628,12 @@ MMAL_STATUS_T mmal_component_action_register(MMAL_COMPONENT_T *component,
                                mmal_component_action_thread_func, component);
    if (status != VCOS_SUCCESS)
    {
+      private->pf_action = NULL;
       vcos_mutex_delete(&private->action_mutex);
       vcos_event_delete(&private->action_event);
       return MMAL_ENOMEM;
    }
 
-   private->pf_action = pf_action;
    return MMAL_SUCCESS;
 }
 
@@ -613,10 +645,17 @@ MMAL_STATUS_T mmal_component_action_deregister(MMAL_COMPONENT_T *component)
    if (!private->pf_action)
       return MMAL_EINVAL;
 
-   private->action_quit = 1;
-   vcos_event_signal(&private->action_event);
-   vcos_thread_join(&private->action_thread, NULL);
-   vcos_event_delete(&private->action_event);
+   if (!private->action_dedicated)
+   {
+      mmal_executor_task_deregister(&private->action_task);
+   }
+   else
+   {
+      private->action_quit = 1;
+      vcos_event_signal(&private->action_event);
+      vcos_thread_join(&private->action_thread, NULL);
+      vcos_event_delete(&private->action_event);
+   }
    vcos_mutex_delete(&private->action_mutex);
    private->pf_action = NULL;
    private->action_quit = 0;
@@ -631,7 +670,10 @@ MMAL_STATUS_T mmal_component_action_trigger(MMAL_COMPONENT_T *component)
    if (!private->pf_action)
       return MMAL_EINVAL;
 
-   vcos_event_signal(&private->action_event);
+   if (!private->action_dedicated)
+      mmal_executor_task_trigger(&private->action_task);
+   else
+      vcos_event_signal(&private->action_event);
    return MMAL_SUCCESS;
 }
 
@@ -681,6 +723,7 @@ static void mmal_core_init(void)
    }
 
    mmal_logging_init();
+   mmal_trace_init();
    vcos_mutex_unlock(&mmal_core_lock);
 }
 
@@ -693,6 +736,7 @@ static void mmal_core_deinit(void)
       return;
    }
 
+   mmal_trace_deinit();
    mmal_logging_deinit();
    vcos_mutex_unlock(&mmal_core_lock);
    vcos_deinit();
@@ -71,8 +71,14 @@ struct MMAL_COMPONENT_PRIVATE_T
    int refcount_ports;
 
    /** Priority associated with the 'action thread' for this component, when
-    * such action thread is applicable. */
+    * such action thread is applicable. Components which set a priority other
+    * than VCOS_THREAD_PRI_NORMAL get a dedicated action thread. */
    int priority;
+
+   /** Set by components whose action never blocks (no sleeping or waiting for I/O)
+    * to have it run by the shared executor instead of a dedicated action thread.
+    * Must be set before the action is registered. */
+   MMAL_BOOL_T action_shared;
 };
 
 /** Set a generic component control parameter.
@@ -97,6 +103,13 @@ MMAL_STATUS_T mmal_component_parameter_get(MMAL_PORT_T *control_port,
   * The MMAL core allows components to register an action which will be run
   * from a separate thread context when the action is explicitly triggered by
   * the component.
+  * Actions get a dedicated thread unless the component opts into the shared
+  * executor (see MMAL_COMPONENT_PRIVATE_T::action_shared), in which case they are run
+  * by its worker threads. Such actions must not block since they would stall every
+  * other action queued on the same worker. Components which need their action to run
+  * at a specific priority (see MMAL_COMPONENT_PRIVATE_T::priority) always get a
+  * dedicated thread. In all cases an action never runs concurrently with itself or
+  * while \ref mmal_component_action_lock is held.
   *
   * @param component    component registering the action.
   * @param action       action to register.
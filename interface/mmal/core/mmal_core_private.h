@@ -28,6 +28,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MMAL_CORE_PRIVATE_H
 #define MMAL_CORE_PRIVATE_H
 
+#include "interface/mmal/mmal.h"
+
+/** The lock-free code paths of the core rely on the GCC atomic builtins */
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+# define MMAL_ATOMICS_SUPPORTED 1
+#else
+# define MMAL_ATOMICS_SUPPORTED 0
+#endif
+
 /** Initialise the logging system.
   */
 void mmal_logging_init(void);
@@ -36,5 +45,24 @@ void mmal_logging_init(void);
   */
 void mmal_logging_deinit(void);
 
+/** Start tracing if requested through the MMAL_TRACE environment variable.
+  */
+void mmal_trace_init(void);
+
+/** Write the trace started by \ref mmal_trace_init.
+  */
+void mmal_trace_deinit(void);
+
+/** Types of events recorded by the tracer */
+typedef enum {
+   MMAL_TRACE_BUFFER_SEND,    /**< Buffer header sent to a port */
+   MMAL_TRACE_BUFFER_RETURN   /**< Buffer header returned by a port */
+} MMAL_TRACE_EVENT_TYPE_T;
+
+/** Record a buffer header transfer if tracing is enabled.
+  */
+void mmal_trace_buffer(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer,
+   MMAL_TRACE_EVENT_TYPE_T type);
+
 #endif /* MMAL_CORE_PRIVATE_H */
 
@@ -0,0 +1,368 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include "mmal.h"
+#include "core/mmal_executor_private.h"
+#include "mmal_logging.h"
+
+/** Minimum and maximum number of worker threads */
+#define MMAL_EXECUTOR_THREADS_MIN 2
+#define MMAL_EXECUTOR_THREADS_MAX 16
+
+/** Definition of a worker thread */
+typedef struct MMAL_EXECUTOR_WORKER_T
+{
+   VCOS_THREAD_T thread;
+   VCOS_MUTEX_T lock;             /**< Protects the deque */
+   MMAL_EXECUTOR_TASK_T *first;   /**< Oldest task in the deque, where other workers steal from */
+   MMAL_EXECUTOR_TASK_T *last;    /**< Newest task in the deque, where the worker takes work from */
+   unsigned int index;
+} MMAL_EXECUTOR_WORKER_T;
+
+/** Definition of the executor */
+static struct
+{
+   VCOS_MUTEX_T lock;             /**< Protects the creation and destruction of the workers */
+   unsigned int refcount;         /**< Number of registered tasks */
+
+   VCOS_SEMAPHORE_T work;         /**< Posted every time a task is queued */
+   MMAL_BOOL_T quit;
+   unsigned int workers_num;
+   MMAL_EXECUTOR_WORKER_T workers[MMAL_EXECUTOR_THREADS_MAX];
+} mmal_executor;
+
+/*****************************************************************************
+ * Deque of tasks. Must be called with the lock of the task held.
+ *****************************************************************************/
+static void mmal_executor_push(MMAL_EXECUTOR_WORKER_T *worker, MMAL_EXECUTOR_TASK_T *task,
+   MMAL_BOOL_T front)
+{
+   vcos_mutex_lock(&worker->lock);
+   task->worker = worker;
+   if (front)
+   {
+      task->prev = NULL;
+      task->next = worker->first;
+      if (worker->first) worker->first->prev = task;
+      else worker->last = task;
+      worker->first = task;
+   }
+   else
+   {
+      task->next = NULL;
+      task->prev = worker->last;
+      if (worker->last) worker->last->next = task;
+      else worker->first = task;
+      worker->last = task;
+   }
+   vcos_mutex_unlock(&worker->lock);
+
+   vcos_semaphore_post(&mmal_executor.work);
+}
+
+/* Must be called with the lock of the worker held */
+static void mmal_executor_unlink(MMAL_EXECUTOR_WORKER_T *worker, MMAL_EXECUTOR_TASK_T *task)
+{
+   if (task->prev) task->prev->next = task->next;
+   else worker->first = task->next;
+   if (task->next) task->next->prev = task->prev;
+   else worker->last = task->prev;
+   task->prev = task->next = NULL;
+   task->worker = NULL;
+}
+
+static MMAL_EXECUTOR_TASK_T *mmal_executor_pop(MMAL_EXECUTOR_WORKER_T *worker, MMAL_BOOL_T steal)
+{
+   MMAL_EXECUTOR_TASK_T *task;
+
+   vcos_mutex_lock(&worker->lock);
+   task = steal ? worker->first : worker->last;
+   if (task)
+      mmal_executor_unlink(worker, task);
+   vcos_mutex_unlock(&worker->lock);
+   return task;
+}
+
+/** Find the worker a task should be queued on */
+static MMAL_EXECUTOR_WORKER_T *mmal_executor_worker_select(MMAL_EXECUTOR_TASK_T *task)
+{
+   VCOS_THREAD_T *thread = vcos_thread_current();
+   unsigned int i;
+
+   /* Tasks triggered by a worker stay on that worker so the data they
+    * exchange stays in the same cache */
+   for (i = 0; i < mmal_executor.workers_num; i++)
+      if (thread == &mmal_executor.workers[i].thread)
+         return &mmal_executor.workers[i];
+
+   /* Spread the other tasks over the workers, keeping a given task on the
+    * same worker */
+   return &mmal_executor.workers[((uintptr_t)task / sizeof(*task)) % mmal_executor.workers_num];
+}
+
+/*****************************************************************************
+ * Worker threads
+ *****************************************************************************/
+static void mmal_executor_run(MMAL_EXECUTOR_WORKER_T *worker, MMAL_EXECUTOR_TASK_T *task)
+{
+   vcos_mutex_lock(&task->lock);
+   if (task->quit)
+   {
+      task->state = MMAL_EXECUTOR_TASK_IDLE;
+      vcos_event_signal(&task->idle);
+      vcos_mutex_unlock(&task->lock);
+      return;
+   }
+   task->state = MMAL_EXECUTOR_TASK_RUNNING;
+   vcos_mutex_unlock(&task->lock);
+
+   task->pf_run(task->context);
+
+   vcos_mutex_lock(&task->lock);
+   if (task->state == MMAL_EXECUTOR_TASK_RERUN && !task->quit)
+   {
+      /* Queue it behind the work which is already pending so a task which
+       * keeps on triggering itself doesn't starve the others */
+      task->state = MMAL_EXECUTOR_TASK_QUEUED;
+      mmal_executor_push(worker, task, MMAL_TRUE);
+   }
+   else
+   {
+      task->state = MMAL_EXECUTOR_TASK_IDLE;
+      if (task->quit)
+         vcos_event_signal(&task->idle);
+   }
+   vcos_mutex_unlock(&task->lock);
+}
+
+static void *mmal_executor_worker_func(void *arg)
+{
+   MMAL_EXECUTOR_WORKER_T *worker = (MMAL_EXECUTOR_WORKER_T *)arg;
+   MMAL_EXECUTOR_TASK_T *task;
+   unsigned int i;
+
+   while (1)
+   {
+      task = mmal_executor_pop(worker, MMAL_FALSE);
+
+      /* Steal work from the other workers */
+      for (i = 1; !task && i < mmal_executor.workers_num; i++)
+         task = mmal_executor_pop(&mmal_executor.workers[(worker->index + i) %
+            mmal_executor.workers_num], MMAL_TRUE);
+
+      if (task)
+      {
+         mmal_executor_run(worker, task);
+         continue;
+      }
+
+      vcos_semaphore_wait(&mmal_executor.work);
+      if (mmal_executor.quit)
+         break;
+   }
+
+   return 0;
+}
+
+static unsigned int mmal_executor_threads_num(void)
+{
+   const char *value = getenv("MMAL_EXECUTOR_THREADS");
+   long num = 0;
+
+   if (value)
+      num = strtol(value, NULL, 0);
+#if defined(_SC_NPROCESSORS_ONLN)
+   if (num <= 0)
+      num = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+   /* Keep a spare worker even on single core systems, so one long task
+    * doesn't hold up all the others */
+   if (num < MMAL_EXECUTOR_THREADS_MIN)
+      num = MMAL_EXECUTOR_THREADS_MIN;
+   return num > MMAL_EXECUTOR_THREADS_MAX ? MMAL_EXECUTOR_THREADS_MAX : (unsigned int)num;
+}
+
+static void mmal_executor_stop(unsigned int threads_num)
+{
+   unsigned int i;
+
+   mmal_executor.quit = MMAL_TRUE;
+   for (i = 0; i < threads_num; i++)
+      vcos_semaphore_post(&mmal_executor.work);
+   for (i = 0; i < threads_num; i++)
+      vcos_thread_join(&mmal_executor.workers[i].thread, NULL);
+
+   /* Workers steal from each other so only delete the deques once they
+    * have all stopped */
+   for (i = 0; i < mmal_executor.workers_num; i++)
+      vcos_mutex_delete(&mmal_executor.workers[i].lock);
+   vcos_semaphore_delete(&mmal_executor.work);
+   mmal_executor.workers_num = 0;
+}
+
+static MMAL_STATUS_T mmal_executor_start(void)
+{
+   unsigned int i, threads = 0, num = mmal_executor_threads_num();
+   VCOS_THREAD_ATTR_T attrs;
+
+   if (vcos_semaphore_create(&mmal_executor.work, "mmal executor", 0) != VCOS_SUCCESS)
+      return MMAL_ENOMEM;
+
+   /* All the deques need to exist before any worker starts */
+   mmal_executor.quit = MMAL_FALSE;
+   for (i = 0; i < num; i++)
+   {
+      MMAL_EXECUTOR_WORKER_T *worker = &mmal_executor.workers[i];
+
+      worker->first = worker->last = NULL;
+      worker->index = i;
+      if (vcos_mutex_create(&worker->lock, "mmal executor worker") != VCOS_SUCCESS)
+         break;
+   }
+   mmal_executor.workers_num = i;
+   if (i < num)
+      goto error;
+
+   vcos_thread_attr_init(&attrs);
+   vcos_thread_attr_setpriority(&attrs, VCOS_THREAD_PRI_NORMAL);
+   for (threads = 0; threads < num; threads++)
+      if (vcos_thread_create(&mmal_executor.workers[threads].thread, "mmal executor", &attrs,
+                             mmal_executor_worker_func, &mmal_executor.workers[threads]) != VCOS_SUCCESS)
+         goto error;
+
+   LOG_TRACE("started %u worker threads", num);
+   return MMAL_SUCCESS;
+
+ error:
+   LOG_ERROR("failed to start worker threads");
+   mmal_executor_stop(threads);
+   return MMAL_ENOMEM;
+}
+
+static void mmal_executor_init_once(void)
+{
+   vcos_mutex_create(&mmal_executor.lock, "mmal executor");
+}
+
+/*****************************************************************************
+ * Tasks
+ *****************************************************************************/
+MMAL_STATUS_T mmal_executor_task_register(MMAL_EXECUTOR_TASK_T *task,
+   void (*pf_run)(void *context), void *context)
+{
+   static VCOS_ONCE_T once = VCOS_ONCE_INIT;
+   MMAL_STATUS_T status = MMAL_SUCCESS;
+
+   vcos_once(&once, mmal_executor_init_once);
+
+   memset(task, 0, sizeof(*task));
+   task->pf_run = pf_run;
+   task->context = context;
+   if (vcos_mutex_create(&task->lock, "mmal executor task") != VCOS_SUCCESS)
+      return MMAL_ENOMEM;
+   if (vcos_event_create(&task->idle, "mmal executor task") != VCOS_SUCCESS)
+   {
+      vcos_mutex_delete(&task->lock);
+      return MMAL_ENOMEM;
+   }
+
+   vcos_mutex_lock(&mmal_executor.lock);
+   if (!mmal_executor.refcount)
+      status = mmal_executor_start();
+   if (status == MMAL_SUCCESS)
+      mmal_executor.refcount++;
+   vcos_mutex_unlock(&mmal_executor.lock);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_event_delete(&task->idle);
+      vcos_mutex_delete(&task->lock);
+   }
+   return status;
+}
+
+void mmal_executor_task_deregister(MMAL_EXECUTOR_TASK_T *task)
+{
+   unsigned int i;
+
+   vcos_mutex_lock(&task->lock);
+   task->quit = MMAL_TRUE;
+
+   /* Take the task out of the deque it is waiting in. A worker might just
+    * have taken it out, in which case it will mark the task idle. */
+   if (task->state == MMAL_EXECUTOR_TASK_QUEUED)
+   {
+      for (i = 0; i < mmal_executor.workers_num; i++)
+      {
+         MMAL_EXECUTOR_WORKER_T *worker = &mmal_executor.workers[i];
+         vcos_mutex_lock(&worker->lock);
+         if (task->worker == worker)
+         {
+            mmal_executor_unlink(worker, task);
+            task->state = MMAL_EXECUTOR_TASK_IDLE;
+         }
+         vcos_mutex_unlock(&worker->lock);
+      }
+   }
+
+   while (task->state != MMAL_EXECUTOR_TASK_IDLE)
+   {
+      vcos_mutex_unlock(&task->lock);
+      vcos_event_wait(&task->idle);
+      vcos_mutex_lock(&task->lock);
+   }
+   vcos_mutex_unlock(&task->lock);
+
+   vcos_event_delete(&task->idle);
+   vcos_mutex_delete(&task->lock);
+
+   vcos_mutex_lock(&mmal_executor.lock);
+   if (!--mmal_executor.refcount)
+      mmal_executor_stop(mmal_executor.workers_num);
+   vcos_mutex_unlock(&mmal_executor.lock);
+}
+
+void mmal_executor_task_trigger(MMAL_EXECUTOR_TASK_T *task)
+{
+   vcos_mutex_lock(&task->lock);
+   if (task->quit)
+      ; /* Nothing to do */
+   else if (task->state == MMAL_EXECUTOR_TASK_IDLE)
+   {
+      task->state = MMAL_EXECUTOR_TASK_QUEUED;
+      mmal_executor_push(mmal_executor_worker_select(task), task, MMAL_FALSE);
+   }
+   else if (task->state == MMAL_EXECUTOR_TASK_RUNNING)
+      task->state = MMAL_EXECUTOR_TASK_RERUN;
+   vcos_mutex_unlock(&task->lock);
+}
@@ -0,0 +1,112 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MMAL_EXECUTOR_PRIVATE_H
+#define MMAL_EXECUTOR_PRIVATE_H
+
+#include "interface/mmal/mmal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \defgroup MmalExecutor Shared executor
+ * The executor runs tasks on a pool of worker threads shared by the whole
+ * process. Each worker has its own deque of pending tasks and steals from the
+ * other workers when it runs out of work.
+ * A task is never queued more than once and never runs on more than one worker
+ * at a time. Triggering a task while it is running makes it run once more.
+ *
+ * The number of workers defaults to the number of cores and can be overridden
+ * with the MMAL_EXECUTOR_THREADS environment variable. There are always at least
+ * 2 workers. Tasks must not block (sleep or wait for I/O) since that would stall
+ * the other tasks queued on the same worker. */
+/* @{ */
+
+/** State of an executor task */
+typedef enum {
+   MMAL_EXECUTOR_TASK_IDLE,
+   MMAL_EXECUTOR_TASK_QUEUED,
+   MMAL_EXECUTOR_TASK_RUNNING,
+   MMAL_EXECUTOR_TASK_RERUN,    /**< Triggered while running */
+} MMAL_EXECUTOR_TASK_STATE_T;
+
+struct MMAL_EXECUTOR_WORKER_T;
+
+/** Definition of a task. This is usually embedded in the structure of its owner
+ * and is private to the executor. */
+typedef struct MMAL_EXECUTOR_TASK_T
+{
+   void (*pf_run)(void *context); /**< Function run by the executor */
+   void *context;                 /**< Argument passed to pf_run */
+
+   VCOS_MUTEX_T lock;             /**< Protects the state of the task */
+   VCOS_EVENT_T idle;             /**< Signalled when a task being deregistered becomes idle */
+   MMAL_EXECUTOR_TASK_STATE_T state;
+   MMAL_BOOL_T quit;              /**< Task is being deregistered */
+
+   struct MMAL_EXECUTOR_WORKER_T *worker; /**< Worker whose deque the task is in */
+   struct MMAL_EXECUTOR_TASK_T *prev, *next;
+} MMAL_EXECUTOR_TASK_T;
+
+/** Register a task with the executor.
+ * The worker threads are started when the first task is registered.
+ *
+ * @param task     task to register
+ * @param pf_run   function to run every time the task is triggered
+ * @param context  argument passed to pf_run
+ *
+ * @return MMAL_SUCCESS on success
+ */
+MMAL_STATUS_T mmal_executor_task_register(MMAL_EXECUTOR_TASK_T *task,
+   void (*pf_run)(void *context), void *context);
+
+/** De-register a task from the executor.
+ * If the task is running, this waits for it to complete. The task will not run
+ * anymore once this returns. The worker threads are stopped when the last task
+ * is de-registered.
+ * This must not be called from the task itself.
+ *
+ * @param task     task to de-register
+ */
+void mmal_executor_task_deregister(MMAL_EXECUTOR_TASK_T *task);
+
+/** Trigger a task.
+ * The task is queued for execution on one of the workers. When called from a
+ * worker, the task is queued on that worker's own deque.
+ *
+ * @param task     task to trigger
+ */
+void mmal_executor_task_trigger(MMAL_EXECUTOR_TASK_T *task);
+
+/* @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MMAL_EXECUTOR_PRIVATE_H */
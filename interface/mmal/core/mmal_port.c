@@ -29,6 +29,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "util/mmal_util.h"
 #include "core/mmal_component_private.h"
 #include "core/mmal_port_private.h"
+#include "core/mmal_core_private.h"
+#include "core/mmal_buffer_private.h"
 #include "interface/vcos/vcos.h"
 #include "mmal_logging.h"
 #include "interface/mmal/util/mmal_util.h"
@@ -48,6 +50,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 # define MMAL_COLLECT_PORT_STATS_ENABLED 0
 #endif
 
+/** Port stats are updated with atomic operations instead of taking the stats lock
+ * when the platform has native 64 bits atomics */
+#if MMAL_ATOMICS_SUPPORTED && defined(__GCC_ATOMIC_LLONG_LOCK_FREE) && __GCC_ATOMIC_LLONG_LOCK_FREE == 2
+# define MMAL_PORT_STATS_LOCKLESS 1
+#else
+# define MMAL_PORT_STATS_LOCKLESS 0
+#endif
+
 static MMAL_STATUS_T mmal_port_private_parameter_get(MMAL_PORT_T *port,
                                                      MMAL_PARAMETER_HEADER_T *param);
 
@@ -57,6 +67,18 @@ static MMAL_STATUS_T mmal_port_private_parameter_set(MMAL_PORT_T *port,
 /* Define this if you want to log all buffer transfers */
 //#define ENABLE_MMAL_EXTRA_LOGGING
 
+/** Statistics collected by the core for one direction of a port */
+typedef struct MMAL_PORT_CORE_STATS_T
+{
+   uint32_t buffer_count;
+   uint32_t first_buffer_time;
+   uint32_t last_buffer_time;
+   uint32_t max_delay;
+   uint64_t bytes;
+   uint32_t interval[MMAL_CORE_HISTOGRAM_BUCKETS];
+   uint32_t residency[MMAL_CORE_HISTOGRAM_BUCKETS];
+} MMAL_PORT_CORE_STATS_T;
+
 /** Definition of the core's private structure for a port. */
 typedef struct MMAL_PORT_PRIVATE_CORE_T
 {
@@ -93,7 +115,8 @@ typedef struct MMAL_PORT_PRIVATE_CORE_T
    MMAL_BUFFER_HEADER_T** queue_last;
 
    /** Per-port statistics collected directly by the MMAL core */
-   MMAL_CORE_PORT_STATISTICS_T stats;
+   MMAL_PORT_CORE_STATS_T stats_rx;
+   MMAL_PORT_CORE_STATS_T stats_tx;
 
    char *name; /**< Port name */
    unsigned int name_size; /** Size of the memory area reserved for the name string */
@@ -116,7 +139,8 @@ static void mmal_port_connected_output_cb(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_
 static MMAL_BOOL_T mmal_port_connected_pool_cb(MMAL_POOL_T *pool, MMAL_BUFFER_HEADER_T *buffer, void *userdata);
 
 static void mmal_port_name_update(MMAL_PORT_T *port);
-static void mmal_port_update_port_stats(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR direction);
+static void mmal_port_update_port_stats(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR direction,
+   MMAL_BUFFER_HEADER_T *buffer, uint32_t length, uint32_t stc);
 
 /*****************************************************************************/
 
@@ -710,6 +734,7 @@ MMAL_STATUS_T mmal_port_send_buffer(MMAL_PORT_T *port,
    MMAL_BUFFER_HEADER_T *buffer)
 {
    MMAL_STATUS_T status = MMAL_SUCCESS;
+   uint32_t length, stc;
 
    if (!port || !port->priv)
    {
@@ -747,6 +772,13 @@ MMAL_STATUS_T mmal_port_send_buffer(MMAL_PORT_T *port,
       buffer->length = 0;
    }
 
+   /* The buffer header can be returned before pf_send returns so we need to
+    * timestamp it beforehand */
+   length = buffer->length;
+   stc = vcos_getmicrosecs();
+   buffer->priv->send_time = stc;
+   mmal_trace_buffer(port, buffer, MMAL_TRACE_BUFFER_SEND);
+
    /* coverity[lock] transit_sema is used for signalling, and is not a lock */
    /* coverity[lock_order] since transit_sema is not a lock, there is no ordering conflict */
    IN_TRANSIT_INCREMENT(port);
@@ -771,7 +803,7 @@ MMAL_STATUS_T mmal_port_send_buffer(MMAL_PORT_T *port,
    }
    else
    {
-      mmal_port_update_port_stats(port, MMAL_CORE_STATS_RX);
+      mmal_port_update_port_stats(port, MMAL_CORE_STATS_RX, NULL, length, stc);
    }
 
    UNLOCK_SENDING(port);
@@ -907,8 +939,10 @@ void mmal_port_buffer_header_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *b
 
    if (MMAL_COLLECT_PORT_STATS_ENABLED)
    {
-      mmal_port_update_port_stats(port, MMAL_CORE_STATS_TX);
+      mmal_port_update_port_stats(port, MMAL_CORE_STATS_TX, buffer, buffer->length,
+                                  vcos_getmicrosecs());
    }
+   mmal_trace_buffer(port, buffer, MMAL_TRACE_BUFFER_RETURN);
 
    port->priv->core->buffer_header_callback(port, buffer);
 
@@ -1387,54 +1421,145 @@ static void mmal_port_name_update(MMAL_PORT_T *port)
             port->format && port->format->encoding ? (char *)&port->format->encoding : "");
 }
 
+#if MMAL_PORT_STATS_LOCKLESS
+# define STATS_LOCK(core)
+# define STATS_UNLOCK(core)
+# define STATS_ADD(field, value) __atomic_fetch_add(&(field), (value), __ATOMIC_RELAXED)
+# define STATS_READ(field, reset) ((reset) ? \
+   __atomic_exchange_n(&(field), 0, __ATOMIC_RELAXED) : __atomic_load_n(&(field), __ATOMIC_RELAXED))
+#else
+# define STATS_LOCK(core) vcos_mutex_lock(&(core)->stats_lock)
+# define STATS_UNLOCK(core) vcos_mutex_unlock(&(core)->stats_lock)
+# define STATS_ADD(field, value) ((field) += (value))
+# define STATS_READ(field, reset) mmal_port_stats_read(&(field), sizeof(field), reset)
+
+/* Must be called with the stats lock held */
+static uint64_t mmal_port_stats_read(void *field, unsigned int size, MMAL_BOOL_T reset)
+{
+   uint64_t value = size == sizeof(uint64_t) ? *(uint64_t *)field : *(uint32_t *)field;
+   if (reset)
+      memset(field, 0, size);
+   return value;
+}
+#endif
+
+/** Histogram bucket for a time value. Bucket n counts values in [2^n, 2^(n+1)) us,
+ * with the first bucket also counting 0 and the last one everything above. */
+static unsigned int mmal_port_stats_bucket(uint32_t value)
+{
+   unsigned int bucket = 0;
+   while ((value >>= 1) && bucket < MMAL_CORE_HISTOGRAM_BUCKETS - 1)
+      bucket++;
+   return bucket;
+}
+
+/** Read (and optionally reset) the stats for one direction of a port.
+ * The histograms are only returned if detailed is not NULL. */
+static void mmal_port_stats_get(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR direction,
+   MMAL_BOOL_T reset, MMAL_CORE_STATISTICS_T *stats,
+   MMAL_PARAMETER_CORE_PORT_STATISTICS_T *detailed)
+{
+   MMAL_PORT_PRIVATE_CORE_T *core = port->priv->core;
+   MMAL_PORT_CORE_STATS_T *src =
+      direction == MMAL_CORE_STATS_RX ? &core->stats_rx : &core->stats_tx;
+   uint32_t interval, residency;
+   uint64_t bytes;
+   unsigned int i;
+
+   STATS_LOCK(core);
+   stats->buffer_count = STATS_READ(src->buffer_count, reset);
+   stats->first_buffer_time = STATS_READ(src->first_buffer_time, reset);
+   stats->last_buffer_time = STATS_READ(src->last_buffer_time, reset);
+   stats->max_delay = STATS_READ(src->max_delay, reset);
+   bytes = STATS_READ(src->bytes, reset);
+   if (detailed)
+      detailed->bytes = bytes;
+   for (i = 0; i < MMAL_CORE_HISTOGRAM_BUCKETS; i++)
+   {
+      interval = STATS_READ(src->interval[i], reset);
+      residency = STATS_READ(src->residency[i], reset);
+      if (!detailed)
+         continue;
+      detailed->interval[i] = interval;
+      detailed->residency[i] = residency;
+   }
+   STATS_UNLOCK(core);
+}
+
 static MMAL_STATUS_T mmal_port_get_core_stats(MMAL_PORT_T *port, MMAL_PARAMETER_HEADER_T *param)
 {
    MMAL_PARAMETER_CORE_STATISTICS_T *stats_param = (MMAL_PARAMETER_CORE_STATISTICS_T*)param;
-   MMAL_CORE_STATISTICS_T *stats = &stats_param->stats;
-   MMAL_CORE_STATISTICS_T *src_stats;
-   MMAL_PORT_PRIVATE_CORE_T *core = port->priv->core;
-   vcos_mutex_lock(&core->stats_lock);
-   switch (stats_param->dir)
-   {
-   case MMAL_CORE_STATS_RX:
-      src_stats = &port->priv->core->stats.rx;
-      break;
-   default:
-      src_stats = &port->priv->core->stats.tx;
-      break;
-   }
-   *stats = *src_stats;
-   if (stats_param->reset)
-      memset(src_stats, 0, sizeof(*src_stats));
-   vcos_mutex_unlock(&core->stats_lock);
+
+   mmal_port_stats_get(port, stats_param->dir, stats_param->reset, &stats_param->stats, NULL);
+   return MMAL_SUCCESS;
+}
+
+static MMAL_STATUS_T mmal_port_get_core_port_stats(MMAL_PORT_T *port, MMAL_PARAMETER_HEADER_T *param)
+{
+   MMAL_PARAMETER_CORE_PORT_STATISTICS_T *stats_param = (MMAL_PARAMETER_CORE_PORT_STATISTICS_T*)param;
+
+   if (param->size < sizeof(*stats_param))
+      return MMAL_EINVAL;
+
+   mmal_port_stats_get(port, stats_param->dir, stats_param->reset, &stats_param->stats, stats_param);
    return MMAL_SUCCESS;
 }
 
 /** Update the port stats, called per buffer.
- *
+ * The buffer header is only given when it is being returned by the port so
+ * we can account for the time it spent in there.
  */
-static void mmal_port_update_port_stats(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR direction)
+static void mmal_port_update_port_stats(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR direction,
+   MMAL_BUFFER_HEADER_T *buffer, uint32_t length, uint32_t stc)
 {
    MMAL_PORT_PRIVATE_CORE_T *core = port->priv->core;
-   MMAL_CORE_STATISTICS_T *stats;
-   unsigned stc = vcos_getmicrosecs();
-
-   vcos_mutex_lock(&core->stats_lock);
+   MMAL_PORT_CORE_STATS_T *stats =
+      direction == MMAL_CORE_STATS_RX ? &core->stats_rx : &core->stats_tx;
+   uint32_t last, delay;
 
-   stats = direction == MMAL_CORE_STATS_RX ? &core->stats.rx : &core->stats.tx;
+   STATS_LOCK(core);
 
-   stats->buffer_count++;
+   STATS_ADD(stats->buffer_count, 1);
+   STATS_ADD(stats->bytes, length);
 
+#if MMAL_PORT_STATS_LOCKLESS
+   last = __atomic_exchange_n(&stats->last_buffer_time, stc, __ATOMIC_RELAXED);
+   if (!last)
+   {
+      __atomic_compare_exchange_n(&stats->first_buffer_time, &last, stc, 0,
+                                  __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+   }
+   else
+   {
+      delay = stc - last;
+      STATS_ADD(stats->interval[mmal_port_stats_bucket(delay)], 1);
+      last = __atomic_load_n(&stats->max_delay, __ATOMIC_RELAXED);
+      while (delay > last &&
+             !__atomic_compare_exchange_n(&stats->max_delay, &last, delay, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+         ;
+   }
+#else
    if (!stats->first_buffer_time)
    {
       stats->last_buffer_time = stats->first_buffer_time = stc;
    }
    else
    {
-      stats->max_delay = vcos_max(stats->max_delay, stc-stats->last_buffer_time);
+      delay = stc - stats->last_buffer_time;
+      stats->interval[mmal_port_stats_bucket(delay)]++;
+      stats->max_delay = vcos_max(stats->max_delay, delay);
       stats->last_buffer_time = stc;
    }
-   vcos_mutex_unlock(&core->stats_lock);
+#endif
+
+   if (buffer && buffer->priv->send_time)
+   {
+      STATS_ADD(stats->residency[mmal_port_stats_bucket(stc - buffer->priv->send_time)], 1);
+      buffer->priv->send_time = 0;
+   }
+
+   STATS_UNLOCK(core);
 }
 
 static MMAL_STATUS_T mmal_port_private_parameter_get(MMAL_PORT_T *port,
@@ -1444,6 +1569,8 @@ static MMAL_STATUS_T mmal_port_private_parameter_get(MMAL_PORT_T *port,
    {
    case MMAL_PARAMETER_CORE_STATISTICS:
       return mmal_port_get_core_stats(port, param);
+   case MMAL_PARAMETER_CORE_PORT_STATISTICS:
+      return mmal_port_get_core_port_stats(port, param);
    default:
       return MMAL_ENOSYS;
    }
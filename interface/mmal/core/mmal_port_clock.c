@@ -264,6 +264,8 @@ static MMAL_STATUS_T mmal_port_clock_parameter_set(MMAL_PORT_T *port, const MMAL
          port->priv->clock->buffer_info_reporting = p->enable;
          return MMAL_SUCCESS;
       }
+      case MMAL_PARAMETER_CLOCK_REQUEST_STATS:
+         return mmal_clock_request_stats_reset(port->priv->clock->clock);
       default:
          LOG_ERROR("unsupported clock parameter 0x%x", param->id);
          return MMAL_ENOSYS;
@@ -331,6 +333,12 @@ static MMAL_STATUS_T mmal_port_clock_parameter_get(MMAL_PORT_T *port, MMAL_PARAM
          p->enable = priv_clock->buffer_info_reporting;
       }
       break;
+      case MMAL_PARAMETER_CLOCK_REQUEST_STATS:
+      {
+         MMAL_PARAMETER_CLOCK_REQUEST_STATS_T *p = (MMAL_PARAMETER_CLOCK_REQUEST_STATS_T *)param;
+         status = mmal_clock_request_stats_get(priv_clock->clock, &p->value);
+      }
+      break;
       default:
          LOG_ERROR("unsupported clock parameter 0x%x", param->id);
          return MMAL_ENOSYS;
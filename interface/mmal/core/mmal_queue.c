@@ -27,6 +27,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "mmal.h"
 #include "mmal_queue.h"
+#include "core/mmal_core_private.h"
+
+
+/** Number of times the consumer of a lock-free queue polls the queue before
+ * going to sleep */
+#define MMAL_QUEUE_SPIN_COUNT 100
 
 /** Definition of the QUEUE */
 struct MMAL_QUEUE_T
@@ -36,6 +42,14 @@ struct MMAL_QUEUE_T
    MMAL_BUFFER_HEADER_T *first;
    MMAL_BUFFER_HEADER_T **last;
    VCOS_SEMAPHORE_T semaphore;
+
+   /* Only used by lock-free queues */
+   MMAL_BOOL_T lockfree;
+   MMAL_BUFFER_HEADER_T *head;  /**< Last buffer put in the queue, updated by the producers */
+   MMAL_BUFFER_HEADER_T *tail;  /**< Oldest buffer in the queue, only used by the consumer */
+   MMAL_BUFFER_HEADER_T *front; /**< Buffers put back by the consumer */
+   unsigned int waiting;        /**< Set while the consumer is going to sleep */
+   MMAL_BUFFER_HEADER_T stub;   /**< Keeps the list from ever becoming empty */
 };
 
 // Only sanity check if asserts are enabled
@@ -80,18 +94,210 @@ MMAL_QUEUE_T *mmal_queue_create(void)
    queue->length = 0;
    queue->first = 0;
    queue->last = &queue->first;
+   queue->lockfree = MMAL_FALSE;
    mmal_queue_sanity_check(queue, NULL);
    /* gratuitous unlock for coverity */ vcos_mutex_unlock(&queue->lock);
 
    return queue;
 }
 
+#if MMAL_ATOMICS_SUPPORTED
+/*****************************************************************************
+ * Lock-free queue.
+ * This is an intrusive multiple producers, single consumer queue using the
+ * next field of the buffer headers to link them together. Producers only need
+ * an atomic exchange to append a buffer to the list. The consumer goes through
+ * the list from the other end and owns the tail so it doesn't need any atomic
+ * operation unless it has reached the last buffer in the list.
+ * The length of the queue is what tells the consumer that a buffer is
+ * available, it is only incremented once the buffer is fully linked in the list.
+ * The semaphore is only used when the consumer actually needs to sleep.
+ *****************************************************************************/
+
+/** Create a lock-free QUEUE of MMAL_BUFFER_HEADER_T */
+MMAL_QUEUE_T *mmal_queue_create_lockfree(void)
+{
+   MMAL_QUEUE_T *queue = mmal_queue_create();
+   if(!queue) return 0;
+
+   queue->lockfree = MMAL_TRUE;
+   queue->stub.next = 0;
+   queue->head = queue->tail = &queue->stub;
+   queue->front = 0;
+   queue->waiting = 0;
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   return queue;
+}
+
+/** Append a buffer to the list */
+static void mmal_queue_lockfree_link(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T *buffer)
+{
+   MMAL_BUFFER_HEADER_T *prev;
+
+   __atomic_store_n(&buffer->next, 0, __ATOMIC_RELAXED);
+   prev = __atomic_exchange_n(&queue->head, buffer, __ATOMIC_ACQ_REL);
+   __atomic_store_n(&prev->next, buffer, __ATOMIC_RELEASE);
+}
+
+/** Wake up the consumer if it went to sleep */
+static void mmal_queue_lockfree_signal(MMAL_QUEUE_T *queue)
+{
+   if(__atomic_load_n(&queue->waiting, __ATOMIC_SEQ_CST) &&
+      __atomic_exchange_n(&queue->waiting, 0, __ATOMIC_SEQ_CST))
+      vcos_semaphore_post(&queue->semaphore);
+}
+
+static void mmal_queue_lockfree_put(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T *buffer)
+{
+   mmal_queue_lockfree_link(queue, buffer);
+   __atomic_fetch_add(&queue->length, 1, __ATOMIC_SEQ_CST);
+   mmal_queue_lockfree_signal(queue);
+}
+
+/** Only the consumer puts buffers back so it can keep them in its own list */
+static void mmal_queue_lockfree_put_back(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T *buffer)
+{
+   buffer->next = queue->front;
+   queue->front = buffer;
+   __atomic_fetch_add(&queue->length, 1, __ATOMIC_SEQ_CST);
+}
+
+/** Claim one of the buffers in the queue. There is only one consumer so the
+ * length can't go down behind our back. */
+static MMAL_BOOL_T mmal_queue_lockfree_claim(MMAL_QUEUE_T *queue)
+{
+   if(!__atomic_load_n(&queue->length, __ATOMIC_SEQ_CST))
+      return MMAL_FALSE;
+   __atomic_fetch_sub(&queue->length, 1, __ATOMIC_ACQ_REL);
+   return MMAL_TRUE;
+}
+
+/** Let a producer which has been interrupted while linking a buffer finish */
+static void mmal_queue_lockfree_backoff(unsigned int *count)
+{
+   if(++*count > MMAL_QUEUE_SPIN_COUNT)
+      vcos_sleep(1);
+}
+
+/** Take the oldest buffer out of the list. Buffer already claimed. */
+static MMAL_BUFFER_HEADER_T *mmal_queue_lockfree_unlink(MMAL_QUEUE_T *queue)
+{
+   MMAL_BUFFER_HEADER_T *tail, *next;
+   unsigned int count = 0;
+
+   if(queue->front)
+   {
+      tail = queue->front;
+      queue->front = tail->next;
+      return tail;
+   }
+
+   for(;; mmal_queue_lockfree_backoff(&count))
+   {
+      tail = queue->tail;
+      next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+      /* Skip the stub */
+      if(tail == &queue->stub)
+      {
+         if(!next) continue;
+         queue->tail = tail = next;
+         next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+      }
+
+      if(next)
+      {
+         queue->tail = next;
+         return tail;
+      }
+
+      /* This is the last buffer in the list unless a producer is busy
+       * appending another one. */
+      if(tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE))
+         continue;
+
+      /* Put the stub back in the list so we can take the last buffer out */
+      mmal_queue_lockfree_link(queue, &queue->stub);
+      next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+      if(next)
+      {
+         queue->tail = next;
+         return tail;
+      }
+   }
+}
+
+static MMAL_BUFFER_HEADER_T *mmal_queue_lockfree_get(MMAL_QUEUE_T *queue)
+{
+   if(!mmal_queue_lockfree_claim(queue))
+      return NULL;
+   return mmal_queue_lockfree_unlink(queue);
+}
+
+static MMAL_BUFFER_HEADER_T *mmal_queue_lockfree_wait(MMAL_QUEUE_T *queue,
+   MMAL_BOOL_T timed, VCOS_UNSIGNED timeout)
+{
+   uint64_t deadline = vcos_getmicrosecs64() + (uint64_t)timeout * 1000;
+   VCOS_STATUS_T status;
+   unsigned int i;
+
+   while(1)
+   {
+      /* Poll for a bit before going to sleep */
+      for(i = 0; i < MMAL_QUEUE_SPIN_COUNT; i++)
+         if(mmal_queue_lockfree_claim(queue))
+            return mmal_queue_lockfree_unlink(queue);
+
+      /* Tell the producers we want to be woken up, then check again so we
+       * don't miss a buffer put in the queue in the meantime */
+      __atomic_store_n(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+      if(mmal_queue_lockfree_claim(queue))
+      {
+         __atomic_store_n(&queue->waiting, 0, __ATOMIC_SEQ_CST);
+         return mmal_queue_lockfree_unlink(queue);
+      }
+
+      if(!timed)
+         status = vcos_semaphore_wait(&queue->semaphore);
+      else
+      {
+         uint64_t now = vcos_getmicrosecs64();
+         status = now >= deadline ? VCOS_EAGAIN :
+            vcos_semaphore_wait_timeout(&queue->semaphore,
+               (VCOS_UNSIGNED)((deadline - now + 999) / 1000));
+      }
+
+      if(status != VCOS_SUCCESS)
+      {
+         __atomic_store_n(&queue->waiting, 0, __ATOMIC_SEQ_CST);
+         return mmal_queue_lockfree_get(queue);
+      }
+   }
+}
+#else
+MMAL_QUEUE_T *mmal_queue_create_lockfree(void)
+{
+   return mmal_queue_create();
+}
+
+#define mmal_queue_lockfree_put(q,b)
+#define mmal_queue_lockfree_put_back(q,b)
+#define mmal_queue_lockfree_get(q) NULL
+#define mmal_queue_lockfree_wait(q,t,o) NULL
+#endif
+
 /** Put a MMAL_BUFFER_HEADER_T into a QUEUE */
 void mmal_queue_put(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T *buffer)
 {
    vcos_assert(queue && buffer);
    if(!queue || !buffer) return;
 
+   if(queue->lockfree)
+   {
+      mmal_queue_lockfree_put(queue, buffer);
+      return;
+   }
+
    vcos_mutex_lock(&queue->lock);
    mmal_queue_sanity_check(queue, buffer);
    queue->length++;
@@ -116,6 +322,12 @@ void mmal_queue_put_back(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T *buffer)
 {
    if(!queue || !buffer) return;
 
+   if(queue->lockfree)
+   {
+      mmal_queue_lockfree_put_back(queue, buffer);
+      return;
+   }
+
    vcos_mutex_lock(&queue->lock);
    mmal_queue_sanity_check(queue, buffer);
    queue->length++;
@@ -152,6 +364,9 @@ MMAL_BUFFER_HEADER_T *mmal_queue_get(MMAL_QUEUE_T *queue)
    vcos_assert(queue);
    if(!queue) return 0;
 
+   if(queue->lockfree)
+      return mmal_queue_lockfree_get(queue);
+
    if(vcos_semaphore_trywait(&queue->semaphore) != VCOS_SUCCESS)
        return NULL;
 
@@ -163,6 +378,9 @@ MMAL_BUFFER_HEADER_T *mmal_queue_wait(MMAL_QUEUE_T *queue)
 {
 	if(!queue) return 0;
 
+   if(queue->lockfree)
+      return mmal_queue_lockfree_wait(queue, MMAL_FALSE, 0);
+
    if (vcos_semaphore_wait(&queue->semaphore) != VCOS_SUCCESS)
        return NULL;
 
@@ -174,6 +392,9 @@ MMAL_BUFFER_HEADER_T *mmal_queue_timedwait(MMAL_QUEUE_T *queue, VCOS_UNSIGNED ti
     if (!queue)
         return NULL;
 
+    if (queue->lockfree)
+        return mmal_queue_lockfree_wait(queue, MMAL_TRUE, timeout);
+
     if (vcos_semaphore_wait_timeout(&queue->semaphore, timeout) != VCOS_SUCCESS)
         return NULL;
 
@@ -185,6 +406,10 @@ unsigned int mmal_queue_length(MMAL_QUEUE_T *queue)
 {
 	if(!queue) return 0;
 
+#if MMAL_ATOMICS_SUPPORTED
+	if(queue->lockfree)
+		return __atomic_load_n(&queue->length, __ATOMIC_SEQ_CST);
+#endif
 	return queue->length;
 }
 
@@ -0,0 +1,259 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mmal.h"
+#include "core/mmal_core_private.h"
+#include "mmal_logging.h"
+
+/** Default size of the ring buffer of events */
+#define MMAL_TRACE_EVENTS_DEFAULT (64*1024)
+/** Maximum size of the ring buffer of events */
+#define MMAL_TRACE_EVENTS_MAX (16*1024*1024)
+/** Maximum length of the port names we record */
+#define MMAL_TRACE_NAME_MAX 40
+
+/** Definition of a recorded event */
+typedef struct MMAL_TRACE_EVENT_T
+{
+   int64_t time;
+   MMAL_BUFFER_HEADER_T *buffer;
+   uint32_t length;
+   uint32_t component_id;
+   MMAL_TRACE_EVENT_TYPE_T type;
+   char port_name[MMAL_TRACE_NAME_MAX];
+} MMAL_TRACE_EVENT_T;
+
+typedef enum {
+   MMAL_TRACE_STATE_STOPPED,
+   MMAL_TRACE_STATE_CHANGING,
+   MMAL_TRACE_STATE_RUNNING
+} MMAL_TRACE_STATE_T;
+
+/** Definition of the tracer */
+static struct
+{
+   int state;                     /**< One of MMAL_TRACE_STATE_T */
+   int enabled;                   /**< Set while events can be recorded */
+   int writers;                   /**< Number of threads currently recording an event */
+   uint32_t index;                /**< Index of the next event to record */
+   uint32_t mask;                 /**< Size of the ring buffer - 1 */
+   MMAL_TRACE_EVENT_T *events;
+   char *filename;                /**< File to write to, when started from the environment */
+} mmal_trace;
+
+#if MMAL_ATOMICS_SUPPORTED
+
+/*****************************************************************************/
+void mmal_trace_buffer(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer,
+   MMAL_TRACE_EVENT_TYPE_T type)
+{
+   MMAL_TRACE_EVENT_T *event;
+
+   if (!__atomic_load_n(&mmal_trace.enabled, __ATOMIC_RELAXED))
+      return;
+
+   /* Let mmal_trace_stop know we are using the ring buffer before checking
+    * again that it is still there */
+   __atomic_fetch_add(&mmal_trace.writers, 1, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&mmal_trace.enabled, __ATOMIC_SEQ_CST))
+   {
+      event = &mmal_trace.events[__atomic_fetch_add(&mmal_trace.index, 1, __ATOMIC_RELAXED) &
+                                 mmal_trace.mask];
+      event->time = vcos_getmicrosecs64();
+      event->buffer = buffer;
+      event->length = buffer->length;
+      event->component_id = port->component->id;
+      event->type = type;
+      strncpy(event->port_name, port->name, sizeof(event->port_name) - 1);
+      event->port_name[sizeof(event->port_name) - 1] = 0;
+   }
+   __atomic_fetch_sub(&mmal_trace.writers, 1, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************/
+MMAL_STATUS_T mmal_trace_start(unsigned int events)
+{
+   int state = MMAL_TRACE_STATE_STOPPED;
+   unsigned int size = 1;
+
+   if (!__atomic_compare_exchange_n(&mmal_trace.state, &state, MMAL_TRACE_STATE_CHANGING, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      return MMAL_EINVAL;
+
+   if (!events)
+      events = MMAL_TRACE_EVENTS_DEFAULT;
+   while (size < events && size < MMAL_TRACE_EVENTS_MAX)
+      size <<= 1;
+
+   mmal_trace.events = vcos_calloc(size, sizeof(*mmal_trace.events), "mmal trace");
+   if (!mmal_trace.events)
+   {
+      __atomic_store_n(&mmal_trace.state, MMAL_TRACE_STATE_STOPPED, __ATOMIC_RELEASE);
+      return MMAL_ENOMEM;
+   }
+   mmal_trace.mask = size - 1;
+   mmal_trace.index = 0;
+
+   __atomic_store_n(&mmal_trace.enabled, 1, __ATOMIC_SEQ_CST);
+   __atomic_store_n(&mmal_trace.state, MMAL_TRACE_STATE_RUNNING, __ATOMIC_RELEASE);
+   return MMAL_SUCCESS;
+}
+
+/** Write a string as a JSON string */
+static void mmal_trace_write_string(FILE *file, const char *string)
+{
+   fputc('"', file);
+   for (; *string; string++)
+   {
+      if (*string == '"' || *string == '\\')
+         fputc('\\', file);
+      if ((unsigned char)*string >= 0x20)
+         fputc(*string, file);
+   }
+   fputc('"', file);
+}
+
+/** Write the recorded events in the Chrome trace event format.
+ * Each buffer header transfer is an asynchronous event, starting when the
+ * buffer header is sent to the port and ending when the port returns it. */
+static MMAL_STATUS_T mmal_trace_write(const char *filename)
+{
+   uint32_t count = mmal_trace.index, i;
+   FILE *file = fopen(filename, "w");
+   MMAL_BOOL_T error;
+
+   if (!file)
+   {
+      LOG_ERROR("could not open %s", filename);
+      return MMAL_EIO;
+   }
+
+   i = count > mmal_trace.mask ? count - mmal_trace.mask - 1 : 0;
+
+   fprintf(file, "{\"traceEvents\":[\n");
+   for (; i != count; i++)
+   {
+      MMAL_TRACE_EVENT_T *event = &mmal_trace.events[i & mmal_trace.mask];
+
+      fprintf(file, "{\"name\":");
+      mmal_trace_write_string(file, event->port_name);
+      fprintf(file, ",\"cat\":\"buffer\",\"ph\":\"%c\",\"id\":\"%p\",\"ts\":%"PRIi64
+              ",\"pid\":0,\"tid\":%u,\"args\":{\"length\":%u}}%s\n",
+              event->type == MMAL_TRACE_BUFFER_SEND ? 'b' : 'e', (void *)event->buffer,
+              event->time, event->component_id, event->length, i + 1 != count ? "," : "");
+   }
+   fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+
+   error = ferror(file);
+   if (fclose(file) || error)
+   {
+      LOG_ERROR("could not write %s", filename);
+      return MMAL_EIO;
+   }
+   return MMAL_SUCCESS;
+}
+
+/*****************************************************************************/
+MMAL_STATUS_T mmal_trace_stop(const char *filename)
+{
+   MMAL_STATUS_T status = MMAL_SUCCESS;
+   int state = MMAL_TRACE_STATE_RUNNING;
+
+   if (!__atomic_compare_exchange_n(&mmal_trace.state, &state, MMAL_TRACE_STATE_CHANGING, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      return MMAL_EINVAL;
+
+   /* Wait for the threads currently recording an event to be done */
+   __atomic_store_n(&mmal_trace.enabled, 0, __ATOMIC_SEQ_CST);
+   while (__atomic_load_n(&mmal_trace.writers, __ATOMIC_ACQUIRE))
+      vcos_sleep(1);
+
+   if (filename)
+      status = mmal_trace_write(filename);
+
+   vcos_free(mmal_trace.events);
+   mmal_trace.events = NULL;
+   __atomic_store_n(&mmal_trace.state, MMAL_TRACE_STATE_STOPPED, __ATOMIC_RELEASE);
+   return status;
+}
+
+#else /* MMAL_ATOMICS_SUPPORTED */
+
+void mmal_trace_buffer(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer,
+   MMAL_TRACE_EVENT_TYPE_T type)
+{
+   MMAL_PARAM_UNUSED(port);
+   MMAL_PARAM_UNUSED(buffer);
+   MMAL_PARAM_UNUSED(type);
+}
+
+MMAL_STATUS_T mmal_trace_start(unsigned int events)
+{
+   MMAL_PARAM_UNUSED(events);
+   return MMAL_ENOSYS;
+}
+
+MMAL_STATUS_T mmal_trace_stop(const char *filename)
+{
+   MMAL_PARAM_UNUSED(filename);
+   return MMAL_ENOSYS;
+}
+
+#endif /* MMAL_ATOMICS_SUPPORTED */
+
+/*****************************************************************************/
+void mmal_trace_init(void)
+{
+   const char *filename = getenv("MMAL_TRACE");
+
+   if (!filename || !*filename || mmal_trace.filename)
+      return;
+
+   if (mmal_trace_start(0) != MMAL_SUCCESS)
+      return;
+
+   mmal_trace.filename = vcos_malloc(strlen(filename) + 1, "mmal trace file");
+   if (mmal_trace.filename)
+      strcpy(mmal_trace.filename, filename);
+   else
+      mmal_trace_stop(NULL);
+}
+
+/*****************************************************************************/
+void mmal_trace_deinit(void)
+{
+   if (!mmal_trace.filename)
+      return;
+
+   mmal_trace_stop(mmal_trace.filename);
+   vcos_free(mmal_trace.filename);
+   mmal_trace.filename = NULL;
+}
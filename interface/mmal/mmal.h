@@ -369,6 +369,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mmal_queue.h"
 #include "mmal_pool.h"
 #include "mmal_events.h"
+#include "mmal_trace.h"
 
 /**/
 /** \name API Version
@@ -147,6 +147,30 @@ typedef struct MMAL_CLOCK_LATENCY_T
                                    every attack_period (microseconds) */
 } MMAL_CLOCK_LATENCY_T;
 
+/** Number of buckets in the request latency histogram */
+#define MMAL_CLOCK_LATENCY_BUCKETS 20
+
+/** Statistics about the servicing of clock requests */
+typedef struct MMAL_CLOCK_REQUEST_STATS_T
+{
+   uint32_t requests;         /**< number of requests serviced when due (flushed requests
+                                   and requests fired because of a discontinuity are not
+                                   counted) */
+   uint32_t wakeups;          /**< number of times requests were serviced; requests which
+                                   fall due together are serviced in a single wakeup */
+   uint32_t pending_max;      /**< highest number of requests pending at the same time */
+   int64_t latency_min;       /**< smallest wall-time delay between the media-time of a
+                                   request and its callback (microseconds, negative when
+                                   serviced early) */
+   int64_t latency_max;       /**< largest delay between due time and callback (microseconds) */
+   int64_t latency_total;     /**< sum of the delays, used to compute the average (microseconds) */
+
+   /** Histogram of the delays. Bucket 0 counts requests serviced early or on
+    * time and bucket n (n > 0) counts delays in [2^(n-1), 2^n) microseconds.
+    * The last bucket also counts all the longer delays. */
+   uint32_t latency_histogram[MMAL_CLOCK_LATENCY_BUCKETS];
+} MMAL_CLOCK_REQUEST_STATS_T;
+
 /** Clock event used to pass data between clock ports and a client. */
 typedef struct MMAL_CLOCK_EVENT_T
 {
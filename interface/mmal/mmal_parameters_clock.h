@@ -51,6 +51,7 @@ enum
    MMAL_PARAMETER_CLOCK_ENABLE_BUFFER_INFO, /**< Takes a MMAL_PARAMETER_BOOLEAN_T */
    MMAL_PARAMETER_CLOCK_FRAME_RATE,         /**< Takes a MMAL_PARAMETER_RATIONAL_T */
    MMAL_PARAMETER_CLOCK_LATENCY,            /**< Takes a MMAL_PARAMETER_CLOCK_LATENCY_T */
+   MMAL_PARAMETER_CLOCK_REQUEST_STATS,      /**< Takes a MMAL_PARAMETER_CLOCK_REQUEST_STATS_T */
 };
 
 /** Media-time update thresholds */
@@ -85,4 +86,13 @@ typedef struct MMAL_PARAMETER_CLOCK_LATENCY_T
    MMAL_CLOCK_LATENCY_T value;
 } MMAL_PARAMETER_CLOCK_LATENCY_T;
 
+/** Clock request statistics parameter.
+ * Setting this parameter resets the statistics. */
+typedef struct MMAL_PARAMETER_CLOCK_REQUEST_STATS_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   MMAL_CLOCK_REQUEST_STATS_T value;
+} MMAL_PARAMETER_CLOCK_REQUEST_STATS_T;
+
 #endif /* MMAL_PARAMETERS_CLOCK_H */
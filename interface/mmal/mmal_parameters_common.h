@@ -74,7 +74,10 @@ enum {
    MMAL_PARAMETER_LOGGING,                /**< Takes a MMAL_PARAMETER_LOGGING_T */
    MMAL_PARAMETER_SYSTEM_TIME,            /**< Takes a MMAL_PARAMETER_UINT64_T */
    MMAL_PARAMETER_NO_IMAGE_PADDING,       /**< Takes a MMAL_PARAMETER_BOOLEAN_T */
-   MMAL_PARAMETER_LOCKSTEP_ENABLE         /**< Takes a MMAL_PARAMETER_BOOLEAN_T */
+   MMAL_PARAMETER_LOCKSTEP_ENABLE,        /**< Takes a MMAL_PARAMETER_BOOLEAN_T */
+   MMAL_PARAMETER_CORE_PORT_STATISTICS,   /**< Takes a MMAL_PARAMETER_CORE_PORT_STATISTICS_T */
+   MMAL_PARAMETER_OUTPUT_POLICY,          /**< Takes a MMAL_PARAMETER_OUTPUT_POLICY_T */
+   MMAL_PARAMETER_READ_AHEAD,             /**< Takes a MMAL_PARAMETER_READ_AHEAD_T */
 };
 
 /**@}*/
@@ -167,6 +170,31 @@ typedef struct MMAL_PARAMETER_CORE_STATISTICS_T
    MMAL_CORE_STATISTICS_T stats;    /**< The statistics */
 } MMAL_PARAMETER_CORE_STATISTICS_T;
 
+/** Number of buckets in the histograms of \ref MMAL_PARAMETER_CORE_PORT_STATISTICS_T.
+ * Bucket 0 counts values below 2us, bucket i counts values in [2^i, 2^(i+1)) us
+ * and the last bucket also counts all the values above its range. */
+#define MMAL_CORE_HISTOGRAM_BUCKETS 24
+
+/** Detailed MMAL core statistics for a port. These are collected by the core itself,
+ * without taking any lock when the platform supports atomic operations.
+ * Counters are read (and reset) individually so they might be slightly out of step
+ * with each other if buffers are flowing through the port.
+ */
+typedef struct MMAL_PARAMETER_CORE_PORT_STATISTICS_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_CORE_STATS_DIR dir;
+   MMAL_BOOL_T reset;               /**< Reset to zero after reading */
+   MMAL_CORE_STATISTICS_T stats;    /**< Same as \ref MMAL_PARAMETER_CORE_STATISTICS */
+   uint64_t bytes;                  /**< Total length of the buffers */
+
+   /** Histogram of the time (us) between consecutive buffers */
+   uint32_t interval[MMAL_CORE_HISTOGRAM_BUCKETS];
+   /** Histogram of the time (us) between a buffer being sent to the port and the port
+    * returning it. Only collected in the MMAL_CORE_STATS_TX direction. */
+   uint32_t residency[MMAL_CORE_HISTOGRAM_BUCKETS];
+} MMAL_PARAMETER_CORE_PORT_STATISTICS_T;
+
 /**
  * Component memory usage statistics.
  */
@@ -187,5 +215,46 @@ typedef struct MMAL_PARAMETER_LOGGING_T
    uint32_t clear;   /**< Logging bits to clear */
 } MMAL_PARAMETER_LOGGING_T;
 
+/** Policies applied by components feeding the same data to several output ports
+ * (e.g. the splitter) when an output port has no buffer available.
+ */
+typedef enum
+{
+   MMAL_OUTPUT_POLICY_LOCKSTEP,     /**< Wait for the output port, stalling all the other ports */
+   MMAL_OUTPUT_POLICY_DROP_OLDEST,  /**< Queue the data, dropping the oldest queued data when full */
+   MMAL_OUTPUT_POLICY_DROP_NEWEST,  /**< Queue the data, dropping the new data when full */
+   MMAL_OUTPUT_POLICY_BOUNDED_LAG,  /**< Queue the data, waiting for the output port when full */
+   MMAL_OUTPUT_POLICY_MAX = 0x7fffffff /* Force 32 bit size for this enum */
+} MMAL_OUTPUT_POLICY_T;
+
+/** Output port policy.
+ * Lets an output port fall behind the other output ports of the same component
+ * by up to \a depth buffers, so a slow consumer doesn't stall the fast ones.
+ * Queued buffers keep a reference to the input buffers so the input port needs
+ * enough buffers to cover them on top of the ones held by the consumers.
+ */
+typedef struct MMAL_PARAMETER_OUTPUT_POLICY_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_OUTPUT_POLICY_T policy;     /**< Policy applied when the port has no buffer available */
+   uint32_t depth;                  /**< Maximum number of buffers queued for the port */
+   uint32_t dropped;                /**< Number of buffers dropped for this port (Read Only) */
+} MMAL_PARAMETER_OUTPUT_POLICY_T;
+
+/** Read-ahead budget of a component reading from a source (e.g. container_reader).
+ * Data is read ahead by a background thread until either the byte budget is
+ * reached or every enabled track has the given duration of data buffered.
+ * Read-ahead is enabled or disabled before the source is opened. */
+typedef struct MMAL_PARAMETER_READ_AHEAD_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   uint32_t bytes;                  /**< Maximum amount of data read ahead, 0 to disable read-ahead */
+   uint32_t bytes_buffered;         /**< Amount of data currently read ahead (Read Only) */
+   int64_t duration;                /**< Duration of data to read ahead on each track in
+                                         microseconds, 0 to only use the byte budget */
+   int64_t duration_buffered;       /**< Shortest duration of data currently read ahead
+                                         on an enabled track in microseconds (Read Only) */
+} MMAL_PARAMETER_READ_AHEAD_T;
+
 #endif /* MMAL_PARAMETERS_COMMON_H */
 
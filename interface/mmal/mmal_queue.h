@@ -48,6 +48,19 @@ typedef struct MMAL_QUEUE_T MMAL_QUEUE_T;
  */
 MMAL_QUEUE_T *mmal_queue_create(void);
 
+/** Create a lock-free queue of MMAL_BUFFER_HEADER_T.
+ * The queue supports any number of threads putting buffers in it but only a
+ * single thread getting buffers out of it (including \ref mmal_queue_put_back).
+ * This makes it suitable for the common case of a component's input queue or a
+ * client's output queue being serviced by a single thread, where it avoids taking
+ * a lock for every buffer. The consumer only sleeps in \ref mmal_queue_wait and
+ * \ref mmal_queue_timedwait, after polling the queue for a short while.
+ * Falls back to a normal queue if the toolchain doesn't provide atomic operations.
+ *
+ * @return pointer to the newly created queue or NULL on failure.
+ */
+MMAL_QUEUE_T *mmal_queue_create_lockfree(void);
+
 /** Put a MMAL_BUFFER_HEADER_T into a queue
  *
  * @param queue  Pointer to a queue
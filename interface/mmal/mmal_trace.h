@@ -0,0 +1,72 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MMAL_TRACE_H
+#define MMAL_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \defgroup MmalTrace Tracing of buffer header transfers
+ * The MMAL core can record every buffer header sent to and returned by a port
+ * into an in-memory ring buffer. The recorded events can then be written out in
+ * the Chrome trace event format, which can be loaded into chrome://tracing or
+ * the Perfetto UI to visualise how long each buffer header spent in each port.
+ *
+ * Tracing can also be enabled without modifying the application by setting the
+ * MMAL_TRACE environment variable to the name of the file to write the trace to.
+ * The trace then covers the lifetime of the MMAL core (i.e. from the creation of
+ * the first component to the destruction of the last one). */
+/* @{ */
+
+/** Start recording buffer header transfers.
+ * Recording is lock-free. Once the ring buffer is full, the oldest events are
+ * overwritten.
+ *
+ * @param events Number of events the ring buffer can hold (rounded up to a power of 2).
+ *               0 selects a default size.
+ * @return MMAL_SUCCESS on success, MMAL_EINVAL if tracing was already started,
+ *         MMAL_ENOSYS if tracing isn't supported on this platform.
+ */
+MMAL_STATUS_T mmal_trace_start(unsigned int events);
+
+/** Stop recording buffer header transfers and write the recorded events to a file.
+ *
+ * @param filename Name of the file to write the trace to. NULL discards the trace.
+ * @return MMAL_SUCCESS on success, MMAL_EINVAL if tracing wasn't started,
+ *         MMAL_EIO if the file couldn't be written.
+ */
+MMAL_STATUS_T mmal_trace_stop(const char *filename);
+
+/* @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MMAL_TRACE_H */
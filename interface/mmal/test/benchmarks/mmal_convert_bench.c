@@ -0,0 +1,201 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Measures the throughput of the pixel format conversion and scaling kernels
+ * used by the convert component. Each conversion is run with the plain C
+ * kernels and with the SIMD kernels (when available for the target) and the
+ * results of both are compared. Conversions without SIMD kernels, such as
+ * scaling, are only run with the C kernels. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mmal.h"
+#include "interface/mmal/components/convert_kernels.h"
+#include "interface/vcos/vcos.h"
+
+#define DEFAULT_ITERATIONS 50
+
+typedef struct TEST_T
+{
+   const char *name;
+   uint32_t src_encoding;
+   unsigned int src_width, src_height;
+   uint32_t dst_encoding;
+   unsigned int dst_width, dst_height;
+   MMAL_CONVERT_SCALE_T scale;
+   MMAL_BOOL_T simd;    /**< Part of the conversion has SIMD kernels */
+   MMAL_BOOL_T exact;   /**< SIMD and C kernels must give the same results */
+} TEST_T;
+
+static const TEST_T tests[] =
+{
+   {"I420->RGBA 1080p", MMAL_ENCODING_I420, 1920, 1080, MMAL_ENCODING_RGBA, 1920, 1080, MMAL_CONVERT_SCALE_NONE, 1, 1},
+   {"NV12->I420 1080p", MMAL_ENCODING_NV12, 1920, 1080, MMAL_ENCODING_I420, 1920, 1080, MMAL_CONVERT_SCALE_NONE, 1, 1},
+   {"I420->NV12 1080p", MMAL_ENCODING_I420, 1920, 1080, MMAL_ENCODING_NV12, 1920, 1080, MMAL_CONVERT_SCALE_NONE, 1, 1},
+   {"RGBA->I420 1080p", MMAL_ENCODING_RGBA, 1920, 1080, MMAL_ENCODING_I420, 1920, 1080, MMAL_CONVERT_SCALE_NONE, 0, 1},
+   {"I420 1080p->720p bilinear", MMAL_ENCODING_I420, 1920, 1080, MMAL_ENCODING_I420, 1280, 720, MMAL_CONVERT_SCALE_BILINEAR, 0, 1},
+   {"I420 1080p->480x270 area", MMAL_ENCODING_I420, 1920, 1080, MMAL_ENCODING_I420, 480, 270, MMAL_CONVERT_SCALE_AREA, 0, 1},
+   {"NV12 1080p->720p RGBA", MMAL_ENCODING_NV12, 1920, 1080, MMAL_ENCODING_RGBA, 1280, 720, MMAL_CONVERT_SCALE_BILINEAR, 1, 1},
+};
+
+static uint8_t *frame_alloc(MMAL_CONVERT_FRAME_T *frame, MMAL_ES_FORMAT_T *format,
+   uint32_t encoding, unsigned int width, unsigned int height)
+{
+   uint32_t size;
+   uint8_t *data;
+
+   format->type = MMAL_ES_TYPE_VIDEO;
+   format->encoding = encoding;
+   format->es->video.width = VCOS_ALIGN_UP(width, 32);
+   format->es->video.height = VCOS_ALIGN_UP(height, 16);
+   format->es->video.crop.x = format->es->video.crop.y = 0;
+   format->es->video.crop.width = width;
+   format->es->video.crop.height = height;
+
+   if (mmal_convert_frame_init(frame, format, NULL, &size) != MMAL_SUCCESS)
+      return NULL;
+   data = malloc(size);
+   if (data)
+      mmal_convert_frame_init(frame, format, data, &size);
+   return data;
+}
+
+static unsigned int frame_size(MMAL_ES_FORMAT_T *format)
+{
+   MMAL_CONVERT_FRAME_T frame;
+   uint32_t size = 0;
+   mmal_convert_frame_init(&frame, format, NULL, &size);
+   return size;
+}
+
+/* Time a conversion, returns the time per frame in microseconds */
+static double run_convert(MMAL_CONVERT_CONTEXT_T *ctx, const MMAL_CONVERT_FRAME_T *src,
+   const MMAL_CONVERT_FRAME_T *dst, unsigned int iterations)
+{
+   unsigned int i, slice, slices = mmal_convert_context_slices(ctx);
+   uint32_t start = vcos_getmicrosecs();
+
+   for (i = 0; i < iterations; i++)
+      for (slice = 0; slice < slices; slice++)
+         mmal_convert_slice(ctx, src, dst, slice);
+
+   return (double)(vcos_getmicrosecs() - start) / iterations;
+}
+
+static int run_test(const TEST_T *test, unsigned int iterations)
+{
+   MMAL_ES_FORMAT_T *src_format = mmal_format_alloc();
+   MMAL_ES_FORMAT_T *dst_format = mmal_format_alloc();
+   MMAL_CONVERT_FRAME_T src, dst_c, dst_simd;
+   MMAL_CONVERT_CONTEXT_T *ctx_c = NULL, *ctx_simd = NULL;
+   uint8_t *src_data = NULL, *dst_data_c = NULL, *dst_data_simd = NULL;
+   unsigned int i, size, pixels = test->dst_width * test->dst_height;
+   double time_c, time_simd;
+   int status = -1;
+
+   if (!src_format || !dst_format)
+      goto end;
+
+   src_data = frame_alloc(&src, src_format, test->src_encoding, test->src_width, test->src_height);
+   dst_data_c = frame_alloc(&dst_c, dst_format, test->dst_encoding, test->dst_width, test->dst_height);
+   dst_data_simd = frame_alloc(&dst_simd, dst_format, test->dst_encoding, test->dst_width, test->dst_height);
+   if (!src_data || !dst_data_c || !dst_data_simd)
+      goto end;
+
+   /* Pseudo-random content so the saturation paths get exercised */
+   for (i = 0; i < frame_size(src_format); i++)
+      src_data[i] = (uint8_t)((i * 2654435761u) >> 13);
+   size = frame_size(dst_format);
+   memset(dst_data_c, 0, size);
+   memset(dst_data_simd, 0, size);
+
+   ctx_c = mmal_convert_context_create(&src, &dst_c, test->scale, 1, 0);
+   if (test->simd)
+      ctx_simd = mmal_convert_context_create(&src, &dst_simd, test->scale, 1, 1);
+   if (!ctx_c || (test->simd && !ctx_simd))
+      goto end;
+
+   time_c = run_convert(ctx_c, &src, &dst_c, iterations);
+   if (!test->simd)
+   {
+      printf("%-26s C %8.0f us %7.1f Mpix/s, C only\n",
+         test->name, time_c, time_c ? pixels / time_c : 0.0);
+      status = 0;
+      goto end;
+   }
+
+   time_simd = run_convert(ctx_simd, &src, &dst_simd, iterations);
+
+   status = 0;
+   if (test->exact && memcmp(dst_data_c, dst_data_simd, size))
+      status = -1;
+
+   printf("%-26s C %8.0f us %7.1f Mpix/s, SIMD %8.0f us %7.1f Mpix/s, x%.2f%s\n",
+      test->name, time_c, time_c ? pixels / time_c : 0.0,
+      time_simd, time_simd ? pixels / time_simd : 0.0,
+      time_simd ? time_c / time_simd : 0.0, status ? " - MISMATCH" : "");
+
+ end:
+   if (!ctx_c || (test->simd && !ctx_simd))
+      printf("%-26s FAILED\n", test->name);
+   mmal_convert_context_destroy(ctx_c);
+   mmal_convert_context_destroy(ctx_simd);
+   free(src_data);
+   free(dst_data_c);
+   free(dst_data_simd);
+   if (src_format)
+      mmal_format_free(src_format);
+   if (dst_format)
+      mmal_format_free(dst_format);
+   return status;
+}
+
+int main(int argc, char **argv)
+{
+   unsigned int iterations = DEFAULT_ITERATIONS, i;
+   int status = 0;
+
+   if (argc > 1)
+      iterations = strtoul(argv[1], NULL, 0);
+   if (!iterations)
+   {
+      fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+      return 1;
+   }
+
+   vcos_init();
+
+   if (!mmal_convert_simd_available())
+      printf("no SIMD kernels for this target, comparing C against C\n");
+
+   for (i = 0; i < sizeof(tests)/sizeof(tests[0]); i++)
+      status |= run_test(&tests[i], iterations);
+
+   return status ? 1 : 0;
+}
@@ -0,0 +1,588 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Measures the overhead of the MMAL framework on host-only pipelines.
+ * An artificial_camera feeds a null_sink through a copy and a splitter
+ * component. The pipeline is assembled in different ways:
+ *  - connection: connections serviced by the benchmark thread
+ *  - tunnel:     tunnelled connections
+ *  - graph:      connections serviced by a MMAL graph
+ *  - aggregator: copy and splitter wrapped in an aggregator component
+ * The connection to the null_sink is always serviced by the benchmark thread
+ * so the end-to-end latency can be measured from the capture time the camera
+ * puts in the pts of its frames. The latency is also measured at every other
+ * connection serviced by the benchmark thread.
+ *
+ * Each combination of topology, frame size, pool depth and frame rate is run
+ * for a fixed time after a short warm-up, and reported as one line of JSON on
+ * stdout. A frame rate of 0 runs the camera as fast as it can. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mmal.h"
+#include "util/mmal_connection.h"
+#include "util/mmal_graph.h"
+#include "util/mmal_util.h"
+#include "interface/vcos/vcos.h"
+
+#define MAX_COMPONENTS 4
+#define MAX_CONNECTIONS 3
+#define MAX_VALUES 16
+
+#define DEFAULT_DURATION 500  /* ms */
+#define WARMUP_FRACTION 10    /* Warm up for a tenth of the duration */
+
+/* Frame rate the camera is set to when running as fast as it can */
+#define UNTHROTTLED_FRAME_RATE 1000000
+
+/* Log-linear latency histogram: values below 2*SUB are exact, larger values
+ * are rounded down to 1/SUB of their power of 2 */
+#define LATENCY_SUB_BUCKETS 32
+#define LATENCY_BUCKETS (LATENCY_SUB_BUCKETS * 34)
+
+typedef enum
+{
+   TOPOLOGY_CONNECTION,
+   TOPOLOGY_TUNNEL,
+   TOPOLOGY_GRAPH,
+   TOPOLOGY_AGGREGATOR,
+   TOPOLOGY_MAX
+} TOPOLOGY_T;
+
+static const char *topology_names[TOPOLOGY_MAX] =
+   {"connection", "tunnel", "graph", "aggregator"};
+
+typedef struct HOP_T
+{
+   uint32_t count;
+   uint32_t max;
+   uint32_t histogram[LATENCY_BUCKETS];
+} HOP_T;
+
+typedef struct RUN_T
+{
+   TOPOLOGY_T topology;
+   unsigned int width, height;
+   unsigned int depth;        /**< Number of buffers in each pool */
+   unsigned int rate;         /**< Frame rate of the camera, 0 for as fast as possible */
+   uint32_t duration;         /**< Measurement time (ms) */
+} RUN_T;
+
+typedef struct BENCH_T
+{
+   VCOS_SEMAPHORE_T semaphore;
+   MMAL_STATUS_T status;
+
+   MMAL_GRAPH_T *graph;
+   MMAL_COMPONENT_T *component[MAX_COMPONENTS];
+   unsigned int component_num;
+
+   /* Connections we created ourselves, the one to the sink being the last */
+   MMAL_CONNECTION_T *connection[MAX_CONNECTIONS];
+   unsigned int connection_num;
+
+   uint32_t frame_size;       /**< Size of the frames produced by the camera */
+   MMAL_BOOL_T measuring;
+   HOP_T hop[MAX_CONNECTIONS];
+} BENCH_T;
+
+/*****************************************************************************/
+static unsigned int latency_bucket(uint32_t value)
+{
+   unsigned int shift = 0;
+
+   while ((value >> shift) >= 2 * LATENCY_SUB_BUCKETS)
+      shift++;
+   return shift * LATENCY_SUB_BUCKETS + (value >> shift);
+}
+
+static uint32_t latency_value(unsigned int bucket)
+{
+   unsigned int shift;
+
+   if (bucket < 2 * LATENCY_SUB_BUCKETS)
+      return bucket;
+   shift = bucket / LATENCY_SUB_BUCKETS - 1;
+   return (bucket - shift * LATENCY_SUB_BUCKETS) << shift;
+}
+
+static void hop_record(HOP_T *hop, int64_t latency)
+{
+   uint32_t value = latency < 0 ? 0 : latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+
+   hop->histogram[latency_bucket(value)]++;
+   hop->max = MMAL_MAX(hop->max, value);
+   hop->count++;
+}
+
+static uint32_t hop_percentile(const HOP_T *hop, unsigned int percentile)
+{
+   uint64_t target = ((uint64_t)hop->count * percentile + 99) / 100, total = 0;
+   unsigned int i;
+
+   for (i = 0; i < LATENCY_BUCKETS; i++)
+   {
+      total += hop->histogram[i];
+      if (total && total >= target)
+         return latency_value(i);
+   }
+   return hop->max;
+}
+
+/*****************************************************************************/
+static void control_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
+{
+   BENCH_T *bench = (BENCH_T *)port->userdata;
+
+   if (buffer->cmd == MMAL_EVENT_ERROR)
+      bench->status = *(MMAL_STATUS_T *)buffer->data;
+   mmal_buffer_header_release(buffer);
+   vcos_semaphore_post(&bench->semaphore);
+}
+
+static void graph_callback(MMAL_GRAPH_T *graph, MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer,
+   void *cb_data)
+{
+   BENCH_T *bench = (BENCH_T *)cb_data;
+   MMAL_PARAM_UNUSED(graph);
+   MMAL_PARAM_UNUSED(port);
+
+   if (buffer->cmd == MMAL_EVENT_ERROR)
+      bench->status = *(MMAL_STATUS_T *)buffer->data;
+   mmal_buffer_header_release(buffer);
+   vcos_semaphore_post(&bench->semaphore);
+}
+
+static void connection_callback(MMAL_CONNECTION_T *connection)
+{
+   BENCH_T *bench = (BENCH_T *)connection->user_data;
+   vcos_semaphore_post(&bench->semaphore);
+}
+
+/*****************************************************************************/
+static MMAL_STATUS_T bench_component(BENCH_T *bench, const char *name, MMAL_COMPONENT_T **component)
+{
+   MMAL_STATUS_T status;
+
+   status = mmal_component_create(name, component);
+   if (status != MMAL_SUCCESS)
+      return status;
+   bench->component[bench->component_num++] = *component;
+
+   if (bench->graph)
+      return mmal_graph_add_component(bench->graph, *component);
+
+   (*component)->control->userdata = (void *)bench;
+   status = mmal_port_enable((*component)->control, control_callback);
+   if (status != MMAL_SUCCESS)
+      return status;
+   return mmal_component_enable(*component);
+}
+
+/** Connect 2 ports, using the given pool depth. Connections are added to the
+ * graph, if any, unless they are to be serviced by the benchmark thread. */
+static MMAL_STATUS_T bench_connect(BENCH_T *bench, MMAL_PORT_T *out, MMAL_PORT_T *in,
+   const RUN_T *run, uint32_t flags, MMAL_BOOL_T serviced)
+{
+   MMAL_CONNECTION_T *connection;
+   MMAL_STATUS_T status;
+   uint32_t buffer_size;
+
+   /* Outputs follow the format of the input of their component */
+   if (out->component->input_num &&
+       mmal_format_compare(out->format, out->component->input[0]->format))
+   {
+      status = mmal_format_full_copy(out->format, out->component->input[0]->format);
+      if (status == MMAL_SUCCESS)
+         status = mmal_port_format_commit(out);
+      if (status != MMAL_SUCCESS)
+         return status;
+   }
+
+   status = mmal_format_full_copy(in->format, out->format);
+   if (status == MMAL_SUCCESS)
+      status = mmal_port_format_commit(in);
+   if (status != MMAL_SUCCESS)
+      return status;
+
+   /* All the ports carry full frames */
+   buffer_size = MMAL_MAX(bench->frame_size, MMAL_MAX(out->buffer_size_min, in->buffer_size_min));
+   out->buffer_size = in->buffer_size = buffer_size;
+   out->buffer_num = in->buffer_num =
+      MMAL_MAX(run->depth, MMAL_MAX(out->buffer_num_min, in->buffer_num_min));
+
+   flags |= MMAL_CONNECTION_FLAG_KEEP_BUFFER_REQUIREMENTS;
+   if (bench->graph && !serviced)
+      return mmal_graph_new_connection(bench->graph, out, in, flags, NULL);
+
+   status = mmal_connection_create(&connection, out, in, flags);
+   if (status != MMAL_SUCCESS)
+      return status;
+   connection->user_data = bench;
+   connection->callback = connection_callback;
+   bench->connection[bench->connection_num++] = connection;
+   return MMAL_SUCCESS;
+}
+
+static MMAL_STATUS_T bench_build(BENCH_T *bench, const RUN_T *run)
+{
+   MMAL_COMPONENT_T *camera, *copy = NULL, *splitter = NULL, *aggregator = NULL, *sink;
+   MMAL_PORT_T *port;
+   uint32_t flags = run->topology == TOPOLOGY_TUNNEL ? MMAL_CONNECTION_FLAG_TUNNELLING : 0;
+   MMAL_STATUS_T status;
+
+   if (run->topology == TOPOLOGY_GRAPH)
+   {
+      status = mmal_graph_create(&bench->graph, 0);
+      if (status != MMAL_SUCCESS)
+         return status;
+   }
+
+   status = bench_component(bench, "artificial_camera", &camera);
+   if (status != MMAL_SUCCESS)
+      return status;
+   if (run->topology == TOPOLOGY_AGGREGATOR)
+      status = bench_component(bench, "aggregator.pipeline:copy:splitter", &aggregator);
+   else if ((status = bench_component(bench, "copy", &copy)) == MMAL_SUCCESS)
+      status = bench_component(bench, "splitter", &splitter);
+   if (status != MMAL_SUCCESS)
+      return status;
+
+   /* The sink stays out of the graph so we can service its connection */
+   {
+      MMAL_GRAPH_T *graph = bench->graph;
+      bench->graph = NULL;
+      status = bench_component(bench, "null_sink", &sink);
+      bench->graph = graph;
+      if (status != MMAL_SUCCESS)
+         return status;
+   }
+
+   port = camera->output[0];
+   port->format->encoding = MMAL_ENCODING_I420;
+   port->format->es->video.width = run->width;
+   port->format->es->video.height = run->height;
+   port->format->es->video.crop.width = run->width;
+   port->format->es->video.crop.height = run->height;
+   port->format->es->video.frame_rate.num = run->rate ? run->rate : UNTHROTTLED_FRAME_RATE;
+   port->format->es->video.frame_rate.den = 1;
+   status = mmal_port_format_commit(port);
+   if (status != MMAL_SUCCESS)
+      return status;
+   bench->frame_size = port->buffer_size_min;
+
+   if (aggregator)
+   {
+      status = bench_connect(bench, port, aggregator->input[0], run, flags, MMAL_FALSE);
+      if (status == MMAL_SUCCESS)
+         status = bench_connect(bench, aggregator->output[0], sink->input[0], run, 0, MMAL_TRUE);
+      return status;
+   }
+
+   status = bench_connect(bench, port, copy->input[0], run, flags, MMAL_FALSE);
+   if (status == MMAL_SUCCESS)
+      status = bench_connect(bench, copy->output[0], splitter->input[0], run, flags, MMAL_FALSE);
+   if (status == MMAL_SUCCESS)
+      status = bench_connect(bench, splitter->output[0], sink->input[0], run, 0, MMAL_TRUE);
+   return status;
+}
+
+static MMAL_STATUS_T bench_enable(BENCH_T *bench)
+{
+   MMAL_STATUS_T status;
+   unsigned int i;
+
+   /* Enable from the sink back to the source */
+   for (i = bench->connection_num; i; i--)
+   {
+      status = mmal_connection_enable(bench->connection[i-1]);
+      if (status != MMAL_SUCCESS)
+         return status;
+   }
+
+   if (bench->graph)
+      return mmal_graph_enable(bench->graph, graph_callback, bench);
+   return MMAL_SUCCESS;
+}
+
+static void bench_destroy(BENCH_T *bench)
+{
+   unsigned int i;
+
+   /* Disable from the sink back to the source. Upstream pools only fill up
+    * again once the buffers replicated by the splitter have been released. */
+   for (i = bench->connection_num; i; i--)
+      mmal_connection_disable(bench->connection[i-1]);
+   if (bench->graph)
+      mmal_graph_disable(bench->graph);
+   for (i = 0; i < bench->connection_num; i++)
+      mmal_connection_destroy(bench->connection[i]);
+   if (bench->graph)
+      mmal_graph_destroy(bench->graph);
+   for (i = 0; i < bench->component_num; i++)
+      mmal_component_destroy(bench->component[i]);
+}
+
+/** Move the buffers along the connections we service */
+static MMAL_STATUS_T bench_service(BENCH_T *bench)
+{
+   MMAL_BUFFER_HEADER_T *buffer;
+   MMAL_STATUS_T status;
+   int64_t now;
+   unsigned int i;
+
+   for (i = 0; i < bench->connection_num; i++)
+   {
+      MMAL_CONNECTION_T *connection = bench->connection[i];
+
+      if (connection->flags & MMAL_CONNECTION_FLAG_TUNNELLING)
+         continue;
+
+      while ((buffer = mmal_queue_get(connection->pool->queue)) != NULL)
+      {
+         status = mmal_port_send_buffer(connection->out, buffer);
+         if (status != MMAL_SUCCESS)
+         {
+            mmal_buffer_header_release(buffer);
+            return status;
+         }
+      }
+
+      while ((buffer = mmal_queue_get(connection->queue)) != NULL)
+      {
+         if (buffer->cmd)
+         {
+            if (buffer->cmd == MMAL_EVENT_FORMAT_CHANGED)
+               status = mmal_connection_event_format_changed(connection, buffer);
+            else
+               status = MMAL_SUCCESS;
+            mmal_buffer_header_release(buffer);
+            if (status != MMAL_SUCCESS)
+               return status;
+            continue;
+         }
+
+         now = vcos_getmicrosecs64();
+         if (bench->measuring && buffer->pts != MMAL_TIME_UNKNOWN)
+            hop_record(&bench->hop[i], now - buffer->pts);
+
+         status = mmal_port_send_buffer(connection->in, buffer);
+         if (status != MMAL_SUCCESS)
+         {
+            mmal_buffer_header_release(buffer);
+            return status;
+         }
+      }
+   }
+
+   return MMAL_SUCCESS;
+}
+
+/*****************************************************************************/
+static void print_hop(const MMAL_CONNECTION_T *connection, const HOP_T *hop, MMAL_BOOL_T first)
+{
+   printf("%s{\"to\":\"%s\",\"count\":%u,\"p50_us\":%u,\"p90_us\":%u,\"p99_us\":%u,\"max_us\":%u}",
+      first ? "" : ",", connection->in->component->name, hop->count, hop_percentile(hop, 50),
+      hop_percentile(hop, 90), hop_percentile(hop, 99), hop->max);
+}
+
+static int run_bench(const RUN_T *run)
+{
+   BENCH_T *bench;
+   MMAL_STATUS_T status;
+   uint64_t start, measure_start = 0, end, now;
+   clock_t cpu_start = 0, cpu;
+   uint32_t buffers;
+   unsigned int i;
+   MMAL_BOOL_T first = MMAL_TRUE;
+   double elapsed;
+
+   bench = calloc(1, sizeof(*bench));
+   if (!bench)
+      return -1;
+   vcos_semaphore_create(&bench->semaphore, "mmal_pipeline_bench", 0);
+
+   status = bench_build(bench, run);
+   if (status == MMAL_SUCCESS)
+      status = bench_enable(bench);
+
+   start = now = vcos_getmicrosecs64();
+   end = start + (uint64_t)run->duration * 1000 * (WARMUP_FRACTION + 1) / WARMUP_FRACTION;
+   while (status == MMAL_SUCCESS && now < end)
+   {
+      vcos_semaphore_wait_timeout(&bench->semaphore, 10);
+      status = bench->status;
+      if (status == MMAL_SUCCESS)
+         status = bench_service(bench);
+
+      now = vcos_getmicrosecs64();
+      if (!bench->measuring && now >= start + (uint64_t)run->duration * 1000 / WARMUP_FRACTION)
+      {
+         memset(bench->hop, 0, sizeof(bench->hop));
+         bench->measuring = MMAL_TRUE;
+         measure_start = now;
+         cpu_start = clock();
+      }
+   }
+   cpu = clock() - cpu_start;
+   elapsed = bench->measuring ? (double)(now - measure_start) : 0.0;
+   buffers = bench->connection_num ? bench->hop[bench->connection_num - 1].count : 0;
+
+   printf("{\"topology\":\"%s\",\"width\":%u,\"height\":%u,\"buffer_size\":%u,"
+          "\"depth\":%u,\"rate\":%u,\"duration_us\":%.0f,\"buffers\":%u,"
+          "\"buffers_per_sec\":%.1f,\"cpu_us\":%.0f,\"cpu_us_per_buffer\":%.2f,\"hops\":[",
+      topology_names[run->topology], run->width, run->height, bench->frame_size, run->depth,
+      run->rate, elapsed, buffers, elapsed ? buffers * 1000000.0 / elapsed : 0.0,
+      cpu * 1000000.0 / CLOCKS_PER_SEC, buffers ? cpu * 1000000.0 / CLOCKS_PER_SEC / buffers : 0.0);
+   for (i = 0; i < bench->connection_num; i++)
+   {
+      if (bench->connection[i]->flags & MMAL_CONNECTION_FLAG_TUNNELLING)
+         continue;
+      print_hop(bench->connection[i], &bench->hop[i], first);
+      first = MMAL_FALSE;
+   }
+   printf("],\"status\":\"%s\"}\n", mmal_status_to_string(status));
+   fflush(stdout);
+
+   bench_destroy(bench);
+   vcos_semaphore_delete(&bench->semaphore);
+   free(bench);
+   return status == MMAL_SUCCESS ? 0 : -1;
+}
+
+/*****************************************************************************/
+static unsigned int parse_list(char *arg, unsigned int *values, unsigned int *values2)
+{
+   unsigned int num = 0;
+   char *token;
+
+   for (token = strtok(arg, ","); token && num < MAX_VALUES; token = strtok(NULL, ","))
+   {
+      char *end;
+      values[num] = strtoul(token, &end, 0);
+      if (values2)
+      {
+         if (*end != 'x')
+            return 0;
+         values2[num] = strtoul(end + 1, &end, 0);
+      }
+      if (*end)
+         return 0;
+      num++;
+   }
+   return num;
+}
+
+static void usage(const char *name)
+{
+   fprintf(stderr, "usage: %s [options]\n"
+      "  -t <topology,...>  topologies to run (connection,tunnel,graph,aggregator)\n"
+      "  -s <WxH,...>       frame sizes (default 320x240,1280x720,1920x1080)\n"
+      "  -n <depth,...>     number of buffers in each pool (default 1,3,8)\n"
+      "  -r <fps,...>       camera frame rates, 0 for as fast as possible (default 0,30)\n"
+      "  -d <ms>            measurement time of each run (default %u)\n",
+      name, DEFAULT_DURATION);
+}
+
+int main(int argc, char **argv)
+{
+   unsigned int widths[MAX_VALUES] = {320, 1280, 1920}, heights[MAX_VALUES] = {240, 720, 1080};
+   unsigned int depths[MAX_VALUES] = {1, 3, 8}, rates[MAX_VALUES] = {0, 30};
+   unsigned int sizes_num = 3, depths_num = 3, rates_num = 2;
+   unsigned int topologies = (1 << TOPOLOGY_MAX) - 1;
+   unsigned int t, s, n, r;
+   RUN_T run;
+   int i, status = 0;
+
+   memset(&run, 0, sizeof(run));
+   run.duration = DEFAULT_DURATION;
+
+   for (i = 1; i < argc; i++)
+   {
+      if (argv[i][0] != '-' || !argv[i][1] || argv[i][2] || i + 1 == argc)
+      {
+         usage(argv[0]);
+         return 1;
+      }
+
+      switch (argv[i++][1])
+      {
+      case 't':
+         {
+            char *token;
+            topologies = 0;
+            for (token = strtok(argv[i], ","); token; token = strtok(NULL, ","))
+            {
+               for (t = 0; t < TOPOLOGY_MAX && strcmp(token, topology_names[t]); t++);
+               if (t == TOPOLOGY_MAX)
+               {
+                  usage(argv[0]);
+                  return 1;
+               }
+               topologies |= 1 << t;
+            }
+         }
+         break;
+      case 's': sizes_num = parse_list(argv[i], widths, heights); break;
+      case 'n': depths_num = parse_list(argv[i], depths, NULL); break;
+      case 'r': rates_num = parse_list(argv[i], rates, NULL); break;
+      case 'd': run.duration = strtoul(argv[i], NULL, 0); break;
+      default: sizes_num = 0; break;
+      }
+
+      if (!sizes_num || !depths_num || !rates_num || !run.duration)
+      {
+         usage(argv[0]);
+         return 1;
+      }
+   }
+
+   vcos_init();
+
+   for (t = 0; t < TOPOLOGY_MAX; t++)
+   {
+      if (!(topologies & (1 << t)))
+         continue;
+      run.topology = (TOPOLOGY_T)t;
+
+      for (s = 0; s < sizes_num; s++)
+         for (n = 0; n < depths_num; n++)
+            for (r = 0; r < rates_num; r++)
+            {
+               run.width = widths[s];
+               run.height = heights[s];
+               run.depth = depths[n];
+               run.rate = rates[r];
+               status |= run_bench(&run);
+            }
+   }
+
+   return status ? 1 : 0;
+}
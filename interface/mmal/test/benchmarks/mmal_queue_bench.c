@@ -0,0 +1,165 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Measures the throughput of MMAL queues when they are contended.
+ * Each producer thread gets buffer headers from its own free queue and puts
+ * them into a shared work queue. A single consumer thread gets the buffers out
+ * of the work queue, checks they arrive in order and sends them back to the
+ * free queue of their producer. The same test is run with normal and lock-free
+ * queues so both can be compared. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mmal.h"
+#include "mmal_queue.h"
+#include "interface/vcos/vcos.h"
+
+#define MAX_PRODUCERS 8
+#define DEFAULT_ITERATIONS 1000000
+#define BUFFERS_PER_PRODUCER 16
+
+typedef MMAL_QUEUE_T *(*QUEUE_CREATE_T)(void);
+
+typedef struct PRODUCER_T
+{
+   VCOS_THREAD_T thread;
+   MMAL_QUEUE_T *work;      /**< Shared queue the buffers are sent to */
+   MMAL_QUEUE_T *free;      /**< Queue of buffers owned by this producer */
+   MMAL_BUFFER_HEADER_T buffers[BUFFERS_PER_PRODUCER];
+   unsigned int index;
+   unsigned int count;      /**< Number of buffers to send */
+   unsigned int received;   /**< Number of buffers the consumer got from us */
+   uint32_t expected;       /**< Sequence number the consumer expects next */
+} PRODUCER_T;
+
+static void *producer_thread(void *arg)
+{
+   PRODUCER_T *producer = arg;
+   MMAL_BUFFER_HEADER_T *buffer;
+   uint32_t sequence = 0;
+
+   while(sequence < producer->count)
+   {
+      buffer = mmal_queue_wait(producer->free);
+      buffer->offset = sequence++;
+      mmal_queue_put(producer->work, buffer);
+   }
+   return NULL;
+}
+
+static int run_test(const char *name, QUEUE_CREATE_T create, unsigned int num_producers,
+   unsigned int iterations)
+{
+   PRODUCER_T producers[MAX_PRODUCERS];
+   MMAL_QUEUE_T *work = create();
+   MMAL_BUFFER_HEADER_T *buffer;
+   unsigned int i, j, total = 0, errors = 0;
+   uint32_t start, elapsed;
+
+   if(!work)
+      return -1;
+
+   memset(producers, 0, sizeof(producers));
+   for(i = 0; i < num_producers; i++)
+   {
+      producers[i].work = work;
+      producers[i].free = create();
+      producers[i].index = i;
+      producers[i].count = iterations / num_producers;
+      total += producers[i].count;
+      for(j = 0; j < BUFFERS_PER_PRODUCER; j++)
+      {
+         producers[i].buffers[j].user_data = &producers[i];
+         mmal_queue_put(producers[i].free, &producers[i].buffers[j]);
+      }
+   }
+
+   start = vcos_getmicrosecs();
+   for(i = 0; i < num_producers; i++)
+      vcos_thread_create(&producers[i].thread, "producer", NULL, producer_thread, &producers[i]);
+
+   for(i = 0; i < total; i++)
+   {
+      PRODUCER_T *producer;
+
+      /* Mix non-blocking and blocking calls */
+      buffer = (i & 1) ? mmal_queue_get(work) : NULL;
+      if(!buffer)
+         buffer = mmal_queue_wait(work);
+
+      producer = buffer->user_data;
+      if(buffer->offset != producer->expected)
+         errors++;
+      producer->expected = buffer->offset + 1;
+      producer->received++;
+      mmal_queue_put(producer->free, buffer);
+   }
+   elapsed = vcos_getmicrosecs() - start;
+
+   for(i = 0; i < num_producers; i++)
+   {
+      vcos_thread_join(&producers[i].thread, NULL);
+      if(producers[i].received != producers[i].count ||
+         mmal_queue_length(producers[i].free) != BUFFERS_PER_PRODUCER)
+         errors++;
+      mmal_queue_destroy(producers[i].free);
+   }
+   if(mmal_queue_length(work) || mmal_queue_timedwait(work, 1))
+      errors++;
+   mmal_queue_destroy(work);
+
+   printf("%-10s %u producer(s): %8u buffers in %7u us, %6.2f Mbuffers/s%s\n",
+      name, num_producers, total, elapsed, elapsed ? (double)total / elapsed : 0.0,
+      errors ? " - ERRORS" : "");
+   return errors ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+   unsigned int iterations = DEFAULT_ITERATIONS, producers;
+   int status = 0;
+
+   if(argc > 1)
+      iterations = strtoul(argv[1], NULL, 0);
+   if(!iterations)
+   {
+      fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+      return 1;
+   }
+
+   vcos_init();
+
+   for(producers = 1; producers <= MAX_PRODUCERS; producers *= 2)
+   {
+      status |= run_test("locked", mmal_queue_create, producers, iterations);
+      status |= run_test("lock-free", mmal_queue_create_lockfree, producers, iterations);
+   }
+
+   return status ? 1 : 0;
+}
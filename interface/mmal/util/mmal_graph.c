@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "util/mmal_graph.h"
 #include "core/mmal_component_private.h"
 #include "core/mmal_port_private.h"
+#include "core/mmal_executor_private.h"
 #include "mmal_logging.h"
 
 #define GRAPH_CONNECTIONS_MAX 16
@@ -37,6 +38,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /*****************************************************************************/
 
+/** Context for an internal connection of a graph.
+ * Each connection is processed by its own executor task so independent
+ * connections can be processed in parallel while the buffers going through
+ * a given connection stay in order. */
+typedef struct GRAPH_CONNECTION_T
+{
+   MMAL_EXECUTOR_TASK_T task;    /**< processes the buffers of the connection */
+   VCOS_MUTEX_T lock;            /**< held while the connection is being processed */
+   struct MMAL_COMPONENT_MODULE_T *graph;
+   MMAL_CONNECTION_T *connection;
+
+   VCOS_MUTEX_T stats_lock;      /**< protects the statistics */
+   int64_t time_triggered;       /**< time the connection became ready, 0 when already pending */
+   MMAL_GRAPH_CONNECTION_STATS_T stats;
+} GRAPH_CONNECTION_T;
+
 /** Private context for our graph.
  * This also acts as a MMAL_COMPONENT_MODULE_T for when components are instantiated from graphs */
 typedef struct MMAL_COMPONENT_MODULE_T
@@ -48,8 +65,8 @@ typedef struct MMAL_COMPONENT_MODULE_T
    unsigned int component_num;
 
    MMAL_CONNECTION_T *connection[GRAPH_CONNECTIONS_MAX];
+   GRAPH_CONNECTION_T connection_ctx[GRAPH_CONNECTIONS_MAX];
    unsigned int connection_num;
-   unsigned int connection_current;
 
    MMAL_PORT_T *input[GRAPH_CONNECTIONS_MAX];
    unsigned int input_num;
@@ -60,9 +77,7 @@ typedef struct MMAL_COMPONENT_MODULE_T
 
    MMAL_COMPONENT_T *graph_component;
 
-   MMAL_BOOL_T stop_thread;      /**< informs the worker thread to exit */
-   VCOS_THREAD_T thread;         /**< worker thread which processes all internal connections */
-   VCOS_SEMAPHORE_T sema;        /**< informs the worker thread that buffers are available */
+   MMAL_BOOL_T stopped;          /**< stops the processing of the internal connections */
 
    MMAL_GRAPH_EVENT_CB event_cb; /**< callback for sending control port events to the client */
    void *event_cb_data;          /**< callback data supplied by the client */
@@ -73,7 +88,7 @@ typedef MMAL_GRAPH_PRIVATE_T MMAL_COMPONENT_MODULE_T;
 
 /*****************************************************************************/
 static MMAL_STATUS_T mmal_component_create_from_graph(const char *name, MMAL_COMPONENT_T *component);
-static MMAL_BOOL_T graph_do_processing(MMAL_GRAPH_PRIVATE_T *graph);
+static void graph_connection_process(void *context);
 static void graph_process_buffer(MMAL_GRAPH_PRIVATE_T *graph_private,
    MMAL_CONNECTION_T *connection, MMAL_BUFFER_HEADER_T *buffer);
 
@@ -97,46 +112,67 @@ static void graph_control_cb(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
    }
 }
 
+/*****************************************************************************/
+static void graph_connection_trigger(GRAPH_CONNECTION_T *ctx)
+{
+   vcos_mutex_lock(&ctx->stats_lock);
+   if (!ctx->time_triggered)
+      ctx->time_triggered = vcos_getmicrosecs64();
+   vcos_mutex_unlock(&ctx->stats_lock);
+
+   mmal_executor_task_trigger(&ctx->task);
+}
+
 /*****************************************************************************/
 static void graph_connection_cb(MMAL_CONNECTION_T *connection)
 {
-   MMAL_GRAPH_PRIVATE_T *graph = (MMAL_GRAPH_PRIVATE_T *)connection->user_data;
+   GRAPH_CONNECTION_T *ctx = (GRAPH_CONNECTION_T *)connection->user_data;
    MMAL_BUFFER_HEADER_T *buffer;
 
    if (connection->flags == MMAL_CONNECTION_FLAG_DIRECT &&
        (buffer = mmal_queue_get(connection->queue)) != NULL)
    {
-      graph_process_buffer(graph, connection, buffer);
+      graph_process_buffer(ctx->graph, connection, buffer);
       return;
    }
 
-   vcos_semaphore_post(&graph->sema);
+   graph_connection_trigger(ctx);
 }
 
 /*****************************************************************************/
-static void* graph_worker_thread(void* ctx)
+static void graph_connections_trigger(MMAL_GRAPH_PRIVATE_T *graph)
 {
-   MMAL_GRAPH_PRIVATE_T *graph = (MMAL_GRAPH_PRIVATE_T *)ctx;
+   unsigned int i;
 
-   while (1)
-   {
-      vcos_semaphore_wait(&graph->sema);
-      if (graph->stop_thread)
-         break;
-      while(graph_do_processing(graph));
-   }
+   for (i = 0; i < graph->connection_num; i++)
+      graph_connection_trigger(&graph->connection_ctx[i]);
+}
 
-   LOG_TRACE("worker thread exit %p", graph);
+/*****************************************************************************/
+/** Stop the processing of all the internal connections while the state of
+ * the graph is being changed */
+static void graph_connections_lock(MMAL_GRAPH_PRIVATE_T *graph)
+{
+   unsigned int i;
 
-   return 0;
+   for (i = 0; i < graph->connection_num; i++)
+      vcos_mutex_lock(&graph->connection_ctx[i].lock);
+}
+
+static void graph_connections_unlock(MMAL_GRAPH_PRIVATE_T *graph)
+{
+   unsigned int i;
+
+   for (i = graph->connection_num; i > 0; i--)
+      vcos_mutex_unlock(&graph->connection_ctx[i - 1].lock);
 }
 
 /*****************************************************************************/
-static void graph_stop_worker_thread(MMAL_GRAPH_PRIVATE_T *graph)
+static void graph_connections_stop(MMAL_GRAPH_PRIVATE_T *graph, MMAL_BOOL_T stop)
 {
-   graph->stop_thread = MMAL_TRUE;
-   vcos_semaphore_post(&graph->sema);
-   vcos_thread_join(&graph->thread, NULL);
+   graph_connections_lock(graph);
+   graph->stopped = stop;
+   graph_connections_unlock(graph);
 }
 
 /*****************************************************************************/
@@ -157,12 +193,8 @@ MMAL_STATUS_T mmal_graph_create(MMAL_GRAPH_T **graph, unsigned int userdata_size
    if (userdata_size)
       (*graph)->userdata = (struct MMAL_GRAPH_USERDATA_T *)&private[1];
 
-   if (vcos_semaphore_create(&private->sema, "mmal graph sema", 0) != VCOS_SUCCESS)
-   {
-      LOG_ERROR("failed to create semaphore %p", graph);
-      vcos_free(private);
-      return MMAL_ENOSPC;
-   }
+   /* Nothing gets processed until the graph is enabled */
+   private->stopped = MMAL_TRUE;
 
    return MMAL_SUCCESS;
 }
@@ -182,14 +214,22 @@ MMAL_STATUS_T mmal_graph_destroy(MMAL_GRAPH_T *graph)
    if (graph->pf_destroy)
       graph->pf_destroy(graph);
 
+   graph_connections_stop(private, MMAL_TRUE);
+
    for (i = 0; i < private->connection_num; i++)
       mmal_connection_release(private->connection[i]);
 
+   for (i = 0; i < private->connection_num; i++)
+   {
+      GRAPH_CONNECTION_T *ctx = &private->connection_ctx[i];
+      mmal_executor_task_deregister(&ctx->task);
+      vcos_mutex_delete(&ctx->stats_lock);
+      vcos_mutex_delete(&ctx->lock);
+   }
+
    for (i = 0; i < private->component_num; i++)
       mmal_component_release(private->component[i]);
 
-   vcos_semaphore_delete(&private->sema);
-
    vcos_free(graph);
    return MMAL_SUCCESS;
 }
@@ -250,6 +290,7 @@ MMAL_STATUS_T mmal_graph_component_topology(MMAL_GRAPH_T *graph, MMAL_COMPONENT_
 MMAL_STATUS_T mmal_graph_add_connection(MMAL_GRAPH_T *graph, MMAL_CONNECTION_T *cx)
 {
    MMAL_GRAPH_PRIVATE_T *private = (MMAL_GRAPH_PRIVATE_T *)graph;
+   GRAPH_CONNECTION_T *ctx;
 
    LOG_TRACE("graph: %p, connection: %s(%p)", graph, cx ? cx->name: 0, cx);
 
@@ -262,11 +303,51 @@ MMAL_STATUS_T mmal_graph_add_connection(MMAL_GRAPH_T *graph, MMAL_CONNECTION_T *
       return MMAL_ENOSPC;
    }
 
+   ctx = &private->connection_ctx[private->connection_num];
+   memset(ctx, 0, sizeof(*ctx));
+   ctx->graph = private;
+   ctx->connection = cx;
+   if (vcos_mutex_create(&ctx->lock, "mmal graph connection") != VCOS_SUCCESS)
+      return MMAL_ENOSPC;
+   if (vcos_mutex_create(&ctx->stats_lock, "mmal graph connection stats") != VCOS_SUCCESS)
+   {
+      vcos_mutex_delete(&ctx->lock);
+      return MMAL_ENOSPC;
+   }
+   if (mmal_executor_task_register(&ctx->task, graph_connection_process, ctx) != MMAL_SUCCESS)
+   {
+      LOG_ERROR("failed to register task for connection %s", cx->name);
+      vcos_mutex_delete(&ctx->stats_lock);
+      vcos_mutex_delete(&ctx->lock);
+      return MMAL_ENOSPC;
+   }
+
    mmal_connection_acquire(cx);
    private->connection[private->connection_num++] = cx;
    return MMAL_SUCCESS;
 }
 
+/*****************************************************************************/
+MMAL_STATUS_T mmal_graph_connection_stats_get(MMAL_GRAPH_T *graph, unsigned int index,
+   MMAL_GRAPH_CONNECTION_STATS_T *stats, MMAL_BOOL_T reset)
+{
+   MMAL_GRAPH_PRIVATE_T *private = (MMAL_GRAPH_PRIVATE_T *)graph;
+   GRAPH_CONNECTION_T *ctx;
+
+   if (!graph || !stats || index >= private->connection_num)
+      return MMAL_EINVAL;
+
+   ctx = &private->connection_ctx[index];
+   vcos_mutex_lock(&ctx->stats_lock);
+   *stats = ctx->stats;
+   if (reset)
+      memset(&ctx->stats, 0, sizeof(ctx->stats));
+   vcos_mutex_unlock(&ctx->stats_lock);
+
+   stats->queue_depth = ctx->connection->queue ? mmal_queue_length(ctx->connection->queue) : 0;
+   return MMAL_SUCCESS;
+}
+
 /*****************************************************************************/
 MMAL_STATUS_T mmal_graph_add_port(MMAL_GRAPH_T *graph, MMAL_PORT_T *port)
 {
@@ -369,7 +450,12 @@ MMAL_STATUS_T mmal_graph_new_connection(MMAL_GRAPH_T *graph, MMAL_PORT_T *out, M
    if (status != MMAL_SUCCESS)
       return status;
 
-   private->connection[private->connection_num++] = cx;
+   /* The graph takes its own reference to the connection */
+   status = mmal_graph_add_connection(graph, cx);
+   mmal_connection_release(cx);
+   if (status != MMAL_SUCCESS)
+      return status;
+
    if (connection)
    {
       mmal_connection_acquire(cx);
@@ -388,13 +474,6 @@ MMAL_STATUS_T mmal_graph_enable(MMAL_GRAPH_T *graph, MMAL_GRAPH_EVENT_CB cb, voi
 
    LOG_TRACE("graph: %p", graph);
 
-   if (vcos_thread_create(&private->thread, "mmal graph thread", NULL,
-                          graph_worker_thread, private) != VCOS_SUCCESS)
-   {
-      LOG_ERROR("failed to create worker thread %p", graph);
-      return MMAL_ENOSPC;
-   }
-
    private->event_cb = cb;
    private->event_cb_data = cb_data;
 
@@ -413,19 +492,19 @@ MMAL_STATUS_T mmal_graph_enable(MMAL_GRAPH_T *graph, MMAL_GRAPH_EVENT_CB cb, voi
       MMAL_CONNECTION_T *cx = private->connection[i];
 
       cx->callback = graph_connection_cb;
-      cx->user_data = private;
+      cx->user_data = &private->connection_ctx[i];
 
       status = mmal_connection_enable(cx);
       if (status != MMAL_SUCCESS)
          goto error;
    }
 
-   /* Trigger the worker thread to populate the output ports with empty buffers */
-   vcos_semaphore_post(&private->sema);
+   /* Populate the output ports with empty buffers */
+   graph_connections_stop(private, MMAL_FALSE);
+   graph_connections_trigger(private);
    return status;
 
  error:
-   graph_stop_worker_thread(private);
    return status;
 }
 
@@ -438,7 +517,7 @@ MMAL_STATUS_T mmal_graph_disable(MMAL_GRAPH_T *graph)
 
    LOG_TRACE("graph: %p", graph);
 
-   graph_stop_worker_thread(private);
+   graph_connections_stop(private, MMAL_TRUE);
 
    /* Disable all our connections */
    for (i = 0; i < private->connection_num; i++)
@@ -490,23 +569,6 @@ static void graph_component_control_cb(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *
    mmal_port_event_send(graph_component->control, buffer);
 }
 
-/*****************************************************************************/
-static void graph_component_connection_cb(MMAL_CONNECTION_T *connection)
-{
-   MMAL_COMPONENT_T *component = (MMAL_COMPONENT_T *)connection->user_data;
-   MMAL_BUFFER_HEADER_T *buffer;
-
-   if (connection->flags == MMAL_CONNECTION_FLAG_DIRECT &&
-       (buffer = mmal_queue_get(connection->queue)) != NULL)
-   {
-      graph_process_buffer((MMAL_GRAPH_PRIVATE_T *)component->priv->module,
-         connection, buffer);
-      return;
-   }
-
-   mmal_component_action_trigger(component);
-}
-
 /*****************************************************************************/
 static void graph_port_event_handler(MMAL_CONNECTION_T *connection,
    MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
@@ -576,73 +638,71 @@ static void graph_process_buffer(MMAL_GRAPH_PRIVATE_T *graph_private,
 }
 
 /*****************************************************************************/
-static MMAL_BOOL_T graph_do_processing(MMAL_GRAPH_PRIVATE_T *graph_private)
+static void graph_connection_process(void *context)
 {
+   GRAPH_CONNECTION_T *ctx = (GRAPH_CONNECTION_T *)context;
+   MMAL_CONNECTION_T *connection = ctx->connection;
+   int64_t start = vcos_getmicrosecs64(), triggered;
    MMAL_BUFFER_HEADER_T *buffer;
-   MMAL_BOOL_T run_again = 0;
+   unsigned int buffers = 0, depth = 0;
    MMAL_STATUS_T status;
-   unsigned int i, j;
 
-   /* Process all the empty buffers first */
-   for (i = 0, j = graph_private->connection_current;
-        i < graph_private->connection_num; i++, j++)
-   {
-      MMAL_CONNECTION_T *connection =
-         graph_private->connection[j%graph_private->connection_num];
+   vcos_mutex_lock(&ctx->stats_lock);
+   triggered = ctx->time_triggered;
+   ctx->time_triggered = 0;
+   vcos_mutex_unlock(&ctx->stats_lock);
 
-      if ((connection->flags & MMAL_CONNECTION_FLAG_TUNNELLING) ||
-          !connection->pool)
-         continue; /* Nothing else to do in tunnelling mode */
+   vcos_mutex_lock(&ctx->lock);
 
-      /* Send empty buffers to the output port of the connection */
-      while ((buffer = mmal_queue_get(connection->pool->queue)) != NULL)
-      {
-         run_again = 1;
+   if (ctx->graph->stopped)
+      goto end;
+   if (connection->flags & MMAL_CONNECTION_FLAG_TUNNELLING)
+      goto end; /* Nothing else to do in tunnelling mode */
 
-         status = mmal_port_send_buffer(connection->out, buffer);
-         if (status != MMAL_SUCCESS)
-         {
-            if (connection->out->is_enabled)
-               LOG_ERROR("mmal_port_send_buffer failed (%i)", status);
-            mmal_queue_put_back(connection->pool->queue, buffer);
-            run_again = 0;
-            break;
-         }
+   /* Send empty buffers to the output port of the connection */
+   while (connection->pool && (buffer = mmal_queue_get(connection->pool->queue)) != NULL)
+   {
+      status = mmal_port_send_buffer(connection->out, buffer);
+      if (status != MMAL_SUCCESS)
+      {
+         if (connection->out->is_enabled)
+            LOG_ERROR("mmal_port_send_buffer failed (%i)", status);
+         mmal_queue_put_back(connection->pool->queue, buffer);
+         break;
       }
    }
 
-   /* Loop through all the connections */
-   for (i = 0, j = graph_private->connection_current++;
-        i < graph_private->connection_num; i++, j++)
+   if (connection->flags & MMAL_CONNECTION_FLAG_DIRECT)
+      goto end; /* Nothing else to do in direct mode */
+
+   /* Send any queued buffer to the next component.
+    * We also make sure no connection can starve the others by
+    * having a timeout after which we let the other connections run. */
+   depth = mmal_queue_length(connection->queue);
+   while ((buffer = mmal_queue_get(connection->queue)) != NULL)
    {
-      MMAL_CONNECTION_T *connection =
-         graph_private->connection[j%graph_private->connection_num];
-      int64_t duration = vcos_getmicrosecs64();
-
-      if (connection->flags & MMAL_CONNECTION_FLAG_TUNNELLING)
-         continue; /* Nothing else to do in tunnelling mode */
-      if (connection->flags & MMAL_CONNECTION_FLAG_DIRECT)
-         continue; /* Nothing else to do in direct mode */
-
-      /* Send any queued buffer to the next component.
-       * We also make sure no connection can starve the others by
-       * having a timeout. */
-      while (vcos_getmicrosecs64() - duration < PROCESSING_TIME_MAX &&
-             (buffer = mmal_queue_get(connection->queue)) != NULL)
-      {
-         run_again = 1;
+      graph_process_buffer(ctx->graph, connection, buffer);
+      buffers++;
 
-         graph_process_buffer(graph_private, connection, buffer);
+      if (vcos_getmicrosecs64() - start >= PROCESSING_TIME_MAX)
+      {
+         graph_connection_trigger(ctx);
+         break;
       }
    }
 
-   return run_again;
-}
-
-/*****************************************************************************/
-static void graph_do_processing_loop(MMAL_COMPONENT_T *component)
-{
-   while (graph_do_processing((MMAL_GRAPH_PRIVATE_T *)component->priv->module));
+ end:
+   vcos_mutex_unlock(&ctx->lock);
+
+   vcos_mutex_lock(&ctx->stats_lock);
+   ctx->stats.runs++;
+   ctx->stats.buffers += buffers;
+   if (depth > ctx->stats.queue_depth_max)
+      ctx->stats.queue_depth_max = depth;
+   if (triggered)
+      ctx->stats.stall_time += start - triggered;
+   ctx->stats.busy_time += vcos_getmicrosecs64() - start;
+   vcos_mutex_unlock(&ctx->stats_lock);
 }
 
 /*****************************************************************************/
@@ -963,7 +1023,7 @@ static MMAL_STATUS_T graph_port_enable(MMAL_PORT_T *graph_port, MMAL_PORT_BH_CB_
    /* We need to enable all the connected connections */
    status = graph_port_state_propagate(graph_private, port, 1);
 
-   mmal_component_action_trigger(graph_port->component);
+   graph_connections_trigger(graph_private);
    return status;
 }
 
@@ -986,19 +1046,24 @@ static MMAL_STATUS_T graph_port_disable(MMAL_PORT_T *graph_port)
          return status;
    }
 
+   /* The internal connections must not be processed while we change their state */
+   graph_connections_lock(graph_private);
+
    /* We need to disable all the connected connections.
     * Since disable does an implicit flush, we only want to do that if
     * we're acting on an input port or we risk discarding buffers along
     * the way. */
    if (!graph_private->input_num || port->type == MMAL_PORT_TYPE_INPUT)
-   {
-      MMAL_STATUS_T status = graph_port_state_propagate(graph_private, port, 0);
-      if (status != MMAL_SUCCESS)
-         return status;
-   }
+      status = graph_port_state_propagate(graph_private, port, 0);
+   else
+      status = MMAL_SUCCESS;
 
    /* Forward the call */
-   return mmal_port_disable(port);
+   if (status == MMAL_SUCCESS)
+      status = mmal_port_disable(port);
+
+   graph_connections_unlock(graph_private);
+   return status;
 }
 
 /** Propagate a port flush */
@@ -1076,8 +1141,12 @@ static MMAL_STATUS_T graph_port_flush(MMAL_PORT_T *graph_port)
          return status;
    }
 
-   /* Forward the call */
-   return graph_port_flush_propagate(graph_private, port);
+   /* Forward the call. The internal connections must not be processed while
+    * we flush them. */
+   graph_connections_lock(graph_private);
+   status = graph_port_flush_propagate(graph_private, port);
+   graph_connections_unlock(graph_private);
+   return status;
 }
 
 /** Send a buffer header to a port */
@@ -1480,18 +1549,13 @@ static MMAL_STATUS_T mmal_component_create_from_graph(const char *name, MMAL_COM
          goto error;
    }
 
-   status = mmal_component_action_register(component, graph_do_processing_loop);
-   if (status != MMAL_SUCCESS)
-      goto error;
-
-#if 1 // FIXME
    /* Set our connection callback */
    for (i = 0; i < graph->connection_num; i++)
    {
-      graph->connection[i]->callback = graph_component_connection_cb;
-      graph->connection[i]->user_data = (void *)component;
+      graph->connection[i]->callback = graph_connection_cb;
+      graph->connection[i]->user_data = (void *)&graph->connection_ctx[i];
    }
-#endif
+   graph->stopped = MMAL_FALSE;
 
    component->priv->pf_destroy = graph_component_destroy;
    component->priv->pf_enable = graph_component_enable;
@@ -51,6 +51,20 @@ typedef enum
 
 } MMAL_GRAPH_TOPOLOGY_T;
 
+/** Statistics about an internal connection of a graph.
+ * The internal connections of a graph are processed in parallel by a pool
+ * of worker threads. These statistics help find out which connections limit
+ * the throughput of the graph. */
+typedef struct MMAL_GRAPH_CONNECTION_STATS_T
+{
+   uint32_t runs;            /**< Number of times the connection was processed */
+   uint32_t buffers;         /**< Number of buffers sent to the input port of the connection */
+   uint32_t queue_depth;     /**< Number of buffers currently waiting in the connection queue */
+   uint32_t queue_depth_max; /**< Largest number of buffers found waiting in the connection queue */
+   int64_t stall_time;       /**< Time the connection was ready but waiting for a worker (microseconds) */
+   int64_t busy_time;        /**< Time spent processing the connection (microseconds) */
+} MMAL_GRAPH_CONNECTION_STATS_T;
+
 /** Structure describing a graph */
 typedef struct MMAL_GRAPH_T
 {
@@ -228,6 +242,16 @@ MMAL_STATUS_T mmal_graph_build(MMAL_GRAPH_T *ctx,
  */
 MMAL_STATUS_T mmal_graph_component_constructor(const char *name, MMAL_COMPONENT_T *component);
 
+/** Get the statistics of an internal connection of a graph
+ * @param graph graph the connection belongs to
+ * @param index index of the connection, in the order connections were added to the graph
+ * @param stats returned statistics
+ * @param reset reset the statistics after reading them
+ * @return MMAL_SUCCESS on success
+ */
+MMAL_STATUS_T mmal_graph_connection_stats_get(MMAL_GRAPH_T *graph, unsigned int index,
+   MMAL_GRAPH_CONNECTION_STATS_T *stats, MMAL_BOOL_T reset);
+
 /** Destroy a previously created graph
  * @param graph graph to destroy
  * @return MMAL_SUCCESS on success
@@ -29,10 +29,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "vchiq.h"
 #include "vchiq_cfg.h"
 #include "vchiq_ioctl.h"
+#include "vchiq_loopback.h"
 #include "interface/vchi/vchi.h"
 #include "interface/vchi/common/endian.h"
 #include "interface/vcos/vcos.h"
@@ -42,6 +44,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MSGBUF_SIZE (VCHIQ_MAX_MSG_SIZE + sizeof(VCHIQ_HEADER_T))
 
 #define RETRY(r,x) do { r = x; } while ((r == -1) && (errno == EINTR))
+#define VCHIQ_IOCTL(fd,cmd,arg) vchiq_ioctl(fd, cmd, (uintptr_t)(arg))
 
 #define VCOS_LOG_CATEGORY (&vchiq_lib_log_category)
 
@@ -63,6 +66,7 @@ typedef struct vchiq_service_struct VCHI_SERVICE_T;
 struct vchiq_instance_struct
 {
    int fd;
+   int loopback;
    int initialised;
    int connected;
    int use_close_delivered;
@@ -87,6 +91,9 @@ vcos_static_assert(IS_POWER_2(VCHIQ_MAX_INSTANCE_SERVICES));
 static VCHIQ_INSTANCE_T
 vchiq_lib_init(const int dev_vchiq_fd);
 
+static void
+vchiq_lib_close(VCHIQ_INSTANCE_T instance);
+
 static void *completion_thread(void *);
 
 static VCHIQ_STATUS_T
@@ -106,6 +113,14 @@ alloc_msgbuf(void);
 static void
 free_msgbuf(void *buf);
 
+static __inline int
+vchiq_ioctl(int fd, unsigned int cmd, uintptr_t arg)
+{
+   if (vchiq_instance.loopback)
+      return vchiq_loopback_ioctl(cmd, arg);
+   return ioctl(fd, cmd, arg);
+}
+
 static __inline int
 is_valid_instance(VCHIQ_INSTANCE_T instance)
 {
@@ -193,13 +208,13 @@ vchiq_shutdown(VCHIQ_INSTANCE_T instance)
       if (instance->connected)
       {
          int ret;
-         RETRY(ret, ioctl(instance->fd, VCHIQ_IOC_SHUTDOWN, 0));
+         RETRY(ret, VCHIQ_IOCTL(instance->fd, VCHIQ_IOC_SHUTDOWN, 0));
          vcos_assert(ret == 0);
          vcos_thread_join(&instance->completion_thread, NULL);
          instance->connected = 0;
       }
 
-      close(instance->fd);
+      vchiq_lib_close(instance);
       instance->fd = -1;
    }
    else if (instance->initialised > 1)
@@ -243,7 +258,7 @@ vchiq_connect(VCHIQ_INSTANCE_T instance)
    if (instance->connected)
       goto out;
 
-   ret = ioctl(instance->fd, VCHIQ_IOC_CONNECT, 0);
+   ret = VCHIQ_IOCTL(instance->fd, VCHIQ_IOC_CONNECT, 0);
    if (ret != 0)
    {
       status = VCHIQ_ERROR;
@@ -340,7 +355,7 @@ vchiq_close_service(VCHIQ_SERVICE_HANDLE_T handle)
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_CLOSE_SERVICE, service->handle));
+   RETRY(ret,VCHIQ_IOCTL(service->fd, VCHIQ_IOC_CLOSE_SERVICE, service->handle));
 
    if (service->is_client)
       service->lib_handle = VCHIQ_SERVICE_HANDLE_INVALID;
@@ -362,7 +377,7 @@ vchiq_remove_service(VCHIQ_SERVICE_HANDLE_T handle)
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_REMOVE_SERVICE, service->handle));
+   RETRY(ret,VCHIQ_IOCTL(service->fd, VCHIQ_IOC_REMOVE_SERVICE, service->handle));
 
    service->lib_handle = VCHIQ_SERVICE_HANDLE_INVALID;
 
@@ -389,7 +404,7 @@ vchiq_queue_message(VCHIQ_SERVICE_HANDLE_T handle,
    args.handle = service->handle;
    args.elements = elements;
    args.count = count;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -423,7 +438,7 @@ vchiq_queue_bulk_transmit(VCHIQ_SERVICE_HANDLE_T handle,
    args.size = size;
    args.userdata = userdata;
    args.mode = VCHIQ_BULK_MODE_CALLBACK;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -448,7 +463,7 @@ vchiq_queue_bulk_receive(VCHIQ_SERVICE_HANDLE_T handle,
    args.size = size;
    args.userdata = userdata;
    args.mode = VCHIQ_BULK_MODE_CALLBACK;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -502,7 +517,7 @@ vchiq_bulk_transmit(VCHIQ_SERVICE_HANDLE_T handle,
    args.size = size;
    args.userdata = userdata;
    args.mode = mode;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -555,7 +570,7 @@ vchiq_bulk_receive_handle(VCHIQ_SERVICE_HANDLE_T handle,
    args.size = size;
    args.userdata = userdata;
    args.mode = mode;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -568,7 +583,7 @@ vchiq_get_client_id(VCHIQ_SERVICE_HANDLE_T handle)
    if (!service)
       return VCHIQ_ERROR;
 
-   return ioctl(service->fd, VCHIQ_IOC_GET_CLIENT_ID, service->handle);
+   return VCHIQ_IOCTL(service->fd, VCHIQ_IOC_GET_CLIENT_ID, service->handle);
 }
 
 void *
@@ -601,7 +616,7 @@ vchiq_get_config(VCHIQ_INSTANCE_T instance,
    args.config_size = config_size;
    args.pconfig = pconfig;
 
-   RETRY(ret, ioctl(instance->fd, VCHIQ_IOC_GET_CONFIG, &args));
+   RETRY(ret, VCHIQ_IOCTL(instance->fd, VCHIQ_IOC_GET_CONFIG, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -615,7 +630,7 @@ vchiq_use_service( const VCHIQ_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_USE_SERVICE, service->handle));
+   RETRY(ret,VCHIQ_IOCTL(service->fd, VCHIQ_IOC_USE_SERVICE, service->handle));
    return ret;
 }
 
@@ -628,7 +643,7 @@ vchiq_release_service( const VCHIQ_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_RELEASE_SERVICE, service->handle));
+   RETRY(ret,VCHIQ_IOCTL(service->fd, VCHIQ_IOC_RELEASE_SERVICE, service->handle));
    return ret;
 }
 
@@ -647,7 +662,7 @@ vchiq_set_service_option(VCHIQ_SERVICE_HANDLE_T handle,
    args.option = option;
    args.value  = value;
 
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_SET_SERVICE_OPTION, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_SET_SERVICE_OPTION, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -783,7 +798,7 @@ vchi_msg_queue( VCHI_SERVICE_HANDLE_T handle,
    args.handle = service->handle;
    args.elements = &element;
    args.count = 1;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
 
    return ret;
 }
@@ -836,7 +851,7 @@ vchi_bulk_queue_receive( VCHI_SERVICE_HANDLE_T handle,
    args.data = data_dst;
    args.size = data_size;
    args.userdata = bulk_handle;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
 
    return ret;
 }
@@ -890,7 +905,7 @@ vchi_bulk_queue_transmit( VCHI_SERVICE_HANDLE_T handle,
    args.data = (void *)data_src;
    args.size = data_size;
    args.userdata = bulk_handle;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
 
    return ret;
 }
@@ -947,7 +962,7 @@ vchi_msg_dequeue( VCHI_SERVICE_HANDLE_T handle,
       args.blocking = (flags == VCHI_FLAGS_BLOCK_UNTIL_OP_COMPLETE);
       args.bufsize = max_data_size_to_read;
       args.buf = data;
-      RETRY(ret, ioctl(service->fd, VCHIQ_IOC_DEQUEUE_MESSAGE, &args));
+      RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_DEQUEUE_MESSAGE, &args));
       if (ret >= 0)
       {
          *actual_msg_size = ret;
@@ -1001,7 +1016,7 @@ vchi_msg_queuev( VCHI_SERVICE_HANDLE_T handle,
    args.handle = service->handle;
    args.elements = (const VCHIQ_ELEMENT_T *)vector;
    args.count = count;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
 
    return ret;
 }
@@ -1222,7 +1237,7 @@ vchi_service_close( const VCHI_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_CLOSE_SERVICE, service->handle));
+   RETRY(ret,VCHIQ_IOCTL(service->fd, VCHIQ_IOC_CLOSE_SERVICE, service->handle));
 
    if (service->is_client)
       service->lib_handle = VCHIQ_SERVICE_HANDLE_INVALID;
@@ -1239,7 +1254,7 @@ vchi_service_destroy( const VCHI_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_REMOVE_SERVICE, service->handle));
+   RETRY(ret,VCHIQ_IOCTL(service->fd, VCHIQ_IOC_REMOVE_SERVICE, service->handle));
 
    service->lib_handle = VCHIQ_SERVICE_HANDLE_INVALID;
 
@@ -1313,7 +1328,7 @@ vchi_service_use( const VCHI_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_USE_SERVICE, service->handle));
+   RETRY(ret,VCHIQ_IOCTL(service->fd, VCHIQ_IOC_USE_SERVICE, service->handle));
    return ret;
 }
 
@@ -1335,7 +1350,7 @@ int32_t vchi_service_release( const VCHI_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_RELEASE_SERVICE, service->handle));
+   RETRY(ret,VCHIQ_IOCTL(service->fd, VCHIQ_IOC_RELEASE_SERVICE, service->handle));
    return ret;
 }
 
@@ -1374,7 +1389,7 @@ int32_t vchi_service_set_option( const VCHI_SERVICE_HANDLE_T handle,
    args.handle = service->handle;
    args.value  = value;
 
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_SET_SERVICE_OPTION, &args));
+   RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_SET_SERVICE_OPTION, &args));
 
    return ret;
 }
@@ -1406,7 +1421,7 @@ VCHIQ_STATUS_T vchiq_dump_phys_mem( VCHIQ_SERVICE_HANDLE_T handle,
    dump_mem.virt_addr = ptr;
    dump_mem.num_bytes = num_bytes;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_DUMP_PHYS_MEM, &dump_mem));
+   RETRY(ret,VCHIQ_IOCTL(service->fd, VCHIQ_IOC_DUMP_PHYS_MEM, &dump_mem));
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
 
@@ -1439,9 +1454,20 @@ vchiq_lib_init(const int dev_vchiq_fd)
 
    if (instance->initialised == 0)
    {
-      instance->fd = dev_vchiq_fd == -1 ?
-         open("/dev/vchiq", O_RDWR) :
-         dup(dev_vchiq_fd);
+      /* VCHIQ_LOOPBACK in the environment forces the in-process loopback
+       * device, which connects our clients to our own services. /dev/vchiq
+       * isn't tried at all, even where it exists. A descriptor passed in by
+       * the caller always takes precedence. */
+      const char *loopback = getenv("VCHIQ_LOOPBACK");
+
+      instance->loopback = (dev_vchiq_fd == -1) && loopback &&
+         (loopback[0] != '\0') && (strcmp(loopback, "0") != 0);
+      if (instance->loopback)
+         instance->fd = vchiq_loopback_open();
+      else
+         instance->fd = dev_vchiq_fd == -1 ?
+            open("/dev/vchiq", O_RDWR) :
+            dup(dev_vchiq_fd);
       if (instance->fd >= 0)
       {
          VCHIQ_GET_CONFIG_T args;
@@ -1449,12 +1475,12 @@ vchiq_lib_init(const int dev_vchiq_fd)
          int ret;
          args.config_size = sizeof(config);
          args.pconfig = &config;
-         RETRY(ret, ioctl(instance->fd, VCHIQ_IOC_GET_CONFIG, &args));
+         RETRY(ret, VCHIQ_IOCTL(instance->fd, VCHIQ_IOC_GET_CONFIG, &args));
          if ((ret == 0) && (config.version >= VCHIQ_VERSION_MIN) && (config.version_min <= VCHIQ_VERSION))
          {
             if (config.version >= VCHIQ_VERSION_LIB_VERSION)
             {
-               RETRY(ret, ioctl(instance->fd, VCHIQ_IOC_LIB_VERSION, VCHIQ_VERSION));
+               RETRY(ret, VCHIQ_IOCTL(instance->fd, VCHIQ_IOC_LIB_VERSION, VCHIQ_VERSION));
             }
             if (ret == 0)
             {
@@ -1475,7 +1501,7 @@ vchiq_lib_init(const int dev_vchiq_fd)
             {
                vcos_log_error("Very incompatible VCHIQ library - cannot retrieve driver version");
             }
-            close(instance->fd);
+            vchiq_lib_close(instance);
             instance = NULL;
          }
       }
@@ -1494,6 +1520,15 @@ vchiq_lib_init(const int dev_vchiq_fd)
    return instance;
 }
 
+static void
+vchiq_lib_close(VCHIQ_INSTANCE_T instance)
+{
+   if (instance->loopback)
+      vchiq_loopback_close();
+   else
+      close(instance->fd);
+}
+
 static void *
 completion_thread(void *arg)
 {
@@ -1537,7 +1572,7 @@ completion_thread(void *arg)
          }
       }
 
-      RETRY(count, ioctl(instance->fd, VCHIQ_IOC_AWAIT_COMPLETION, &args));
+      RETRY(count, VCHIQ_IOCTL(instance->fd, VCHIQ_IOC_AWAIT_COMPLETION, &args));
 
       if (count <= 0)
          break;
@@ -1565,7 +1600,7 @@ completion_thread(void *arg)
              instance->use_close_delivered)
          {
             int ret;
-            RETRY(ret,ioctl(service->fd, VCHIQ_IOC_CLOSE_DELIVERED, service->handle));
+            RETRY(ret,VCHIQ_IOCTL(service->fd, VCHIQ_IOC_CLOSE_DELIVERED, service->handle));
          }
       }
    }
@@ -1669,7 +1704,7 @@ create_service(VCHIQ_INSTANCE_T instance,
       args.is_open = is_open;
       args.is_vchi = (params->callback == NULL);
       args.handle = VCHIQ_SERVICE_HANDLE_INVALID; /* OUT parameter */
-      RETRY(ret, ioctl(instance->fd, VCHIQ_IOC_CREATE_SERVICE, &args));
+      RETRY(ret, VCHIQ_IOCTL(instance->fd, VCHIQ_IOC_CREATE_SERVICE, &args));
       if (ret == 0)
          service->handle = args.handle;
       else
@@ -1718,7 +1753,7 @@ fill_peek_buf(VCHI_SERVICE_T *service,
          args.bufsize = MSGBUF_SIZE;
          args.buf = service->peek_buf;
 
-         RETRY(ret, ioctl(service->fd, VCHIQ_IOC_DEQUEUE_MESSAGE, &args));
+         RETRY(ret, VCHIQ_IOCTL(service->fd, VCHIQ_IOC_DEQUEUE_MESSAGE, &args));
 
          if (ret >= 0)
          {
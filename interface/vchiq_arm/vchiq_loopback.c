@@ -0,0 +1,789 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <string.h>
+
+#include "vchiq_loopback.h"
+#include "vchiq_cfg.h"
+#include "vchiq_ioctl.h"
+#include "interface/vcos/vcos.h"
+
+/* Must be a power of 2 */
+#define LOOPBACK_MAX_SERVICES 64
+
+#define LOOPBACK_MAX_OUTSTANDING_BULKS 4
+#define LOOPBACK_BULK_THRESHOLD 256
+
+#define VCOS_LOG_CATEGORY (&vchiq_loopback_log_category)
+
+typedef struct loopback_msg_struct
+{
+   struct loopback_msg_struct *next;
+   VCHIQ_HEADER_T header; /* Followed by the message data */
+} LOOPBACK_MSG_T;
+
+typedef struct loopback_bulk_struct
+{
+   struct loopback_bulk_struct *next;
+   void *data;
+   unsigned int size;
+   void *userdata;
+   VCHIQ_BULK_MODE_T mode;
+   /* Only used by VCHIQ_BULK_MODE_BLOCKING transfers, which live on the
+    * stack of the blocked caller rather than being allocated */
+   int status;
+   VCOS_SEMAPHORE_T done;
+} LOOPBACK_BULK_T;
+
+typedef struct
+{
+   LOOPBACK_BULK_T *head;
+   LOOPBACK_BULK_T *tail;
+} LOOPBACK_BULK_QUEUE_T;
+
+typedef struct loopback_service_struct
+{
+   unsigned int handle; /* VCHIQ_SERVICE_HANDLE_INVALID if unused */
+   VCHIQ_SERVICE_PARAMS_T params;
+   int is_client;
+   int is_vchi;
+   struct loopback_service_struct *peer;
+   LOOPBACK_BULK_QUEUE_T tx;
+   LOOPBACK_BULK_QUEUE_T rx;
+   /* VCHI services dequeue their messages rather than receiving them
+    * with the completions */
+   LOOPBACK_MSG_T *msg_head;
+   LOOPBACK_MSG_T *msg_tail;
+   VCOS_SEMAPHORE_T *msg_waiter;
+} LOOPBACK_SERVICE_T;
+
+typedef struct loopback_completion_struct
+{
+   struct loopback_completion_struct *next;
+   VCHIQ_REASON_T reason;
+   LOOPBACK_SERVICE_T *service;
+   LOOPBACK_MSG_T *msg;
+   void *bulk_userdata;
+} LOOPBACK_COMPLETION_T;
+
+static struct
+{
+   int opened;
+   int connected;
+   int shutdown;
+   VCOS_MUTEX_T lock;
+   VCOS_EVENT_T completion_available;
+   LOOPBACK_COMPLETION_T *completion_head;
+   LOOPBACK_COMPLETION_T *completion_tail;
+   unsigned int handle_seq;
+   LOOPBACK_SERVICE_T services[LOOPBACK_MAX_SERVICES];
+} loopback;
+
+static VCOS_LOG_CAT_T vchiq_loopback_log_category;
+
+vcos_static_assert((LOOPBACK_MAX_SERVICES & (LOOPBACK_MAX_SERVICES - 1)) == 0);
+
+/*
+ * Support functions - all called with the lock held
+ */
+
+static LOOPBACK_SERVICE_T *
+find_service(unsigned int handle)
+{
+   LOOPBACK_SERVICE_T *service =
+      &loopback.services[handle & (LOOPBACK_MAX_SERVICES - 1)];
+
+   if ((handle == VCHIQ_SERVICE_HANDLE_INVALID) || (service->handle != handle))
+      return NULL;
+   return service;
+}
+
+static int
+add_completion(LOOPBACK_SERVICE_T *service, VCHIQ_REASON_T reason,
+   LOOPBACK_MSG_T *msg, void *bulk_userdata)
+{
+   LOOPBACK_COMPLETION_T *completion;
+
+   completion = vcos_malloc(sizeof(*completion), "vchiq loopback completion");
+   if (!completion)
+      return -1;
+
+   completion->next = NULL;
+   completion->reason = reason;
+   completion->service = service;
+   completion->msg = msg;
+   completion->bulk_userdata = bulk_userdata;
+
+   if (loopback.completion_tail)
+   {
+      loopback.completion_tail->next = completion;
+   }
+   else
+   {
+      loopback.completion_head = completion;
+      /* The completion thread only waits when the queue is empty */
+      vcos_event_signal(&loopback.completion_available);
+   }
+   loopback.completion_tail = completion;
+   return 0;
+}
+
+/* Discards the completions of a service which is going away */
+static void
+purge_completions(LOOPBACK_SERVICE_T *service)
+{
+   LOOPBACK_COMPLETION_T **link = &loopback.completion_head;
+
+   loopback.completion_tail = NULL;
+   while (*link)
+   {
+      LOOPBACK_COMPLETION_T *completion = *link;
+      if (completion->service == service)
+      {
+         *link = completion->next;
+         vcos_free(completion->msg);
+         vcos_free(completion);
+      }
+      else
+      {
+         loopback.completion_tail = completion;
+         link = &completion->next;
+      }
+   }
+}
+
+static void
+bulk_push(LOOPBACK_BULK_QUEUE_T *queue, LOOPBACK_BULK_T *bulk)
+{
+   bulk->next = NULL;
+   if (queue->tail)
+      queue->tail->next = bulk;
+   else
+      queue->head = bulk;
+   queue->tail = bulk;
+}
+
+static LOOPBACK_BULK_T *
+bulk_pop(LOOPBACK_BULK_QUEUE_T *queue)
+{
+   LOOPBACK_BULK_T *bulk = queue->head;
+   if (bulk)
+   {
+      queue->head = bulk->next;
+      if (!queue->head)
+         queue->tail = NULL;
+   }
+   return bulk;
+}
+
+/* Completes a bulk transfer which has been removed from its queue, either
+ * successfully or by aborting it */
+static void
+bulk_complete(LOOPBACK_SERVICE_T *service, LOOPBACK_BULK_T *bulk,
+   VCHIQ_REASON_T reason, int notify)
+{
+   switch (bulk->mode)
+   {
+   case VCHIQ_BULK_MODE_BLOCKING:
+      bulk->status = ((reason == VCHIQ_BULK_TRANSMIT_DONE) ||
+                      (reason == VCHIQ_BULK_RECEIVE_DONE)) ? 1 : -1;
+      vcos_semaphore_post(&bulk->done);
+      break;
+   case VCHIQ_BULK_MODE_CALLBACK:
+      if (notify)
+         add_completion(service, reason, NULL, bulk->userdata);
+      /* Fall through */
+   default:
+      vcos_free(bulk);
+      break;
+   }
+}
+
+/* Copies data from the transmits queued on one end of a connection to the
+ * receives queued on the other, in order */
+static void
+bulk_transfer(LOOPBACK_SERVICE_T *from, LOOPBACK_SERVICE_T *to)
+{
+   while (from->tx.head && to->rx.head)
+   {
+      LOOPBACK_BULK_T *tx = bulk_pop(&from->tx);
+      LOOPBACK_BULK_T *rx = bulk_pop(&to->rx);
+
+      memcpy(rx->data, tx->data, vcos_min(tx->size, rx->size));
+
+      bulk_complete(from, tx, VCHIQ_BULK_TRANSMIT_DONE, 1);
+      bulk_complete(to, rx, VCHIQ_BULK_RECEIVE_DONE, 1);
+   }
+}
+
+static void
+bulk_abort_all(LOOPBACK_SERVICE_T *service, int notify)
+{
+   LOOPBACK_BULK_T *bulk;
+
+   while ((bulk = bulk_pop(&service->tx)) != NULL)
+      bulk_complete(service, bulk, VCHIQ_BULK_TRANSMIT_ABORTED, notify);
+   while ((bulk = bulk_pop(&service->rx)) != NULL)
+      bulk_complete(service, bulk, VCHIQ_BULK_RECEIVE_ABORTED, notify);
+}
+
+static void
+discard_messages(LOOPBACK_SERVICE_T *service)
+{
+   while (service->msg_head)
+   {
+      LOOPBACK_MSG_T *msg = service->msg_head;
+      service->msg_head = msg->next;
+      vcos_free(msg);
+   }
+   service->msg_tail = NULL;
+}
+
+/* Breaks the connection of a service to its peer. The peer is told about it,
+ * but not the service itself as its user is the one closing it. */
+static void
+disconnect_service(LOOPBACK_SERVICE_T *service)
+{
+   LOOPBACK_SERVICE_T *peer = service->peer;
+
+   bulk_abort_all(service, 0);
+   purge_completions(service);
+   discard_messages(service);
+   if (service->msg_waiter)
+      vcos_semaphore_post(service->msg_waiter);
+
+   if (peer)
+   {
+      service->peer = NULL;
+      peer->peer = NULL;
+      bulk_abort_all(peer, 1);
+      if (peer->msg_waiter)
+         vcos_semaphore_post(peer->msg_waiter);
+      add_completion(peer, VCHIQ_SERVICE_CLOSED, NULL, NULL);
+   }
+}
+
+static void
+free_service(LOOPBACK_SERVICE_T *service)
+{
+   disconnect_service(service);
+   service->handle = VCHIQ_SERVICE_HANDLE_INVALID;
+}
+
+/*
+ * ioctl handlers
+ */
+
+static int
+loopback_create_service(VCHIQ_CREATE_SERVICE_T *args)
+{
+   LOOPBACK_SERVICE_T *service = NULL;
+   LOOPBACK_SERVICE_T *server = NULL;
+   int i;
+
+   if (args->is_open && !loopback.connected)
+   {
+      errno = ENOTCONN;
+      return -1;
+   }
+
+   for (i = 0; i < LOOPBACK_MAX_SERVICES; i++)
+   {
+      LOOPBACK_SERVICE_T *s = &loopback.services[i];
+      if (s->handle == VCHIQ_SERVICE_HANDLE_INVALID)
+      {
+         if (!service)
+            service = s;
+      }
+      else if (args->is_open && !server && !s->is_client && !s->peer &&
+               (s->params.fourcc == args->params.fourcc))
+      {
+         server = s;
+      }
+   }
+
+   if (!service)
+   {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   if (args->is_open)
+   {
+      if (!server)
+      {
+         errno = ECONNREFUSED;
+         return -1;
+      }
+      if ((args->params.version < server->params.version_min) ||
+          (server->params.version < args->params.version_min))
+      {
+         vcos_log_info("service %x version %d (min %d) "
+            "incompatible with %d (min %d)", args->params.fourcc,
+            args->params.version, args->params.version_min,
+            server->params.version, server->params.version_min);
+         errno = EINVAL;
+         return -1;
+      }
+   }
+
+   memset(service, 0, sizeof(*service));
+   service->params = args->params;
+   service->is_client = args->is_open;
+   service->is_vchi = args->is_vchi;
+
+   loopback.handle_seq += LOOPBACK_MAX_SERVICES;
+   if (!loopback.handle_seq)
+      loopback.handle_seq = LOOPBACK_MAX_SERVICES;
+   service->handle = loopback.handle_seq | (service - loopback.services);
+
+   if (server)
+   {
+      service->peer = server;
+      server->peer = service;
+      add_completion(server, VCHIQ_SERVICE_OPENED, NULL, NULL);
+   }
+
+   args->handle = service->handle;
+   return 0;
+}
+
+static int
+loopback_close_service(unsigned int handle, int remove)
+{
+   LOOPBACK_SERVICE_T *service = find_service(handle);
+
+   if (!service)
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   /* A closed server goes back to listening, but clients are gone for good */
+   if (remove || service->is_client)
+      free_service(service);
+   else
+      disconnect_service(service);
+   return 0;
+}
+
+static int
+loopback_queue_message(const VCHIQ_QUEUE_MESSAGE_T *args)
+{
+   LOOPBACK_SERVICE_T *service = find_service(args->handle);
+   LOOPBACK_SERVICE_T *peer;
+   LOOPBACK_MSG_T *msg;
+   unsigned int size = 0;
+   char *data;
+   unsigned int i;
+
+   if (!service || !service->peer)
+   {
+      errno = service ? ENOTCONN : EINVAL;
+      return -1;
+   }
+   peer = service->peer;
+
+   for (i = 0; i < args->count; i++)
+      size += args->elements[i].size;
+   if (size > VCHIQ_MAX_MSG_SIZE)
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   msg = vcos_malloc(sizeof(*msg) + size, "vchiq loopback message");
+   if (!msg)
+   {
+      errno = ENOMEM;
+      return -1;
+   }
+   msg->next = NULL;
+   msg->header.msgid = 0;
+   msg->header.size = size;
+   data = msg->header.data;
+   for (i = 0; i < args->count; i++)
+   {
+      memcpy(data, args->elements[i].data, args->elements[i].size);
+      data += args->elements[i].size;
+   }
+
+   if (peer->is_vchi)
+   {
+      if (peer->msg_tail)
+         peer->msg_tail->next = msg;
+      else
+         peer->msg_head = msg;
+      peer->msg_tail = msg;
+      if (peer->msg_waiter)
+         vcos_semaphore_post(peer->msg_waiter);
+      msg = NULL;
+   }
+
+   if (add_completion(peer, VCHIQ_MESSAGE_AVAILABLE, msg, NULL) != 0)
+   {
+      vcos_free(msg);
+      errno = ENOMEM;
+      return -1;
+   }
+   return 0;
+}
+
+static int
+loopback_queue_bulk(const VCHIQ_QUEUE_BULK_TRANSFER_T *args, int transmit)
+{
+   LOOPBACK_SERVICE_T *service = find_service(args->handle);
+   LOOPBACK_BULK_T blocking_bulk;
+   LOOPBACK_BULK_T *bulk;
+   int ret = 0;
+
+   if (!service || !service->peer)
+   {
+      errno = service ? ENOTCONN : EINVAL;
+      return -1;
+   }
+
+   if (args->mode == VCHIQ_BULK_MODE_BLOCKING)
+   {
+      bulk = &blocking_bulk;
+      bulk->status = 0;
+      if (vcos_semaphore_create(&bulk->done, "vchiq loopback bulk", 0) != VCOS_SUCCESS)
+      {
+         errno = ENOMEM;
+         return -1;
+      }
+   }
+   else
+   {
+      bulk = vcos_malloc(sizeof(*bulk), "vchiq loopback bulk");
+      if (!bulk)
+      {
+         errno = ENOMEM;
+         return -1;
+      }
+   }
+
+   bulk->data = args->data;
+   bulk->size = args->size;
+   bulk->userdata = args->userdata;
+   bulk->mode = args->mode;
+
+   if (transmit)
+   {
+      bulk_push(&service->tx, bulk);
+      bulk_transfer(service, service->peer);
+   }
+   else
+   {
+      bulk_push(&service->rx, bulk);
+      bulk_transfer(service->peer, service);
+   }
+
+   if (bulk == &blocking_bulk)
+   {
+      vcos_mutex_unlock(&loopback.lock);
+      vcos_semaphore_wait(&bulk->done);
+      vcos_mutex_lock(&loopback.lock);
+      vcos_semaphore_delete(&bulk->done);
+      if (bulk->status < 0)
+      {
+         errno = EIO;
+         ret = -1;
+      }
+   }
+
+   return ret;
+}
+
+static int
+loopback_await_completion(VCHIQ_AWAIT_COMPLETION_T *args)
+{
+   unsigned int count = 0;
+
+   while (!loopback.completion_head && !loopback.shutdown)
+   {
+      vcos_mutex_unlock(&loopback.lock);
+      vcos_event_wait(&loopback.completion_available);
+      vcos_mutex_lock(&loopback.lock);
+   }
+
+   while (loopback.completion_head && (count < args->count))
+   {
+      LOOPBACK_COMPLETION_T *completion = loopback.completion_head;
+      VCHIQ_COMPLETION_DATA_T *data = &args->buf[count];
+
+      data->header = NULL;
+      if (completion->msg)
+      {
+         unsigned int size = sizeof(VCHIQ_HEADER_T) + completion->msg->header.size;
+
+         /* Deliver what we have so far and wait for more buffers */
+         if (args->msgbufcount == 0)
+            break;
+         vcos_assert(size <= args->msgbufsize);
+
+         data->header = args->msgbufs[--args->msgbufcount];
+         memcpy(data->header, &completion->msg->header, size);
+      }
+      data->reason = completion->reason;
+      data->service_userdata = completion->service->params.userdata;
+      data->bulk_userdata = completion->bulk_userdata;
+      count++;
+
+      loopback.completion_head = completion->next;
+      if (!loopback.completion_head)
+         loopback.completion_tail = NULL;
+      vcos_free(completion->msg);
+      vcos_free(completion);
+   }
+
+   if ((count == 0) && !loopback.shutdown)
+   {
+      errno = ENOMEM;
+      return -1;
+   }
+   return count;
+}
+
+static int
+loopback_dequeue_message(const VCHIQ_DEQUEUE_MESSAGE_T *args)
+{
+   LOOPBACK_SERVICE_T *service = find_service(args->handle);
+   LOOPBACK_MSG_T *msg;
+   int size;
+
+   if (!service)
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   while (!service->msg_head)
+   {
+      VCOS_SEMAPHORE_T waiter;
+
+      if (!args->blocking || !service->peer || service->msg_waiter)
+      {
+         errno = service->peer ? EWOULDBLOCK : ENOTCONN;
+         return -1;
+      }
+
+      if (vcos_semaphore_create(&waiter, "vchiq loopback dequeue", 0) != VCOS_SUCCESS)
+      {
+         errno = ENOMEM;
+         return -1;
+      }
+      service->msg_waiter = &waiter;
+      vcos_mutex_unlock(&loopback.lock);
+      vcos_semaphore_wait(&waiter);
+      vcos_mutex_lock(&loopback.lock);
+      vcos_semaphore_delete(&waiter);
+
+      /* The service may have been removed while we were waiting */
+      if (service->handle != args->handle)
+      {
+         errno = ENOTCONN;
+         return -1;
+      }
+      service->msg_waiter = NULL;
+   }
+
+   msg = service->msg_head;
+   if (msg->header.size > args->bufsize)
+   {
+      errno = EMSGSIZE;
+      return -1;
+   }
+
+   size = msg->header.size;
+   memcpy(args->buf, msg->header.data, size);
+   service->msg_head = msg->next;
+   if (!service->msg_head)
+      service->msg_tail = NULL;
+   vcos_free(msg);
+
+   return size;
+}
+
+static int
+loopback_get_config(const VCHIQ_GET_CONFIG_T *args)
+{
+   VCHIQ_CONFIG_T config;
+
+   if (args->config_size > sizeof(config))
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   config.max_msg_size = VCHIQ_MAX_MSG_SIZE;
+   config.bulk_threshold = LOOPBACK_BULK_THRESHOLD;
+   config.max_outstanding_bulks = LOOPBACK_MAX_OUTSTANDING_BULKS;
+   config.max_services = LOOPBACK_MAX_SERVICES;
+   config.version = VCHIQ_VERSION;
+   config.version_min = VCHIQ_VERSION_MIN;
+
+   memcpy(args->pconfig, &config, args->config_size);
+   return 0;
+}
+
+/*
+ * Public functions
+ */
+
+int
+vchiq_loopback_open(void)
+{
+   if (loopback.opened)
+   {
+      errno = EBUSY;
+      return -1;
+   }
+
+   memset(&loopback, 0, sizeof(loopback));
+
+   if (vcos_mutex_create(&loopback.lock, "vchiq loopback") != VCOS_SUCCESS)
+   {
+      errno = ENOMEM;
+      return -1;
+   }
+   if (vcos_event_create(&loopback.completion_available, "vchiq loopback") != VCOS_SUCCESS)
+   {
+      vcos_mutex_delete(&loopback.lock);
+      errno = ENOMEM;
+      return -1;
+   }
+
+   vcos_log_register("vchiq_loopback", VCOS_LOG_CATEGORY);
+
+   loopback.opened = 1;
+   return 0;
+}
+
+void
+vchiq_loopback_close(void)
+{
+   int i;
+
+   if (!loopback.opened)
+      return;
+
+   for (i = 0; i < LOOPBACK_MAX_SERVICES; i++)
+   {
+      if (loopback.services[i].handle != VCHIQ_SERVICE_HANDLE_INVALID)
+         free_service(&loopback.services[i]);
+   }
+   /* Only the peers' SERVICE_CLOSED notifications can be left */
+   while (loopback.completion_head)
+   {
+      LOOPBACK_COMPLETION_T *completion = loopback.completion_head;
+      loopback.completion_head = completion->next;
+      vcos_free(completion->msg);
+      vcos_free(completion);
+   }
+
+   vcos_event_delete(&loopback.completion_available);
+   vcos_mutex_delete(&loopback.lock);
+   vcos_log_unregister(VCOS_LOG_CATEGORY);
+   loopback.opened = 0;
+}
+
+int
+vchiq_loopback_ioctl(unsigned int cmd, uintptr_t arg)
+{
+   int ret = 0;
+
+   vcos_mutex_lock(&loopback.lock);
+
+   switch (cmd)
+   {
+   case VCHIQ_IOC_CONNECT:
+      loopback.connected = 1;
+      loopback.shutdown = 0;
+      break;
+
+   case VCHIQ_IOC_SHUTDOWN:
+      loopback.connected = 0;
+      loopback.shutdown = 1;
+      vcos_event_signal(&loopback.completion_available);
+      break;
+
+   case VCHIQ_IOC_CREATE_SERVICE:
+      ret = loopback_create_service((VCHIQ_CREATE_SERVICE_T *)arg);
+      break;
+
+   case VCHIQ_IOC_CLOSE_SERVICE:
+      ret = loopback_close_service((unsigned int)arg, 0);
+      break;
+
+   case VCHIQ_IOC_REMOVE_SERVICE:
+      ret = loopback_close_service((unsigned int)arg, 1);
+      break;
+
+   case VCHIQ_IOC_QUEUE_MESSAGE:
+      ret = loopback_queue_message((const VCHIQ_QUEUE_MESSAGE_T *)arg);
+      break;
+
+   case VCHIQ_IOC_QUEUE_BULK_TRANSMIT:
+   case VCHIQ_IOC_QUEUE_BULK_RECEIVE:
+      ret = loopback_queue_bulk((const VCHIQ_QUEUE_BULK_TRANSFER_T *)arg,
+         cmd == VCHIQ_IOC_QUEUE_BULK_TRANSMIT);
+      break;
+
+   case VCHIQ_IOC_AWAIT_COMPLETION:
+      ret = loopback_await_completion((VCHIQ_AWAIT_COMPLETION_T *)arg);
+      break;
+
+   case VCHIQ_IOC_DEQUEUE_MESSAGE:
+      ret = loopback_dequeue_message((const VCHIQ_DEQUEUE_MESSAGE_T *)arg);
+      break;
+
+   case VCHIQ_IOC_GET_CONFIG:
+      ret = loopback_get_config((const VCHIQ_GET_CONFIG_T *)arg);
+      break;
+
+   case VCHIQ_IOC_GET_CLIENT_ID:
+   case VCHIQ_IOC_USE_SERVICE:
+   case VCHIQ_IOC_RELEASE_SERVICE:
+   case VCHIQ_IOC_SET_SERVICE_OPTION:
+   case VCHIQ_IOC_CLOSE_DELIVERED:
+   case VCHIQ_IOC_LIB_VERSION:
+   case VCHIQ_IOC_DUMP_PHYS_MEM:
+      /* Quotas, power management and client ids don't apply here */
+      break;
+
+   default:
+      errno = ENOTTY;
+      ret = -1;
+      break;
+   }
+
+   vcos_mutex_unlock(&loopback.lock);
+
+   return ret;
+}
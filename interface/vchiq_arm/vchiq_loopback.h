@@ -0,0 +1,58 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VCHIQ_LOOPBACK_H
+#define VCHIQ_LOOPBACK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An in-process implementation of the /dev/vchiq ioctl interface. Instead
+ * of talking to VideoCore, services opened through it are connected to the
+ * services which the same process has added with vchiq_add_service, so that
+ * VCHIQ clients and their servers can be run and benchmarked on any host.
+ *
+ * vchiq_lib uses it instead of /dev/vchiq, without trying to open the device,
+ * whenever VCHIQ_LOOPBACK is set in the environment (to anything but "0").
+ */
+
+/* Returns 0 on success, or -1 with errno set */
+extern int  vchiq_loopback_open(void);
+extern void vchiq_loopback_close(void);
+
+/* Behaves as ioctl() would on /dev/vchiq */
+extern int  vchiq_loopback_ioctl(unsigned int cmd, uintptr_t arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -99,7 +99,7 @@ static void do_vchi_ping_test(VCHI_SERVICE_HANDLE_T service, int size, int async
 
 static VCHIQ_STATUS_T func_data_test(VCHIQ_SERVICE_HANDLE_T service, int size, int align, int server_align);
 
-#ifdef VCHIQ_LOCAL
+#if defined(VCHIQ_LOCAL) || defined(__linux__)
 static void *vchiq_test_server(void *);
 #endif
 
@@ -163,6 +163,8 @@ static int vchiq_test(int argc, char **argv)
    int run_functional_test = 0;
    int run_ping_test = 0;
    int run_signal_test = 0;
+   int run_server = 0;
+   int use_loopback = 0;
    int verbose = 0;
    int argn;
  
@@ -210,6 +212,16 @@ static int vchiq_test(int argc, char **argv)
       {
          run_signal_test = 1;
       }
+#ifdef __linux__
+      else if (strcmp(arg, "-l") == 0)
+      {
+         /* Serve the test services in this process, through the loopback
+          * VCHIQ device */
+         setenv("VCHIQ_LOOPBACK", "1", 1);
+         run_server = 1;
+         use_loopback = 1;
+      }
+#endif
       else if (strcmp(arg, "-m") == 0)
       {
          g_params.client_message_quota = atoi(argv[argn++]);
@@ -285,6 +297,12 @@ static int vchiq_test(int argc, char **argv)
    if ((run_ctrl_test + run_bulk_test + run_functional_test + run_ping_test + run_signal_test) != 1)
       usage();
 
+   if (use_loopback && (run_functional_test || run_signal_test))
+   {
+      printf("* the functional (-f) and signal (-i) tests are not supported with -l\n");
+      exit(1);
+   }
+
    if (argn < argc)
    {
       g_params.iters = atoi(argv[argn++]);
@@ -312,6 +330,11 @@ static int vchiq_test(int argc, char **argv)
    }
 #endif
 
+#ifdef __linux__
+   if (run_server)
+      vchiq_test_server(NULL);
+#endif
+
    vcos_event_create(&g_server_reply, "g_server_reply");
    vcos_event_create(&g_shutdown, "g_shutdown");
    vcos_mutex_create(&g_mutex, "g_mutex");
@@ -1309,7 +1332,7 @@ error_exit:
 }
 
 
-#ifdef VCHIQ_LOCAL
+#if defined(VCHIQ_LOCAL) || defined(__linux__)
 
 static void *vchiq_test_server(void *param)
 {
@@ -1620,6 +1643,8 @@ static void usage(void)
    printf("    -A <c> <s>  set the client and server bulk alignment (modulo 4096)\n");
    printf("    -e          disable echoing in the main bulk transfer mode\n");
    printf("    -k <n>      skip the first <n> func data tests\n");
+   printf("    -l          serve the echo service in-process via the loopback VCHIQ\n");
+   printf("                (not with -f or -i)\n");
    printf("    -m <n>      set the client message quota to <n>\n");
    printf("    -M <n>      set the server message quota to <n>\n");
    printf("    -q          disable data verification\n");
@@ -0,0 +1,241 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * The echo service used by vchiq_test, for hosts where it can't be served by
+ * VideoCore. It is normally reached through the loopback device (see
+ * vchiq_loopback.h), which is how "vchiq_test -l" runs.
+ *
+ * Messages start with one of the MSG_* types:
+ *    MSG_CONFIG  sets the parameters of the following bulk transfers
+ *    MSG_ECHO    is sent back as it is
+ *    MSG_SYNC    gets a 1 byte reply, which the client waits for
+ *    MSG_ASYNC   gets an empty reply, which the client doesn't wait for
+ *    MSG_ONEWAY  gets no reply
+ * Any other reply is an error string.
+ *
+ * After a MSG_CONFIG, the service receives params.iters bulk transfers of
+ * params.blocksize bytes, sending each one back if params.echo is set.
+ */
+
+#include <string.h>
+
+#include "vchiq_test.h"
+
+#define ECHO_FOURCC        VCHIQ_MAKE_FOURCC('e','c','h','o')
+#define ECHO_NUM_BULK_BUFS 4
+
+typedef struct
+{
+   struct test_params params;
+   char *bulk_bufs;     /* ECHO_NUM_BULK_BUFS blocks of params.blocksize */
+   int rx_queued;       /* Bulk receives queued since the last MSG_CONFIG */
+   int outstanding;     /* Bulk transfers not completed yet */
+} ECHO_SERVICE_T;
+
+static VCOS_LOG_CAT_T vchiq_test_log_category;
+
+static ECHO_SERVICE_T echo_service;
+
+static void
+echo_reply(VCHIQ_SERVICE_HANDLE_T service, const void *data, int size)
+{
+   VCHIQ_ELEMENT_T element;
+
+   element.data = data;
+   element.size = size;
+   if (vchiq_queue_message(service, &element, 1) != VCHIQ_SUCCESS)
+      vcos_log_error("echo: failed to send a reply");
+}
+
+static void
+echo_error(VCHIQ_SERVICE_HANDLE_T service, const char *error)
+{
+   vcos_log_warn("echo: %s", error);
+   echo_reply(service, error, strlen(error) + 1);
+}
+
+static void
+echo_queue_receive(ECHO_SERVICE_T *echo, VCHIQ_SERVICE_HANDLE_T service, int buf)
+{
+   if (echo->rx_queued >= echo->params.iters)
+      return;
+
+   if (vchiq_queue_bulk_receive(service,
+          echo->bulk_bufs + buf * echo->params.blocksize,
+          echo->params.blocksize, (void *)(intptr_t)buf) == VCHIQ_SUCCESS)
+   {
+      echo->rx_queued++;
+      echo->outstanding++;
+   }
+   else
+   {
+      vcos_log_error("echo: failed to queue a bulk receive");
+   }
+}
+
+static const char *
+echo_config(ECHO_SERVICE_T *echo, VCHIQ_SERVICE_HANDLE_T service,
+   const VCHIQ_HEADER_T *header)
+{
+   int i;
+
+   if (header->size < sizeof(echo->params))
+      return "config message too short";
+   if (echo->outstanding)
+      return "bulk transfers still in progress";
+
+   memcpy(&echo->params, header->data, sizeof(echo->params));
+   echo->rx_queued = 0;
+
+   vcos_free(echo->bulk_bufs);
+   echo->bulk_bufs = NULL;
+
+   if (echo->params.server_message_quota)
+      vchiq_set_service_option(service, VCHIQ_SERVICE_OPTION_MESSAGE_QUOTA,
+         echo->params.server_message_quota);
+
+   if ((echo->params.blocksize <= 0) || (echo->params.iters <= 0))
+      return NULL;
+
+   echo->bulk_bufs = vcos_malloc(ECHO_NUM_BULK_BUFS * echo->params.blocksize,
+      "echo bulk buffers");
+   if (!echo->bulk_bufs)
+      return "out of memory";
+
+   for (i = 0; i < ECHO_NUM_BULK_BUFS; i++)
+      echo_queue_receive(echo, service, i);
+
+   return NULL;
+}
+
+static VCHIQ_STATUS_T
+echo_callback(VCHIQ_REASON_T reason, VCHIQ_HEADER_T *header,
+   VCHIQ_SERVICE_HANDLE_T service, void *bulk_userdata)
+{
+   ECHO_SERVICE_T *echo = (ECHO_SERVICE_T *)VCHIQ_GET_SERVICE_USERDATA(service);
+   int buf = (int)(intptr_t)bulk_userdata;
+
+   switch (reason)
+   {
+   case VCHIQ_SERVICE_OPENED:
+      memset(&echo->params, 0, sizeof(echo->params));
+      echo->rx_queued = 0;
+      echo->outstanding = 0;
+      break;
+
+   case VCHIQ_SERVICE_CLOSED:
+      /* Any outstanding bulk transfers have been aborted by now */
+      vcos_free(echo->bulk_bufs);
+      echo->bulk_bufs = NULL;
+      echo->outstanding = 0;
+      break;
+
+   case VCHIQ_MESSAGE_AVAILABLE:
+   {
+      int type = MSG_ERROR;
+      const char *error;
+      char ack = 0;
+
+      if (header->size >= sizeof(type))
+         memcpy(&type, header->data, sizeof(type));
+
+      switch (type)
+      {
+      case MSG_CONFIG:
+         error = echo_config(echo, service, header);
+         if (error)
+            echo_error(service, error);
+         else
+            echo_reply(service, &ack, sizeof(ack));
+         break;
+      case MSG_ECHO:
+         echo_reply(service, header->data, header->size);
+         break;
+      case MSG_SYNC:
+         echo_reply(service, &ack, sizeof(ack));
+         break;
+      case MSG_ASYNC:
+         echo_reply(service, NULL, 0);
+         break;
+      case MSG_ONEWAY:
+         break;
+      default:
+         echo_error(service, "unknown message type");
+         break;
+      }
+      vchiq_release_message(service, header);
+      break;
+   }
+
+   case VCHIQ_BULK_RECEIVE_DONE:
+      echo->outstanding--;
+      if (echo->params.echo &&
+          (vchiq_queue_bulk_transmit(service,
+              echo->bulk_bufs + buf * echo->params.blocksize,
+              echo->params.blocksize, bulk_userdata) == VCHIQ_SUCCESS))
+      {
+         /* The buffer is reused once it has been sent back */
+         echo->outstanding++;
+         break;
+      }
+      echo_queue_receive(echo, service, buf);
+      break;
+
+   case VCHIQ_BULK_TRANSMIT_DONE:
+      echo->outstanding--;
+      echo_queue_receive(echo, service, buf);
+      break;
+
+   case VCHIQ_BULK_TRANSMIT_ABORTED:
+   case VCHIQ_BULK_RECEIVE_ABORTED:
+      echo->outstanding--;
+      break;
+   }
+
+   return VCHIQ_SUCCESS;
+}
+
+void
+vchiq_test_start_services(VCHIQ_INSTANCE_T instance)
+{
+   VCHIQ_SERVICE_PARAMS_T params;
+   VCHIQ_SERVICE_HANDLE_T service;
+
+   vcos_log_set_level(VCOS_LOG_CATEGORY, VCOS_LOG_WARN);
+   vcos_log_register("vchiq_test_server", VCOS_LOG_CATEGORY);
+
+   memset(&params, 0, sizeof(params));
+   params.fourcc = ECHO_FOURCC;
+   params.callback = echo_callback;
+   params.userdata = &echo_service;
+   params.version = VCHIQ_TEST_VER;
+   params.version_min = VCHIQ_TEST_VER;
+
+   if (vchiq_add_service(instance, &params, &service) != VCHIQ_SUCCESS)
+      vcos_log_error("failed to add the echo service");
+}
@@ -0,0 +1,206 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Measures the cost of VCOS timers when many of them are armed at once.
+ * A set of timers is created and armed with delays spread over a window.
+ * A quarter of them is then cancelled and another quarter is set again with
+ * a new delay. The test checks that every timer still armed expires exactly
+ * once, and that cancelled timers don't expire at all. It reports the cost
+ * of each operation, how late the timers expire and how many threads the
+ * process uses while the timers are armed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interface/vcos/vcos.h"
+
+#define DEFAULT_TIMERS 10000
+#define DEFAULT_DELAY_MS 200
+#define DEFAULT_SPREAD_MS 1000
+
+typedef struct BENCH_TIMER_T
+{
+   VCOS_TIMER_T timer;
+   VCOS_SEMAPHORE_T *expired; /**< Posted every time a timer expires */
+   uint64_t deadline;         /**< Time at which we expect the timer to expire */
+   uint64_t fired;            /**< Time at which the timer expired */
+   unsigned int count;        /**< Number of times the timer expired */
+   int armed;
+} BENCH_TIMER_T;
+
+static void timer_expired(void *context)
+{
+   BENCH_TIMER_T *timer = context;
+   timer->fired = vcos_getmicrosecs64();
+   timer->count++;
+   vcos_semaphore_post(timer->expired);
+}
+
+static void timer_set(BENCH_TIMER_T *timer, VCOS_UNSIGNED delay_ms)
+{
+   timer->deadline = vcos_getmicrosecs64() + delay_ms * 1000ULL;
+   timer->armed = 1;
+   vcos_timer_set(&timer->timer, delay_ms);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+   return x < y ? -1 : x > y;
+}
+
+static int process_threads(void)
+{
+   char line[128];
+   int threads = -1;
+   FILE *file = fopen("/proc/self/status", "r");
+
+   if(!file)
+      return -1;
+   while(fgets(line, sizeof(line), file))
+      if(sscanf(line, "Threads: %d", &threads) == 1)
+         break;
+   fclose(file);
+   return threads;
+}
+
+static void print_cost(const char *name, unsigned int count, uint64_t elapsed)
+{
+   printf("%-8s %6u timers in %8u us, %8.3f us/timer\n", name, count,
+      (unsigned int)elapsed, count ? (double)elapsed / count : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+   unsigned int num = DEFAULT_TIMERS, delay = DEFAULT_DELAY_MS, spread = DEFAULT_SPREAD_MS;
+   unsigned int i, armed = 0, created = 0, errors = 0, late = 0;
+   VCOS_SEMAPHORE_T expired;
+   BENCH_TIMER_T *timers;
+   uint64_t *lateness, start;
+   int threads;
+
+   if(argc > 1)
+      num = strtoul(argv[1], NULL, 0);
+   if(argc > 2)
+      delay = strtoul(argv[2], NULL, 0);
+   if(argc > 3)
+      spread = strtoul(argv[3], NULL, 0);
+   if(!num || !delay || !spread)
+   {
+      fprintf(stderr, "usage: %s [timers] [min delay ms] [delay spread ms]\n", argv[0]);
+      return 1;
+   }
+
+   vcos_init();
+
+   timers = calloc(num, sizeof(*timers));
+   lateness = calloc(num, sizeof(*lateness));
+   if(!timers || !lateness || vcos_semaphore_create(&expired, "expired", 0) != VCOS_SUCCESS)
+   {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+   }
+
+   start = vcos_getmicrosecs64();
+   for(i = 0; i < num; i++, created++)
+   {
+      timers[i].expired = &expired;
+      if(vcos_timer_create(&timers[i].timer, "bench", timer_expired, &timers[i]) != VCOS_SUCCESS)
+         break;
+   }
+   print_cost("create", created, vcos_getmicrosecs64() - start);
+   if(created != num)
+   {
+      fprintf(stderr, "only %u timers could be created\n", created);
+      num = created;
+      errors++;
+   }
+
+   /* Spread the expiry times so that the heap sees them in a scrambled order */
+   start = vcos_getmicrosecs64();
+   for(i = 0; i < num; i++)
+      timer_set(&timers[i], delay + (i * 7919) % spread);
+   print_cost("set", num, vcos_getmicrosecs64() - start);
+
+   threads = process_threads();
+
+   start = vcos_getmicrosecs64();
+   for(i = 0; i < num; i += 4)
+   {
+      vcos_timer_cancel(&timers[i].timer);
+      timers[i].armed = 0;
+   }
+   print_cost("cancel", (num + 3) / 4, vcos_getmicrosecs64() - start);
+
+   start = vcos_getmicrosecs64();
+   for(i = 1; i < num; i += 4)
+      timer_set(&timers[i], delay + (i * 104729) % spread);
+   print_cost("reset", num / 4, vcos_getmicrosecs64() - start);
+
+   for(i = 0; i < num; i++)
+      armed += timers[i].armed;
+
+   /* Wait for all the armed timers to expire, and a bit longer to catch
+    * any stray expirations */
+   for(i = 0; i < armed; i++)
+      if(vcos_semaphore_wait_timeout(&expired, delay + spread + 1000) != VCOS_SUCCESS)
+         break;
+   vcos_sleep(100);
+
+   for(i = 0; i < num; i++)
+   {
+      if(timers[i].count != (unsigned int)timers[i].armed)
+         errors++;
+      if(!timers[i].count)
+         continue;
+      if(timers[i].fired < timers[i].deadline)
+         errors++;
+      else
+         lateness[late++] = timers[i].fired - timers[i].deadline;
+   }
+
+   start = vcos_getmicrosecs64();
+   for(i = 0; i < num; i++)
+      vcos_timer_delete(&timers[i].timer);
+   print_cost("delete", num, vcos_getmicrosecs64() - start);
+
+   if(late)
+   {
+      qsort(lateness, late, sizeof(*lateness), compare_u64);
+      printf("lateness over %u expirations: p50 %u us, p99 %u us, max %u us\n", late,
+         (unsigned int)lateness[late / 2], (unsigned int)lateness[late * 99 / 100],
+         (unsigned int)lateness[late - 1]);
+   }
+   printf("%d threads with %u timers armed%s\n", threads, num, errors ? " - ERRORS" : "");
+
+   vcos_semaphore_delete(&expired);
+   free(lateness);
+   free(timers);
+   vcos_deinit();
+   return errors ? 1 : 0;
+}
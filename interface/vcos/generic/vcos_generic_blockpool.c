@@ -75,6 +75,86 @@ static VCOS_LOG_CAT_T vcos_blockpool_log =
 VCOS_LOG_INIT("vcos_blockpool", VCOS_BLOCKPOOL_TRACE_LEVEL);
 #endif
 
+/* Threads allocate and free blocks through a magazine, a small stack of free
+ * blocks protected by its own mutex, and only go to the subpools under the
+ * pool mutex to refill or flush a magazine by batches. A thread always uses
+ * the same magazine, picked from its thread index, so magazine mutexes are
+ * uncontended as long as there are no more busy threads than magazines.
+ * Magazines belong to the pool rather than to the threads, so nothing needs
+ * to be done when a thread exits or a pool is deleted.
+ *
+ * Blocks in a magazine are free as far as the handle and validity checks
+ * are concerned: their header refers to their subpool with the
+ * VCOS_BLOCKPOOL_CACHED tag set, so it doesn't match the subpool.
+ */
+#define VCOS_BLOCKPOOL_MAGAZINES              8
+#define VCOS_BLOCKPOOL_MAGAZINE_SIZE          16
+#define VCOS_BLOCKPOOL_MAGAZINE_BATCH         (VCOS_BLOCKPOOL_MAGAZINE_SIZE / 2)
+/* Smaller pools don't use magazines so that blocks aren't hoarded */
+#define VCOS_BLOCKPOOL_MAGAZINE_MIN_BLOCKS \
+   (VCOS_BLOCKPOOL_MAGAZINES * VCOS_BLOCKPOOL_MAGAZINE_SIZE)
+
+#define VCOS_BLOCKPOOL_CACHED                 ((size_t) 1)
+#define VCOS_BLOCKPOOL_TAG(s) \
+   ((VCOS_BLOCKPOOL_SUBPOOL_T *) ((size_t) (s) | VCOS_BLOCKPOOL_CACHED))
+#define VCOS_BLOCKPOOL_UNTAG(s) \
+   ((VCOS_BLOCKPOOL_SUBPOOL_T *) ((size_t) (s) & ~VCOS_BLOCKPOOL_CACHED))
+
+typedef struct VCOS_BLOCKPOOL_MAGAZINE_TAG
+{
+   VCOS_MUTEX_T mutex;
+   /** Number of blocks in the magazine */
+   VCOS_UNSIGNED count;
+   /** Free blocks, most recently freed last */
+   VCOS_BLOCKPOOL_HEADER_T *blocks[VCOS_BLOCKPOOL_MAGAZINE_SIZE];
+} VCOS_BLOCKPOOL_MAGAZINE_T;
+
+static VCOS_ONCE_T vcos_blockpool_thread_once = VCOS_ONCE_INIT;
+static VCOS_TLS_KEY_T vcos_blockpool_thread_key;
+static VCOS_STATUS_T vcos_blockpool_thread_key_status = VCOS_EINVAL;
+static VCOS_UNSIGNED vcos_blockpool_thread_count;
+
+static void vcos_generic_blockpool_thread_init(void)
+{
+   vcos_blockpool_thread_key_status = vcos_tls_create(&vcos_blockpool_thread_key);
+}
+
+/** Returns the magazine the current thread uses for this pool */
+static VCOS_BLOCKPOOL_MAGAZINE_T *vcos_generic_blockpool_magazine(
+      VCOS_BLOCKPOOL_T *pool)
+{
+   size_t index = 0;
+
+   if (vcos_blockpool_thread_key_status == VCOS_SUCCESS)
+   {
+      /* The TLS value is the thread index + 1 so that 0 means unassigned */
+      index = (size_t) vcos_tls_get(vcos_blockpool_thread_key);
+      if (! index)
+      {
+         vcos_global_lock();
+         index = ++vcos_blockpool_thread_count;
+         vcos_global_unlock();
+         vcos_tls_set(vcos_blockpool_thread_key, (void *) index);
+      }
+      index--;
+   }
+
+   return &pool->magazines[index % VCOS_BLOCKPOOL_MAGAZINES];
+}
+
+/** Returns the index of the lowest bit set in a non-zero mask */
+static VCOS_UNSIGNED vcos_generic_blockpool_first_bit(uint32_t mask)
+{
+#ifdef __GNUC__
+   return __builtin_ctz(mask);
+#else
+   VCOS_UNSIGNED i = 0;
+   while (! (mask & 1))
+      mask >>= 1, i++;
+   return i;
+#endif
+}
+
 static void vcos_generic_blockpool_subpool_init(
       VCOS_BLOCKPOOL_T *pool, VCOS_BLOCKPOOL_SUBPOOL_T *subpool,
       void *mem, size_t pool_size, VCOS_UNSIGNED num_blocks, int align,
@@ -137,6 +217,45 @@ static void vcos_generic_blockpool_subpool_init(
 
 }
 
+static void vcos_generic_blockpool_magazines_create(VCOS_BLOCKPOOL_T *pool)
+{
+   VCOS_BLOCKPOOL_MAGAZINE_T *magazines;
+   VCOS_UNSIGNED i;
+
+   vcos_once(&vcos_blockpool_thread_once, vcos_generic_blockpool_thread_init);
+
+   magazines = vcos_calloc(VCOS_BLOCKPOOL_MAGAZINES, sizeof(*magazines),
+         "vcos blockpool magazines");
+   if (! magazines)
+      return;
+
+   for (i = 0; i < VCOS_BLOCKPOOL_MAGAZINES; ++i)
+   {
+      if (vcos_mutex_create(&magazines[i].mutex, "vcos blockpool magazine")
+            != VCOS_SUCCESS)
+      {
+         while (i--)
+            vcos_mutex_delete(&magazines[i].mutex);
+         vcos_free(magazines);
+         return;
+      }
+   }
+   pool->magazines = magazines;
+}
+
+static void vcos_generic_blockpool_magazines_delete(VCOS_BLOCKPOOL_T *pool)
+{
+   VCOS_UNSIGNED i;
+
+   if (! pool->magazines)
+      return;
+
+   for (i = 0; i < VCOS_BLOCKPOOL_MAGAZINES; ++i)
+      vcos_mutex_delete(&pool->magazines[i].mutex);
+   vcos_free(pool->magazines);
+   pool->magazines = NULL;
+}
+
 VCOS_STATUS_T vcos_generic_blockpool_init(VCOS_BLOCKPOOL_T *pool,
       VCOS_UNSIGNED num_blocks, VCOS_UNSIGNED block_size,
       void *start, VCOS_UNSIGNED pool_size, VCOS_UNSIGNED align,
@@ -195,6 +314,12 @@ VCOS_STATUS_T vcos_generic_blockpool_init(VCOS_BLOCKPOOL_T *pool,
 
    vcos_generic_blockpool_subpool_init(pool, &pool->subpools[0], start,
          pool_size, num_blocks, align, VCOS_BLOCKPOOL_SUBPOOL_FLAG_NONE);
+   pool->available_subpools = 1;
+
+   /* The pool still works without magazines if they can't be created */
+   pool->magazines = NULL;
+   if (num_blocks >= VCOS_BLOCKPOOL_MAGAZINE_MIN_BLOCKS)
+      vcos_generic_blockpool_magazines_create(pool);
 
    return status;
 }
@@ -261,26 +386,22 @@ VCOS_STATUS_T vcos_generic_blockpool_extend(VCOS_BLOCKPOOL_T *pool,
    return VCOS_SUCCESS;
 }
 
-void *vcos_generic_blockpool_alloc(VCOS_BLOCKPOOL_T *pool)
+/** Takes a block off the free list of the first subpool with available
+ * blocks, allocating an extension subpool if they are all full.
+ * Called with the pool mutex held. */
+static VCOS_BLOCKPOOL_HEADER_T *vcos_generic_blockpool_take(VCOS_BLOCKPOOL_T *pool)
 {
-   VCOS_UNSIGNED i;
-   void* ret = NULL;
    VCOS_BLOCKPOOL_SUBPOOL_T *subpool = NULL;
+   VCOS_BLOCKPOOL_HEADER_T *nb;
+   VCOS_UNSIGNED i;
 
-   ASSERT_POOL(pool);
-   vcos_mutex_lock(&pool->mutex);
-
-   /* Starting with the main pool try and find a free block */
-   for (i = 0; i < pool->num_subpools; ++i)
+   if (pool->available_subpools)
    {
-      if (pool->subpools[i].start && pool->subpools[i].available_blocks > 0)
-      {
-         subpool = &pool->subpools[i];
-         break; /* Found a subpool with free blocks */
-      }
+      /* Starting with the main pool, the first subpool with free blocks */
+      subpool = &pool->subpools[
+         vcos_generic_blockpool_first_bit(pool->available_subpools)];
    }
-
-   if (! subpool)
+   else
    {
       /* All current subpools are full, try to allocate a new one */
       for (i = 1; i < pool->num_subpools; ++i)
@@ -299,6 +420,7 @@ void *vcos_generic_blockpool_alloc(VCOS_BLOCKPOOL_T *pool)
                      pool->align,
                      VCOS_BLOCKPOOL_SUBPOOL_FLAG_OWNS_MEM |
                      VCOS_BLOCKPOOL_SUBPOOL_FLAG_EXTENSION);
+               pool->available_subpools |= 1 << i;
                subpool = s;
                break; /* Created a subpool */
             }
@@ -310,29 +432,122 @@ void *vcos_generic_blockpool_alloc(VCOS_BLOCKPOOL_T *pool)
       }
    }
 
-   if (subpool)
+   if (! subpool)
+      return NULL;
+
+   /* Remove from free list */
+   nb = subpool->free_list;
+   vcos_assert(subpool->free_list);
+   subpool->free_list = nb->owner.next;
+
+   /* Owner is pool so free can be called without passing pool
+    * as a parameter */
+   nb->owner.subpool = subpool;
+
+   if (--(subpool->available_blocks) == 0)
+      pool->available_subpools &= ~(1 << (subpool - pool->subpools));
+
+   vcos_assert((void *) (nb + 1) > subpool->start);
+   vcos_assert((void *) (nb + 1) < subpool->end);
+   return nb;
+}
+
+/** Puts a block back on the free list of its subpool, releasing the subpool
+ * if it was dynamically allocated and is now unused.
+ * Called with the pool mutex held. */
+static void vcos_generic_blockpool_give(VCOS_BLOCKPOOL_T *pool,
+      VCOS_BLOCKPOOL_HEADER_T *hdr)
+{
+   VCOS_BLOCKPOOL_SUBPOOL_T *subpool = VCOS_BLOCKPOOL_UNTAG(hdr->owner.subpool);
+   uint32_t bit = 1 << (subpool - pool->subpools);
+
+   vcos_assert((unsigned) subpool->available_blocks < subpool->num_blocks);
+
+   /* Change ownership of block to be the free list */
+   hdr->owner.next = subpool->free_list;
+   subpool->free_list = hdr;
+   ++(subpool->available_blocks);
+   pool->available_subpools |= bit;
+
+   if ( (subpool->flags & VCOS_BLOCKPOOL_SUBPOOL_FLAG_EXTENSION) &&
+         subpool->available_blocks == subpool->num_blocks)
+   {
+      VCOS_BLOCKPOOL_DEBUG_LOG("%s: freeing subpool %p mem %p", VCOS_FUNCTION,
+            subpool, subpool->mem);
+      /* Free the sub-pool if it was dynamically allocated */
+      vcos_free(subpool->mem);
+      subpool->mem = NULL;
+      subpool->start = NULL;
+      pool->available_subpools &= ~bit;
+   }
+}
+
+/** Takes a block out of any magazine, used when the subpools are exhausted
+ * so that blocks cached by other threads can still be allocated */
+static VCOS_BLOCKPOOL_HEADER_T *vcos_generic_blockpool_steal(VCOS_BLOCKPOOL_T *pool)
+{
+   VCOS_BLOCKPOOL_HEADER_T *nb = NULL;
+   VCOS_UNSIGNED i;
+
+   for (i = 0; i < VCOS_BLOCKPOOL_MAGAZINES && ! nb; ++i)
    {
-      /* Remove from free list */
-      VCOS_BLOCKPOOL_HEADER_T* nb = subpool->free_list;
+      VCOS_BLOCKPOOL_MAGAZINE_T *magazine = &pool->magazines[i];
 
-      vcos_assert(subpool->free_list);
-      subpool->free_list = nb->owner.next;
+      vcos_mutex_lock(&magazine->mutex);
+      if (magazine->count)
+         nb = magazine->blocks[--magazine->count];
+      vcos_mutex_unlock(&magazine->mutex);
+   }
+   return nb;
+}
+
+void *vcos_generic_blockpool_alloc(VCOS_BLOCKPOOL_T *pool)
+{
+   VCOS_BLOCKPOOL_MAGAZINE_T *magazine;
+   VCOS_BLOCKPOOL_HEADER_T *nb = NULL;
+   void *ret = NULL;
 
-      /* Owner is pool so free can be called without passing pool
-       * as a parameter */
-      nb->owner.subpool = subpool;
+   ASSERT_POOL(pool);
 
-      ret = nb + 1; /* Return pointer to block data */
-      --(subpool->available_blocks);
+   if (! pool->magazines)
+   {
+      vcos_mutex_lock(&pool->mutex);
+      nb = vcos_generic_blockpool_take(pool);
+      vcos_mutex_unlock(&pool->mutex);
+      ret = nb ? nb + 1 : NULL; /* Return pointer to block data */
+      VCOS_BLOCKPOOL_DEBUG_LOG("pool %p ret %p", pool, ret);
+      return ret;
    }
-   vcos_mutex_unlock(&pool->mutex);
-   VCOS_BLOCKPOOL_DEBUG_LOG("pool %p subpool %p ret %p", pool, subpool, ret);
 
-   if (ret)
+   magazine = vcos_generic_blockpool_magazine(pool);
+   vcos_mutex_lock(&magazine->mutex);
+   if (! magazine->count)
+   {
+      /* Refill the magazine with a batch of blocks */
+      vcos_mutex_lock(&pool->mutex);
+      while (magazine->count < VCOS_BLOCKPOOL_MAGAZINE_BATCH)
+      {
+         VCOS_BLOCKPOOL_HEADER_T *block = vcos_generic_blockpool_take(pool);
+         if (! block)
+            break;
+         block->owner.subpool = VCOS_BLOCKPOOL_TAG(block->owner.subpool);
+         magazine->blocks[magazine->count++] = block;
+      }
+      vcos_mutex_unlock(&pool->mutex);
+   }
+   if (magazine->count)
+      nb = magazine->blocks[--magazine->count];
+   vcos_mutex_unlock(&magazine->mutex);
+
+   if (! nb)
+      nb = vcos_generic_blockpool_steal(pool);
+
+   if (nb)
    {
-      vcos_assert(ret > subpool->start);
-      vcos_assert(ret < subpool->end);
+      nb->owner.subpool = VCOS_BLOCKPOOL_UNTAG(nb->owner.subpool);
+      ret = nb + 1; /* Return pointer to block data */
    }
+   VCOS_BLOCKPOOL_DEBUG_LOG("pool %p ret %p", pool, ret);
    return ret;
 }
 
@@ -351,43 +566,73 @@ void vcos_generic_blockpool_free(void *block)
    {
       VCOS_BLOCKPOOL_HEADER_T* hdr = (VCOS_BLOCKPOOL_HEADER_T*) block - 1;
       VCOS_BLOCKPOOL_SUBPOOL_T *subpool = hdr->owner.subpool;
+      VCOS_BLOCKPOOL_MAGAZINE_T *magazine;
       VCOS_BLOCKPOOL_T *pool = NULL;
 
+      /* A block sitting in a magazine has already been freed */
+      VCOS_BLOCKPOOL_ASSERT(! ((size_t) subpool & VCOS_BLOCKPOOL_CACHED));
       ASSERT_SUBPOOL(subpool);
       pool = subpool->owner;
       ASSERT_POOL(pool);
 
-      vcos_mutex_lock(&pool->mutex);
-      vcos_assert((unsigned) subpool->available_blocks < subpool->num_blocks);
-
-      /* Change ownership of block to be the free list */
-      hdr->owner.next = subpool->free_list;
-      subpool->free_list = hdr;
-      ++(subpool->available_blocks);
-
       if (VCOS_BLOCKPOOL_OVERWRITE_ON_FREE)
          memset(block, 0xBD, pool->block_data_size); /* For debugging */
 
-      if ( (subpool->flags & VCOS_BLOCKPOOL_SUBPOOL_FLAG_EXTENSION) &&
-            subpool->available_blocks == subpool->num_blocks)
+      if (! pool->magazines)
       {
-         VCOS_BLOCKPOOL_DEBUG_LOG("%s: freeing subpool %p mem %p", VCOS_FUNCTION,
-               subpool, subpool->mem);
-         /* Free the sub-pool if it was dynamically allocated */
-         vcos_free(subpool->mem);
-         subpool->mem = NULL;
-         subpool->start = NULL;
+         vcos_mutex_lock(&pool->mutex);
+         vcos_generic_blockpool_give(pool, hdr);
+         vcos_mutex_unlock(&pool->mutex);
+         return;
       }
-      vcos_mutex_unlock(&pool->mutex);
+
+      magazine = vcos_generic_blockpool_magazine(pool);
+      vcos_mutex_lock(&magazine->mutex);
+      if (magazine->count == VCOS_BLOCKPOOL_MAGAZINE_SIZE)
+      {
+         /* Flush the least recently freed half of the magazine */
+         VCOS_UNSIGNED i;
+
+         vcos_mutex_lock(&pool->mutex);
+         for (i = 0; i < VCOS_BLOCKPOOL_MAGAZINE_BATCH; ++i)
+            vcos_generic_blockpool_give(pool, magazine->blocks[i]);
+         vcos_mutex_unlock(&pool->mutex);
+
+         magazine->count -= VCOS_BLOCKPOOL_MAGAZINE_BATCH;
+         memmove(magazine->blocks, magazine->blocks + VCOS_BLOCKPOOL_MAGAZINE_BATCH,
+               magazine->count * sizeof(magazine->blocks[0]));
+      }
+      hdr->owner.subpool = VCOS_BLOCKPOOL_TAG(subpool);
+      magazine->blocks[magazine->count++] = hdr;
+      vcos_mutex_unlock(&magazine->mutex);
    }
 }
 
+/** Number of blocks held by the magazines */
+static VCOS_UNSIGNED vcos_generic_blockpool_cached_count(VCOS_BLOCKPOOL_T *pool)
+{
+   VCOS_UNSIGNED ret = 0;
+   VCOS_UNSIGNED i;
+
+   if (! pool->magazines)
+      return 0;
+
+   for (i = 0; i < VCOS_BLOCKPOOL_MAGAZINES; ++i)
+   {
+      vcos_mutex_lock(&pool->magazines[i].mutex);
+      ret += pool->magazines[i].count;
+      vcos_mutex_unlock(&pool->magazines[i].mutex);
+   }
+   return ret;
+}
+
 VCOS_UNSIGNED vcos_generic_blockpool_available_count(VCOS_BLOCKPOOL_T *pool)
 {
    VCOS_UNSIGNED ret = 0;
    VCOS_UNSIGNED i;
 
    ASSERT_POOL(pool);
+   ret = vcos_generic_blockpool_cached_count(pool);
    vcos_mutex_lock(&pool->mutex);
    for (i = 0; i < pool->num_subpools; ++i)
    {
@@ -408,8 +653,11 @@ VCOS_UNSIGNED vcos_generic_blockpool_used_count(VCOS_BLOCKPOOL_T *pool)
 {
    VCOS_UNSIGNED ret = 0;
    VCOS_UNSIGNED i;
+   VCOS_UNSIGNED cached;
 
    ASSERT_POOL(pool);
+   /* Blocks in the magazines are still counted as used by their subpool */
+   cached = vcos_generic_blockpool_cached_count(pool);
    vcos_mutex_lock(&pool->mutex);
 
    for (i = 0; i < pool->num_subpools; ++i)
@@ -420,7 +668,7 @@ VCOS_UNSIGNED vcos_generic_blockpool_used_count(VCOS_BLOCKPOOL_T *pool)
          ret += (subpool->num_blocks - subpool->available_blocks);
    }
    vcos_mutex_unlock(&pool->mutex);
-   return ret;
+   return ret > cached ? ret - cached : 0;
 }
 
 void vcos_generic_blockpool_delete(VCOS_BLOCKPOOL_T *pool)
@@ -450,6 +698,7 @@ void vcos_generic_blockpool_delete(VCOS_BLOCKPOOL_T *pool)
             subpool->start = NULL;
          }
       }
+      vcos_generic_blockpool_magazines_delete(pool);
       vcos_mutex_delete(&pool->mutex);
       memset(pool, 0xBE, sizeof(VCOS_BLOCKPOOL_T)); /* For debugging */
    }
@@ -471,10 +720,10 @@ uint32_t vcos_generic_blockpool_elem_to_handle(void *block)
 
    pool = subpool->owner;
    ASSERT_POOL(pool);
-   vcos_mutex_lock(&pool->mutex);
 
    /* The handle is the index into the array of blocks combined
-    * with the subpool id.
+    * with the subpool id. The subpool can't go away while one of its
+    * blocks is allocated so the pool mutex isn't needed.
     */
    index = ((size_t) hdr - (size_t) subpool->start) / pool->block_size;
    vcos_assert(index < subpool->num_blocks);
@@ -489,7 +738,6 @@ uint32_t vcos_generic_blockpool_elem_to_handle(void *block)
    vcos_log_trace("%s: index %d subpool_id %d handle 0x%08x",
          VCOS_FUNCTION, index, subpool_id, ret);
 
-   vcos_mutex_unlock(&pool->mutex);
    return ret;
 }
 
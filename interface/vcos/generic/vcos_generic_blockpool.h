@@ -127,6 +127,11 @@ typedef struct VCOS_BLOCKPOOL_TAG
     * subpool[index.mem] is null then the subpool entry is valid but
     * "not currently allocated" */
    VCOS_BLOCKPOOL_SUBPOOL_T subpools[VCOS_BLOCKPOOL_MAX_SUBPOOLS];
+   /** Bit mask of the allocated subpools which have available blocks */
+   uint32_t available_subpools;
+   /** Caches of free blocks used by threads without taking the pool mutex,
+    * or NULL if the pool is too small for them to be worthwhile */
+   struct VCOS_BLOCKPOOL_MAGAZINE_TAG *magazines;
 } VCOS_BLOCKPOOL_T;
 
 #define VCOS_BLOCKPOOL_ROUND_UP(x,s)   (((x) + ((s) - 1)) & ~((s) - 1))
@@ -30,9 +30,13 @@ VideoCore OS Abstraction Layer - memory alloc implementation
 =============================================================================*/
 
 #include "interface/vcos/vcos.h"
+#include "interface/vcos/vcos_cmd.h"
 
-#ifndef _vcos_platform_malloc
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+
+#ifndef _vcos_platform_malloc
 #define _vcos_platform_malloc malloc
 #define _vcos_platform_free   free
 #endif
@@ -48,6 +52,117 @@ typedef struct malloc_header_s {
 #define MIN_ALIGN sizeof(MALLOC_HEADER_T)
 
 #define GUARDWORDHEAP  0xa55a5aa5
+/* Guard word of blocks allocated while accounting was enabled, so that
+ * they are removed from the counters when freed even if accounting has been
+ * disabled since, and blocks allocated before it was enabled aren't */
+#define GUARDWORDHEAP_COUNTED  0xa55a5aa6
+
+/******************************************************************************
+Memory accounting.
+
+Allocations are counted per description. Descriptions are looked up by
+address in a fixed size open addressing table, so that allocating and freeing
+only costs a hash and a few atomic operations and never takes a lock, and
+their text is copied when first seen as it may not outlive the allocation.
+Descriptions which don't fit in the table are counted together.
+******************************************************************************/
+
+#define MEM_STATS_ENTRIES       512
+#define MEM_STATS_NAME_LEN      32
+/** Bucket 0 counts allocations of less than 32 bytes, bucket n those from
+ * (16 << n) to (32 << n) - 1 bytes and the last bucket all the larger ones */
+#define MEM_STATS_BUCKETS       16
+
+typedef struct mem_stats_entry_s {
+   const char *key;                 /**< Description address, NULL if unused */
+   int ready;                       /**< Set once the name has been copied */
+   char name[MEM_STATS_NAME_LEN];
+   size_t live_bytes;
+   size_t peak_bytes;
+   uint32_t live_count;
+   uint32_t allocs;
+   uint32_t frees;
+   uint32_t histogram[MEM_STATS_BUCKETS];
+   uint32_t reported_allocs;        /**< allocs at the previous report */
+} MEM_STATS_ENTRY_T;
+
+static struct {
+   VCOS_ONCE_T once;
+   VCOS_MUTEX_T lock;               /**< Serialises enabling and reports */
+   int enabled;
+   int dump_at_exit;
+   uint64_t start_time;             /**< When accounting was first enabled */
+   uint64_t report_time;            /**< When the previous report was made */
+   MEM_STATS_ENTRY_T entries[MEM_STATS_ENTRIES];
+   MEM_STATS_ENTRY_T overflow;
+} mem_stats = { VCOS_ONCE_INIT };
+
+static void mem_stats_init(void)
+{
+   vcos_demand(vcos_mutex_create(&mem_stats.lock, "vcos_mem_stats") == VCOS_SUCCESS);
+}
+
+static MEM_STATS_ENTRY_T *mem_stats_lookup(const char *desc)
+{
+   const char *key = desc ? desc : "(none)";
+   size_t hash = (size_t)key;
+   unsigned int i, n;
+
+   hash ^= hash >> 15;
+   hash *= 0x9e3779b1;
+   i = (unsigned int)(hash >> 7) % MEM_STATS_ENTRIES;
+
+   for (n = 0; n < MEM_STATS_ENTRIES; n++, i = (i + 1) % MEM_STATS_ENTRIES)
+   {
+      MEM_STATS_ENTRY_T *entry = &mem_stats.entries[i];
+      const char *current = __atomic_load_n(&entry->key, __ATOMIC_ACQUIRE);
+
+      if (current == key)
+         return entry;
+      if (!current)
+      {
+         if (__atomic_compare_exchange_n(&entry->key, &current, key, 0,
+                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+         {
+            strncpy(entry->name, key, MEM_STATS_NAME_LEN - 1);
+            __atomic_store_n(&entry->ready, 1, __ATOMIC_RELEASE);
+            return entry;
+         }
+         if (current == key)
+            return entry;
+      }
+   }
+   return &mem_stats.overflow;
+}
+
+static void mem_stats_alloc(const char *desc, uint32_t size)
+{
+   MEM_STATS_ENTRY_T *entry = mem_stats_lookup(desc);
+   size_t live = __atomic_add_fetch(&entry->live_bytes, size, __ATOMIC_RELAXED);
+   size_t peak = __atomic_load_n(&entry->peak_bytes, __ATOMIC_RELAXED);
+   unsigned int bucket = 0;
+
+   while (peak < live &&
+         !__atomic_compare_exchange_n(&entry->peak_bytes, &peak, live, 1,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      continue;
+
+   while ((size >> (bucket + 5)) && bucket < MEM_STATS_BUCKETS - 1)
+      bucket++;
+
+   __atomic_add_fetch(&entry->live_count, 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&entry->allocs, 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&entry->histogram[bucket], 1, __ATOMIC_RELAXED);
+}
+
+static void mem_stats_free(const char *desc, uint32_t size)
+{
+   MEM_STATS_ENTRY_T *entry = mem_stats_lookup(desc);
+
+   __atomic_sub_fetch(&entry->live_bytes, size, __ATOMIC_RELAXED);
+   __atomic_sub_fetch(&entry->live_count, 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&entry->frees, 1, __ATOMIC_RELAXED);
+}
 
 void *vcos_generic_mem_alloc_aligned(VCOS_UNSIGNED size, VCOS_UNSIGNED align, const char *desc)
 {
@@ -65,6 +180,12 @@ void *vcos_generic_mem_alloc_aligned(VCOS_UNSIGNED size, VCOS_UNSIGNED align, co
       h->description = desc;
       h->guardword = GUARDWORDHEAP;
       h->ptr = ptr;
+
+      if (__atomic_load_n(&mem_stats.enabled, __ATOMIC_RELAXED))
+      {
+         h->guardword = GUARDWORDHEAP_COUNTED;
+         mem_stats_alloc(desc, size);
+      }
    }
 
    return ret;
@@ -92,7 +213,210 @@ void vcos_generic_mem_free(void *ptr)
    if (! ptr) return;
 
    h = ((MALLOC_HEADER_T *)ptr)-1;
-   vcos_assert(h->guardword == GUARDWORDHEAP);
+   if (h->guardword == GUARDWORDHEAP_COUNTED)
+      mem_stats_free(h->description, h->size);
+   else
+      vcos_assert(h->guardword == GUARDWORDHEAP);
    _vcos_platform_free(h->ptr);
 }
 
+/******************************************************************************
+Memory accounting reports.
+******************************************************************************/
+
+typedef void (*MEM_STATS_PRINT_T)(void *context, const char *fmt, ...);
+
+static int mem_stats_compare_live(const void *a, const void *b)
+{
+   size_t la = (*(MEM_STATS_ENTRY_T *const *)a)->live_bytes;
+   size_t lb = (*(MEM_STATS_ENTRY_T *const *)b)->live_bytes;
+   return la < lb ? 1 : la > lb ? -1 : 0;
+}
+
+static int mem_stats_compare_churn(const void *a, const void *b)
+{
+   const MEM_STATS_ENTRY_T *ea = *(MEM_STATS_ENTRY_T *const *)a;
+   const MEM_STATS_ENTRY_T *eb = *(MEM_STATS_ENTRY_T *const *)b;
+   uint32_t ca = ea->allocs - ea->reported_allocs;
+   uint32_t cb = eb->allocs - eb->reported_allocs;
+   return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+/** Prints the counters of every description, sorted by live bytes or by
+ * allocations since the previous report (churn). */
+static void mem_stats_report(MEM_STATS_PRINT_T print, void *context, int churn)
+{
+   static MEM_STATS_ENTRY_T *sorted[MEM_STATS_ENTRIES + 1];
+   uint64_t now = vcos_getmicrosecs64();
+   uint64_t total_time, interval;
+   unsigned int i, n = 0;
+
+   vcos_once(&mem_stats.once, mem_stats_init);
+   vcos_mutex_lock(&mem_stats.lock);
+
+   if (!mem_stats.start_time)
+   {
+      vcos_mutex_unlock(&mem_stats.lock);
+      print(context, "Memory accounting has not been enabled\n");
+      return;
+   }
+
+   total_time = now - mem_stats.start_time;
+   interval = now - mem_stats.report_time;
+   mem_stats.report_time = now;
+   if (!total_time) total_time = 1;
+   if (!interval) interval = 1;
+
+   for (i = 0; i < MEM_STATS_ENTRIES; i++)
+      if (__atomic_load_n(&mem_stats.entries[i].ready, __ATOMIC_ACQUIRE))
+         sorted[n++] = &mem_stats.entries[i];
+   if (mem_stats.overflow.allocs)
+   {
+      strcpy(mem_stats.overflow.name, "(overflow)");
+      sorted[n++] = &mem_stats.overflow;
+   }
+
+   qsort(sorted, n, sizeof(sorted[0]),
+         churn ? mem_stats_compare_churn : mem_stats_compare_live);
+
+   print(context, "%-31s %10s %10s %8s %10s %10s %10s\n", "description",
+         "live", "peak", "blocks", "allocs", "allocs/s", "recent/s");
+   for (i = 0; i < n; i++)
+   {
+      MEM_STATS_ENTRY_T *entry = sorted[i];
+      uint32_t allocs = __atomic_load_n(&entry->allocs, __ATOMIC_RELAXED);
+      unsigned int b;
+
+      print(context, "%-31s %10lu %10lu %8u %10u %10lu %10lu\n", entry->name,
+            (unsigned long)__atomic_load_n(&entry->live_bytes, __ATOMIC_RELAXED),
+            (unsigned long)__atomic_load_n(&entry->peak_bytes, __ATOMIC_RELAXED),
+            __atomic_load_n(&entry->live_count, __ATOMIC_RELAXED),
+            allocs,
+            (unsigned long)(allocs * (uint64_t)1000000 / total_time),
+            (unsigned long)((allocs - entry->reported_allocs) *
+               (uint64_t)1000000 / interval));
+
+      print(context, "   sizes:");
+      for (b = 0; b < MEM_STATS_BUCKETS; b++)
+      {
+         uint32_t count = __atomic_load_n(&entry->histogram[b], __ATOMIC_RELAXED);
+         if (!count)
+            continue;
+         if (b == 0)
+            print(context, " <32:%u", count);
+         else if (b == MEM_STATS_BUCKETS - 1)
+            print(context, " >=%u:%u", 16u << b, count);
+         else
+            print(context, " %u:%u", 16u << b, count);
+      }
+      print(context, "\n");
+      entry->reported_allocs = allocs;
+   }
+
+   vcos_mutex_unlock(&mem_stats.lock);
+}
+
+static void mem_stats_print_file(void *context, const char *fmt, ...)
+{
+   va_list args;
+   va_start(args, fmt);
+   vfprintf((FILE *)context, fmt, args);
+   va_end(args);
+}
+
+static void mem_stats_dump_at_exit(void)
+{
+   if (mem_stats.dump_at_exit)
+      mem_stats_report(mem_stats_print_file, stderr, 0);
+}
+
+#if VCOS_HAVE_CMD
+
+static void mem_stats_print_cmd(void *context, const char *fmt, ...)
+{
+   va_list args;
+   va_start(args, fmt);
+   vcos_cmd_vprintf((VCOS_CMD_PARAM_T *)context, fmt, args);
+   va_end(args);
+}
+
+static VCOS_STATUS_T mem_stats_status_cmd(VCOS_CMD_PARAM_T *param)
+{
+   int churn = 0;
+
+   if (param->argc > 2 || (param->argc == 2 && strcmp(param->argv[1], "churn")))
+   {
+      vcos_cmd_usage(param);
+      return VCOS_EINVAL;
+   }
+   if (param->argc == 2)
+      churn = 1;
+
+   mem_stats_report(mem_stats_print_cmd, param, churn);
+   return VCOS_SUCCESS;
+}
+
+static VCOS_STATUS_T mem_stats_enable_cmd(VCOS_CMD_PARAM_T *param)
+{
+   vcos_generic_mem_stats_enable(0);
+   vcos_cmd_printf(param, "Memory accounting enabled\n");
+   return VCOS_SUCCESS;
+}
+
+static VCOS_STATUS_T mem_stats_disable_cmd(VCOS_CMD_PARAM_T *param)
+{
+   vcos_generic_mem_stats_disable();
+   vcos_cmd_printf(param, "Memory accounting disabled\n");
+   return VCOS_SUCCESS;
+}
+
+static VCOS_CMD_T mem_cmd_entry[] =
+{
+    { "disable",  "",                  mem_stats_disable_cmd, NULL,  "Stops counting new allocations" },
+    { "enable",   "",                  mem_stats_enable_cmd,  NULL,  "Starts counting allocations" },
+    { "status",   "[churn]",           mem_stats_status_cmd,  NULL,  "Prints allocations per description, by live bytes or by recent allocation rate" },
+
+    { NULL,       NULL,                NULL,                  NULL,  NULL }
+};
+
+static VCOS_CMD_T cmd_mem =
+    { "mem",        "command [args]",  NULL,    mem_cmd_entry, "Commands related to vcos memory accounting" };
+
+#endif
+
+void vcos_generic_mem_stats_enable(int dump_at_exit)
+{
+   int first;
+
+   vcos_once(&mem_stats.once, mem_stats_init);
+   vcos_mutex_lock(&mem_stats.lock);
+   first = !mem_stats.start_time;
+   if (first)
+   {
+      mem_stats.start_time = vcos_getmicrosecs64();
+      mem_stats.report_time = mem_stats.start_time;
+   }
+   if (dump_at_exit && !mem_stats.dump_at_exit)
+   {
+      mem_stats.dump_at_exit = 1;
+      atexit(mem_stats_dump_at_exit);
+   }
+   vcos_mutex_unlock(&mem_stats.lock);
+
+   __atomic_store_n(&mem_stats.enabled, 1, __ATOMIC_RELAXED);
+
+#if VCOS_HAVE_CMD
+   if (first)
+      vcos_cmd_register(&cmd_mem);
+#endif
+}
+
+void vcos_generic_mem_stats_disable(void)
+{
+   __atomic_store_n(&mem_stats.enabled, 0, __ATOMIC_RELAXED);
+}
+
+void vcos_generic_mem_stats_dump(void)
+{
+   mem_stats_report(mem_stats_print_file, stderr, 0);
+}
@@ -46,6 +46,25 @@ VCOSPRE_  void * VCOSPOST_ vcos_generic_mem_calloc(VCOS_UNSIGNED count, VCOS_UNS
 VCOSPRE_  void VCOSPOST_   vcos_generic_mem_free(void *ptr);
 VCOSPRE_  void * VCOSPOST_ vcos_generic_mem_alloc_aligned(VCOS_UNSIGNED sz, VCOS_UNSIGNED align, const char *desc);
 
+/**
+  * Start counting allocations per description: live and peak bytes, number
+  * of allocations and a histogram of their sizes. Only blocks allocated while
+  * accounting is enabled are counted. The first call registers a "mem" vcos
+  * command to query the counters.
+  *
+  * @param dump_at_exit  If non-zero, print the counters to stderr when the
+  *                      process exits.
+  */
+VCOSPRE_  void VCOSPOST_   vcos_generic_mem_stats_enable(int dump_at_exit);
+
+/** Stop counting new allocations. Blocks already counted are still
+  * removed from the counters when freed. */
+VCOSPRE_  void VCOSPOST_   vcos_generic_mem_stats_disable(void);
+
+/** Print the counters of every description to stderr, largest live
+  * allocations first. */
+VCOSPRE_  void VCOSPOST_   vcos_generic_mem_stats_dump(void);
+
 #ifdef VCOS_INLINE_BODIES
 
 VCOS_INLINE_IMPL
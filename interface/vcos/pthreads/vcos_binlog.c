@@ -0,0 +1,1237 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Asynchronous logging backend.
+ *
+ * vcos_vlog_binary_impl() doesn't format anything. It walks the format string
+ * to find out the type of each argument, then copies the arguments, the
+ * format pointer and a timestamp into a single-producer/single-consumer ring
+ * buffer owned by the calling thread. A background thread drains the ring
+ * buffers of all the threads in timestamp order and either formats the
+ * messages, or writes them to a compact binary log in which formats,
+ * categories and threads are described once and then referred to by id.
+ */
+
+#include "interface/vcos/vcos.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Cygwin doesn't always have prctl.h and it doesn't have PR_GET_NAME */
+#if defined( __linux__ )
+# if !defined(HAVE_PRCTL)
+#  define HAVE_PRCTL
+# endif
+#include <sys/prctl.h>
+#endif
+
+/** Default size of the ring buffer of each thread */
+#define VCOS_BINLOG_RING_SIZE_DEFAULT (64*1024)
+#define VCOS_BINLOG_RING_SIZE_MIN     (4*1024)
+#define VCOS_BINLOG_RING_SIZE_MAX     (16*1024*1024)
+/** Maximum size of the recorded arguments of a message */
+#define VCOS_BINLOG_ARGS_MAX          1024
+/** Strings longer than this are truncated when recorded */
+#define VCOS_BINLOG_STRING_MAX        256
+/** Maximum length of a formatted message */
+#define VCOS_BINLOG_LINE_MAX          1024
+/** Maximum number of arguments recorded per message */
+#define VCOS_BINLOG_FORMAT_ARGS       32
+/** Number of parsed format strings cached by each thread */
+#define VCOS_BINLOG_FORMATS           64
+/** Period at which the ring buffers are drained when they aren't filling up */
+#define VCOS_BINLOG_PERIOD_MS         10
+
+#define VCOS_BINLOG_MAGIC             "VCOSBLOG"
+#define VCOS_BINLOG_VERSION           1
+#define VCOS_BINLOG_BYTE_ORDER        0x01020304
+
+#define VCOS_BINLOG_ALIGN(x) (((x) + 7) & ~7)
+
+/** Precision of a string conversion given by the argument before the string */
+#define BINLOG_PRECISION_ARG          0xffff
+/** Ids above this in a binary log are ignored by the decoder */
+#define BINLOG_TABLE_ID_MAX           (1 << 20)
+
+/** Type of the argument consumed by a conversion specification */
+typedef enum {
+   BINLOG_ARG_NONE,           /**< %% */
+   BINLOG_ARG_IGNORED,        /**< %n, which takes a pointer we don't record */
+   BINLOG_ARG_INT,
+   BINLOG_ARG_UINT,
+   BINLOG_ARG_DOUBLE,
+   BINLOG_ARG_POINTER,
+   BINLOG_ARG_STRING,
+   BINLOG_ARG_INVALID         /**< We don't know what the remaining arguments are */
+} BINLOG_ARG_T;
+
+typedef enum {
+   BINLOG_LENGTH_NONE,
+   BINLOG_LENGTH_HH,
+   BINLOG_LENGTH_H,
+   BINLOG_LENGTH_L,
+   BINLOG_LENGTH_LL,
+   BINLOG_LENGTH_INTMAX,
+   BINLOG_LENGTH_SIZE,
+   BINLOG_LENGTH_PTRDIFF,
+   BINLOG_LENGTH_LONG_DOUBLE
+} BINLOG_LENGTH_T;
+
+/** A parsed conversion specification */
+typedef struct BINLOG_SPEC_T
+{
+   size_t size;               /**< Size of the whole specification */
+   size_t prefix;             /**< Size of the '%', flags, width and precision */
+   unsigned int stars;        /**< Number of '*' in the width and precision */
+   int precision;             /**< Precision, -1 if there is none, BINLOG_PRECISION_ARG for '*' */
+   BINLOG_LENGTH_T length;
+   BINLOG_ARG_T arg;
+   char conversion;
+} BINLOG_SPEC_T;
+
+/** Type of the arguments of a format string */
+typedef struct BINLOG_FORMAT_T
+{
+   const char *fmt;
+   unsigned int count;
+   uint8_t args[VCOS_BINLOG_FORMAT_ARGS]; /**< BINLOG_ARG_T | BINLOG_LENGTH_T << 4 */
+   uint16_t precision[VCOS_BINLOG_FORMAT_ARGS]; /**< Strings: maximum number of characters read */
+} BINLOG_FORMAT_T;
+
+/** Header of a message in a ring buffer, followed by the arguments */
+typedef struct BINLOG_HEADER_T
+{
+   uint64_t time;
+   const VCOS_LOG_CAT_T *cat;
+   const char *fmt;
+   uint32_t size;             /**< Size of the arguments */
+   uint32_t level;
+} BINLOG_HEADER_T;
+
+/** Ring buffer of the messages logged by a thread */
+typedef struct BINLOG_RING_T
+{
+   uint32_t head;             /**< Written by the owning thread only */
+   uint32_t dropped;          /**< Messages dropped, written by the owning thread only */
+   uint32_t tail;             /**< Written by the drainer only */
+   uint32_t size;             /**< Size of the data, a power of 2 */
+   int dead;                  /**< Set once the owning thread has exited */
+
+   /* Only used by the drainer */
+   uint32_t limit;            /**< End of the messages to drain in this pass */
+   uint32_t dropped_reported;
+   int announced;             /**< The thread has been described in the binary log */
+   int peeked;                /**< next holds the header of the next message */
+   BINLOG_HEADER_T next;
+
+   /* Only used by the owning thread */
+   BINLOG_FORMAT_T formats[VCOS_BINLOG_FORMATS];
+
+   uint32_t id;
+   char name[16];
+   struct BINLOG_RING_T *next_ring;
+   uint8_t *data;
+} BINLOG_RING_T;
+
+/** Assigns ids to the formats and categories written to the binary log */
+typedef struct BINLOG_MAP_T
+{
+   struct {
+      const void *key;
+      uint32_t id;
+   } *entries;
+   uint32_t size;
+   uint32_t count;
+} BINLOG_MAP_T;
+
+/** Binary log file layout: a BINLOG_FILE_HEADER_T followed by records, each
+ * made of a BINLOG_FILE_RECORD_T and its payload. Values are in native byte
+ * order, which the header records. */
+typedef struct BINLOG_FILE_HEADER_T
+{
+   char magic[8];
+   uint32_t version;
+   uint32_t byte_order;
+} BINLOG_FILE_HEADER_T;
+
+typedef enum {
+   BINLOG_RECORD_FORMAT = 1,  /**< payload is the format string */
+   BINLOG_RECORD_CATEGORY,    /**< payload is a flags byte then the name */
+   BINLOG_RECORD_THREAD,      /**< payload is the thread name */
+   BINLOG_RECORD_MESSAGE,     /**< payload is a BINLOG_FILE_MESSAGE_T then the arguments */
+   BINLOG_RECORD_DROPPED      /**< payload is the number of messages dropped */
+} BINLOG_RECORD_T;
+
+#define BINLOG_CATEGORY_PREFIX 1
+
+typedef struct BINLOG_FILE_RECORD_T
+{
+   uint16_t type;
+   uint16_t size;             /**< Size of the payload */
+   uint32_t id;               /**< Id being defined, or thread of the message */
+} BINLOG_FILE_RECORD_T;
+
+typedef struct BINLOG_FILE_MESSAGE_T
+{
+   uint64_t time;
+   uint32_t category;
+   uint32_t format;
+   uint32_t level;
+   uint32_t reserved;
+} BINLOG_FILE_MESSAGE_T;
+
+typedef enum {
+   BINLOG_STATE_STOPPED,
+   BINLOG_STATE_CHANGING,
+   BINLOG_STATE_RUNNING
+} BINLOG_STATE_T;
+
+static struct
+{
+   pthread_once_t once;
+   pthread_mutex_t lock;      /**< Protects the list of rings and drainer_running */
+   pthread_key_t key;         /**< Ring buffer of the current thread */
+   int key_created;
+
+   int state;                 /**< One of BINLOG_STATE_T */
+   int enabled;               /**< Set while messages can be recorded */
+   int writers;               /**< Number of threads currently recording a message */
+
+   BINLOG_RING_T *rings;
+   uint32_t ring_size;        /**< Size of the ring buffers of new threads */
+   uint32_t next_id;
+   int drainer_running;
+
+   VCOS_THREAD_T drainer;
+   VCOS_SEMAPHORE_T wake;     /**< Wakes up the drainer before its period */
+   int wake_pending;
+   int quit;
+
+   /* Only used by the drainer */
+   FILE *file;                /**< Binary log, or NULL to format the messages */
+   BINLOG_MAP_T formats;
+   BINLOG_MAP_T categories;
+   BINLOG_RING_T **drain;     /**< Rings being drained */
+   unsigned int drain_size;
+} binlog = { PTHREAD_ONCE_INIT, PTHREAD_MUTEX_INITIALIZER };
+
+static VCOS_LOG_CAT_T binlog_category = { VCOS_LOG_WARN, "vcos_binlog" };
+
+/*****************************************************************************
+ * Format strings
+ *****************************************************************************/
+
+/** Parse the conversion specification starting at p, which points to a '%' */
+static void binlog_parse_spec(const char *p, BINLOG_SPEC_T *spec)
+{
+   const char *q = p + 1;
+
+   spec->stars = 0;
+   spec->precision = -1;
+   spec->length = BINLOG_LENGTH_NONE;
+
+   while (*q && strchr("-+ #0'", *q))
+      q++;
+   if (*q == '*')
+      q++, spec->stars++;
+   else while (*q >= '0' && *q <= '9')
+      q++;
+   if (*q == '.')
+   {
+      q++;
+      spec->precision = 0;
+      if (*q == '*')
+         q++, spec->stars++, spec->precision = BINLOG_PRECISION_ARG;
+      else while (*q >= '0' && *q <= '9')
+      {
+         if (spec->precision < VCOS_BINLOG_STRING_MAX)
+            spec->precision = spec->precision * 10 + *q - '0';
+         q++;
+      }
+   }
+   spec->prefix = q - p;
+
+   switch (*q)
+   {
+   case 'h':
+      q++;
+      spec->length = BINLOG_LENGTH_H;
+      if (*q == 'h')
+         q++, spec->length = BINLOG_LENGTH_HH;
+      break;
+   case 'l':
+      q++;
+      spec->length = BINLOG_LENGTH_L;
+      if (*q == 'l')
+         q++, spec->length = BINLOG_LENGTH_LL;
+      break;
+   case 'q': q++; spec->length = BINLOG_LENGTH_LL; break;
+   case 'j': q++; spec->length = BINLOG_LENGTH_INTMAX; break;
+   case 'z': q++; spec->length = BINLOG_LENGTH_SIZE; break;
+   case 't': q++; spec->length = BINLOG_LENGTH_PTRDIFF; break;
+   case 'L': q++; spec->length = BINLOG_LENGTH_LONG_DOUBLE; break;
+   default: break;
+   }
+
+   spec->conversion = *q;
+   switch (*q)
+   {
+   case 'd': case 'i': case 'c':
+      spec->arg = BINLOG_ARG_INT; break;
+   case 'o': case 'u': case 'x': case 'X':
+      spec->arg = BINLOG_ARG_UINT; break;
+   case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+      spec->arg = BINLOG_ARG_DOUBLE; break;
+   case 'p':
+      spec->arg = BINLOG_ARG_POINTER; break;
+   case 's':
+      spec->arg = BINLOG_ARG_STRING; break;
+   case 'n':
+      spec->arg = BINLOG_ARG_IGNORED; break;
+   case '%':
+      spec->arg = BINLOG_ARG_NONE; break;
+   default:
+      spec->arg = BINLOG_ARG_INVALID; break;
+   }
+   if (*q)
+      q++;
+   spec->size = q - p;
+}
+
+static size_t binlog_put_number(uint8_t *args, size_t max, size_t pos, uint64_t value)
+{
+   if (max - pos < sizeof(value))
+      return max;
+   memcpy(args + pos, &value, sizeof(value));
+   return pos + sizeof(value);
+}
+
+/** Record a string of at most precision characters. Only these characters
+ * are read, since the string doesn't have to be terminated within them. */
+static size_t binlog_put_string(uint8_t *args, size_t max, size_t pos, const char *string,
+   size_t precision)
+{
+   uint16_t size;
+
+   if (max - pos < sizeof(size))
+      return max;
+   size = (uint16_t)strnlen(string, precision);
+   if (size > max - pos - sizeof(size))
+      size = (uint16_t)(max - pos - sizeof(size));
+   memcpy(args + pos, &size, sizeof(size));
+   memcpy(args + pos + sizeof(size), string, size);
+   return pos + sizeof(size) + size;
+}
+
+/** Work out the type of the arguments consumed by a format string */
+static void binlog_compile(BINLOG_FORMAT_T *format, const char *fmt)
+{
+   BINLOG_SPEC_T spec;
+   const char *p;
+   unsigned int i;
+
+   format->fmt = fmt;
+   format->count = 0;
+
+   for (p = strchr(fmt, '%'); p; p = strchr(p + spec.size, '%'))
+   {
+      binlog_parse_spec(p, &spec);
+      if (spec.arg == BINLOG_ARG_INVALID)
+         return;
+
+      for (i = 0; i < spec.stars && format->count < VCOS_BINLOG_FORMAT_ARGS; i++)
+         format->args[format->count++] = BINLOG_ARG_INT;
+      if (spec.arg != BINLOG_ARG_NONE && format->count < VCOS_BINLOG_FORMAT_ARGS)
+      {
+         format->precision[format->count] = spec.precision < 0 ? VCOS_BINLOG_STRING_MAX :
+            spec.precision == BINLOG_PRECISION_ARG ? BINLOG_PRECISION_ARG :
+            spec.precision > VCOS_BINLOG_STRING_MAX ? VCOS_BINLOG_STRING_MAX : (uint16_t)spec.precision;
+         format->args[format->count++] = (uint8_t)(spec.arg | spec.length << 4);
+      }
+   }
+}
+
+/** Record the arguments of a message. Integers, floating point values and
+ * pointers are stored as 64 bits values, strings as a 16 bits size followed
+ * by the characters. Returns the size of the recorded arguments. */
+static size_t binlog_encode(uint8_t *args, size_t max, const BINLOG_FORMAT_T *format, va_list ap)
+{
+   size_t pos = 0;
+   int64_t last_int = -1;     /* Last int recorded, the precision of a "%.*s" */
+   unsigned int i;
+
+   for (i = 0; i < format->count && pos < max; i++)
+   {
+      BINLOG_LENGTH_T length = (BINLOG_LENGTH_T)(format->args[i] >> 4);
+      int64_t value = 0;
+
+      switch ((BINLOG_ARG_T)(format->args[i] & 0xf))
+      {
+      case BINLOG_ARG_INT:
+         switch (length)
+         {
+         case BINLOG_LENGTH_HH:      value = (signed char)va_arg(ap, int); break;
+         case BINLOG_LENGTH_H:       value = (short)va_arg(ap, int); break;
+         case BINLOG_LENGTH_L:       value = va_arg(ap, long); break;
+         case BINLOG_LENGTH_LL:      value = va_arg(ap, long long); break;
+         case BINLOG_LENGTH_INTMAX:  value = va_arg(ap, intmax_t); break;
+         case BINLOG_LENGTH_SIZE:    value = va_arg(ap, ssize_t); break;
+         case BINLOG_LENGTH_PTRDIFF: value = va_arg(ap, ptrdiff_t); break;
+         default:                    value = va_arg(ap, int); break;
+         }
+         pos = binlog_put_number(args, max, pos, (uint64_t)value);
+         last_int = value;
+         break;
+      case BINLOG_ARG_UINT:
+         switch (length)
+         {
+         case BINLOG_LENGTH_HH:      value = (unsigned char)va_arg(ap, unsigned int); break;
+         case BINLOG_LENGTH_H:       value = (unsigned short)va_arg(ap, unsigned int); break;
+         case BINLOG_LENGTH_L:       value = va_arg(ap, unsigned long); break;
+         case BINLOG_LENGTH_LL:      value = va_arg(ap, unsigned long long); break;
+         case BINLOG_LENGTH_INTMAX:  value = va_arg(ap, uintmax_t); break;
+         case BINLOG_LENGTH_SIZE:    value = va_arg(ap, size_t); break;
+         case BINLOG_LENGTH_PTRDIFF: value = va_arg(ap, ptrdiff_t); break;
+         default:                    value = va_arg(ap, unsigned int); break;
+         }
+         pos = binlog_put_number(args, max, pos, (uint64_t)value);
+         break;
+      case BINLOG_ARG_DOUBLE:
+      {
+         double d = length == BINLOG_LENGTH_LONG_DOUBLE ?
+            (double)va_arg(ap, long double) : va_arg(ap, double);
+         uint64_t bits;
+         memcpy(&bits, &d, sizeof(bits));
+         pos = binlog_put_number(args, max, pos, bits);
+         break;
+      }
+      case BINLOG_ARG_POINTER:
+         pos = binlog_put_number(args, max, pos, (uint64_t)(uintptr_t)va_arg(ap, void *));
+         break;
+      case BINLOG_ARG_STRING:
+      {
+         const char *string = va_arg(ap, const char *);
+         size_t precision = format->precision[i];
+         if (precision == BINLOG_PRECISION_ARG)
+            precision = last_int < 0 || last_int > VCOS_BINLOG_STRING_MAX ?
+               VCOS_BINLOG_STRING_MAX : (size_t)last_int;
+         if (length == BINLOG_LENGTH_L)
+            string = "(wide string)";
+         else if (!string)
+            string = "(null)";
+         pos = binlog_put_string(args, max, pos, string, precision);
+         break;
+      }
+      case BINLOG_ARG_IGNORED:
+         (void)va_arg(ap, void *);
+         break;
+      default:
+         break;
+      }
+   }
+
+   return pos;
+}
+
+static int binlog_get_number(const uint8_t *args, size_t size, size_t *pos, uint64_t *value)
+{
+   if (size - *pos < sizeof(*value))
+      return 0;
+   memcpy(value, args + *pos, sizeof(*value));
+   *pos += sizeof(*value);
+   return 1;
+}
+
+/** Format a message from the arguments recorded by binlog_encode() */
+static void binlog_render(char *line, size_t max, const char *fmt, const uint8_t *args, size_t size)
+{
+   char spec_fmt[64], string[VCOS_BINLOG_STRING_MAX + 1];
+   size_t out = 0, pos = 0;
+   const char *p = fmt;
+
+   while (*p && out < max - 1)
+   {
+      BINLOG_SPEC_T spec;
+      uint64_t value = 0;
+      size_t i, n = 0;
+      int written = 0, missing = 0;
+
+      if (*p != '%')
+      {
+         line[out++] = *p++;
+         continue;
+      }
+
+      binlog_parse_spec(p, &spec);
+      if (spec.arg == BINLOG_ARG_INVALID || spec.prefix > sizeof(spec_fmt) - 32)
+      {
+         /* Output the rest of the format as is */
+         while (*p && out < max - 1)
+            line[out++] = *p++;
+         break;
+      }
+      if (spec.arg == BINLOG_ARG_NONE || spec.arg == BINLOG_ARG_IGNORED)
+      {
+         if (spec.conversion == '%')
+            line[out++] = '%';
+         p += spec.size;
+         continue;
+      }
+
+      /* Rebuild the specification with the recorded width and precision */
+      for (i = 0; i < spec.prefix; i++)
+      {
+         if (p[i] != '*')
+            spec_fmt[n++] = p[i];
+         else if (binlog_get_number(args, size, &pos, &value))
+            n += sprintf(spec_fmt + n, "%d", (int)(int64_t)value);
+         else
+            missing = 1;
+      }
+      if (spec.arg == BINLOG_ARG_STRING)
+      {
+         uint16_t length;
+         if (size - pos >= sizeof(length))
+         {
+            memcpy(&length, args + pos, sizeof(length));
+            pos += sizeof(length);
+            if (length > size - pos)
+               length = (uint16_t)(size - pos);
+            memcpy(string, args + pos, length);
+            string[length] = 0;
+            pos += length;
+         }
+         else
+            missing = 1;
+      }
+      else if (!binlog_get_number(args, size, &pos, &value))
+         missing = 1;
+
+      p += spec.size;
+      if (missing)
+         continue;
+
+      /* Integers were recorded as 64 bits values */
+      if ((spec.arg == BINLOG_ARG_INT || spec.arg == BINLOG_ARG_UINT) && spec.conversion != 'c')
+      {
+         spec_fmt[n++] = 'l';
+         spec_fmt[n++] = 'l';
+      }
+      spec_fmt[n++] = spec.conversion;
+      spec_fmt[n] = 0;
+
+      switch (spec.arg)
+      {
+      case BINLOG_ARG_INT:
+         if (spec.conversion == 'c')
+            written = snprintf(line + out, max - out, spec_fmt, (int)(int64_t)value);
+         else
+            written = snprintf(line + out, max - out, spec_fmt, (long long)(int64_t)value);
+         break;
+      case BINLOG_ARG_UINT:
+         written = snprintf(line + out, max - out, spec_fmt, (unsigned long long)value);
+         break;
+      case BINLOG_ARG_DOUBLE:
+      {
+         double d;
+         memcpy(&d, &value, sizeof(d));
+         written = snprintf(line + out, max - out, spec_fmt, d);
+         break;
+      }
+      case BINLOG_ARG_POINTER:
+         written = snprintf(line + out, max - out, spec_fmt, (void *)(uintptr_t)value);
+         break;
+      case BINLOG_ARG_STRING:
+         written = snprintf(line + out, max - out, spec_fmt, string);
+         break;
+      default:
+         break;
+      }
+      if (written > 0)
+         out += (size_t)written < max - 1 - out ? (size_t)written : max - 1 - out;
+   }
+
+   line[out] = 0;
+}
+
+/*****************************************************************************
+ * Ring buffers
+ *****************************************************************************/
+
+static void binlog_ring_read(BINLOG_RING_T *ring, uint32_t pos, void *data, size_t size)
+{
+   uint32_t offset = pos & (ring->size - 1);
+   size_t first = ring->size - offset < size ? ring->size - offset : size;
+
+   memcpy(data, ring->data + offset, first);
+   memcpy((uint8_t *)data + first, ring->data, size - first);
+}
+
+static void binlog_ring_write(BINLOG_RING_T *ring, uint32_t pos, const void *data, size_t size)
+{
+   uint32_t offset = pos & (ring->size - 1);
+   size_t first = ring->size - offset < size ? ring->size - offset : size;
+
+   memcpy(ring->data + offset, data, first);
+   memcpy(ring->data, (const uint8_t *)data + first, size - first);
+}
+
+/** Called when a thread which logged messages exits */
+static void binlog_ring_release(void *arg)
+{
+   BINLOG_RING_T *ring = arg, **link;
+
+   pthread_mutex_lock(&binlog.lock);
+   if (binlog.drainer_running)
+   {
+      /* The drainer will free the ring once it is empty */
+      __atomic_store_n(&ring->dead, 1, __ATOMIC_RELEASE);
+   }
+   else
+   {
+      for (link = &binlog.rings; *link != ring; link = &(*link)->next_ring)
+         ;
+      *link = ring->next_ring;
+      vcos_free(ring);
+   }
+   pthread_mutex_unlock(&binlog.lock);
+}
+
+/** Free the rings of the threads which exited, once drained.
+ * Called with binlog.lock held. */
+static void binlog_ring_collect(void)
+{
+   BINLOG_RING_T **link = &binlog.rings;
+
+   while (*link)
+   {
+      BINLOG_RING_T *ring = *link;
+      if (__atomic_load_n(&ring->dead, __ATOMIC_ACQUIRE) && ring->tail == ring->head)
+      {
+         *link = ring->next_ring;
+         vcos_free(ring);
+      }
+      else
+         link = &ring->next_ring;
+   }
+}
+
+static BINLOG_RING_T *binlog_ring_get(void)
+{
+   BINLOG_RING_T *ring = pthread_getspecific(binlog.key);
+   uint32_t size;
+
+   if (ring)
+      return ring;
+
+   size = binlog.ring_size;
+   ring = vcos_malloc(sizeof(*ring) + size, "vcos binlog ring");
+   if (!ring)
+      return NULL;
+   memset(ring, 0, sizeof(*ring));
+   ring->size = size;
+   ring->data = (uint8_t *)(ring + 1);
+#if defined( HAVE_PRCTL ) && defined( PR_GET_NAME )
+   prctl(PR_GET_NAME, (unsigned long)ring->name, 0, 0, 0);
+   ring->name[sizeof(ring->name) - 1] = 0;
+#endif
+
+   pthread_mutex_lock(&binlog.lock);
+   ring->id = ++binlog.next_id;
+   ring->next_ring = binlog.rings;
+   binlog.rings = ring;
+   pthread_mutex_unlock(&binlog.lock);
+
+   pthread_setspecific(binlog.key, ring);
+   return ring;
+}
+
+/*****************************************************************************/
+void vcos_vlog_binary_impl(const VCOS_LOG_CAT_T *cat, VCOS_LOG_LEVEL_T _level, const char *fmt, va_list args)
+{
+   struct {
+      BINLOG_HEADER_T header;
+      uint8_t args[VCOS_BINLOG_ARGS_MAX];
+   } record;
+   BINLOG_RING_T *ring = NULL;
+   BINLOG_FORMAT_T *format;
+   uint32_t head, tail, size;
+
+   if (!__atomic_load_n(&binlog.enabled, __ATOMIC_RELAXED))
+   {
+      vcos_vlog_default_impl(cat, _level, fmt, args);
+      return;
+   }
+
+   /* Let vcos_log_binary_stop know we are recording a message before
+    * checking again that the drainer is still there */
+   __atomic_fetch_add(&binlog.writers, 1, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&binlog.enabled, __ATOMIC_SEQ_CST))
+      ring = binlog_ring_get();
+   if (!ring)
+   {
+      __atomic_fetch_sub(&binlog.writers, 1, __ATOMIC_RELEASE);
+      vcos_vlog_default_impl(cat, _level, fmt, args);
+      return;
+   }
+
+   record.header.time = vcos_getmicrosecs64();
+   record.header.cat = cat;
+   record.header.fmt = fmt;
+   record.header.level = _level;
+   /* Formats are only parsed the first time a thread uses them */
+   format = &ring->formats[((uintptr_t)fmt >> 3 ^ (uintptr_t)fmt >> 9) & (VCOS_BINLOG_FORMATS - 1)];
+   if (format->fmt != fmt)
+      binlog_compile(format, fmt);
+   record.header.size = binlog_encode(record.args, sizeof(record.args), format, args);
+   size = VCOS_BINLOG_ALIGN(sizeof(record.header) + record.header.size);
+
+   head = ring->head;
+   tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+   if (size > ring->size - (head - tail))
+   {
+      __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+   }
+   else
+   {
+      binlog_ring_write(ring, head, &record, sizeof(record.header) + record.header.size);
+      __atomic_store_n(&ring->head, head + size, __ATOMIC_RELEASE);
+
+      /* Don't wait for the end of the period if the ring is filling up */
+      if (head + size - tail > ring->size / 2 &&
+          !__atomic_exchange_n(&binlog.wake_pending, 1, __ATOMIC_RELAXED))
+         vcos_semaphore_post(&binlog.wake);
+   }
+
+   __atomic_fetch_sub(&binlog.writers, 1, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************
+ * Drainer
+ *****************************************************************************/
+
+static uint32_t binlog_map_get(BINLOG_MAP_T *map, const void *key, int *added)
+{
+   uint32_t i, mask;
+
+   *added = 0;
+   if ((map->count + 1) * 2 > map->size)
+   {
+      BINLOG_MAP_T bigger;
+      bigger.size = map->size ? map->size * 2 : 64;
+      bigger.count = map->count;
+      bigger.entries = vcos_calloc(bigger.size, sizeof(*bigger.entries), "vcos binlog map");
+      if (!bigger.entries)
+         return 0;
+      for (i = 0; i < map->size; i++)
+      {
+         uint32_t j;
+         if (!map->entries[i].key)
+            continue;
+         j = (uint32_t)(((uintptr_t)map->entries[i].key >> 3) * 2654435761u);
+         for (j &= bigger.size - 1; bigger.entries[j].key; j = (j + 1) & (bigger.size - 1))
+            ;
+         bigger.entries[j] = map->entries[i];
+      }
+      vcos_free(map->entries);
+      *map = bigger;
+   }
+
+   mask = map->size - 1;
+   for (i = (uint32_t)(((uintptr_t)key >> 3) * 2654435761u) & mask; map->entries[i].key;
+        i = (i + 1) & mask)
+      if (map->entries[i].key == key)
+         return map->entries[i].id;
+
+   map->entries[i].key = key;
+   map->entries[i].id = ++map->count;
+   *added = 1;
+   return map->entries[i].id;
+}
+
+static void binlog_map_clear(BINLOG_MAP_T *map)
+{
+   vcos_free(map->entries);
+   memset(map, 0, sizeof(*map));
+}
+
+static void binlog_write_record(BINLOG_RECORD_T type, uint32_t id,
+   const void *data, size_t size, const void *extra, size_t extra_size)
+{
+   BINLOG_FILE_RECORD_T record;
+
+   /* Truncate oversized records (e.g. huge format strings) to fit */
+   size = vcos_min(size, 0xffff);
+   extra_size = vcos_min(extra_size, 0xffff - size);
+   record.type = (uint16_t)type;
+   record.size = (uint16_t)(size + extra_size);
+   record.id = id;
+   fwrite(&record, sizeof(record), 1, binlog.file);
+   fwrite(data, 1, size, binlog.file);
+   if (extra_size)
+      fwrite(extra, 1, extra_size, binlog.file);
+}
+
+static void binlog_output(const VCOS_LOG_CAT_T *cat, VCOS_LOG_LEVEL_T level, const char *fmt, ...)
+{
+   va_list args;
+   va_start(args, fmt);
+   vcos_vlog_default_impl(cat, level, fmt, args);
+   va_end(args);
+}
+
+static void binlog_emit(BINLOG_RING_T *ring, const BINLOG_HEADER_T *header, const uint8_t *args)
+{
+   BINLOG_FILE_MESSAGE_T message;
+   const VCOS_LOG_CAT_T *cat = header->cat;
+   char line[VCOS_BINLOG_LINE_MAX];
+   int added;
+
+   if (!binlog.file)
+   {
+      binlog_render(line, sizeof(line), header->fmt, args, header->size);
+      binlog_output(cat, (VCOS_LOG_LEVEL_T)header->level, "%s", line);
+      return;
+   }
+
+   if (!ring->announced)
+   {
+      binlog_write_record(BINLOG_RECORD_THREAD, ring->id, ring->name, strlen(ring->name), NULL, 0);
+      ring->announced = 1;
+   }
+
+   message.time = header->time;
+   message.level = header->level;
+   message.reserved = 0;
+   message.category = binlog_map_get(&binlog.categories, cat, &added);
+   if (added)
+   {
+      uint8_t flags = cat->flags.want_prefix ? BINLOG_CATEGORY_PREFIX : 0;
+      binlog_write_record(BINLOG_RECORD_CATEGORY, message.category, &flags, sizeof(flags),
+         cat->name, cat->name ? strlen(cat->name) : 0);
+   }
+   message.format = binlog_map_get(&binlog.formats, header->fmt, &added);
+   if (added)
+      binlog_write_record(BINLOG_RECORD_FORMAT, message.format, header->fmt,
+         strlen(header->fmt), NULL, 0);
+
+   binlog_write_record(BINLOG_RECORD_MESSAGE, ring->id, &message, sizeof(message),
+      args, header->size);
+}
+
+/** Output the messages recorded so far by all the threads, oldest first */
+static void binlog_drain(void)
+{
+   uint8_t args[VCOS_BINLOG_ARGS_MAX];
+   BINLOG_RING_T *ring;
+   unsigned int i, count = 0;
+
+   pthread_mutex_lock(&binlog.lock);
+   for (ring = binlog.rings; ring; ring = ring->next_ring)
+   {
+      if (count == binlog.drain_size)
+      {
+         unsigned int size = binlog.drain_size ? binlog.drain_size * 2 : 16;
+         BINLOG_RING_T **drain = vcos_malloc(size * sizeof(*drain), "vcos binlog drain");
+         if (!drain)
+            break;
+         memcpy(drain, binlog.drain, count * sizeof(*drain));
+         vcos_free(binlog.drain);
+         binlog.drain = drain;
+         binlog.drain_size = size;
+      }
+      binlog.drain[count++] = ring;
+   }
+   pthread_mutex_unlock(&binlog.lock);
+
+   for (i = 0; i < count; i++)
+   {
+      ring = binlog.drain[i];
+      ring->limit = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      ring->peeked = 0;
+   }
+
+   for (;;)
+   {
+      BINLOG_RING_T *oldest = NULL;
+
+      for (i = 0; i < count; i++)
+      {
+         ring = binlog.drain[i];
+         if (ring->tail == ring->limit)
+            continue;
+         if (!ring->peeked)
+         {
+            binlog_ring_read(ring, ring->tail, &ring->next, sizeof(ring->next));
+            ring->peeked = 1;
+         }
+         if (!oldest || ring->next.time < oldest->next.time)
+            oldest = ring;
+      }
+      if (!oldest)
+         break;
+
+      binlog_ring_read(oldest, oldest->tail + sizeof(oldest->next), args, oldest->next.size);
+      binlog_emit(oldest, &oldest->next, args);
+      oldest->peeked = 0;
+      __atomic_store_n(&oldest->tail,
+         oldest->tail + VCOS_BINLOG_ALIGN(sizeof(oldest->next) + oldest->next.size),
+         __ATOMIC_RELEASE);
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      uint32_t dropped;
+
+      ring = binlog.drain[i];
+      dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED) - ring->dropped_reported;
+      if (!dropped)
+         continue;
+      ring->dropped_reported += dropped;
+
+      if (binlog.file)
+         binlog_write_record(BINLOG_RECORD_DROPPED, ring->id, &dropped, sizeof(dropped), NULL, 0);
+      else
+         binlog_output(&binlog_category, VCOS_LOG_WARN, "vcos_binlog: %u messages dropped by %s",
+            dropped, ring->name);
+   }
+
+   if (binlog.file)
+      fflush(binlog.file);
+
+   pthread_mutex_lock(&binlog.lock);
+   binlog_ring_collect();
+   pthread_mutex_unlock(&binlog.lock);
+}
+
+static void *binlog_drainer(void *arg)
+{
+   int quit;
+   (void)arg;
+
+   do
+   {
+      vcos_semaphore_wait_timeout(&binlog.wake, VCOS_BINLOG_PERIOD_MS);
+      __atomic_store_n(&binlog.wake_pending, 0, __ATOMIC_RELAXED);
+      quit = __atomic_load_n(&binlog.quit, __ATOMIC_ACQUIRE);
+      binlog_drain();
+   } while (!quit);
+
+   return NULL;
+}
+
+static void binlog_key_init(void)
+{
+   binlog.key_created = !pthread_key_create(&binlog.key, binlog_ring_release);
+}
+
+/*****************************************************************************/
+VCOS_STATUS_T vcos_log_binary_start(const char *filename, VCOS_UNSIGNED ring_size)
+{
+   int state = BINLOG_STATE_STOPPED;
+   VCOS_STATUS_T status;
+   BINLOG_RING_T *ring;
+   uint32_t size = VCOS_BINLOG_RING_SIZE_MIN;
+
+   if (!__atomic_compare_exchange_n(&binlog.state, &state, BINLOG_STATE_CHANGING, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      return VCOS_EEXIST;
+
+   pthread_once(&binlog.once, binlog_key_init);
+   if (!binlog.key_created)
+   {
+      status = VCOS_ENOSPC;
+      goto error;
+   }
+
+   if (!ring_size)
+      ring_size = VCOS_BINLOG_RING_SIZE_DEFAULT;
+   while (size < ring_size && size < VCOS_BINLOG_RING_SIZE_MAX)
+      size <<= 1;
+
+   binlog.file = NULL;
+   if (filename)
+   {
+      BINLOG_FILE_HEADER_T header;
+
+      binlog.file = fopen(filename, "wb");
+      if (!binlog.file)
+      {
+         status = vcos_pthreads_map_errno();
+         goto error;
+      }
+      memcpy(header.magic, VCOS_BINLOG_MAGIC, sizeof(header.magic));
+      header.version = VCOS_BINLOG_VERSION;
+      header.byte_order = VCOS_BINLOG_BYTE_ORDER;
+      fwrite(&header, sizeof(header), 1, binlog.file);
+   }
+
+   status = vcos_semaphore_create(&binlog.wake, "vcos binlog", 0);
+   if (status != VCOS_SUCCESS)
+      goto error;
+
+   /* Threads which logged messages during a previous session keep their
+    * ring buffer, which is empty by now */
+   pthread_mutex_lock(&binlog.lock);
+   binlog.ring_size = size;
+   for (ring = binlog.rings; ring; ring = ring->next_ring)
+   {
+      ring->tail = ring->head;
+      ring->dropped_reported = ring->dropped;
+      ring->announced = 0;
+   }
+   binlog.drainer_running = 1;
+   pthread_mutex_unlock(&binlog.lock);
+
+   binlog.quit = 0;
+   binlog.wake_pending = 0;
+   status = vcos_thread_create(&binlog.drainer, "vcos_binlog", NULL, binlog_drainer, NULL);
+   if (status != VCOS_SUCCESS)
+   {
+      pthread_mutex_lock(&binlog.lock);
+      binlog.drainer_running = 0;
+      binlog_ring_collect();
+      pthread_mutex_unlock(&binlog.lock);
+      vcos_semaphore_delete(&binlog.wake);
+      goto error;
+   }
+
+   __atomic_store_n(&binlog.enabled, 1, __ATOMIC_SEQ_CST);
+   __atomic_store_n(&binlog.state, BINLOG_STATE_RUNNING, __ATOMIC_RELEASE);
+   return VCOS_SUCCESS;
+
+ error:
+   if (binlog.file)
+      fclose(binlog.file);
+   binlog.file = NULL;
+   __atomic_store_n(&binlog.state, BINLOG_STATE_STOPPED, __ATOMIC_RELEASE);
+   return status;
+}
+
+/*****************************************************************************/
+void vcos_log_binary_stop(void)
+{
+   int state = BINLOG_STATE_RUNNING;
+
+   if (!__atomic_compare_exchange_n(&binlog.state, &state, BINLOG_STATE_CHANGING, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      return;
+
+   /* Wait for the threads currently recording a message to be done */
+   __atomic_store_n(&binlog.enabled, 0, __ATOMIC_SEQ_CST);
+   while (__atomic_load_n(&binlog.writers, __ATOMIC_ACQUIRE))
+      vcos_sleep(1);
+
+   /* The drainer outputs whatever is left before quitting */
+   __atomic_store_n(&binlog.quit, 1, __ATOMIC_RELEASE);
+   vcos_semaphore_post(&binlog.wake);
+   vcos_thread_join(&binlog.drainer, NULL);
+   vcos_semaphore_delete(&binlog.wake);
+
+   pthread_mutex_lock(&binlog.lock);
+   binlog.drainer_running = 0;
+   binlog_ring_collect();
+   pthread_mutex_unlock(&binlog.lock);
+
+   if (binlog.file)
+      fclose(binlog.file);
+   binlog.file = NULL;
+   binlog_map_clear(&binlog.formats);
+   binlog_map_clear(&binlog.categories);
+   vcos_free(binlog.drain);
+   binlog.drain = NULL;
+   binlog.drain_size = 0;
+
+   __atomic_store_n(&binlog.state, BINLOG_STATE_STOPPED, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************
+ * Decoder
+ *****************************************************************************/
+
+/** Strings defined by the records of a binary log, indexed by id */
+typedef struct BINLOG_TABLE_T
+{
+   char **strings;
+   uint32_t size;
+} BINLOG_TABLE_T;
+
+static void binlog_table_set(BINLOG_TABLE_T *table, uint32_t id, const uint8_t *data, size_t size)
+{
+   char *string;
+
+   if (id > BINLOG_TABLE_ID_MAX)
+      return;
+
+   if (id >= table->size)
+   {
+      uint32_t new_size = table->size ? table->size : 64;
+      char **strings;
+
+      /* Can't overflow since the ids are bounded */
+      while (new_size <= id)
+         new_size *= 2;
+      strings = realloc(table->strings, new_size * sizeof(*strings));
+      if (!strings)
+         return;
+      memset(strings + table->size, 0, (new_size - table->size) * sizeof(*strings));
+      table->strings = strings;
+      table->size = new_size;
+   }
+
+   string = malloc(size + 1);
+   if (!string)
+      return;
+   memcpy(string, data, size);
+   string[size] = 0;
+   free(table->strings[id]);
+   table->strings[id] = string;
+}
+
+static const char *binlog_table_get(BINLOG_TABLE_T *table, uint32_t id)
+{
+   return id < table->size ? table->strings[id] : NULL;
+}
+
+static void binlog_table_clear(BINLOG_TABLE_T *table)
+{
+   uint32_t i;
+   for (i = 0; i < table->size; i++)
+      free(table->strings[i]);
+   free(table->strings);
+}
+
+/*****************************************************************************/
+VCOS_STATUS_T vcos_log_binary_decode(const char *filename, const char *output)
+{
+   BINLOG_TABLE_T formats = {0}, categories = {0}, threads = {0};
+   VCOS_STATUS_T status = VCOS_SUCCESS;
+   BINLOG_FILE_HEADER_T header;
+   BINLOG_FILE_RECORD_T record;
+   uint8_t *payload = NULL;
+   uint64_t start = 0;
+   int started = 0;
+   FILE *in, *out;
+
+   in = fopen(filename, "rb");
+   if (!in)
+      return vcos_pthreads_map_errno();
+   out = output ? fopen(output, "w") : stdout;
+   if (!out)
+   {
+      status = vcos_pthreads_map_errno();
+      fclose(in);
+      return status;
+   }
+
+   payload = malloc(0x10000);
+   if (!payload)
+   {
+      status = VCOS_ENOMEM;
+      goto end;
+   }
+
+   if (fread(&header, sizeof(header), 1, in) != 1 ||
+       memcmp(header.magic, VCOS_BINLOG_MAGIC, sizeof(header.magic)) ||
+       header.version != VCOS_BINLOG_VERSION || header.byte_order != VCOS_BINLOG_BYTE_ORDER)
+   {
+      status = VCOS_EINVAL;
+      goto end;
+   }
+
+   while (fread(&record, sizeof(record), 1, in) == 1)
+   {
+      const char *thread, *format, *category;
+      BINLOG_FILE_MESSAGE_T message;
+      char line[VCOS_BINLOG_LINE_MAX];
+      uint32_t dropped;
+      uint64_t time;
+
+      if (fread(payload, 1, record.size, in) != record.size)
+      {
+         status = VCOS_EINVAL;
+         break;
+      }
+
+      switch (record.type)
+      {
+      case BINLOG_RECORD_FORMAT:
+         binlog_table_set(&formats, record.id, payload, record.size);
+         break;
+      case BINLOG_RECORD_CATEGORY:
+         binlog_table_set(&categories, record.id, payload, record.size);
+         break;
+      case BINLOG_RECORD_THREAD:
+         binlog_table_set(&threads, record.id, payload, record.size);
+         break;
+      case BINLOG_RECORD_MESSAGE:
+         if (record.size < sizeof(message))
+            break;
+         memcpy(&message, payload, sizeof(message));
+         format = binlog_table_get(&formats, message.format);
+         category = binlog_table_get(&categories, message.category);
+         thread = binlog_table_get(&threads, record.id);
+         binlog_render(line, sizeof(line), format ? format : "(unknown format)",
+            payload + sizeof(message), record.size - sizeof(message));
+
+         if (!started)
+            start = message.time, started = 1;
+         time = message.time - start;
+         fprintf(out, "%6u.%06u %-15s %-6s %s%s%s\n", (unsigned int)(time / 1000000),
+            (unsigned int)(time % 1000000), thread ? thread : "?",
+            vcos_log_level_to_string((VCOS_LOG_LEVEL_T)message.level),
+            category && (category[0] & BINLOG_CATEGORY_PREFIX) ? category + 1 : "",
+            category && (category[0] & BINLOG_CATEGORY_PREFIX) ? ": " : "", line);
+         break;
+      case BINLOG_RECORD_DROPPED:
+         if (record.size < sizeof(dropped))
+            break;
+         memcpy(&dropped, payload, sizeof(dropped));
+         thread = binlog_table_get(&threads, record.id);
+         fprintf(out, "%13s %-15s %u messages dropped\n", "", thread ? thread : "?", dropped);
+         break;
+      default:
+         /* Skip records we don't know about */
+         break;
+      }
+   }
+
+ end:
+   free(payload);
+   binlog_table_clear(&formats);
+   binlog_table_clear(&categories);
+   binlog_table_clear(&threads);
+   fclose(in);
+   if (out != stdout)
+      fclose(out);
+   else
+      fflush(out);
+   return status;
+}
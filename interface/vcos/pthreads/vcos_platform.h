@@ -122,13 +122,11 @@ typedef struct
 
 typedef struct VCOS_TIMER_T
 {
-   pthread_t thread;                      /**< id of the timer thread */
-
-   pthread_mutex_t lock;                  /**< lock protecting all other members of the struct */
-   pthread_cond_t settings_changed;       /**< cond. var. for informing the timer thread about changes*/
-   int quit;                              /**< non-zero if the timer thread is requested to quit*/
+   pthread_mutex_t lock;                  /**< lock held while the timer is set up or expires */
 
    struct timespec expires;               /**< absolute time of next expiration, or 0 if disarmed*/
+   int heap_index;                        /**< position in the timer service's queue, or -1 if not queued*/
+   unsigned int generation;               /**< bumped whenever the timer is set, cancelled or deleted*/
 
    void (*orig_expiration_routine)(void*);/**< the expiration routine provided by the user of the timer*/
    void *orig_context;                    /**< the context for exp. routine provided by the user*/
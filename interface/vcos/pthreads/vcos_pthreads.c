@@ -344,8 +344,12 @@ enum
    VCOS_INIT_ALL         = 0xffffffff
 };
 
+static void _timer_service_stop(void);
+
 static void vcos_term(uint32_t flags)
 {
+   _timer_service_stop();
+
    if (flags & VCOS_INIT_MSGQ)
       vcos_msgq_deinit();
 
@@ -366,6 +370,7 @@ VCOS_STATUS_T vcos_platform_init(void)
    VCOS_STATUS_T st;
    uint32_t flags = 0;
    int pst;
+   const char *mem_stats;
 
    st = _vcos_named_semaphore_init();
    if (!vcos_verify(st == VCOS_SUCCESS))
@@ -416,6 +421,12 @@ VCOS_STATUS_T vcos_platform_init(void)
 
    vcos_logging_init();
 
+   /* VCOS_MEM_STATS=1 counts allocations per description, and
+    * VCOS_MEM_STATS=dump also prints the counters when the process exits */
+   mem_stats = getenv("VCOS_MEM_STATS");
+   if (mem_stats && *mem_stats)
+      vcos_generic_mem_stats_enable(strcmp(mem_stats, "dump") == 0);
+
 end:
    if (st != VCOS_SUCCESS)
       vcos_term(flags);
@@ -678,11 +689,6 @@ VCOS_THREAD_T *vcos_dummy_thread_create(void)
 #define MSEC_IN_SEC  (1000)
 #define NSEC_IN_MSEC (1000*1000)
 
-static int _timespec_is_zero(struct timespec *ts)
-{
-   return ((ts->tv_sec == 0) && (ts->tv_nsec == 0));
-}
-
 static void _timespec_set_zero(struct timespec *ts)
 {
    ts->tv_sec = ts->tv_nsec = 0;
@@ -708,37 +714,224 @@ static int _timespec_is_larger(struct timespec *left, struct timespec *right)
       return left->tv_nsec > right->tv_nsec;
 }
 
-static void* _timer_thread(void *arg)
+/* All timers are driven by a small pool of shared worker threads rather than
+ * a thread each. Armed timers sit in a binary min-heap ordered by expiry time,
+ * so setting or cancelling a timer is O(log n). The earliest timer is waited
+ * for with a condition variable (rather than timerfd or clock_nanosleep) so
+ * that workers can be woken as soon as the head of the heap changes.
+ *
+ * Lock ordering is timer->lock then timer_service.lock. Expiration routines
+ * are called with timer->lock held (but not the service lock), which gives
+ * the same guarantees as when each timer had its own thread: a cancel from
+ * another thread waits for a running expiration routine to complete, and
+ * the routine itself may set or cancel its timer.
+ */
+#define VCOS_TIMER_SERVICE_THREADS 2
+#define VCOS_TIMER_HEAP_MIN_SIZE   16
+
+typedef struct VCOS_TIMER_WORKER_T
 {
-   VCOS_TIMER_T *timer = (VCOS_TIMER_T*)arg;
+   pthread_t thread;
+   VCOS_TIMER_T *firing;         /**< timer whose expiration is being handled, if any */
+} VCOS_TIMER_WORKER_T;
 
-   pthread_mutex_lock(&timer->lock);
-   while (!timer->quit)
+static struct
+{
+   pthread_mutex_t lock;         /**< lock protecting all other members of the struct */
+   pthread_cond_t changed;       /**< signalled when the earliest expiration changes */
+   pthread_cond_t done;          /**< broadcast when a worker is done with a timer */
+
+   VCOS_TIMER_T **heap;          /**< armed timers, earliest expiration first */
+   unsigned int count;           /**< number of armed timers */
+   unsigned int size;            /**< number of entries allocated in heap */
+   unsigned int timers;          /**< number of created timers, all of which fit in heap */
+
+   unsigned int running;         /**< number of worker threads started */
+   int quit;                     /**< non-zero if the workers are requested to quit */
+   VCOS_TIMER_WORKER_T workers[VCOS_TIMER_SERVICE_THREADS];
+} timer_service = {
+   PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER
+};
+
+static void _timer_heap_place(VCOS_TIMER_T *timer, unsigned int index)
+{
+   timer_service.heap[index] = timer;
+   timer->heap_index = (int)index;
+}
+
+static void _timer_heap_sift_up(unsigned int index)
+{
+   VCOS_TIMER_T **heap = timer_service.heap;
+   VCOS_TIMER_T *timer = heap[index];
+
+   while (index)
    {
-      struct timespec now;
+      unsigned int parent = (index - 1) / 2;
+      if (!_timespec_is_larger(&heap[parent]->expires, &timer->expires))
+         break;
+      _timer_heap_place(heap[parent], index);
+      index = parent;
+   }
+   _timer_heap_place(timer, index);
+}
 
-      /* Wait until next expiry time, or until timer's settings are changed */
-      if (_timespec_is_zero(&timer->expires))
-         pthread_cond_wait(&timer->settings_changed, &timer->lock);
-      else
-         pthread_cond_timedwait(&timer->settings_changed, &timer->lock, &timer->expires);
+static void _timer_heap_sift_down(unsigned int index)
+{
+   VCOS_TIMER_T **heap = timer_service.heap;
+   VCOS_TIMER_T *timer = heap[index];
 
-      /* See if the timer has expired - reloop if it didn't */
+   for (;;)
+   {
+      unsigned int child = 2 * index + 1;
+      if (child >= timer_service.count)
+         break;
+      if (child + 1 < timer_service.count &&
+          _timespec_is_larger(&heap[child]->expires, &heap[child + 1]->expires))
+         child++;
+      if (!_timespec_is_larger(&timer->expires, &heap[child]->expires))
+         break;
+      _timer_heap_place(heap[child], index);
+      index = child;
+   }
+   _timer_heap_place(timer, index);
+}
+
+static void _timer_heap_remove(VCOS_TIMER_T *timer)
+{
+   unsigned int index = (unsigned int)timer->heap_index;
+   VCOS_TIMER_T *last = timer_service.heap[--timer_service.count];
+
+   timer->heap_index = -1;
+   if (last == timer)
+      return;
+
+   _timer_heap_place(last, index);
+   _timer_heap_sift_up(index);
+   _timer_heap_sift_down((unsigned int)last->heap_index);
+}
+
+static void* _timer_service_thread(void *arg)
+{
+   VCOS_TIMER_WORKER_T *worker = (VCOS_TIMER_WORKER_T*)arg;
+
+#if defined( HAVE_PRCTL ) && defined( PR_SET_NAME )
+   prctl( PR_SET_NAME, (unsigned long)"vcos_timer", 0, 0, 0 );
+#endif
+
+   pthread_mutex_lock(&timer_service.lock);
+   while (!timer_service.quit)
+   {
+      struct timespec now, expires;
+      VCOS_TIMER_T *timer;
+      unsigned int generation;
+
+      /* Wait until the earliest expiry time, or until it changes */
+      if (!timer_service.count)
+      {
+         pthread_cond_wait(&timer_service.changed, &timer_service.lock);
+         continue;
+      }
+
+      timer = timer_service.heap[0];
       clock_gettime(CLOCK_REALTIME, &now);
-      if (_timespec_is_zero(&timer->expires) || _timespec_is_larger(&timer->expires, &now))
+      if (_timespec_is_larger(&timer->expires, &now))
+      {
+         expires = timer->expires;
+         pthread_cond_timedwait(&timer_service.changed, &timer_service.lock, &expires);
          continue;
+      }
 
-      /* The timer has expired. Clear the expiry time and call the
-       * expiration routine
-       */
-      _timespec_set_zero(&timer->expires);
-      timer->orig_expiration_routine(timer->orig_context);
+      /* The timer has expired. Take it off the heap and let another worker
+       * deal with the next one if that has expired as well. */
+      _timer_heap_remove(timer);
+      if (timer_service.count)
+         pthread_cond_signal(&timer_service.changed);
+
+      generation = timer->generation;
+      worker->firing = timer;
+      pthread_mutex_unlock(&timer_service.lock);
+
+      /* The timer may have been set again, cancelled or deleted before we
+       * got hold of its lock, in which case the expiration is stale.
+       * Otherwise clear the expiry time and call the expiration routine. */
+      pthread_mutex_lock(&timer->lock);
+      if (timer->generation == generation)
+      {
+         _timespec_set_zero(&timer->expires);
+         timer->orig_expiration_routine(timer->orig_context);
+      }
+      pthread_mutex_unlock(&timer->lock);
+
+      pthread_mutex_lock(&timer_service.lock);
+      worker->firing = NULL;
+      pthread_cond_broadcast(&timer_service.done);
    }
-   pthread_mutex_unlock(&timer->lock);
+   pthread_mutex_unlock(&timer_service.lock);
 
    return NULL;
 }
 
+/* Starts the worker threads if they aren't running yet. Called with
+ * timer_service.lock held. */
+static VCOS_STATUS_T _timer_service_start(void)
+{
+   while (timer_service.running < VCOS_TIMER_SERVICE_THREADS && !timer_service.quit)
+   {
+      VCOS_TIMER_WORKER_T *worker = &timer_service.workers[timer_service.running];
+      int rc;
+
+      worker->firing = NULL;
+      rc = pthread_create(&worker->thread, NULL, _timer_service_thread, worker);
+      if (rc != 0)
+         return timer_service.running ? VCOS_SUCCESS : vcos_pthreads_map_error(rc);
+      timer_service.running++;
+   }
+
+   return timer_service.running ? VCOS_SUCCESS : VCOS_EAGAIN;
+}
+
+/* Stops the worker threads. Timers which are still armed stay queued and
+ * will expire once the workers are restarted by the next timer creation or
+ * vcos_timer_set(). */
+static void _timer_service_stop(void)
+{
+   unsigned int i, running;
+
+   pthread_mutex_lock(&timer_service.lock);
+   timer_service.quit = 1;
+   pthread_cond_broadcast(&timer_service.changed);
+   running = timer_service.running;
+   pthread_mutex_unlock(&timer_service.lock);
+
+   for (i = 0; i < running; i++)
+      pthread_join(timer_service.workers[i].thread, NULL);
+
+   pthread_mutex_lock(&timer_service.lock);
+   timer_service.running = 0;
+   timer_service.quit = 0;
+   if (!timer_service.timers)
+   {
+      free(timer_service.heap);
+      timer_service.heap = NULL;
+      timer_service.size = 0;
+   }
+   pthread_mutex_unlock(&timer_service.lock);
+}
+
+/* Takes the timer off the heap and invalidates any expiration a worker may
+ * be about to handle. Called with both timer->lock and timer_service.lock
+ * held. */
+static void _timer_service_disarm(VCOS_TIMER_T *timer)
+{
+   timer->generation++;
+   if (timer->heap_index < 0)
+      return;
+
+   if (timer->heap_index == 0)
+      pthread_cond_signal(&timer_service.changed);
+   _timer_heap_remove(timer);
+}
+
 VCOS_STATUS_T vcos_timer_init(void)
 {
    return VCOS_SUCCESS;
@@ -751,7 +944,6 @@ VCOS_STATUS_T vcos_pthreads_timer_create(VCOS_TIMER_T *timer,
 {
    pthread_mutexattr_t lock_attr;
    VCOS_STATUS_T result = VCOS_SUCCESS;
-   int settings_changed_initialized = 0;
    int lock_attr_initialized = 0;
    int lock_initialized = 0;
 
@@ -764,18 +956,7 @@ VCOS_STATUS_T vcos_pthreads_timer_create(VCOS_TIMER_T *timer,
 
    timer->orig_expiration_routine = expiration_routine;
    timer->orig_context = context;
-
-   /* Create conditional variable for notifying the timer's thread
-    * when settings change.
-    */
-   if (result == VCOS_SUCCESS)
-   {
-      int rc = pthread_cond_init(&timer->settings_changed, NULL);
-      if (rc == 0)
-         settings_changed_initialized = 1;
-      else
-         result = vcos_pthreads_map_error(rc);
-   }
+   timer->heap_index = -1;
 
    /* Create attributes for the lock (we want it to be recursive) */
    if (result == VCOS_SUCCESS)
@@ -806,12 +987,30 @@ VCOS_STATUS_T vcos_pthreads_timer_create(VCOS_TIMER_T *timer,
    if (lock_attr_initialized)
       pthread_mutexattr_destroy(&lock_attr);
 
-   /* Create the underlying thread */
+   /* Make room for the timer in the heap, so that arming it can't fail,
+    * and make sure the service is running */
    if (result == VCOS_SUCCESS)
    {
-      int rc = pthread_create(&timer->thread, NULL, _timer_thread, timer);
-      if (rc != 0)
-         result = vcos_pthreads_map_error(rc);
+      pthread_mutex_lock(&timer_service.lock);
+      if (timer_service.timers == timer_service.size)
+      {
+         unsigned int size = timer_service.size ? timer_service.size * 2 : VCOS_TIMER_HEAP_MIN_SIZE;
+         VCOS_TIMER_T **heap = realloc(timer_service.heap, size * sizeof(*heap));
+         if (heap)
+         {
+            timer_service.heap = heap;
+            timer_service.size = size;
+         }
+         else
+         {
+            result = VCOS_ENOMEM;
+         }
+      }
+      if (result == VCOS_SUCCESS)
+         result = _timer_service_start();
+      if (result == VCOS_SUCCESS)
+         timer_service.timers++;
+      pthread_mutex_unlock(&timer_service.lock);
    }
 
    /* Clean up if anything went wrong */
@@ -819,9 +1018,6 @@ VCOS_STATUS_T vcos_pthreads_timer_create(VCOS_TIMER_T *timer,
    {
       if (lock_initialized)
          pthread_mutex_destroy(&timer->lock);
-
-      if (settings_changed_initialized)
-         pthread_cond_destroy(&timer->settings_changed);
    }
 
    return result;
@@ -830,6 +1026,7 @@ VCOS_STATUS_T vcos_pthreads_timer_create(VCOS_TIMER_T *timer,
 void vcos_pthreads_timer_set(VCOS_TIMER_T *timer, VCOS_UNSIGNED delay_ms)
 {
    struct timespec now;
+   VCOS_STATUS_T st;
 
    vcos_assert(timer);
 
@@ -841,6 +1038,9 @@ void vcos_pthreads_timer_set(VCOS_TIMER_T *timer, VCOS_UNSIGNED delay_ms)
       return;
 
    pthread_mutex_lock(&timer->lock);
+   pthread_mutex_lock(&timer_service.lock);
+
+   _timer_service_disarm(timer);
 
    /* Calculate the new absolute expiry time */
    clock_gettime(CLOCK_REALTIME, &now);
@@ -848,9 +1048,19 @@ void vcos_pthreads_timer_set(VCOS_TIMER_T *timer, VCOS_UNSIGNED delay_ms)
    timer->expires.tv_nsec = (delay_ms % MSEC_IN_SEC) * NSEC_IN_MSEC;
    _timespec_add(&timer->expires, &now);
 
-   /* Notify the timer's thread about the change */
-   pthread_cond_signal(&timer->settings_changed);
+   /* Queue the timer and wake up a worker if it is now the earliest one */
+   vcos_assert(timer_service.count < timer_service.size);
+   _timer_heap_place(timer, timer_service.count++);
+   _timer_heap_sift_up((unsigned int)timer->heap_index);
+   if (timer->heap_index == 0)
+      pthread_cond_signal(&timer_service.changed);
 
+   /* The workers may have been stopped by vcos_deinit() */
+   st = _timer_service_start();
+   vcos_assert(st == VCOS_SUCCESS);
+   (void)st;
+
+   pthread_mutex_unlock(&timer_service.lock);
    pthread_mutex_unlock(&timer->lock);
 }
 
@@ -859,39 +1069,57 @@ void vcos_pthreads_timer_cancel(VCOS_TIMER_T *timer)
    vcos_assert(timer);
 
    pthread_mutex_lock(&timer->lock);
+   pthread_mutex_lock(&timer_service.lock);
 
+   _timer_service_disarm(timer);
    _timespec_set_zero(&timer->expires);
-   pthread_cond_signal(&timer->settings_changed);
 
+   pthread_mutex_unlock(&timer_service.lock);
    pthread_mutex_unlock(&timer->lock);
 }
 
 void vcos_pthreads_timer_delete(VCOS_TIMER_T *timer)
 {
+   pthread_t self = pthread_self();
+   unsigned int i;
+   int busy;
+
    vcos_assert(timer);
 
+   /* Stop the timer */
    pthread_mutex_lock(&timer->lock);
+   pthread_mutex_lock(&timer_service.lock);
 
-   /* Other implementation of this function (e.g. ThreadX)
-    * disallow it being called from the expiration routine
-    */
-   vcos_assert(pthread_self() != timer->thread);
-
-   /* Stop the timer and set flag telling the timer thread to quit */
+   _timer_service_disarm(timer);
    _timespec_set_zero(&timer->expires);
-   timer->quit = 1;
-
-   /* Notify the timer's thread about the change */
-   pthread_cond_signal(&timer->settings_changed);
 
-   /* Release the lock, so that the timer's thread can quit */
+   pthread_mutex_unlock(&timer_service.lock);
    pthread_mutex_unlock(&timer->lock);
 
-   /* Wait for the timer thread to finish */
-   pthread_join(timer->thread, NULL);
+   /* Wait for any worker still handling an expiration of this timer */
+   pthread_mutex_lock(&timer_service.lock);
+   do
+   {
+      busy = 0;
+      for (i = 0; i < timer_service.running; i++)
+      {
+         /* Other implementations of this function (e.g. ThreadX)
+          * disallow it being called from the expiration routine, but
+          * don't deadlock waiting for ourselves if it is
+          */
+         if (timer_service.workers[i].firing != timer ||
+             pthread_equal(self, timer_service.workers[i].thread))
+            continue;
+
+         busy = 1;
+      }
+      if (busy)
+         pthread_cond_wait(&timer_service.done, &timer_service.lock);
+   } while (busy);
+   timer_service.timers--;
+   pthread_mutex_unlock(&timer_service.lock);
 
    /* Free resources used by the timer */
    pthread_mutex_destroy(&timer->lock);
-   pthread_cond_destroy(&timer->settings_changed);
 }
 
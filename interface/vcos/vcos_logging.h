@@ -145,6 +145,43 @@ VCOSPRE_ void VCOSPOST_ vcos_set_vlog_impl( VCOS_VLOG_IMPL_FUNC_T vlog_impl_func
 
 VCOSPRE_ void VCOSPOST_ vcos_vlog_default_impl(const VCOS_LOG_CAT_T *cat, VCOS_LOG_LEVEL_T _level, const char *fmt, va_list args) VCOS_FORMAT_ATTR_(printf, 3, 0);
 
+/** Asynchronous logging function, to be installed with vcos_set_vlog_impl().
+  *
+  * Messages are not formatted by the calling thread. The format pointer, the
+  * arguments and a timestamp are recorded into a ring buffer owned by the
+  * calling thread and a background thread formats them later on. Format
+  * strings must therefore stay valid until logging is stopped (string
+  * literals, as used with the vcos_log macros, are fine). Messages are
+  * dropped rather than blocking the caller when its ring buffer is full.
+  *
+  * Falls back to vcos_vlog_default_impl() while vcos_log_binary_start()
+  * hasn't been called. Only available on pthreads platforms.
+  */
+VCOSPRE_ void VCOSPOST_ vcos_vlog_binary_impl(const VCOS_LOG_CAT_T *cat, VCOS_LOG_LEVEL_T _level, const char *fmt, va_list args) VCOS_FORMAT_ATTR_(printf, 3, 0);
+
+/** Start the background thread used by vcos_vlog_binary_impl().
+  *
+  * @param filename   file to write a binary log to, which can be rendered
+  *                   with vcos_log_binary_decode(). If NULL, messages are
+  *                   formatted by the background thread and output by
+  *                   vcos_vlog_default_impl().
+  * @param ring_size  size in bytes of the ring buffer of each thread, or 0
+  *                   for the default.
+  */
+VCOSPRE_ VCOS_STATUS_T VCOSPOST_ vcos_log_binary_start(const char *filename, VCOS_UNSIGNED ring_size);
+
+/** Output the messages still buffered and stop the background thread.
+  * vcos_vlog_binary_impl() falls back to vcos_vlog_default_impl() afterwards.
+  */
+VCOSPRE_ void VCOSPOST_ vcos_log_binary_stop(void);
+
+/** Render a binary log written by vcos_vlog_binary_impl() as text.
+  *
+  * @param filename  binary log to read.
+  * @param output    file to write the text to, or NULL for stdout.
+  */
+VCOSPRE_ VCOS_STATUS_T VCOSPOST_ vcos_log_binary_decode(const char *filename, const char *output);
+
 /*
  * Initialise the logging subsystem. This is called from
  * vcos_init() so you don't normally need to call it.